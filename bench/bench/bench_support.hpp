@@ -0,0 +1,44 @@
+
+#ifndef UNFACT_BENCH_SUPPORT_HPP
+#define UNFACT_BENCH_SUPPORT_HPP
+
+/*
+ * a minimum benchmark harness: run a function on N threads and measure the wall-clock.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <vector>
+
+inline double bench_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return double(ts.tv_sec) + double(ts.tv_nsec)*1e-9;
+}
+
+/*
+ * call fn(arg) on 'nthreads' threads at once.
+ * @return elapsed seconds from the start to the last thread's end.
+ */
+inline double bench_run_threads(size_t nthreads, void* (*fn)(void*), void* arg)
+{
+  std::vector<pthread_t> threads(nthreads);
+  double start = bench_now();
+  for (size_t i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, fn, arg); }
+  for (size_t i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+  return bench_now() - start;
+}
+
+/* thread counts to try: 1, 2, 4, ... 64 */
+enum { bench_max_threads = 64 };
+
+inline void bench_report(const char* name, size_t nthreads, size_t nops, double sec)
+{
+  printf("%-32s threads=%2d %10.1f kops/sec %8.1f ns/op(per thread)\n", 
+		 name, int(nthreads), double(nops)/sec/1000.0, sec*1e9*double(nthreads)/double(nops));
+}
+
+#endif//UNFACT_BENCH_SUPPORT_HPP
@@ -0,0 +1,58 @@
+
+/*
+ * benchmark driver.
+ *
+ * each benchmarks are placed on xxx_bench.cpp, that define entrypoint named bench_xxx().
+ * run without arguments to run all, or give names to pick some.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+void bench_arena(); // in unfact_arena_bench.cpp
+void bench_slab(); // in unfact_slab_bench.cpp
+void bench_lock(); // in unfact_lock_bench.cpp
+void bench_rw_lock(); // in unfact_rw_lock_bench.cpp
+void bench_exporter(); // in unfact_exporter_bench.cpp
+void bench_trace(); // in unfact_trace_bench.cpp
+
+struct bench_entry_t
+{
+  const char* name;
+  void (*fn)();
+};
+
+static const bench_entry_t benches[] = {
+  { "arena", bench_arena },
+  { "slab", bench_slab },
+  { "lock", bench_lock },
+  { "rw_lock", bench_rw_lock },
+  { "exporter", bench_exporter },
+  { "trace", bench_trace },
+};
+
+int main(int argc, char* argv[])
+{
+  for (size_t i=0; i<sizeof(benches)/sizeof(benches[0]); ++i) {
+	bool picked = (argc < 2);
+	for (int j=1; j<argc; ++j) {
+	  picked = picked || (0 == strcmp(argv[j], benches[i].name));
+	}
+
+	if (picked) {
+	  printf("== %s\n", benches[i].name);
+	  benches[i].fn();
+	}
+  }
+  
+  return 0;
+}
+
+/* -*-
+ Local Variables:
+ mode: c++
+ c-tab-always-indent: t
+ c-indent-level: 2
+ c-basic-offset: 2
+ End:
+ -*- */
@@ -0,0 +1,83 @@
+
+#include <unfact/arena.hpp>
+#include <unfact/magazine_arena.hpp>
+#ifdef UNFACT_USE_LOCKFREE_ARENA
+#include <unfact/lockfree_arena.hpp>
+#endif
+#include <bench/bench_support.hpp>
+#include <vector>
+
+namespace uf = unfact;
+
+namespace
+{
+  enum { bench_batch = 64, bench_rounds = 5000 };
+
+  /*
+   * tracer-like pattern: allocate a batch of nodes, then release them.
+   */
+  template<class Arena>
+  void* arena_worker(void* p)
+  {
+	Arena* arena = reinterpret_cast<Arena*>(p);
+	uf::byte_t* items[bench_batch];
+	for (int k=0; k<bench_rounds; ++k) {
+	  for (int i=0; i<bench_batch; ++i) { items[i] = arena->allocate(); }
+	  for (int i=0; i<bench_batch; ++i) { arena->deallocate(items[i]); }
+	}
+
+	return 0;
+  }
+
+  template<class Arena>
+  void bench_arena_scaling(const char* name)
+  {
+	uf::stdlib_allocator_t allocator;
+	for (size_t n=1; n<=bench_max_threads; n*=2) {
+	  Arena arena(&allocator, 64, 4096);
+	  double sec = bench_run_threads(n, arena_worker<Arena>, &arena);
+	  bench_report(name, n, n*bench_rounds*bench_batch*2, sec);
+	}
+  }
+
+  /*
+   * frees 'n' items in scattered order: each page empties late, like heap_tracer_t blocks.
+   */
+  void bench_arena_scattered_free(const char* name, size_t n, uf::arena_t::option_e opts)
+  {
+	uf::stdlib_allocator_t allocator;
+	uf::arena_t arena(&allocator, 64, 4096, sizeof(void*), opts);
+	std::vector<uf::byte_t*> items(n);
+	for (size_t i=0; i<n; ++i) { items[i] = arena.allocate(); }
+	for (size_t i=0; i<n; ++i) { std::swap(items[i], items[(i*7919)%n]); }
+
+	double start = bench_now();
+	for (size_t i=0; i<n; ++i) { arena.deallocate(items[i]); }
+	bench_report(name, 1, n, bench_now() - start);
+  }
+}
+
+void bench_arena()
+{
+  for (size_t n=100000; n<=400000; n*=2) {
+	bench_arena_scattered_free("arena_t free", n, uf::arena_t::option_default);
+	bench_arena_scattered_free("arena_t free (reclaim)", n, 
+							   uf::arena_t::option_e(uf::arena_t::option_default|uf::arena_t::option_reclaim_pages));
+  }
+
+
+  bench_arena_scaling< uf::basic_arena_t<uf::default_concurrent_t> >("basic_arena_t");
+  bench_arena_scaling< uf::magazine_arena_t<uf::default_concurrent_t> >("magazine_arena_t");
+#ifdef UNFACT_USE_LOCKFREE_ARENA
+  bench_arena_scaling< uf::lockfree_arena_t<uf::default_concurrent_t> >("lockfree_arena_t");
+#endif
+}
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
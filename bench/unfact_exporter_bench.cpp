@@ -0,0 +1,85 @@
+
+#include <unfact/heap_tracer.hpp>
+#include <unfact/extras/ontree_exporter.hpp>
+#include <bench/bench_support.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+namespace uf = unfact;
+
+namespace
+{
+  enum { bench_fanout = 224, bench_rounds = 20 };
+
+  typedef uf::accumulative_heap_tracer_t tracer_type;
+
+  /*
+   * root -> fanout -> fanout^2 scopes: about 50k. static strings need names to live long.
+   */
+  void bench_exporter_setup(tracer_type* tr, std::vector<std::string>* names, std::vector<uf::byte_t>* heap)
+  {
+	char buf[32];
+	for (size_t i=0; i<bench_fanout; ++i) {
+	  snprintf(buf, sizeof(buf), "scope%d", int(i));
+	  names->push_back(buf);
+	}
+
+	size_t k = 0;
+	for (size_t i=0; i<bench_fanout; ++i) {
+	  tracer_type::ticket_type t = tr->push(tr->root(), (*names)[i].c_str());
+	  for (size_t j=0; j<bench_fanout; ++j) {
+		tr->trace_allocated(tr->push(t, (*names)[j].c_str()), &(*heap)[k++], 16 + j);
+	  }
+	}
+  }
+
+  template<class Output>
+  void bench_exporter_output(const char* name, const uf::accumulative_heap_snapshot_t& ss, Output* out, size_t bytes)
+  {
+	double start = bench_now();
+	for (size_t i=0; i<bench_rounds; ++i) {
+	  uf::extras::export_ontree_json(ss, *out);
+	}
+
+	double sec = bench_now() - start;
+	printf("%-32s scopes=%d %8.2f ms/export %8.1f ns/scope %d bytes\n", 
+		   name, int(ss.size()), sec*1e3/bench_rounds, sec*1e9/bench_rounds/ss.size(), int(bytes));
+  }
+}
+
+void bench_exporter()
+{
+  uf::stdlib_allocator_t allocator;
+  tracer_type tr(&allocator);
+  std::vector<std::string> names;
+  std::vector<uf::byte_t> heap(bench_fanout*bench_fanout);
+  bench_exporter_setup(&tr, &names, &heap);
+
+  uf::accumulative_heap_snapshot_t ss(&allocator);
+  double start = bench_now();
+  ss.take(tr.tracer());
+  printf("%-32s scopes=%d %8.2f ms\n", "take", int(ss.size()), (bench_now() - start)*1e3);
+
+  /* the first export grows the buffer. the rest reuse it */
+  uf::extras::ontree_buffer_output_t buffer(&allocator);
+  uf::extras::export_ontree_json(ss, buffer);
+  size_t bytes = buffer.size();
+  bench_exporter_output("ontree_buffer_output_t", ss, &buffer, bytes);
+
+  int fd = open("/dev/null", O_WRONLY);
+  char scratch[64*1024];
+  uf::extras::ontree_fd_output_t null(fd, scratch, sizeof(scratch));
+  bench_exporter_output("ontree_fd_output_t(/dev/null)", ss, &null, bytes);
+  close(fd);
+}
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
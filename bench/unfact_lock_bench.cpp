@@ -0,0 +1,75 @@
+
+#include <unfact/concurrent.hpp>
+#include <bench/bench_support.hpp>
+
+namespace uf = unfact;
+
+namespace
+{
+  enum { bench_rounds = 200000 };
+
+  /* baseline */
+  class pthread_mutex_lock_t
+  {
+  public:
+	pthread_mutex_lock_t() { pthread_mutex_init(&m_mutex, 0); }
+	~pthread_mutex_lock_t() { pthread_mutex_destroy(&m_mutex); }
+	void acquire() { pthread_mutex_lock(&m_mutex); }
+	void release() { pthread_mutex_unlock(&m_mutex); }
+  private:
+	pthread_mutex_t m_mutex;
+  };
+
+  template<class Lock>
+  struct contended_t
+  {
+	contended_t() : m_count(0) {}
+	Lock m_lock;
+	volatile size_t m_count;
+  };
+
+  /*
+   * every thread hammers single lock with a tiny critical section.
+   */
+  template<class Lock>
+  void* lock_worker(void* p)
+  {
+	contended_t<Lock>* c = reinterpret_cast<contended_t<Lock>*>(p);
+	for (int k=0; k<bench_rounds; ++k) {
+	  c->m_lock.acquire();
+	  c->m_count = c->m_count + 1;
+	  c->m_lock.release();
+	}
+
+	return 0;
+  }
+
+  template<class Lock>
+  void bench_lock_scaling(const char* name)
+  {
+	for (size_t n=1; n<=bench_max_threads; n*=2) {
+	  contended_t<Lock> c;
+	  double sec = bench_run_threads(n, lock_worker<Lock>, &c);
+	  bench_report(name, n, n*bench_rounds, sec);
+	}
+  }
+}
+
+void bench_lock()
+{
+  bench_lock_scaling<pthread_mutex_lock_t>("pthread_mutex_t");
+  bench_lock_scaling<uf::default_concurrent_t::spin_lock_type>("spin_lock_t");
+  bench_lock_scaling< uf::ticket_concurrent_t<uf::default_concurrent_t>::spin_lock_type >("ticket_lock_t");
+#ifdef UNFACT_HAS_FUTEX_LOCK
+  bench_lock_scaling<uf::futex_lock_t>("futex_lock_t");
+#endif
+}
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
@@ -0,0 +1,112 @@
+
+#include <unfact/concurrent.hpp>
+#include <unfact/tree_set.hpp>
+#include <bench/bench_support.hpp>
+
+namespace uf = unfact;
+
+namespace
+{
+  enum { bench_rounds = 100000, bench_keys = 1024, bench_write_ratio = 64 };
+  typedef uf::default_concurrent_t::atomic_ops_type ops_type;
+  typedef uf::tree_set_t<int> set_type;
+  typedef uf::tree_set_t<int, uf::less_t<int>, uf::optimistic_concurrent_t<uf::default_concurrent_t> > optimistic_set_type;
+
+  /* baseline */
+  class pthread_rw_lock_t
+  {
+  public:
+	pthread_rw_lock_t() { pthread_rwlock_init(&m_lock, 0); }
+	~pthread_rw_lock_t() { pthread_rwlock_destroy(&m_lock); }
+	void read_acquire() { pthread_rwlock_rdlock(&m_lock); }
+	void read_release() { pthread_rwlock_unlock(&m_lock); }
+	void write_acquire() { pthread_rwlock_wrlock(&m_lock); }
+	void write_release() { pthread_rwlock_unlock(&m_lock); }
+  private:
+	pthread_rwlock_t m_lock;
+  };
+
+  /* to see what we get from sharing: readers are exclusive too */
+  class exclusive_rw_lock_t
+  {
+  public:
+	void read_acquire() { m_lock.acquire(); }
+	void read_release() { m_lock.release(); }
+	void write_acquire() { m_lock.acquire(); }
+	void write_release() { m_lock.release(); }
+  private:
+	uf::default_concurrent_t::spin_lock_type m_lock;
+  };
+
+  /* for the set which locks by itself: optimistic_set_type reads under seqlock */
+  class internal_rw_lock_t
+  {
+  public:
+	void read_acquire() {}
+	void read_release() {}
+	void write_acquire() {}
+	void write_release() {}
+  };
+
+  template<class RWLock, class Set=set_type>
+  struct shared_set_t
+  {
+	explicit shared_set_t(uf::allocator_t* allocator) : m_set(allocator) {}
+	RWLock m_lock;
+	Set m_set;
+  };
+
+  /*
+   * read-mostly lookups on shared set, like tracer hot-paths with occasional insertion.
+   */
+  template<class RWLock, class Set>
+  void* rw_lock_worker(void* p)
+  {
+	shared_set_t<RWLock, Set>* s = reinterpret_cast<shared_set_t<RWLock, Set>*>(p);
+	size_t found = 0;
+	for (int k=0; k<bench_rounds; ++k) {
+	  int key = (k*7919)%bench_keys;
+	  if (0 == k%bench_write_ratio) {
+		s->m_lock.write_acquire();
+		s->m_set.ensure(key);
+		s->m_lock.write_release();
+	  } else {
+		s->m_lock.read_acquire();
+		found += s->m_set.contains(key) ? 1 : 0;
+		s->m_lock.read_release();
+	  }
+	}
+
+	return reinterpret_cast<void*>(found);
+  }
+
+  template<class RWLock, class Set>
+  void bench_rw_lock_scaling(const char* name)
+  {
+	uf::stdlib_allocator_t allocator;
+	for (size_t n=1; n<=bench_max_threads; n*=2) {
+	  shared_set_t<RWLock, Set> s(&allocator);
+	  for (int i=0; i<bench_keys; i+=2) { s.m_set.insert(i); }
+	  double sec = bench_run_threads(n, rw_lock_worker<RWLock, Set>, &s);
+	  bench_report(name, n, n*bench_rounds, sec);
+	}
+  }
+}
+
+void bench_rw_lock()
+{
+  bench_rw_lock_scaling<pthread_rw_lock_t, set_type>("pthread_rwlock_t");
+  bench_rw_lock_scaling<exclusive_rw_lock_t, set_type>("spin_lock_t(exclusive)");
+  bench_rw_lock_scaling<uf::rw_lock_t<ops_type, uf::default_concurrent_t::spin_lock_type>, set_type>("rw_lock_t");
+  bench_rw_lock_scaling<uf::distributed_rw_lock_t<ops_type, uf::default_concurrent_t::spin_lock_type>, set_type>("distributed_rw_lock_t");
+  bench_rw_lock_scaling<internal_rw_lock_t, optimistic_set_type>("optimistic_concurrent_t");
+}
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
@@ -0,0 +1,58 @@
+
+#include <unfact/slab_allocator.hpp>
+#include <bench/bench_support.hpp>
+
+namespace uf = unfact;
+
+namespace
+{
+  enum { bench_batch = 64, bench_rounds = 5000 };
+
+  /*
+   * small mixed-size blocks, like profiler nodes and annotations.
+   */
+  void* slab_worker(void* p)
+  {
+	uf::allocator_t* allocator = reinterpret_cast<uf::allocator_t*>(p);
+	uf::byte_t* items[bench_batch];
+	for (int k=0; k<bench_rounds; ++k) {
+	  for (int i=0; i<bench_batch; ++i) { items[i] = allocator->allocate(8 + (i*24)%256); }
+	  for (int i=0; i<bench_batch; ++i) { allocator->deallocate(items[i]); }
+	}
+
+	return 0;
+  }
+
+  /* every call takes the arena lock */
+  class shared_slab_allocator_t : public uf::slab_allocator_t<>
+  {
+  public:
+	shared_slab_allocator_t() : uf::slab_allocator_t<>(0, default_page_size, 0) {}
+  };
+
+  template<class Allocator>
+  void bench_slab_scaling(const char* name)
+  {
+	for (size_t n=1; n<=bench_max_threads; n*=2) {
+	  Allocator allocator;
+	  double sec = bench_run_threads(n, slab_worker, static_cast<uf::allocator_t*>(&allocator));
+	  bench_report(name, n, n*bench_rounds*bench_batch*2, sec);
+	}
+  }
+}
+
+void bench_slab()
+{
+  bench_slab_scaling<uf::stdlib_allocator_t>("malloc");
+  bench_slab_scaling<shared_slab_allocator_t>("slab_allocator_t(shared)");
+  bench_slab_scaling< uf::slab_allocator_t<> >("slab_allocator_t");
+}
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
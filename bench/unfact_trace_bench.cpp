@@ -0,0 +1,82 @@
+#include <unfact/tick_tracer.hpp>
+#include <unfact/heap_tracer.hpp>
+#include <bench/bench_support.hpp>
+#include <stdio.h>
+
+namespace uf = unfact;
+
+namespace
+{
+  enum { bench_rounds = 200000, bench_blocks = 16 };
+
+  /*
+   * each thread traces its own scope: we measure the tracer, not the contention on one node.
+   */
+  struct tick_arg_t
+  {
+	uf::accumulative_tick_tracer_t* tracer;
+	volatile size_t next;
+  };
+
+  void* tick_worker(void* p)
+  {
+	tick_arg_t* arg = reinterpret_cast<tick_arg_t*>(p);
+	char name[32];
+	snprintf(name, sizeof(name), "t%lu", static_cast<unsigned long>(__sync_fetch_and_add(&arg->next, 1)));
+	uf::accumulative_tick_tracer_t::ticket_type here = arg->tracer->push(arg->tracer->root(), name);
+	for (int k=0; k<bench_rounds; ++k) {
+	  arg->tracer->trace(here, 1.0f);
+	}
+
+	return 0;
+  }
+
+  struct heap_arg_t
+  {
+	uf::accumulative_heap_tracer_t* tracer;
+	volatile size_t next;
+  };
+
+  void* heap_worker(void* p)
+  {
+	heap_arg_t* arg = reinterpret_cast<heap_arg_t*>(p);
+	char name[32];
+	snprintf(name, sizeof(name), "h%lu", static_cast<unsigned long>(__sync_fetch_and_add(&arg->next, 1)));
+	uf::accumulative_heap_tracer_t::ticket_type here = arg->tracer->push(arg->tracer->root(), name);
+	uf::byte_t blocks[bench_blocks];
+	for (int k=0; k<bench_rounds/bench_blocks; ++k) {
+	  for (int i=0; i<bench_blocks; ++i) { arg->tracer->trace_allocated(here, &blocks[i], 16); }
+	  for (int i=0; i<bench_blocks; ++i) { arg->tracer->trace_deallocated(&blocks[i]); }
+	}
+
+	return 0;
+  }
+}
+
+void bench_trace()
+{
+  uf::stdlib_allocator_t allocator;
+  for (size_t n=1; n<=bench_max_threads; n*=4) {
+	uf::accumulative_tick_tracer_t tracer(&allocator);
+	tick_arg_t arg = { &tracer, 0 };
+	double sec = bench_run_threads(n, tick_worker, &arg);
+	bench_report("tick trace()", n, n*bench_rounds, sec);
+  }
+
+  for (size_t n=1; n<=bench_max_threads; n*=4) {
+	uf::accumulative_heap_tracer_t tracer(&allocator);
+	tracer.set_aggregating(true);
+	heap_arg_t arg = { &tracer, 0 };
+	double sec = bench_run_threads(n, heap_worker, &arg);
+	bench_report("heap trace_(de)allocated()", n, n*(bench_rounds/bench_blocks)*bench_blocks*2, sec);
+  }
+}
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
@@ -111,7 +111,7 @@ public:
 	  }
 
 	  char buf[64];
-	  size_t len  = min_of(i, 64U);
+	  size_t len  = min_of(i, size_t(64));
 	  memcpy(buf, str.head(), len);
 	  buf[len] = '\0';
 	  size_t num = size_t(atoi(buf));
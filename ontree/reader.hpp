@@ -40,7 +40,7 @@ ONT_NAMESPACE_BEGIN
 class reader_t
 {
 public:
-  enum { scope_depth_limit = 32 };
+  enum { scope_depth_limit = 256 }; // same as writer_t
 
   reader_t() 
 	: m_last(event_begin), m_scope_depth(0), 
@@ -299,7 +299,7 @@ public: // export for testing
 	 * make temporal null-terminated string that strtod() requires.
 	 */
 	char buf[32];
-	size_t len = min_of((32U-1U), r.size());
+	size_t len = min_of(size_t(32-1), r.size());
 	memcpy(buf, r.head(), len);
 	buf[len] = '\0';
 	char* out = 0;
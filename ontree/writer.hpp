@@ -47,7 +47,8 @@ struct counted_scope_t
 class writer_t
 {
 public:
-  enum { scope_depth_limit = 32 };
+  /* each level of nested objects in arrays takes two: deep enough for profiler trees */
+  enum { scope_depth_limit = 256 };
 
   writer_t() : m_scope_depth(0), m_last(event_begin) {}
 
@@ -252,6 +253,27 @@ public: // export just for testing
 	return error_ok;
   }
 
+  static error_e write_value_literal(const range_t& from, range_t* to, int value)
+  {
+	return write_value_literal(from, to, static_cast<long>(value));
+  }
+
+  static error_e write_value_literal(const range_t& from, range_t* to, unsigned int value)
+  {
+	return write_value_literal(from, to, static_cast<unsigned long>(value));
+  }
+
+  static error_e write_value_literal(const range_t& from, range_t* to, long value)
+  {
+	// negate in unsigned arithmetic to survive LONG_MIN
+	return write_integer(from, to, value < 0 ? 0UL - static_cast<unsigned long>(value) : static_cast<unsigned long>(value), value < 0);
+  }
+
+  static error_e write_value_literal(const range_t& from, range_t* to, unsigned long value)
+  {
+	return write_integer(from, to, value, false);
+  }
+
   static error_e write_value_literal(const range_t& from, range_t* to, const char* str)
   {
 	error_e err = error_ok;
@@ -287,8 +309,28 @@ public: // export just for testing
 	return error_ok;
   }
 
+  static bool plain_char_p(char ch)
+  {
+	return (' ' <= ch && ch <= '~' && '"' != ch && '\\' != ch && '/' != ch);
+  }
+
   static error_e write_string(const range_t& from, range_t* to, const char* str)
   {
+	// fast path: most keys and names have nothing to escape
+	size_t plain = 0;
+	while (plain_char_p(str[plain])) {
+	  ++plain;
+	}
+
+	if ('\0' == str[plain]) {
+	  if (from.size() < plain + 2) {
+		return error_need_buffer;
+	  }
+
+	  *to = from.write('"').write(str, plain).write('"');
+	  return error_ok;
+	}
+
 	size_t len  = strlen(str);
 	size_t oh   = count_escape_overhead(str, len);
 	size_t need = len + oh + 2; // +2 for and quotes
@@ -329,6 +371,29 @@ public: // export just for testing
 	return error_ok;
   }
 
+  // integers don't go through real_t: we keep every digit and skip the stream
+  static error_e write_integer(const range_t& from, range_t* to, unsigned long magnitude, bool negative)
+  {
+	char buf[32];
+	char* p = buf + sizeof(buf);
+	do {
+	  *--p = static_cast<char>('0' + magnitude%10);
+	  magnitude /= 10;
+	} while (0 < magnitude);
+
+	if (negative) {
+	  *--p = '-';
+	}
+
+	size_t len = buf + sizeof(buf) - p;
+	if (from.size() < len) {
+	  return error_need_buffer;
+	}
+
+	*to = from.write(p, len);
+	return error_ok;
+  }
+
   static error_e write_word(const range_t& from, range_t* to, const char* word)
   {
 	size_t wlen  = strlen(word);
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * out-of-line part of bundled libatomic_ops, that lockfree_arena_t uses.
+ * we build it here as C++ so that we need no extra library.
+ * it is opt-in: define UNFACT_USE_LOCKFREE_ARENA or UNFACT_USE_AO_ATOMIC_OPS to build it.
+ * define UNFACT_HAS_EXTERNAL_ATOMIC_OPS if you link libatomic_ops by yourself.
+ */
+
+#include <unfact/platform.hpp>
+
+#if defined(UNFACT_PLATFORM_LINUX) && !defined(UNFACT_HAS_EXTERNAL_ATOMIC_OPS) && \
+	(defined(UNFACT_USE_LOCKFREE_ARENA) || defined(UNFACT_USE_AO_ATOMIC_OPS))
+/* bundled sources are not ours: keep our build warning-clean without touching them */
+# if defined(__GNUC__)
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wunused-variable"
+#  pragma GCC diagnostic ignored "-Wtype-limits"
+# endif
+# include "atomic_ops.c"
+# include "atomic_ops_stack.c"
+# if defined(__GNUC__)
+#  pragma GCC diagnostic pop
+# endif
+#endif
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
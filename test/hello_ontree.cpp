@@ -27,8 +27,8 @@ void hello_ontree()
 
 	// array access
 	var_t results = root["ResultSet"]["Result"];
-	assert("425" == results[0U]["Width"].to_s());
-	assert("473" == results[1U]["Width"].to_s());
+	assert("425" == results[size_t(0)]["Width"].to_s());
+	assert("473" == results[size_t(1)]["Width"].to_s());
 
 	// iteration
 	var_t iter = root["ResultSet"]["Result"].first();
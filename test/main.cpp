@@ -22,6 +22,17 @@ void test_concurrent(); // in unfact_concurrent_test.cpp
 void test_tls(); // in unfact_tls_test.cpp
 void test_heap_tracing_annotation(); // in unfact_heap_tracing_annotation_test.cpp
 void test_sticky_tracer(); // in unfact_sticky_tracer_test.cpp
+void test_magazine_arena(); // in unfact_magazine_arena_test.cpp
+void test_lockfree_arena(); // in unfact_lockfree_arena_test.cpp
+void test_mmap_allocator(); // in unfact_mmap_allocator_test.cpp
+void test_slab_allocator(); // in unfact_slab_allocator_test.cpp
+void test_snapshot(); // in unfact_snapshot_test.cpp
+void test_exporter(); // in unfact_exporter_test.cpp
+void test_binary_snapshot(); // in unfact_binary_snapshot_test.cpp
+void test_live(); // in unfact_live_test.cpp
+void test_fork(); // in unfact_fork_test.cpp
+void test_interval(); // in unfact_interval_test.cpp
+void test_exemplar(); // in unfact_exemplar_test.cpp
 
 /* ontree */
 void test_reader(); // in reader_test.cpp
@@ -52,6 +63,17 @@ int main(int /*argc*/, char* /*argv*/[])
   test_tls();
   test_heap_tracing_annotation();
   test_sticky_tracer();
+  test_magazine_arena();
+  test_lockfree_arena();
+  test_mmap_allocator();
+  test_slab_allocator();
+  test_snapshot();
+  test_exporter();
+  test_binary_snapshot();
+  test_live();
+  test_fork();
+  test_interval();
+  test_exemplar();
 
   /* ontree */
   test_reader();
@@ -75,6 +75,27 @@ void test_writer_hello()
   assert(is_ok(t4.writer().write_end()));
   assert(t4.matched());
 
+  /* integers keep every digit */
+  writer_tester_t t7("{\"foo\":[123456789,-42,0,4294967295]}");
+  assert(is_ok(t7.writer().write_begin(scope_object)));
+  assert(is_ok(t7.writer().write_key("foo")));
+  assert(is_ok(t7.writer().write_begin(scope_array)));
+  assert(is_ok(t7.writer().write_value(123456789UL)));
+  assert(is_ok(t7.writer().write_value(-42)));
+  assert(is_ok(t7.writer().write_value(0L)));
+  assert(is_ok(t7.writer().write_value(4294967295U)));
+  assert(is_ok(t7.writer().write_end()));
+  assert(is_ok(t7.writer().write_end()));
+  assert(t7.matched());
+
+  /* escaped string */
+  writer_tester_t t8("{\"a\\/b\":\"c\\\"d\"}");
+  assert(is_ok(t8.writer().write_begin(scope_object)));
+  assert(is_ok(t8.writer().write_key("a/b")));
+  assert(is_ok(t8.writer().write_value("c\"d")));
+  assert(is_ok(t8.writer().write_end()));
+  assert(t8.matched());
+
   /* predicate */
   writer_tester_t t5("{\"foo\":true}");
   assert(is_ok(t5.writer().write_begin(scope_object)));
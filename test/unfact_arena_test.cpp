@@ -172,6 +172,136 @@ test_arena_swap()
 
 }
 
+static void
+test_arena_reclaim_pages()
+{
+  tracing_allocator_t allocator;
+  std::vector<uf::byte_t*> items;
+
+  arena_type arena(&allocator, 16, 100, sizeof(void*), 
+				   arena_type::option_e(arena_type::option_default|arena_type::option_reclaim_pages));
+  UF_TEST_EQUAL(128, arena.page_size()); // rounded up to power of 2
+  arena.set_page_retention(2);
+
+  for (int i=0; i<70; ++i) { items.push_back(arena.allocate()); }
+  size_t peak = arena.npages();
+  UF_TEST_EQUAL(peak, arena.stat().m_peak_npages);
+  UF_TEST_EQUAL(70, arena.stat().m_peak_size);
+  UF_TEST_EQUAL(0, arena.stat().m_nempty);
+
+  // free all but the last one: most pages go back to the allocator
+  for (size_t i=0; i+1<items.size(); ++i) { arena.deallocate(items[i]); }
+  UF_TEST(arena.npages() < peak);
+  UF_TEST(arena.stat().m_nempty <= 2);
+  UF_TEST_EQUAL(peak - arena.npages(), arena.stat().m_nreleased);
+  UF_TEST_EQUAL(1, arena.size());
+
+  // remaining slots are still usable
+  std::vector<uf::byte_t*> again;
+  for (int i=0; i<70; ++i) { again.push_back(arena.allocate()); }
+  for (size_t i=0; i<again.size(); ++i) { UF_TEST(again[i] != items.back()); }
+  for (size_t i=0; i<again.size(); ++i) { arena.deallocate(again[i]); }
+  arena.deallocate(items.back());
+  UF_TEST_EQUAL(0, arena.size());
+
+  arena.set_page_retention(0);
+  UF_TEST_EQUAL(1, arena.npages()); // only the tail page
+  UF_TEST_EQUAL(1, arena.stat().m_nempty);
+  UF_TEST(arena.nslots() < arena.page_size()/arena.item_size());
+}
+
+static void
+test_arena_reclaim_pages_partial_first()
+{
+  tracing_allocator_t allocator;
+  std::vector<uf::byte_t*> items;
+
+  arena_type arena(&allocator, 16, 128, sizeof(void*), 
+				   arena_type::option_e(arena_type::option_default|arena_type::option_reclaim_pages));
+  arena.set_page_retention(8);
+  for (int i=0; i<40; ++i) { items.push_back(arena.allocate()); }
+  size_t mask = ~(arena.page_size() - 1);
+  size_t per_page = 0;
+  while ((reinterpret_cast<size_t>(items[per_page]) & mask) == (reinterpret_cast<size_t>(items[0]) & mask)) {
+	per_page++;
+  }
+
+  // the first page gets empty, and the second one partially
+  for (size_t i=0; i<per_page+1; ++i) { arena.deallocate(items[i]); }
+  UF_TEST_EQUAL(1, arena.stat().m_nempty);
+  UF_TEST_EQUAL(per_page+1, arena.nslots());
+  // a slot on the partially used page, instead of the empty one
+  UF_TEST(arena.allocate() == items[per_page]);
+  UF_TEST_EQUAL(1, arena.stat().m_nempty);
+
+  for (size_t i=per_page; i<items.size(); ++i) { arena.deallocate(items[i]); }
+  arena.set_page_retention(0);
+  UF_TEST_EQUAL(1, arena.npages()); // only the tail page
+  UF_TEST_EQUAL(0, arena.size());
+  UF_TEST(arena.nslots() <= per_page);
+}
+
+static void
+test_arena_reclaim_pages_disabled()
+{
+  tracing_allocator_t allocator;
+  std::vector<uf::byte_t*> items;
+
+  arena_type arena(&allocator, 16, 100);
+  arena.set_page_retention(0);
+  for (int i=0; i<70; ++i) { items.push_back(arena.allocate()); }
+  size_t peak = arena.npages();
+  for (size_t i=0; i<items.size(); ++i) { arena.deallocate(items[i]); }
+  UF_TEST_EQUAL(peak, arena.npages());
+  UF_TEST_EQUAL(0, arena.stat().m_nreleased);
+}
+
+static void
+test_arena_reset()
+{
+  tracing_allocator_t allocator;
+  arena_type arena(&allocator, 16, 100);
+  std::vector<uf::byte_t*> items;
+  for (int i=0; i<70; ++i) { items.push_back(arena.allocate()); }
+  arena.deallocate(items[0]);
+  size_t npages = arena.npages();
+
+  arena.reset();
+  UF_TEST_EQUAL(0, arena.size());
+  UF_TEST_EQUAL(0, arena.nslots());
+  UF_TEST_EQUAL(npages, arena.npages()); // pages are kept
+  UF_TEST_EQUAL(npages - 1, arena.nspares());
+
+  // spare pages are used before allocating new ones
+  for (int i=0; i<70; ++i) { arena.allocate(); }
+  UF_TEST_EQUAL(npages, arena.npages());
+  UF_TEST_EQUAL(0, arena.nspares());
+  arena.reset();
+}
+
+static void
+test_arena_reset_reclaim_pages()
+{
+  tracing_allocator_t allocator;
+  arena_type arena(&allocator, 16, 100, sizeof(void*), 
+				   arena_type::option_e(arena_type::option_default|arena_type::option_reclaim_pages));
+  arena.set_page_retention(4);
+  for (int i=0; i<70; ++i) { arena.allocate(); }
+  UF_TEST(4 < arena.npages());
+
+  // reset pages go to the retention policy
+  arena.reset();
+  UF_TEST_EQUAL(0, arena.size());
+  UF_TEST(arena.npages() <= 4);
+  UF_TEST_EQUAL(arena.npages(), arena.stat().m_nempty);
+
+  std::vector<uf::byte_t*> items;
+  for (int i=0; i<70; ++i) { items.push_back(arena.allocate()); }
+  UF_TEST_EQUAL(0, arena.stat().m_nempty);
+  for (size_t i=0; i<items.size(); ++i) { arena.deallocate(items[i]); }
+  UF_TEST_EQUAL(0, arena.size());
+}
+
 void test_arena()
 {
   test_arena_hello();
@@ -181,6 +311,11 @@ void test_arena()
   test_arena_allocate_fail_first();
   test_arena_allocate_fail_second();
   test_arena_swap();
+  test_arena_reclaim_pages();
+  test_arena_reclaim_pages_partial_first();
+  test_arena_reclaim_pages_disabled();
+  test_arena_reset();
+  test_arena_reset_reclaim_pages();
 }
 
 /* -*-
@@ -0,0 +1,234 @@
+
+#include <unfact/heap_tracer.hpp>
+#include <unfact/tick_tracer.hpp>
+#include <unfact/binary_snapshot.hpp>
+#include <unfact/binary_snapshot_file.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+namespace uf = unfact;
+typedef uf::accumulative_heap_tracer_t tracer_type;
+typedef uf::accumulative_heap_snapshot_t snapshot_type;
+typedef uf::binary_snapshot_encoder_t<snapshot_type> encoder_type;
+
+namespace {
+  struct binary_snapshot_setup_t
+  {
+	binary_snapshot_setup_t()
+	  : tr(&alloc), ss(&alloc), h1(0), h3(0), h5(0), h7(0)
+	{
+	  tr.trace_allocated(tr.root(), &h1, 10);
+	  tracer_type::ticket_type t0 = tr.push(tr.root(), "hello");
+	  tr.trace_allocated(t0, &h3, 30);
+	  tr.trace_allocated(tr.push(t0, "howau"), &h5, 50);
+	  tracer_type::ticket_type t2 = tr.push(tr.root(), "imfine");
+	  tr.trace_allocated(tr.push(t2, "howau"), &h7, 70);
+	  ss.take(tr.tracer());
+	}
+
+	tracing_allocator_t alloc;
+	tracer_type tr;
+	snapshot_type ss;
+	uf::byte_t h1;
+	uf::byte_t h3;
+	uf::byte_t h5;
+	uf::byte_t h7;
+  };
+
+  /* u64 keeps the image aligned like mmap() does */
+  template<class Encoder>
+  void copy_image(const Encoder& enc, std::vector<uf::binary_u64_t>* image)
+  {
+	image->resize(enc.total_size()/sizeof(uf::binary_u64_t) + 1);
+	enc.copy_to(reinterpret_cast<uf::byte_t*>(&(*image)[0]), enc.total_size());
+  }
+}
+
+void test_binary_snapshot_hello()
+{
+  binary_snapshot_setup_t setup;
+  encoder_type enc(&setup.alloc);
+  UF_TEST(enc.encode(setup.ss));
+  std::vector<uf::binary_u64_t> image;
+  copy_image(enc, &image);
+
+  uf::binary_snapshot_view_t view;
+  UF_TEST(view.open(&image[0], enc.total_size()));
+  UF_TEST_EQUAL(view.size(), 5);
+  UF_TEST_EQUAL(view.root(), 4);
+  UF_TEST_EQUAL(view.epoch(), setup.ss.epoch());
+  UF_TEST_EQUAL(view.field_count(), 4);
+  UF_TEST_EQUAL(std::string(view.field_name(0)), "final");
+  UF_TEST_EQUAL(view.field_type(0), uf::binary_field_i64);
+  UF_TEST_EQUAL(std::string(view.field_name(1)), "raised");
+  UF_TEST_EQUAL(view.field_type(1), uf::binary_field_u64);
+  UF_TEST_EQUAL(view.find_field("samples"), 3);
+  UF_TEST_EQUAL(view.find_field("nothing"), size_t(uf::binary_snapshot_view_t::npos));
+
+  for (size_t i=0; i<view.size(); ++i) {
+	UF_TEST_EQUAL(std::string(view.name_of(i)), std::string(setup.ss.name_of(i).c_str()));
+	UF_TEST_EQUAL(view.parent_of(i), setup.ss.parent_of(i));
+	UF_TEST_EQUAL(view.depth_of(i), setup.ss.depth_of(i));
+	UF_TEST_EQUAL(view.i64_of(i, 0), setup.ss.value_of(i).final());
+	UF_TEST_EQUAL(view.number_of(i, 3), double(setup.ss.value_of(i).samples()));
+  }
+
+  /* "howau" is stored once */
+  UF_TEST_EQUAL(std::string(view.name_of(0)), "howau");
+  UF_TEST_EQUAL(std::string(view.name_of(2)), "howau");
+  UF_TEST(view.name_of(0) == view.name_of(2));
+}
+
+void test_binary_snapshot_empty()
+{
+  tracing_allocator_t alloc;
+  snapshot_type ss(&alloc);
+  encoder_type enc(&alloc);
+  UF_TEST(enc.encode(ss));
+  std::vector<uf::binary_u64_t> image;
+  copy_image(enc, &image);
+
+  uf::binary_snapshot_view_t view;
+  UF_TEST(view.open(&image[0], enc.total_size()));
+  UF_TEST(view.empty());
+  UF_TEST_EQUAL(view.field_count(), 0);
+}
+
+void test_binary_snapshot_broken()
+{
+  binary_snapshot_setup_t setup;
+  encoder_type enc(&setup.alloc);
+  UF_TEST(enc.encode(setup.ss));
+  std::vector<uf::binary_u64_t> image;
+  uf::binary_snapshot_view_t view;
+  uf::byte_t* head = 0;
+
+  /* truncated */
+  copy_image(enc, &image);
+  UF_TEST(!view.open(&image[0], enc.total_size() - 1));
+  UF_TEST(!view.opened());
+
+  /* magic */
+  copy_image(enc, &image);
+  head = reinterpret_cast<uf::byte_t*>(&image[0]);
+  head[0] = 'X';
+  UF_TEST(!view.open(&image[0], enc.total_size()));
+
+  /* version */
+  copy_image(enc, &image);
+  reinterpret_cast<uf::binary_snapshot_header_t*>(&image[0])->m_version++;
+  UF_TEST(!view.open(&image[0], enc.total_size()));
+
+  /* parent goes backward */
+  copy_image(enc, &image);
+  head = reinterpret_cast<uf::byte_t*>(&image[0]);
+  uf::binary_snapshot_record_t* r = 
+	reinterpret_cast<uf::binary_snapshot_record_t*>(head + enc.header().m_records_offset + enc.header().m_record_size);
+  r->m_parent = 0;
+  UF_TEST(!view.open(&image[0], enc.total_size()));
+
+  /* name out of the string table */
+  copy_image(enc, &image);
+  head = reinterpret_cast<uf::byte_t*>(&image[0]);
+  r = reinterpret_cast<uf::binary_snapshot_record_t*>(head + enc.header().m_records_offset);
+  r->m_name = uf::binary_u32_t(enc.header().m_strings_size);
+  UF_TEST(!view.open(&image[0], enc.total_size()));
+
+  copy_image(enc, &image);
+  UF_TEST(view.open(&image[0], enc.total_size()));
+}
+
+/* scopes which lost their parent while taking the snapshot are written parentless */
+void test_binary_snapshot_orphan()
+{
+  binary_snapshot_setup_t setup;
+  encoder_type enc(&setup.alloc);
+  UF_TEST(enc.encode(setup.ss));
+  std::vector<uf::binary_u64_t> image;
+  uf::binary_snapshot_view_t view;
+
+  copy_image(enc, &image);
+  uf::byte_t* head = reinterpret_cast<uf::byte_t*>(&image[0]);
+  uf::binary_snapshot_record_t* r = 
+	reinterpret_cast<uf::binary_snapshot_record_t*>(head + enc.header().m_records_offset + enc.header().m_record_size);
+  r->m_parent = uf::binary_snapshot_npos;
+  UF_TEST(view.open(&image[0], enc.total_size()));
+  UF_TEST_EQUAL(size_t(5), view.size());
+  UF_TEST_EQUAL(std::string("hello"), std::string(view.name_of(1)));
+  UF_TEST_EQUAL(size_t(uf::binary_snapshot_view_t::npos), view.parent_of(1));
+  UF_TEST_EQUAL(size_t(1), view.parent_of(0));
+  UF_TEST_EQUAL(size_t(4), view.root());
+
+  /* the root still can't have a parent */
+  r = reinterpret_cast<uf::binary_snapshot_record_t*>(head + enc.header().m_records_offset + enc.header().m_record_size*4);
+  r->m_parent = 1;
+  UF_TEST(!view.open(&image[0], enc.total_size()));
+}
+
+void test_binary_snapshot_sticky()
+{
+  tracing_allocator_t alloc;
+  uf::accumulative_tick_tracer_t tr(&alloc);
+  tr.trace(tr.push(tr.root(), "x"), 1.5f);
+  tr.trace(tr.push(tr.root(), "x"), 2.5f);
+
+  uf::accumulative_tick_snapshot_t ss(&alloc);
+  UF_TEST(ss.take(tr.tracer()));
+  uf::binary_snapshot_encoder_t<uf::accumulative_tick_snapshot_t> enc(&alloc);
+  UF_TEST(enc.encode(ss));
+  std::vector<uf::binary_u64_t> image;
+  copy_image(enc, &image);
+
+  uf::binary_snapshot_view_t view;
+  UF_TEST(view.open(&image[0], enc.total_size()));
+  UF_TEST_EQUAL(view.field_type(0), uf::binary_field_f64);
+  UF_TEST_EQUAL(view.f64_of(0, 0), 4.0);
+  UF_TEST_EQUAL(view.u64_of(0, 1), 2);
+  UF_TEST_EQUAL(view.f64_of(0, 2), 2.0);
+}
+
+void test_binary_snapshot_file()
+{
+#ifdef UNFACT_HAS_BINARY_SNAPSHOT_FILE
+  binary_snapshot_setup_t setup;
+  char path[256];
+  snprintf(path, sizeof(path), "/tmp/unfact_binary_snapshot_test.%d", int(getpid()));
+  UF_TEST(uf::dump_binary_snapshot(path, setup.tr.tracer(), &setup.alloc));
+
+  uf::mapped_binary_snapshot_t mapped;
+  UF_TEST(mapped.open(path));
+  UF_TEST_EQUAL(mapped.view().size(), 5);
+  UF_TEST_EQUAL(std::string(mapped.view().name_of(1)), "hello");
+  UF_TEST_EQUAL(mapped.view().i64_of(mapped.view().root(), 0), 10);
+  mapped.close();
+  UF_TEST(!mapped.opened());
+  unlink(path);
+
+  /* through the fd */
+  FILE* file = tmpfile();
+  UF_TEST(uf::write_binary_snapshot(fileno(file), setup.ss, &setup.alloc));
+  std::vector<uf::binary_u64_t> image(4096);
+  fseek(file, 0, SEEK_SET);
+  size_t read = fread(&image[0], 1, image.size()*sizeof(uf::binary_u64_t), file);
+  fclose(file);
+
+  uf::binary_snapshot_view_t view;
+  UF_TEST(view.open(&image[0], read));
+  UF_TEST_EQUAL(view.size(), 5);
+
+  UF_TEST(!mapped.open("/tmp/unfact_binary_snapshot_test.nothing"));
+#endif
+}
+
+void test_binary_snapshot()
+{
+  test_binary_snapshot_hello();
+  test_binary_snapshot_empty();
+  test_binary_snapshot_broken();
+  test_binary_snapshot_orphan();
+  test_binary_snapshot_sticky();
+  test_binary_snapshot_file();
+}
@@ -1,10 +1,16 @@
 
 #include <unfact/concurrent.hpp>
+#include <unfact/tree_set.hpp>
+#include <unfact/tick_tracer.hpp>
+#include <unfact/platform/posix/ao_atomic_ops.hpp>
 #include <test/memory_support.hpp>
 #include <test/unit.hpp>
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
 
 namespace uf = unfact;
 
@@ -33,10 +39,419 @@ void test_concurrent_rw_lock_hello()
   rw.write_release();
 }
 
+typedef uf::ticket_concurrent_t<uf::default_concurrent_t> ticket_concurrent_type;
+
+template<class AtomicOps>
+void test_concurrent_atomic_ops_hello()
+{
+  typedef typename AtomicOps::value_type value_type;
+  volatile value_type v = 0;
+  UF_TEST(AtomicOps::compare_and_swap(&v, 0, 1));
+  UF_TEST(!AtomicOps::compare_and_swap(&v, 0, 2));
+  UF_TEST(AtomicOps::compare_and_swap_acquire(&v, 1, 2));
+  UF_TEST(!AtomicOps::compare_and_swap_acquire(&v, 1, 3));
+  UF_TEST_EQUAL(2, AtomicOps::fetch_and_add(&v, 3));
+  UF_TEST_EQUAL(5, AtomicOps::fetch_and_add(&v, -1));
+  UF_TEST_EQUAL(4, AtomicOps::load_acquire(&v));
+  UF_TEST_EQUAL(4, AtomicOps::fetch_and_add_relaxed(&v, 2));
+  UF_TEST_EQUAL(6, AtomicOps::fetch_and_add_relaxed(&v, size_t(-1)));
+  UF_TEST_EQUAL(5, AtomicOps::load_relaxed(&v));
+  AtomicOps::store_release(&v, 0);
+  UF_TEST_EQUAL(0, v);
+}
+
+void test_concurrent_ticket_lock_hello()
+{
+  ticket_concurrent_type::spin_lock_type l;
+  UF_TEST(l.try_acquire());
+  UF_TEST(!l.try_acquire());
+  l.release();
+  l.acquire();
+  l.release();
+
+  ticket_concurrent_type::rw_lock_type rw;
+  rw.read_acquire();
+  rw.read_release();
+  rw.write_acquire();
+  rw.write_release();
+}
+
+namespace
+{
+  template<class Lock>
+  struct locked_counter_t
+  {
+	locked_counter_t() : m_count(0) {}
+	Lock m_lock;
+	int m_count;
+  };
+
+  template<class Lock>
+  void* locked_counter_worker(void* p)
+  {
+	locked_counter_t<Lock>* c = reinterpret_cast<locked_counter_t<Lock>*>(p);
+	for (int i=0; i<10000; ++i) {
+	  c->m_lock.acquire();
+	  c->m_count++;
+	  c->m_lock.release();
+	}
+
+	return 0;
+  }
+
+  template<class Lock>
+  int count_with_threads()
+  {
+	enum { nthreads = 8 };
+	locked_counter_t<Lock> c;
+	pthread_t threads[nthreads];
+	for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, locked_counter_worker<Lock>, &c); }
+	for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+	return c.m_count;
+  }
+}
+
+void test_concurrent_lock_threads()
+{
+  UF_TEST_EQUAL(80000, count_with_threads<uf::default_concurrent_t::spin_lock_type>());
+  UF_TEST_EQUAL(80000, count_with_threads<ticket_concurrent_type::spin_lock_type>());
+  UF_TEST_EQUAL(80000, count_with_threads< uf::spin_lock_t<uf::gcc_atomic_ops_t> >());
+  UF_TEST_EQUAL(80000, count_with_threads< uf::spin_lock_t<uf::ao_atomic_ops_t> >());
+  UF_TEST_EQUAL(80000, count_with_threads< uf::ticket_lock_t<uf::ao_atomic_ops_t> >());
+#ifdef UNFACT_HAS_FUTEX_LOCK
+  UF_TEST_EQUAL(80000, count_with_threads<uf::futex_lock_t>());
+#endif
+}
+
+namespace
+{
+  template<class RWLock>
+  struct guarded_pair_t
+  {
+	guarded_pair_t() : m_first(0), m_second(0), m_torn(0) {}
+	RWLock m_lock;
+	volatile int m_first;
+	volatile int m_second;
+	volatile int m_torn;
+  };
+
+  /* one of 16 iterations writes. readers should never see torn pair */
+  template<class RWLock>
+  void* rw_lock_worker(void* p)
+  {
+	guarded_pair_t<RWLock>* g = reinterpret_cast<guarded_pair_t<RWLock>*>(p);
+	for (int i=0; i<5000; ++i) {
+	  if (0 == i%16) {
+		g->m_lock.write_acquire();
+		g->m_first = g->m_first + 1;
+		g->m_second = g->m_second + 1;
+		g->m_lock.write_release();
+	  } else {
+		g->m_lock.read_acquire();
+		if (g->m_first != g->m_second) { g->m_torn = 1; }
+		g->m_lock.read_release();
+	  }
+	}
+
+	return 0;
+  }
+}
+
+template<class RWLock>
+void test_concurrent_rw_lock_threads()
+{
+  enum { nthreads = 8 };
+  guarded_pair_t<RWLock> g;
+  pthread_t threads[nthreads];
+  for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, rw_lock_worker<RWLock>, &g); }
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+  UF_TEST_EQUAL(0, g.m_torn);
+  UF_TEST_EQUAL(nthreads*(5000/16 + 1), g.m_first);
+}
+
+namespace
+{
+  typedef uf::default_concurrent_t::quiescence_type quiescence_type;
+
+  struct quiesced_pairs_t
+  {
+	enum { nthreads = 4 };
+	quiesced_pairs_t() : m_done(0) { for (int i=0; i<nthreads; ++i) { m_first[i] = m_second[i] = 0; } }
+	volatile int m_first[nthreads];
+	volatile int m_second[nthreads];
+	volatile int m_done;
+  };
+
+  struct quiesced_worker_arg_t
+  {
+	quiesced_pairs_t* m_pairs;
+	int m_index;
+  };
+
+  /* each worker changes its own pair in a section. quiesce() should never see it half-done */
+  void* quiesced_pair_worker(void* p)
+  {
+	quiesced_worker_arg_t* a = reinterpret_cast<quiesced_worker_arg_t*>(p);
+	while (!a->m_pairs->m_done) {
+	  uf::quiescent_section_t<quiescence_type> w;
+	  a->m_pairs->m_first[a->m_index] = a->m_pairs->m_first[a->m_index] + 1;
+	  a->m_pairs->m_second[a->m_index] = a->m_pairs->m_second[a->m_index] + 1;
+	}
+
+	return 0;
+  }
+}
+
+void test_concurrent_quiescence_threads()
+{
+  quiesced_pairs_t q;
+  quiesced_worker_arg_t args[quiesced_pairs_t::nthreads];
+  pthread_t threads[quiesced_pairs_t::nthreads];
+  for (int i=0; i<quiesced_pairs_t::nthreads; ++i) {
+	args[i].m_pairs = &q;
+	args[i].m_index = i;
+	pthread_create(&threads[i], 0, quiesced_pair_worker, &args[i]);
+  }
+
+  int torn = 0;
+  for (int k=0; k<200; ++k) {
+	quiescence_type::quiesce();
+	quiescence_type::quiesce(); // nests
+	for (int i=0; i<quiesced_pairs_t::nthreads; ++i) {
+	  if (q.m_first[i] != q.m_second[i]) { ++torn; }
+	}
+
+	{
+	  /* the quiescing thread passes its own sections */
+	  uf::quiescent_section_t<quiescence_type> w;
+	}
+
+	quiescence_type::resume();
+	quiescence_type::resume();
+	usleep(100);
+  }
+
+  q.m_done = 1;
+  for (int i=0; i<quiesced_pairs_t::nthreads; ++i) { pthread_join(threads[i], 0); }
+  UF_TEST_EQUAL(0, torn);
+}
+
+#ifdef UNFACT_HAS_FUTEX_LOCK
+void test_concurrent_futex_lock_hello()
+{
+  uf::futex_lock_t l;
+  UF_TEST(l.try_acquire());
+  UF_TEST(!l.try_acquire());
+  l.release();
+  l.acquire();
+  l.release();
+}
+#endif
+
+template<class Concurrent>
+void test_concurrent_policy_tree_set()
+{
+  tracing_allocator_t alloc;
+  uf::tree_set_t<int, uf::less_t<int>, Concurrent> s(&alloc);
+  for (int i=0; i<100; ++i) { s.insert(i); }
+  UF_TEST_EQUAL(100, s.size());
+  UF_TEST(s.contains(50));
+  s.clear();
+}
+
+namespace
+{
+  typedef uf::optimistic_concurrent_t<uf::default_concurrent_t> optimistic_concurrent_type;
+  typedef uf::tree_set_t<int, uf::less_t<int>, optimistic_concurrent_type> optimistic_set_type;
+
+  struct optimistic_find_t
+  {
+	enum { nthreads = 4 };
+	optimistic_find_t(uf::allocator_t* alloc) : m_set(alloc, 1024), m_missed(0) {}
+	optimistic_set_type m_set;
+	volatile int m_missed;
+  };
+
+  struct optimistic_finder_t
+  {
+	optimistic_find_t* m_find;
+	int m_id;
+  };
+
+  /*
+   * even keys always stay. odd keys come and go, rotating the tree under readers.
+   * each odd key belongs to one thread: find() then remove() is not atomic.
+   */
+  void* optimistic_find_worker(void* p)
+  {
+	optimistic_finder_t* finder = reinterpret_cast<optimistic_finder_t*>(p);
+	optimistic_find_t* f = finder->m_find;
+	for (int i=0; i<2000; ++i) {
+	  int k = (i*7)%200;
+	  if (k%2) {
+		if ((k/2)%optimistic_find_t::nthreads != finder->m_id) {
+		  f->m_set.contains(k);
+		  continue;
+		}
+
+		optimistic_set_type::iterator found = f->m_set.find(k);
+		if (found == f->m_set.end()) {
+		  f->m_set.insert(k);
+		} else {
+		  f->m_set.remove(found);
+		}
+	  } else if (!f->m_set.contains(k)) {
+		f->m_missed = 1;
+	  }
+	}
+
+	return 0;
+  }
+}
+
+void test_concurrent_optimistic_tree_set_threads()
+{
+  enum { nthreads = optimistic_find_t::nthreads };
+  tracing_allocator_t alloc;
+  optimistic_find_t f(&alloc);
+  for (int i=0; i<200; i+=2) { f.m_set.insert(i); }
+
+  pthread_t threads[nthreads];
+  optimistic_finder_t finders[nthreads];
+  for (int i=0; i<nthreads; ++i) { 
+	finders[i].m_find = &f;
+	finders[i].m_id = i;
+	pthread_create(&threads[i], 0, optimistic_find_worker, &finders[i]); 
+  }
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+  UF_TEST_EQUAL(0, f.m_missed);
+  UF_TEST(f.m_set.invariant());
+  f.m_set.clear();
+}
+
+namespace {
+  template<class Concurrent>
+  struct evicting_tracer_t
+  {
+	typedef uf::sticky_tracer_t<uf::sticky_accumulation_t<int>, Concurrent> tracer_type;
+	typedef typename tracer_type::ticket_type ticket_type;
+	enum { iterations = 2000 };
+	evicting_tracer_t(uf::allocator_t* alloc) : m_tracer(alloc), m_running(1) { m_tracer.set_node_budget(64); }
+	tracer_type m_tracer;
+	volatile int m_running;
+  };
+
+  template<class Concurrent>
+  void* evicting_tracer_worker(void* p)
+  {
+	typedef evicting_tracer_t<Concurrent> evicting_type;
+	evicting_type* e = reinterpret_cast<evicting_type*>(p);
+	char name[16];
+	for (int i=0; i<evicting_type::iterations; ++i) {
+	  sprintf(name, "s%d", i%100);
+	  typename evicting_type::ticket_type s = e->m_tracer.push(e->m_tracer.root(), name);
+	  typename evicting_type::ticket_type x = e->m_tracer.push(s, "x");
+	  e->m_tracer.trace(x, 1);
+	  e->m_tracer.pop(x);
+	  e->m_tracer.pop(s);
+	}
+
+	return 0;
+  }
+
+  template<class Concurrent>
+  void* evicting_tracer_evictor(void* p)
+  {
+	evicting_tracer_t<Concurrent>* e = reinterpret_cast<evicting_tracer_t<Concurrent>*>(p);
+	while (e->m_running) { e->m_tracer.evict(); }
+	return 0;
+  }
+}
+
+/* optimistic_concurrent_t pins without locks: see set_tree_t::pin_child() */
+template<class Concurrent>
+void test_concurrent_tree_tracer_evict_threads()
+{
+  enum { nthreads = 4 };
+  typedef evicting_tracer_t<Concurrent> evicting_type;
+  tracing_allocator_t alloc;
+  evicting_type e(&alloc);
+
+  pthread_t evictor;
+  pthread_t threads[nthreads];
+  pthread_create(&evictor, 0, evicting_tracer_evictor<Concurrent>, &e);
+  for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, evicting_tracer_worker<Concurrent>, &e); }
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+  e.m_running = 0;
+  pthread_join(evictor, 0);
+
+  /* the first call gives the second chance. then every trace is folded into the root */
+  e.m_tracer.evict();
+  e.m_tracer.evict();
+  UF_TEST_EQUAL(e.m_tracer.tracer().size(), 0);
+  UF_TEST_EQUAL(e.m_tracer.at(e.m_tracer.root()).total(), nthreads*evicting_type::iterations);
+}
+
+namespace {
+  typedef uf::tree_tracer_t<uf::sticky_accumulation_t<int>, uf::default_concurrent_t> aggregating_tracer_type;
+
+  struct aggregating_tracer_t
+  {
+	enum { nthreads = 4, iterations = 20000 };
+	aggregating_tracer_t(uf::allocator_t* alloc) : m_tracer(alloc) { m_tracer.set_aggregating(true); }
+	aggregating_tracer_type m_tracer;
+  };
+
+  /* every thread walks up through the same ancestors */
+  void* aggregating_tracer_worker(void* p)
+  {
+	aggregating_tracer_t* a = reinterpret_cast<aggregating_tracer_t*>(p);
+	char name[16];
+	sprintf(name, "t%lu", static_cast<unsigned long>(pthread_self()%1000));
+	aggregating_tracer_type::ticket_type t = a->m_tracer.push(a->m_tracer.push(a->m_tracer.root(), "a"), name);
+	for (int i=0; i<aggregating_tracer_t::iterations; ++i) {
+	  a->m_tracer.advance_aggregate(t, 3);
+	  a->m_tracer.advance_aggregate(t, uf::size_t(0) - 1);
+	}
+
+	return 0;
+  }
+}
+
+void test_concurrent_aggregate_threads()
+{
+  enum { nthreads = aggregating_tracer_t::nthreads };
+  tracing_allocator_t alloc;
+  aggregating_tracer_t a(&alloc);
+
+  pthread_t threads[nthreads];
+  for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, aggregating_tracer_worker, &a); }
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+  UF_TEST_EQUAL(a.m_tracer.aggregate_of(a.m_tracer.root()), uf::size_t(nthreads*aggregating_tracer_t::iterations*2));
+}
+
 void test_concurrent()
 {
+  test_concurrent_atomic_ops_hello<uf::gcc_atomic_ops_t>();
+  test_concurrent_atomic_ops_hello<uf::ao_atomic_ops_t>();
   test_concurrent_spin_lock_hello();
   test_concurrent_rw_lock_hello();
+  test_concurrent_ticket_lock_hello();
+  test_concurrent_lock_threads();
+  test_concurrent_rw_lock_threads<uf::default_concurrent_t::rw_lock_type>();
+  test_concurrent_rw_lock_threads<ticket_concurrent_type::rw_lock_type>();
+  test_concurrent_rw_lock_threads< uf::rw_lock_t<uf::default_concurrent_t::atomic_ops_type, uf::default_concurrent_t::spin_lock_type> >();
+  test_concurrent_policy_tree_set<ticket_concurrent_type>();
+  test_concurrent_policy_tree_set<optimistic_concurrent_type>();
+  test_concurrent_optimistic_tree_set_threads();
+  test_concurrent_tree_tracer_evict_threads<uf::default_concurrent_t>();
+  test_concurrent_tree_tracer_evict_threads<optimistic_concurrent_type>();
+  test_concurrent_aggregate_threads();
+  test_concurrent_quiescence_threads();
+#ifdef UNFACT_HAS_FUTEX_LOCK
+  test_concurrent_futex_lock_hello();
+  test_concurrent_policy_tree_set< uf::futex_concurrent_t<uf::default_concurrent_t> >();
+#endif
 }
 
 
@@ -0,0 +1,162 @@
+
+#include <unfact/exemplar.hpp>
+#include <unfact/extras/tick_tracing_annotation.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <string>
+
+namespace uf = unfact;
+namespace ufx = unfact::extras;
+typedef uf::exemplar_t<std::string, float, 4> exemplar_type;
+typedef uf::exemplar_store_t<exemplar_type, 2, 2> store_type;
+
+namespace {
+	exemplar_type make_exemplar(float total)
+	{
+		exemplar_type e;
+		e.record("child", 2, total/2);
+		e.record("parent", 1, total);
+		e.set_total(total);
+		return e;
+	}
+}
+
+void test_exemplar_record()
+{
+	exemplar_type e;
+	for (int i=0; i<6; ++i) {
+		e.record("x", 1, float(i));
+	}
+
+	UF_TEST_EQUAL(e.size(), size_t(4));
+	UF_TEST_EQUAL(e.dropped(), size_t(2));
+	UF_TEST_EQUAL(e.at(3).m_value, 3.0f);
+	e.clear();
+	UF_TEST_EQUAL(e.size(), size_t(0));
+	UF_TEST_EQUAL(e.dropped(), size_t(0));
+}
+
+void test_exemplar_store()
+{
+	store_type store(10.0f);
+	exemplar_type out[2];
+	UF_TEST_EQUAL(store.copy_slowest(out, 2), size_t(0));
+
+	/* slowest ones in descending order */
+	UF_TEST(store.offer(make_exemplar(3.0f)));
+	UF_TEST(store.offer(make_exemplar(5.0f)));
+	UF_TEST(store.offer(make_exemplar(4.0f)));
+	UF_TEST_EQUAL(store.copy_slowest(out, 2), size_t(2));
+	UF_TEST_EQUAL(out[0].total(), 5.0f);
+	UF_TEST_EQUAL(out[1].total(), 4.0f);
+	UF_TEST_EQUAL(out[1].at(1).m_name, std::string("parent"));
+
+	/* under the floor and the threshold: rejected without the lock */
+	size_t offered = store.offered();
+	UF_TEST(!store.wants(2.0f));
+	UF_TEST(!store.offer(make_exemplar(2.0f)));
+	UF_TEST_EQUAL(store.offered(), offered);
+	UF_TEST_EQUAL(store.copy_recent(out, 2), size_t(0));
+
+	/* over the threshold: recent ones, latest first */
+	UF_TEST(store.offer(make_exemplar(20.0f)));
+	UF_TEST(store.offer(make_exemplar(11.0f)));
+	UF_TEST(store.offer(make_exemplar(12.0f)));
+	UF_TEST_EQUAL(store.copy_recent(out, 2), size_t(2));
+	UF_TEST_EQUAL(out[0].total(), 12.0f);
+	UF_TEST_EQUAL(out[1].total(), 11.0f);
+	UF_TEST_EQUAL(store.copy_slowest(out, 2), size_t(2));
+	UF_TEST_EQUAL(out[0].total(), 20.0f);
+	UF_TEST_EQUAL(out[1].total(), 12.0f);
+
+	store.clear();
+	UF_TEST_EQUAL(store.copy_slowest(out, 2), size_t(0));
+	UF_TEST_EQUAL(store.copy_recent(out, 2), size_t(0));
+	UF_TEST(store.wants(1.0f));
+}
+
+void test_exemplar_formatter()
+{
+	exemplar_type e = make_exemplar(8.0f);
+	e.record("a", 1, 1.0f);
+	e.record("b", 1, 1.0f);
+	e.record("c", 1, 1.0f);
+	char buf[64];
+	uf::exemplar_formatter_t<exemplar_type> f(&e, buf, sizeof(buf));
+	UF_TEST_EQUAL(std::string(f.c_str()), std::string("exemplar:     8.0 (1 dropped)"));
+	f.increment();
+	UF_TEST_EQUAL(std::string(f.c_str()), std::string("     1.0 b"));
+	f.increment();
+	f.increment();
+	UF_TEST_EQUAL(std::string(f.c_str()), std::string("     8.0 parent"));
+	f.increment();
+	UF_TEST_EQUAL(std::string(f.c_str()), std::string("     4.0   child"));
+	f.increment();
+	UF_TEST(f.atend());
+}
+
+void test_exemplar_annotation()
+{
+	typedef ufx::tick_tracing_annotation_t<15> annotation_type;
+	typedef ufx::tracing_annotation_context_t< annotation_type > context_type;
+	typedef annotation_type::exemplar_store_type exemplar_store_type;
+	typedef exemplar_store_type::exemplar_type annotated_exemplar_type;
+
+	context_type ctx = { 0, {0} };
+	ctx.init();
+	exemplar_store_type store;
+	{
+		annotation_type::counting_scope_type outer(&(ctx->chain()), "outer");
+		annotation_type::exemplar_scope_type s(&(ctx->chain()), "request", &store);
+		{
+			annotation_type::counting_scope_type parse(&(ctx->chain()), "parse");
+			{
+				annotation_type::counting_scope_type lex(&(ctx->chain()), "lex");
+			}
+
+			/* disjoint ones stay where they are entered, with their subtrees */
+			annotation_type::counting_disjoint_type cache(&(ctx->chain()), "cache");
+			annotation_type::counting_scope_type hit(&(ctx->chain()), "hit");
+		}
+		{
+			annotation_type::counting_disjoint_type io(&(ctx->chain()), "io");
+			annotation_type::counting_scope_type read(&(ctx->chain()), "read");
+		}
+		{
+			/* nested one keeps its own breakdown */
+			exemplar_store_type inner_store;
+			annotation_type::exemplar_scope_type inner(&(ctx->chain()), "query", &inner_store);
+			annotation_type::counting_scope_type plan(&(ctx->chain()), "plan");
+		}
+	}
+
+	UF_TEST(!ctx->chain().recorder());
+	annotated_exemplar_type out[1];
+	UF_TEST_EQUAL(store.copy_slowest(out, 1), size_t(1));
+	UF_TEST_EQUAL(out[0].size(), size_t(7));
+	const char* names[] = { "lex", "hit", "cache", "parse", "read", "io", "query" };
+	size_t depths[] = { 2, 3, 2, 1, 2, 1, 1 };
+	for (size_t i=0; i<7; ++i) {
+		UF_TEST_EQUAL(std::string(out[0].at(i).m_name.c_str()), std::string(names[i]));
+		UF_TEST_EQUAL(out[0].at(i).m_depth, depths[i]);
+	}
+
+	UF_TEST(out[0].at(3).m_value <= out[0].total());
+
+	/* no store, no recording */
+	{
+		annotation_type::exemplar_scope_type s(&(ctx->chain()), "request", 0);
+		UF_TEST(!ctx->chain().recorder());
+	}
+
+	ufx::report_tick_exemplars(store);
+	ctx.fini();
+}
+
+void test_exemplar()
+{
+	test_exemplar_record();
+	test_exemplar_store();
+	test_exemplar_formatter();
+	test_exemplar_annotation();
+}
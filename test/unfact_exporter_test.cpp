@@ -0,0 +1,288 @@
+
+#include <unfact/exporter.hpp>
+#include <unfact/heap_tracer.hpp>
+#include <unfact/tick_tracer.hpp>
+#include <unfact/extras/ontree_exporter.hpp>
+#include <ontree/ontree.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+namespace uf = unfact;
+typedef uf::accumulative_heap_tracer_t tracer_type;
+typedef uf::accumulative_heap_snapshot_t snapshot_type;
+
+namespace {
+  struct exporter_setup_t
+  {
+	exporter_setup_t()
+	  : tr(&alloc), ss(&alloc), h1(0), h3(0), h5(0)
+	{
+	  tr.trace_allocated(tr.root(), &h1, 10);
+	  tracer_type::ticket_type t0 = tr.push(tr.root(), "hello");
+	  tr.trace_allocated(t0, &h3, 30);
+	  tr.trace_allocated(tr.push(t0, "howau"), &h5, 50);
+	  tr.push(t0, "imfine");
+	  ss.take(tr.tracer());
+	}
+
+	tracing_allocator_t alloc;
+	tracer_type tr;
+	snapshot_type ss;
+	uf::byte_t h1;
+	uf::byte_t h3;
+	uf::byte_t h5;
+  };
+}
+
+void test_exporter_buffer_sink()
+{
+  char buf[8];
+  uf::buffer_sink_t sink(buf, sizeof(buf));
+  UF_TEST_EQUAL(std::string(sink.c_str()), "");
+  UF_TEST(sink.write("hello", 5));
+  UF_TEST(!sink.write("hello", 5));
+  UF_TEST(sink.overflowed());
+  UF_TEST(sink.write("ab", 2));
+  UF_TEST_EQUAL(std::string(sink.c_str()), "helloab");
+  UF_TEST_EQUAL(sink.size(), 7);
+}
+
+void test_exporter_text()
+{
+  exporter_setup_t setup;
+  char buf[256];
+  uf::buffer_sink_t sink(buf, sizeof(buf));
+  UF_TEST(uf::export_text(setup.ss, sink, uf::final_measure_t()));
+  UF_TEST_EQUAL(std::string(sink.c_str()), 
+								"       50:hello.howau\n"
+								"       80:hello\n"
+								"       90:\n");
+
+  uf::buffer_sink_t small(buf, 20);
+  UF_TEST(!uf::export_text(setup.ss, small, uf::final_measure_t()));
+}
+
+void test_exporter_folded()
+{
+  exporter_setup_t setup;
+  char buf[256];
+  uf::buffer_sink_t sink(buf, sizeof(buf));
+  UF_TEST(uf::export_folded(setup.ss, sink, uf::final_measure_t()));
+  UF_TEST_EQUAL(std::string(sink.c_str()), 
+								"hello;howau 50\n"
+								"hello 30\n"
+								"(root) 10\n");
+
+  uf::buffer_sink_t samples(buf, sizeof(buf));
+  UF_TEST(uf::export_folded(setup.ss, samples, uf::samples_measure_t()));
+  UF_TEST_EQUAL(std::string(samples.c_str()), 
+								"hello;howau 1\n"
+								"hello 1\n"
+								"(root) 1\n");
+}
+
+void test_exporter_json()
+{
+  exporter_setup_t setup;
+  char buf[1024];
+  uf::buffer_sink_t sink(buf, sizeof(buf));
+  UF_TEST(uf::export_json(setup.ss, sink));
+  UF_TEST_EQUAL(std::string(sink.c_str()), 
+								"{\"name\":\"\","
+								"\"self\":{\"final\":10,\"raised\":10,\"fallen\":0,\"samples\":1},"
+								"\"total\":{\"final\":90,\"raised\":90,\"fallen\":0,\"samples\":3},"
+								"\"children\":["
+								"{\"name\":\"hello\","
+								"\"self\":{\"final\":30,\"raised\":30,\"fallen\":0,\"samples\":1},"
+								"\"total\":{\"final\":80,\"raised\":80,\"fallen\":0,\"samples\":2},"
+								"\"children\":["
+								"{\"name\":\"howau\","
+								"\"self\":{\"final\":50,\"raised\":50,\"fallen\":0,\"samples\":1},"
+								"\"total\":{\"final\":50,\"raised\":50,\"fallen\":0,\"samples\":1}},"
+								"{\"name\":\"imfine\","
+								"\"self\":{\"final\":0,\"raised\":0,\"fallen\":0,\"samples\":0},"
+								"\"total\":{\"final\":0,\"raised\":0,\"fallen\":0,\"samples\":0}}"
+								"]}]}");
+
+  uf::buffer_sink_t small(buf, 64);
+  UF_TEST(!uf::export_json(setup.ss, small));
+}
+
+void test_exporter_json_escape()
+{
+  char buf[64];
+  uf::buffer_sink_t sink(buf, sizeof(buf));
+  UF_TEST(uf::export_json_string(sink, "a\"b\\c\n"));
+  UF_TEST_EQUAL(std::string(sink.c_str()), "\"a\\\"b\\\\c\\u000a\"");
+}
+
+void test_exporter_sticky()
+{
+  typedef uf::sticky_tracer_t< uf::sticky_accumulation_t<double> > sticky_type;
+  tracing_allocator_t alloc;
+  sticky_type tr(&alloc);
+  tr.trace(tr.push(tr.root(), "x"), 1.5);
+
+  uf::tracing_snapshot_t<sticky_type::tracer_type> ss(&alloc);
+  UF_TEST(ss.take(tr.tracer()));
+  char buf[512];
+  uf::buffer_sink_t sink(buf, sizeof(buf));
+  UF_TEST(uf::export_json(ss, sink));
+  UF_TEST_EQUAL(std::string(sink.c_str()), 
+								"{\"name\":\"\","
+								"\"self\":{\"total\":0,\"samples\":0,\"average\":0},"
+								"\"total\":{\"total\":1.5,\"samples\":1,\"average\":1.5},"
+								"\"children\":["
+								"{\"name\":\"x\","
+								"\"self\":{\"total\":1.5,\"samples\":1,\"average\":1.5},"
+								"\"total\":{\"total\":1.5,\"samples\":1,\"average\":1.5}}"
+								"]}");
+}
+
+static const char* const hello_json =
+  "{\"name\":\"\","
+  "\"self\":{\"final\":10,\"raised\":10,\"fallen\":0,\"samples\":1},"
+  "\"total\":{\"final\":90,\"raised\":90,\"fallen\":0,\"samples\":3},"
+  "\"children\":["
+  "{\"name\":\"hello\","
+  "\"self\":{\"final\":30,\"raised\":30,\"fallen\":0,\"samples\":1},"
+  "\"total\":{\"final\":80,\"raised\":80,\"fallen\":0,\"samples\":2},"
+  "\"children\":["
+  "{\"name\":\"howau\","
+  "\"self\":{\"final\":50,\"raised\":50,\"fallen\":0,\"samples\":1},"
+  "\"total\":{\"final\":50,\"raised\":50,\"fallen\":0,\"samples\":1}},"
+  "{\"name\":\"imfine\","
+  "\"self\":{\"final\":0,\"raised\":0,\"fallen\":0,\"samples\":0},"
+  "\"total\":{\"final\":0,\"raised\":0,\"fallen\":0,\"samples\":0}}"
+  "]}]}";
+
+void test_exporter_ontree()
+{
+  exporter_setup_t setup;
+  /* starts on our buffer, then grows */
+  char buf[16];
+  uf::extras::ontree_buffer_output_t out(&setup.alloc, buf, sizeof(buf));
+  UF_TEST(uf::extras::export_ontree_json(setup.ss, out));
+  UF_TEST(out.owned());
+  UF_TEST_EQUAL(std::string(out.c_str()), hello_json);
+  UF_TEST_EQUAL(out.size(), strlen(hello_json));
+
+  /* large enough: no allocation */
+  char large[1024];
+  uf::extras::ontree_buffer_output_t fit(&setup.alloc, large, sizeof(large));
+  UF_TEST(uf::extras::export_ontree_json(setup.ss, fit));
+  UF_TEST(!fit.owned());
+  UF_TEST(fit.c_str() == large);
+  UF_TEST_EQUAL(std::string(fit.c_str()), hello_json);
+
+  /* reads back */
+  ontree::tree_t tree;
+  UF_TEST(ontree::is_ok(ontree::build_tree(&tree, out.c_str())));
+  ontree::var_t root = tree.root();
+  UF_TEST_EQUAL(root["total"]["final"].to_size(), 90);
+  UF_TEST_EQUAL(std::string(root["children"].first()["name"].c_str()), "hello");
+
+  snapshot_type empty(&setup.alloc);
+  uf::extras::ontree_buffer_output_t none(&setup.alloc);
+  UF_TEST(uf::extras::export_ontree_json(empty, none));
+  UF_TEST_EQUAL(std::string(none.c_str()), "{}");
+}
+
+void test_exporter_ontree_fd()
+{
+  exporter_setup_t setup;
+  FILE* file = tmpfile();
+  UF_TEST(file);
+
+  char scratch[64];
+  uf::extras::ontree_fd_output_t out(fileno(file), scratch, sizeof(scratch));
+  UF_TEST(uf::extras::export_ontree_json(setup.ss, out));
+  UF_TEST_EQUAL(out.written(), strlen(hello_json));
+
+  char buf[1024];
+  fseek(file, 0, SEEK_SET);
+  size_t read = fread(buf, 1, sizeof(buf) - 1, file);
+  buf[read] = '\0';
+  UF_TEST_EQUAL(std::string(buf), hello_json);
+
+  /* no token fits in */
+  uf::extras::ontree_fd_output_t tiny(fileno(file), scratch, 4);
+  UF_TEST(!uf::extras::export_ontree_json(setup.ss, tiny));
+  fclose(file);
+}
+
+void test_exporter_ontree_deep()
+{
+  tracing_allocator_t alloc;
+  tracer_type tr(&alloc);
+  tracer_type::ticket_type here = tr.root();
+  size_t deep = 100;
+  for (size_t i=0; i<deep; ++i) {
+	here = tr.push(here, "d");
+  }
+
+  snapshot_type ss(&alloc);
+  UF_TEST(ss.take(tr.tracer()));
+  uf::extras::ontree_buffer_output_t out(&alloc);
+  UF_TEST(uf::extras::export_ontree_json(ss, out));
+  UF_TEST(0 == strstr(out.c_str(), "elided"));
+
+  /* same as the plain one, whatever deep */
+  std::vector<char> plain(out.size() + 1);
+  uf::buffer_sink_t sink(&plain[0], plain.size());
+  UF_TEST(uf::export_json(ss, sink));
+  UF_TEST_EQUAL(std::string(sink.c_str()), std::string(out.c_str()));
+
+  ontree::tree_t tree;
+  UF_TEST(ontree::is_ok(ontree::build_tree(&tree, out.c_str())));
+  ontree::var_t v = tree.root();
+  for (size_t i=0; i<deep; ++i) { v = v["children"].first(); }
+  UF_TEST_EQUAL(std::string(v["name"].c_str()), "d");
+}
+
+void test_exporter_ontree_tick()
+{
+  tracing_allocator_t alloc;
+  uf::accumulative_tick_tracer_t tr(&alloc);
+  tr.trace(tr.push(tr.root(), "x"), 1.5f);
+
+  uf::extras::ontree_buffer_output_t out(&alloc);
+  UF_TEST(uf::extras::export_tracer_ontree_json(tr.tracer(), &alloc, out));
+  UF_TEST_EQUAL(std::string(out.c_str()), 
+								"{\"name\":\"\","
+								"\"self\":{\"total\":0,\"samples\":0,\"average\":0},"
+								"\"total\":{\"total\":1.5,\"samples\":1,\"average\":1.5},"
+								"\"children\":["
+								"{\"name\":\"x\","
+								"\"self\":{\"total\":1.5,\"samples\":1,\"average\":1.5},"
+								"\"total\":{\"total\":1.5,\"samples\":1,\"average\":1.5}}"
+								"]}");
+}
+
+void test_exporter()
+{
+  test_exporter_buffer_sink();
+  test_exporter_text();
+  test_exporter_folded();
+  test_exporter_json();
+  test_exporter_json_escape();
+  test_exporter_sticky();
+  test_exporter_ontree();
+  test_exporter_ontree_fd();
+  test_exporter_ontree_deep();
+  test_exporter_ontree_tick();
+}
+
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   tab-width:2
+   End:
+   -*- */
@@ -0,0 +1,160 @@
+
+#include <unfact/heap_tracer.hpp>
+#include <unfact/tick_tracer.hpp>
+#include <unfact/fork.hpp>
+#include <unfact/binary_snapshot_file.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <string>
+#include <stdio.h>
+
+#if defined(UNFACT_HAS_FORK_GUARD) && defined(UNFACT_HAS_BINARY_SNAPSHOT_FILE)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace uf = unfact;
+typedef uf::accumulative_heap_tracer_t heap_type;
+typedef uf::accumulative_tick_tracer_t tick_type;
+
+namespace {
+  struct fork_setup_t
+  {
+	fork_setup_t() : heap(&alloc), tick(&alloc), done(false)
+	{
+	  hello = heap.push(heap.root(), "hello");
+	  heap.trace_allocated(hello, &blocks[0], 10);
+	  heap.trace_allocated(heap.push(hello, "howau"), &blocks[1], 20);
+	  tick.trace(tick.push(tick.root(), "x"), 1.0f);
+	}
+
+	tracing_allocator_t alloc;
+	heap_type heap;
+	tick_type tick;
+	heap_type::ticket_type hello;
+	uf::byte_t blocks[64];
+	volatile bool done;
+  };
+
+  /* keeps tracing, and pushing new scopes, while the main thread forks */
+  void* fork_tracing_worker(void* arg)
+  {
+	fork_setup_t* s = reinterpret_cast<fork_setup_t*>(arg);
+	char name[16];
+	for (int i=0; !s->done; ++i) {
+	  snprintf(name, sizeof(name), "w%d", i%200);
+	  heap_type::ticket_type t = s->heap.push(s->hello, name);
+	  s->heap.trace_allocated(t, &s->blocks[2], 1);
+	  s->heap.trace_deallocated(&s->blocks[2]);
+	  s->tick.trace(s->tick.push(s->tick.root(), name), 1.0f);
+	}
+
+	return 0;
+  }
+
+  /* @return exit status of the child: 0 if OK */
+  int fork_child_main(fork_setup_t* s, const char* path)
+  {
+	/* counts are restarted, and the scopes are there */
+	if (0 != s->heap.tracer().at(s->hello).final() || 0 != s->heap.size()) { return 1; }
+	if (0 != s->tick.tracer().at(s->tick.push(s->tick.root(), "x")).samples()) { return 2; }
+
+	/* inherited blocks are not traced again */
+	s->heap.trace_deallocated(&s->blocks[0]);
+	if (0 != s->heap.tracer().at(s->hello).samples()) { return 3; }
+
+	s->heap.trace_allocated(s->hello, &s->blocks[3], 5);
+	s->tick.trace(s->tick.push(s->tick.root(), "x"), 3.0f);
+	if (!uf::dump_process_binary_snapshot(path, s->heap.tracer(), &s->alloc)) { return 4; }
+	return 0;
+  }
+}
+
+void test_fork_acquire_all()
+{
+  fork_setup_t s;
+  s.heap.acquire_all();
+  s.heap.release_all();
+  s.tick.acquire_all();
+  s.tick.release_all();
+
+  /* tracing goes on */
+  s.heap.trace_allocated(s.heap.push(s.hello, "more"), &s.blocks[2], 5);
+  UF_TEST_EQUAL(s.heap.size(), 35);
+
+  s.heap.restart();
+  UF_TEST_EQUAL(s.heap.size(), 0);
+  UF_TEST_EQUAL(s.heap.tracer().at(s.hello).final(), 0);
+  s.heap.trace_deallocated(&s.blocks[2]);
+  UF_TEST_EQUAL(s.heap.tracer().at(s.heap.push(s.hello, "more")).final(), 0);
+  s.heap.trace_deallocated(&s.blocks[0]);
+  s.heap.trace_deallocated(&s.blocks[1]);
+
+  s.tick.restart();
+  UF_TEST_EQUAL(s.tick.tracer().at(s.tick.push(s.tick.root(), "x")).samples(), 0);
+}
+
+void test_fork_workers()
+{
+  fork_setup_t s;
+  uf::fork_guard_t<heap_type> heap_guard(&s.heap);
+  uf::fork_guard_t<tick_type> tick_guard(&s.tick);
+
+  char path[256];
+  snprintf(path, sizeof(path), "/tmp/unfact_fork_test.%d", int(getpid()));
+
+  pthread_t worker;
+  pthread_create(&worker, 0, fork_tracing_worker, &s);
+
+  enum { nchildren = 4 };
+  pid_t children[nchildren];
+  for (int i=0; i<nchildren; ++i) {
+	children[i] = fork();
+	if (0 == children[i]) {
+	  _exit(fork_child_main(&s, path));
+	}
+
+	UF_TEST(0 < children[i]);
+	usleep(1000);
+  }
+
+  for (int i=0; i<nchildren; ++i) {
+	int status = -1;
+	UF_TEST_EQUAL(waitpid(children[i], &status, 0), children[i]);
+	UF_TEST(WIFEXITED(status));
+	UF_TEST_EQUAL(WEXITSTATUS(status), 0);
+
+	char mine[sizeof(path) + 16]; // ".<pid>"
+	snprintf(mine, sizeof(mine), "%s.%d", path, int(children[i]));
+	uf::mapped_binary_snapshot_t dumped;
+	UF_TEST(dumped.open(mine));
+	const uf::binary_snapshot_view_t& view = dumped.view();
+	for (size_t k=0; k<view.size(); ++k) {
+	  if (std::string("hello") == view.name_of(k)) {
+		UF_TEST_EQUAL(view.i64_of(k, 0), 5);
+	  }
+	}
+
+	unlink(mine);
+  }
+
+  s.done = true;
+  pthread_join(worker, 0);
+
+  /* the parent keeps its counts */
+  UF_TEST_EQUAL(s.heap.tracer().at(s.hello).final(), 10);
+  s.heap.trace_deallocated(&s.blocks[0]);
+  s.heap.trace_deallocated(&s.blocks[1]);
+}
+
+void test_fork()
+{
+  test_fork_acquire_all();
+  test_fork_workers();
+}
+
+#else
+
+void test_fork() {}
+
+#endif
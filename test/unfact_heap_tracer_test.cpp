@@ -76,12 +76,44 @@ void test_heap_tracer_trace()
   UF_TEST_EQUAL(tr.size(), 0);
 }
 
+void test_heap_tracer_evict()
+{
+  tracing_allocator_t alloc;
+  tracer_type tr(&alloc);
+  tr.set_node_budget(16);
+
+  tracer_type::ticket_type t0 = tr.push(tr.root(), "hello");
+  tracer_type::ticket_type t1 = tr.push(t0, "howau");
+  tracer_type::ticket_type t2 = tr.push(t0, "bye");
+
+  uf::byte_t heap01 = 0;
+  uf::byte_t heap03 = 0;
+  tr.trace_allocated(t1, &heap01, 10);
+  tr.trace_allocated(t2, &heap03, 30);
+  tr.trace_deallocated(&heap01);
+  tr.pop(t2);
+  tr.pop(t1);
+  tr.pop(t0);
+
+  tr.evict(); // second chance
+  /* "bye" has a live block: "hello" is kept as its parent */
+  UF_TEST_EQUAL(tr.evict(), 1);
+  UF_TEST_EQUAL(tr.at(t0).raised(), 10);
+  UF_TEST_EQUAL(tr.at(t0).fallen(), 10);
+
+  tr.trace_deallocated(&heap03);
+  UF_TEST_EQUAL(tr.evict(), 2);
+  UF_TEST_EQUAL(tr.at(tr.root()).raised(), 10+30);
+  UF_TEST_EQUAL(tr.at(tr.root()).final(), 0);
+}
+
 namespace {
   struct typical_heap_setup_t
   {
-	typical_heap_setup_t()
+	typical_heap_setup_t(bool aggregating=false)
 	  : tr(&alloc)
 	{
+	  tr.set_aggregating(aggregating);
 	  h1 = 0;
 	  h3 = 0;
 	  h5 = 0;
@@ -111,21 +143,26 @@ namespace {
   };
 }
 
-void test_heap_tracer_count()
+void test_heap_tracer_count(bool aggregating)
 {
-  typical_heap_setup_t setup;
+  typical_heap_setup_t setup(aggregating);
 
   UF_TEST_EQUAL(accumulation_count(setup.tr.tracer(), setup.tr.root()), 10 + 30 + 50 + 70);
   UF_TEST_EQUAL(accumulation_count(setup.tr.tracer(), setup.t0), 30 + 50 + 70);
   UF_TEST_EQUAL(accumulation_count(setup.tr.tracer(), setup.t1), 50);
   UF_TEST_EQUAL(accumulation_count(setup.tr.tracer(), setup.t2), 70);
+
+  setup.tr.trace_deallocated(&(setup.h5));
+  UF_TEST_EQUAL(accumulation_count(setup.tr.tracer(), setup.tr.root()), 10 + 30 + 70);
+  UF_TEST_EQUAL(accumulation_count(setup.tr.tracer(), setup.t0), 30 + 70);
+  UF_TEST_EQUAL(accumulation_count(setup.tr.tracer(), setup.t1), 0);
 }
 
-void test_heap_tracing_formatter_hello()
+void test_heap_tracing_formatter_hello(bool aggregating)
 {
   char buf[128];
   char testbuf[128];
-  typical_heap_setup_t setup;
+  typical_heap_setup_t setup(aggregating);
   uf::accumulation_formatter_t<tracer_type::tracer_type>
 	f1(&(setup.tr.tracer()), buf, 128, setup.tr.root());
 
@@ -196,12 +233,43 @@ void test_heap_tracing_formatter_hello()
 
 }
 
+/* aggregates have no height limit */
+void test_heap_tracing_formatter_deep()
+{
+  enum { height = uf::accumulative_heap_tracing_formatter_t::max_height*2 };
+  char buf[256];
+  tracing_allocator_t alloc;
+  tracer_type tr(&alloc);
+  tr.set_aggregating(true);
+
+  uf::byte_t h = 0;
+  tracer_type::ticket_type t = tr.root();
+  for (int i=0; i<height; ++i) { t = tr.push(t, "d"); }
+  tr.trace_allocated(t, &h, 10);
+  UF_TEST_EQUAL(tr.aggregate_of(tr.root()), 10);
+
+  uf::accumulative_heap_tracing_formatter_t f(&(tr.tracer()), buf, sizeof(buf), tr.root());
+  int lines = 0;
+  for (/* */; !f.atend(); f.increment()) {
+	UF_TEST_EQUAL(std::string(f.c_str(), 10), std::string("       10:"));
+	lines++;
+  }
+
+  UF_TEST_EQUAL(lines, height + 1);
+  tr.trace_deallocated(&h);
+  UF_TEST_EQUAL(tr.aggregate_of(tr.root()), 0);
+}
+
 void test_heap_tracer()
 {
   test_heap_tracer_hello();
   test_heap_tracer_trace();
-  test_heap_tracer_count();
-  test_heap_tracing_formatter_hello();
+  test_heap_tracer_count(false);
+  test_heap_tracer_count(true);
+  test_heap_tracer_evict();
+  test_heap_tracing_formatter_hello(false);
+  test_heap_tracing_formatter_hello(true);
+  test_heap_tracing_formatter_deep();
 }
 
 
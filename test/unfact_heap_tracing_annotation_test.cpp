@@ -1,9 +1,12 @@
 
 #include <unfact/extras/heap_tracing_annotation.hpp>
+#include <unfact/extras/tracing_config.hpp>
 #include <test/memory_support.hpp>
 #include <test/tracer_support.hpp>
 #include <test/unit.hpp>
+#include <pthread.h>
 
+namespace uf  = unfact;
 namespace ufx = unfact::extras;
 
 void test_hta_hello()
@@ -51,6 +54,258 @@ void test_hta_init_fini()
 	UF_TEST_EQUAL(ctx.self, 0);
 }
 
+typedef ufx::heap_tracing_annotation_t<14> controlled_annotation_type;
+
+void test_hta_disable()
+{
+	controlled_annotation_type a;
+	controlled_annotation_type::chain_type& c = a.chain();
+	uf::byte_t x;
+
+	c.disable();
+	UF_TEST(!c.accounting());
+	c.push("hello");
+	UF_TEST(c.empty());
+	a.trace_allocated(&x, 10);
+	UF_TEST_EQUAL(0U, a.tracer().size());
+	UF_TEST_EQUAL(1U, a.skipped());
+	c.pop();
+
+	c.enable();
+	a.trace_deallocated(&x); // skipped one: not an error
+	UF_TEST_EQUAL(0U, a.skipped());
+	c.push("hello");
+	UF_TEST_EQUAL("hello", qualified_tracing_name(a.tracer(), c.ticket()));
+	c.pop();
+	UF_TEST(c.empty());
+}
+
+void test_hta_max_depth()
+{
+	controlled_annotation_type a;
+	controlled_annotation_type::chain_type& c = a.chain();
+	uf::byte_t x;
+
+	c.set_max_depth(2);
+	c.push("a");
+	c.push("b");
+	c.push("c");
+	c.push("d");
+	UF_TEST_EQUAL("a.b", qualified_tracing_name(a.tracer(), c.ticket()));
+	UF_TEST(c.accounting());
+	UF_TEST(!c.accounting_here());
+	/* goes to the deepest traced scope */
+	a.trace_allocated(&x, 10);
+	UF_TEST_EQUAL(10, a.tracer().at(c.ticket()).final());
+	a.trace_deallocated(&x);
+	c.pop();
+	c.pop();
+	UF_TEST_EQUAL("a.b", qualified_tracing_name(a.tracer(), c.ticket()));
+	UF_TEST(c.accounting_here());
+	c.pop();
+	UF_TEST_EQUAL("a", qualified_tracing_name(a.tracer(), c.ticket()));
+	c.pop();
+	UF_TEST(c.empty());
+}
+
+void test_hta_mute()
+{
+	controlled_annotation_type a;
+	controlled_annotation_type::chain_type& c = a.chain();
+	uf::byte_t x;
+
+	c.push("hello");
+	c.mute();
+	UF_TEST(c.muted());
+	c.push("muted");
+	a.trace_allocated(&x, 10);
+	UF_TEST_EQUAL(0U, a.tracer().size());
+	c.pop();
+	c.unmute();
+	UF_TEST_EQUAL("hello", qualified_tracing_name(a.tracer(), c.ticket()));
+	c.pop();
+	UF_TEST(c.empty());
+}
+
+void test_hta_mute_scope()
+{
+	controlled_annotation_type a;
+	controlled_annotation_type::chain_type& c = a.chain();
+	uf::byte_t x;
+
+	c.push("noisy");
+	c.push("child");
+	c.pop();
+	controlled_annotation_type::ticket_type noisy = c.ticket();
+	c.mute_scope(noisy);
+	UF_TEST(a.tracer().muted(noisy));
+	UF_TEST(a.tracer().muted(a.tracer().push(noisy, "child")));
+	/* new children inherit the flag */
+	UF_TEST(a.tracer().muted(a.tracer().push(noisy, "newcomer")));
+	UF_TEST(!a.tracer().muted(c.root()));
+
+	UF_TEST(!c.accounting());
+	a.trace_allocated(&x, 10);
+	UF_TEST_EQUAL(0U, a.tracer().size());
+	c.push("skipped");
+	UF_TEST_EQUAL("noisy", qualified_tracing_name(a.tracer(), c.ticket()));
+	c.pop();
+
+	c.unmute_scope(noisy);
+	UF_TEST(!a.tracer().muted(a.tracer().push(noisy, "child")));
+	UF_TEST(c.accounting());
+	c.pop();
+	UF_TEST(c.empty());
+}
+
+namespace
+{
+	struct handoff_work_t
+	{
+		controlled_annotation_type* a;
+		uf::byte_t* x;
+		size_t* depth;
+		void operator()() { a->trace_allocated(x, 10); *depth = a->tracer().depth_of(a->chain().ticket()); }
+	};
+
+	void handoff_work(void* arg) { (*reinterpret_cast<handoff_work_t*>(arg))(); }
+
+	void* handoff_worker(void* arg)
+	{
+		ufx::adopting_call_t<controlled_annotation_type::chain_type>::run(arg);
+		return 0;
+	}
+}
+
+void test_hta_handoff()
+{
+	controlled_annotation_type a;
+	controlled_annotation_type::chain_type& c = a.chain();
+	uf::byte_t x[3];
+	size_t depth = 0;
+
+	c.push("request");
+	controlled_annotation_type::ticket_type request = c.ticket();
+	controlled_annotation_type::handoff_type h = c.capture();
+	/* no node budget, no pin */
+	UF_TEST(!h.pinned());
+	handoff_work_t work = { &a, &x[0], &depth };
+	ufx::adopting_call_t<controlled_annotation_type::chain_type> call(&c, handoff_work, &work);
+	c.pop();
+
+	/* on another thread: allocations go to the captured scope */
+	pthread_t worker;
+	pthread_create(&worker, 0, handoff_worker, &call);
+	pthread_join(worker, 0);
+	UF_TEST_EQUAL(10, a.tracer().at(request).final());
+	UF_TEST_EQUAL(size_t(1), depth);
+
+	/* the worker gets its own top back */
+	c.push("worker");
+	{
+		controlled_annotation_type::adopt_scope_type s(&c, h);
+		UF_TEST_EQUAL("request", qualified_tracing_name(a.tracer(), c.ticket()));
+		c.push("task");
+		UF_TEST_EQUAL("request.task", qualified_tracing_name(a.tracer(), c.ticket()));
+		c.pop();
+	}
+	UF_TEST_EQUAL("worker", qualified_tracing_name(a.tracer(), c.ticket()));
+
+	/* the null one adopts the root */
+	{
+		controlled_annotation_type::adopt_scope_type s(&c, controlled_annotation_type::handoff_type());
+		UF_TEST(c.empty());
+	}
+	c.pop();
+	UF_TEST(c.empty());
+
+	/* wrapping a function object */
+	handoff_work_t wrapped_work = { &a, &x[1], &depth };
+	c.push("wrapped");
+	ufx::adopting_t<controlled_annotation_type::chain_type, handoff_work_t> wrapped = ufx::adopting(&c, wrapped_work);
+	c.pop();
+	wrapped();
+	UF_TEST_EQUAL(10, a.tracer().at(wrapped.handoff().top()).final());
+	UF_TEST_EQUAL("wrapped", qualified_tracing_name(a.tracer(), wrapped.handoff().top()));
+	UF_TEST(c.empty());
+
+	/* no chain, no adoption */
+	handoff_work_t unchained_work = { &a, &x[2], &depth };
+	ufx::adopting(static_cast<controlled_annotation_type::chain_type*>(0), unchained_work)();
+	UF_TEST_EQUAL(10, a.tracer().at(c.root()).final());
+
+	a.trace_deallocated(&x[0]);
+	a.trace_deallocated(&x[1]);
+	a.trace_deallocated(&x[2]);
+}
+
+void test_hta_handoff_pinned()
+{
+	controlled_annotation_type a;
+	controlled_annotation_type::chain_type& c = a.chain();
+	a.tracer().set_node_budget(16);
+
+	c.push("request");
+	controlled_annotation_type::ticket_type request = c.ticket();
+	{
+		controlled_annotation_type::handoff_type h = c.capture();
+		UF_TEST(h.pinned());
+		c.pop();
+		/* a cold leaf, but the handoff keeps it */
+		a.tracer().evict();
+		a.tracer().evict();
+		UF_TEST_EQUAL(size_t(1), a.tracer().tracer().size());
+		controlled_annotation_type::handoff_type copied;
+		UF_TEST(!copied.pinned());
+		copied = h;
+		UF_TEST(copied.pinned());
+		controlled_annotation_type::adopt_scope_type s(&c, copied);
+		UF_TEST_EQUAL("request", qualified_tracing_name(a.tracer(), c.ticket()));
+		UF_TEST_EQUAL(request, c.ticket());
+	}
+
+	UF_TEST(c.empty());
+	a.tracer().evict();
+	a.tracer().evict();
+	UF_TEST_EQUAL(size_t(0), a.tracer().tracer().size());
+}
+
+void test_hta_configure()
+{
+	controlled_annotation_type a;
+	controlled_annotation_type::chain_type& c = a.chain();
+
+	UF_TEST(!ufx::configure_tracing(&c, "{ broken"));
+	UF_TEST(ufx::configure_tracing(&c, "{ \"enabled\": false, \"max_depth\": 3, \"muted\": [\"x.y\", \"z\"] }"));
+	UF_TEST(!c.enabled());
+	UF_TEST_EQUAL(3U, c.max_depth());
+	controlled_annotation_type::ticket_type xy = ufx::ensure_tracing_path(&c, "x.y");
+	UF_TEST_EQUAL("x.y", qualified_tracing_name(a.tracer(), xy));
+	UF_TEST( a.tracer().muted(xy));
+	UF_TEST(!a.tracer().muted(a.tracer().parent(xy)));
+	UF_TEST( a.tracer().muted(ufx::ensure_tracing_path(&c, "z")));
+
+	UF_TEST(ufx::configure_tracing(&c, "{ \"enabled\": true }"));
+	UF_TEST(c.enabled());
+	UF_TEST_EQUAL(3U, c.max_depth());
+}
+
+void test_hta_configure_from_file()
+{
+	const char* filename = "unfact_hta_config_test.json";
+	FILE* file = fopen(filename, "wb");
+	UF_TEST(file);
+	fputs("{ \"max_depth\": 5 }", file);
+	fclose(file);
+
+	controlled_annotation_type a;
+	tracing_allocator_t alloc;
+	UF_TEST(ufx::configure_tracing_from_file(&(a.chain()), filename, &alloc));
+	UF_TEST_EQUAL(5U, a.chain().max_depth());
+	remove(filename);
+	UF_TEST(!ufx::configure_tracing_from_file(&(a.chain()), filename, &alloc));
+}
+
 namespace 
 {
 	UFX_HEAP_TRACE_DECLARE();
@@ -67,6 +322,17 @@ namespace
 			}
 		}
 		UFX_HEAP_TRACE_POP();
+		{
+			ufx::default_heap_tracing_annotation_handoff_t h = UFX_HEAP_TRACE_CAPTURE();
+			UFX_HEAP_TRACE_ADOPT(h);
+			UFX_HEAP_TRACE_SCOPE(task);
+		}
+		UFX_HEAP_TRACE_DISABLE();
+		UFX_HEAP_TRACE_PUSH(skipped);
+		UFX_HEAP_TRACE_POP();
+		UFX_HEAP_TRACE_ENABLE();
+		UFX_HEAP_TRACE_MUTE();
+		UFX_HEAP_TRACE_UNMUTE();
 		UFX_HEAP_TRACE_FINI();
 	}
 	
@@ -86,6 +352,14 @@ void test_heap_tracing_annotation()
 {
   test_hta_hello();
 	test_hta_init_fini();
+	test_hta_disable();
+	test_hta_max_depth();
+	test_hta_mute();
+	test_hta_mute_scope();
+	test_hta_handoff();
+	test_hta_handoff_pinned();
+	test_hta_configure();
+	test_hta_configure_from_file();
 	test_hta_macros();
 	test_hta_macros_noinit();
 }
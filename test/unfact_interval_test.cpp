@@ -0,0 +1,243 @@
+
+#include <unfact/heap_tracer.hpp>
+#include <unfact/tick_tracer.hpp>
+#include <unfact/interval.hpp>
+#include <unfact/reporter_thread.hpp>
+#include <unfact/extras/tick_tracing_annotation.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace uf = unfact;
+namespace ufx = unfact::extras;
+typedef uf::accumulative_heap_tracer_t heap_type;
+typedef uf::accumulative_tick_tracer_t tick_type;
+typedef uf::interval_tracker_t<heap_type::tracer_type> heap_tracker_type;
+
+namespace {
+  template<class Value>
+  struct collecting_sink_t
+  {
+	collecting_sink_t() : reports(0), seconds(0) {}
+
+	bool begin(size_t, double s) { reports++; seconds = s; paths.clear(); values.clear(); return true; }
+	bool scope(const char* path, const Value& delta, double) { paths.push_back(path); values.push_back(delta); return true; }
+	bool end() { return true; }
+
+	const Value* find(const char* path) const
+	{
+	  for (size_t i=0; i<paths.size(); ++i) {
+		if (paths[i] == path) { return &values[i]; }
+	  }
+
+	  return 0;
+	}
+
+	size_t reports;
+	double seconds;
+	std::vector<std::string> paths;
+	std::vector<Value> values;
+  };
+}
+
+void test_interval_tracker()
+{
+  tracing_allocator_t alloc;
+  heap_type heap(&alloc);
+  uf::byte_t blocks[8];
+  heap_type::ticket_type hello = heap.push(heap.root(), "hello");
+  heap_type::ticket_type howau = heap.push(hello, "howau");
+  heap.trace_allocated(hello, &blocks[0], 10);
+  heap.trace_allocated(howau, &blocks[1], 20);
+
+  heap_tracker_type tracker(&alloc);
+  collecting_sink_t<uf::heap_accumulation_t> sink;
+  UF_TEST(!tracker.report(1.0, sink));
+  UF_TEST(tracker.take(heap.tracer()));
+
+  /* the first one has no base: whole values */
+  UF_TEST(tracker.report(1.0, sink));
+  UF_TEST_EQUAL(sink.reports, size_t(1));
+  UF_TEST(sink.find("hello"));
+  UF_TEST_EQUAL(sink.find("hello")->final(), 10);
+  UF_TEST_EQUAL(sink.find("hello.howau")->final(), 20);
+
+  heap.trace_allocated(howau, &blocks[2], 5);
+  heap.trace_deallocated(&blocks[0]);
+  heap.trace_allocated(heap.push(howau, "fine"), &blocks[3], 7);
+  UF_TEST(tracker.take(heap.tracer()));
+  UF_TEST(tracker.report(2.0, sink));
+  UF_TEST_EQUAL(sink.reports, size_t(2));
+  UF_TEST_EQUAL(sink.seconds, 2.0);
+  UF_TEST_EQUAL(sink.find("hello")->final(), -10);
+  UF_TEST_EQUAL(sink.find("hello")->samples(), size_t(0));
+  UF_TEST_EQUAL(sink.find("hello.howau")->final(), 5);
+  UF_TEST_EQUAL(sink.find("hello.howau")->samples(), size_t(1));
+  UF_TEST_EQUAL(sink.find("hello.howau.fine")->final(), 7);
+
+  /* nothing moved */
+  UF_TEST(tracker.take(heap.tracer()));
+  UF_TEST(tracker.report(1.0, sink));
+  UF_TEST(sink.paths.empty());
+
+  heap.trace_deallocated(&blocks[1]);
+  heap.trace_deallocated(&blocks[2]);
+  heap.trace_deallocated(&blocks[3]);
+}
+
+void test_interval_job_reset()
+{
+  tracing_allocator_t alloc;
+  tick_type tick(&alloc);
+  tick_type::ticket_type x = tick.push(tick.root(), "x");
+  tick.trace(x, 3.0f);
+
+  collecting_sink_t<uf::tick_accumulation_t> sink;
+  uf::interval_job_t<tick_type, collecting_sink_t<uf::tick_accumulation_t>, uf::interval_reset_tag_t> job(&tick, &sink, &alloc);
+  UF_TEST(job.prime());
+  UF_TEST_EQUAL(tick.tracer().at(x).samples(), size_t(0));
+
+  tick.trace(x, 1.0f);
+  tick.trace(x, 2.0f);
+  UF_TEST(job.run(1.0));
+  UF_TEST_EQUAL(sink.find("x")->samples(), size_t(2));
+  UF_TEST_EQUAL(sink.find("x")->total(), 3.0f);
+  UF_TEST_EQUAL(tick.tracer().at(x).samples(), size_t(0));
+
+  tick.trace(x, 4.0f);
+  UF_TEST(job.run(1.0));
+  UF_TEST_EQUAL(sink.find("x")->samples(), size_t(1));
+  UF_TEST_EQUAL(sink.find("x")->total(), 4.0f);
+}
+
+void test_interval_file_sink()
+{
+  char path[256];
+  snprintf(path, sizeof(path), "/tmp/unfact_interval_test.%d", int(getpid()));
+  char rotated[300];
+  snprintf(rotated, sizeof(rotated), "%s.1", path);
+  remove(path);
+  remove(rotated);
+
+  tracing_allocator_t alloc;
+  tick_type tick(&alloc);
+  tick_type::ticket_type x = tick.push(tick.root(), "x");
+  uf::interval_tracker_t<tick_type::tracer_type> tracker(&alloc);
+  {
+	uf::interval_file_sink_t sink(path, 64, 1);
+	for (int i=0; i<4; ++i) {
+	  tick.trace(x, 1.0f);
+	  UF_TEST(tracker.take(tick.tracer()));
+	  UF_TEST(tracker.report(0.5, sink));
+	}
+  }
+
+  FILE* f = fopen(path, "r");
+  UF_TEST(f);
+  char line[256];
+  UF_TEST(fgets(line, sizeof(line), f));
+  UF_TEST_EQUAL(std::string(line), std::string("#3 0.500s\n"));
+  UF_TEST(fgets(line, sizeof(line), f));
+  UF_TEST_EQUAL(std::string(line), std::string("#3 x total=1 total/s=2 samples=1 samples/s=2 average=1 average/s=2\n"));
+  fclose(f);
+
+  f = fopen(rotated, "r");
+  UF_TEST(f);
+  fclose(f);
+
+  remove(path);
+  remove(rotated);
+}
+
+#ifdef UNFACT_HAS_REPORTER_THREAD
+
+void test_interval_reporter_thread()
+{
+  tracing_allocator_t alloc;
+  tick_type tick(&alloc);
+  tick_type::ticket_type x = tick.push(tick.root(), "x");
+
+  collecting_sink_t<uf::tick_accumulation_t> sink;
+  uf::reporter_thread_t reporter(&alloc);
+  UF_TEST(reporter.attach(&tick, &sink, uf::interval_reset_tag_t()));
+  UF_TEST(reporter.start(5));
+  UF_TEST(!reporter.start(5));
+  for (int i=0; i<20; ++i) {
+	tick.trace(x, 1.0f);
+	usleep(1000);
+  }
+
+  reporter.stop();
+  UF_TEST(!reporter.running());
+  UF_TEST(0 < sink.reports);
+
+  /* after the thread is gone. the first one takes traces since its last report */
+  UF_TEST(reporter.report_now());
+  size_t reports = sink.reports;
+  tick.trace(x, 1.0f);
+  UF_TEST(reporter.report_now());
+  UF_TEST_EQUAL(sink.reports, reports + 1);
+  UF_TEST_EQUAL(sink.find("x")->samples(), size_t(1));
+
+  UF_TEST(reporter.detach(&tick));
+  UF_TEST(!reporter.detach(&tick));
+  UF_TEST(reporter.report_now());
+  UF_TEST_EQUAL(sink.reports, reports + 1);
+}
+
+void test_interval_annotation_context()
+{
+  typedef ufx::tick_tracing_annotation_t<15> annotation_type;
+  typedef ufx::tracing_annotation_context_t< annotation_type > context_type;
+
+  tracing_allocator_t alloc;
+  uf::reporter_thread_t reporter(&alloc);
+  collecting_sink_t<uf::tick_accumulation_t> sink;
+  context_type ctx = { 0, {0} };
+  ctx.init(&reporter, &sink, uf::interval_reset_tag_t());
+  UF_TEST(ctx.reporter() == &reporter);
+  {
+	annotation_type::counting_scope_type s(&(ctx->chain()), "hello");
+  }
+
+  UF_TEST(reporter.report_now());
+  UF_TEST(sink.find("hello"));
+  UF_TEST_EQUAL(sink.find("hello")->samples(), size_t(1));
+
+  /* fini() detaches */
+  ctx.fini();
+  UF_TEST(!ctx.reporter());
+  size_t reports = sink.reports;
+  UF_TEST(reporter.report_now());
+  UF_TEST_EQUAL(sink.reports, reports);
+
+  /* the reporter goes first: the context forgets it */
+  context_type ctx2 = { 0, {0} };
+  {
+	uf::reporter_thread_t shortlived(&alloc);
+	ctx2.init(&shortlived, &sink);
+	UF_TEST(ctx2.reporter() == &shortlived);
+  }
+
+  UF_TEST(!ctx2.reporter());
+  ctx2.fini();
+}
+
+#else
+
+void test_interval_reporter_thread() {}
+void test_interval_annotation_context() {}
+
+#endif
+
+void test_interval()
+{
+  test_interval_tracker();
+  test_interval_job_reset();
+  test_interval_file_sink();
+  test_interval_reporter_thread();
+  test_interval_annotation_context();
+}
@@ -0,0 +1,266 @@
+
+#include <unfact/heap_tracer.hpp>
+#include <unfact/tick_tracer.hpp>
+#include <unfact/live_region.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <string>
+#include <map>
+#include <vector>
+#include <stdio.h>
+
+#ifdef UNFACT_HAS_LIVE_REGION
+#include <pthread.h>
+
+namespace uf = unfact;
+typedef uf::live_tracer_t<uf::live_heap_tracer_t> live_heap_type;
+typedef uf::live_tracer_t<uf::live_tick_tracer_t> live_tick_type;
+
+namespace {
+  template<class View>
+  struct collector_t
+  {
+	typedef typename View::scope_t scope_type;
+	typedef typename View::value_type value_type;
+
+	void operator()(const scope_type& scope)
+	{
+	  /* names are unique in these tests */
+	  values[scope.name()] = scope.value();
+	  depths[scope.name()] = scope.depth();
+	}
+
+	std::map<std::string, value_type> values;
+	std::map<std::string, size_t> depths;
+  };
+
+  struct sticky_checker_t
+  {
+	sticky_checker_t() : nscopes(0), nbroken(0) {}
+
+	template<class Scope>
+	void operator()(const Scope& scope)
+	{
+	  nscopes++;
+	  /* every trace() adds 1: torn copies break it */
+	  if (scope.value().total() != float(scope.value().samples())) {
+		nbroken++;
+	  }
+	}
+
+	size_t nscopes;
+	size_t nbroken;
+  };
+
+  struct sticky_writer_t
+  {
+	sticky_writer_t(uf::live_tick_tracer_t* tracer) : tracer(tracer), done(false) {}
+
+	uf::live_tick_tracer_t* tracer;
+	volatile bool done;
+  };
+
+  void* sticky_writer(void* arg)
+  {
+	sticky_writer_t* w = reinterpret_cast<sticky_writer_t*>(arg);
+	char name[16];
+	for (int i=0; i<100000; ++i) {
+	  snprintf(name, sizeof(name), "s%d", i%100);
+	  uf::live_tick_tracer_t::ticket_type t = w->tracer->push(w->tracer->root(), name);
+	  w->tracer->trace(t, 1.0f);
+	  w->tracer->trace(w->tracer->push(t, "inner"), 1.0f);
+	}
+
+	w->done = true;
+	return 0;
+  }
+}
+
+void test_live_hello()
+{
+  live_heap_type live;
+  UF_TEST(live.open(1024*1024));
+  uf::live_heap_tracer_t* tr = live.tracer();
+  uf::byte_t h1 = 0, h3 = 0, h5 = 0;
+  tr->trace_allocated(tr->root(), &h1, 10);
+  uf::live_heap_tracer_t::ticket_type t0 = tr->push(tr->root(), "hello");
+  tr->trace_allocated(t0, &h3, 30);
+  tr->trace_allocated(tr->push(t0, "howau"), &h5, 50);
+  tr->push(tr->root(), "imfine");
+  UF_TEST(0 < live.allocator().used());
+
+  /* another mapping, like another process does */
+  uf::live_region_t region;
+  UF_TEST(region.attach(live.path()));
+  UF_TEST(region.head() != live.region().head());
+
+  tracing_allocator_t alloc;
+  live_heap_type::view_type view(&alloc);
+  UF_TEST(view.open(region.head(), region.size()));
+  UF_TEST_EQUAL(view.header().m_pid, size_t(getpid()));
+  UF_TEST_EQUAL(std::string(view.header().m_schema), "final,raised,fallen,samples");
+
+  collector_t<live_heap_type::view_type> c;
+  UF_TEST(view.visit(c));
+  UF_TEST_EQUAL(view.skipped(), 0);
+  UF_TEST_EQUAL(c.values.size(), 4);
+  UF_TEST_EQUAL(c.values[""].final(), 10);
+  UF_TEST_EQUAL(c.values["hello"].final(), 30);
+  UF_TEST_EQUAL(c.values["howau"].final(), 50);
+  UF_TEST_EQUAL(c.values["imfine"].samples(), 0);
+  UF_TEST_EQUAL(c.depths["howau"], 2);
+
+  /* readers see later changes */
+  tr->trace_deallocated(&h3);
+  c.values.clear();
+  UF_TEST(view.visit(c));
+  UF_TEST_EQUAL(c.values["hello"].final(), 0);
+
+  tr->trace_deallocated(&h1);
+  tr->trace_deallocated(&h5);
+}
+
+void test_live_named()
+{
+  char name[64];
+  snprintf(name, sizeof(name), "/unfact_live_test.%d", int(getpid()));
+  std::string path;
+  {
+	live_tick_type live;
+	UF_TEST(live.open(256*1024, name));
+	path = live.path();
+	UF_TEST_EQUAL(path, std::string("/dev/shm") + name);
+	live.tracer()->trace(live.tracer()->push(live.tracer()->root(), "x"), 2.0f);
+
+	uf::live_region_t region;
+	UF_TEST(region.attach(path.c_str()));
+	tracing_allocator_t alloc;
+	live_tick_type::view_type view(&alloc);
+	UF_TEST(view.open(region.head(), region.size()));
+	collector_t<live_tick_type::view_type> c;
+	UF_TEST(view.visit(c));
+	UF_TEST_EQUAL(c.values["x"].total(), 2.0f);
+  }
+
+  /* unlinked at close */
+  uf::live_region_t region;
+  UF_TEST(!region.attach(path.c_str()));
+}
+
+void test_live_mismatch()
+{
+  live_heap_type live;
+  UF_TEST(live.open(256*1024));
+  uf::live_region_t region;
+  UF_TEST(region.attach(live.path()));
+
+  tracing_allocator_t alloc;
+  live_tick_type::view_type view(&alloc);
+  UF_TEST(!view.open(region.head(), region.size()));
+  UF_TEST(!view.opened());
+
+  /* not published yet */
+  uf::live_region_t empty;
+  UF_TEST(empty.create(4096));
+  live_heap_type::view_type hview(&alloc);
+  UF_TEST(!hview.open(empty.head(), empty.size()));
+  UF_TEST(hview.open(region.head(), region.size()));
+}
+
+void test_live_full()
+{
+  live_tick_type live;
+  UF_TEST(live.open(64*1024, 0, 4096));
+  uf::live_tick_tracer_t* tr = live.tracer();
+  char name[16];
+  size_t pushed = 0;
+  for (int i=0; i<10000; ++i) {
+	snprintf(name, sizeof(name), "s%d", i);
+	if (!tr->push(tr->root(), name)) {
+	  break;
+	}
+
+	pushed++;
+  }
+
+  /* the tracer stops growing, and the region stays readable */
+  UF_TEST(0 < pushed && pushed < 10000);
+  uf::live_region_t region;
+  UF_TEST(region.attach(live.path()));
+  tracing_allocator_t alloc;
+  live_tick_type::view_type view(&alloc);
+  UF_TEST(view.open(region.head(), region.size()));
+  sticky_checker_t checker;
+  UF_TEST(view.visit(checker));
+  UF_TEST_EQUAL(checker.nscopes, pushed + 1);
+}
+
+/* living blocks are the writer's business: they don't eat the region up */
+void test_live_heap_local()
+{
+  live_heap_type live;
+  UF_TEST(live.open(64*1024, 0, 4096));
+  uf::live_heap_tracer_t* tr = live.tracer();
+  uf::live_heap_tracer_t::ticket_type t0 = tr->push(tr->root(), "hello");
+  size_t used = live.allocator().used();
+  std::vector<uf::byte_t> blocks(10000);
+  for (size_t i=0; i<blocks.size(); ++i) {
+	tr->trace_allocated(t0, &blocks[i], 10);
+  }
+
+  UF_TEST_EQUAL(live.allocator().used(), used);
+  UF_TEST_EQUAL(size_t(tr->at(t0).final()), 10*blocks.size());
+  for (size_t i=0; i<blocks.size(); ++i) {
+	UF_TEST(tr->trace_deallocated(&blocks[i]));
+  }
+
+  UF_TEST_EQUAL(tr->at(t0).final(), 0);
+}
+
+void test_live_concurrent()
+{
+  live_tick_type live;
+  UF_TEST(live.open(4*1024*1024));
+  uf::live_region_t region;
+  UF_TEST(region.attach(live.path()));
+  tracing_allocator_t alloc;
+  live_tick_type::view_type view(&alloc);
+  UF_TEST(view.open(region.head(), region.size()));
+
+  sticky_writer_t w(live.tracer());
+  pthread_t writer;
+  pthread_create(&writer, 0, sticky_writer, &w);
+
+  size_t nvisits = 0;
+  sticky_checker_t checker;
+  while (!w.done) {
+	UF_TEST(view.visit(checker));
+	nvisits++;
+  }
+
+  pthread_join(writer, 0);
+  UF_TEST(0 < nvisits);
+  UF_TEST_EQUAL(checker.nbroken, 0);
+
+  checker = sticky_checker_t();
+  UF_TEST(view.visit(checker));
+  UF_TEST_EQUAL(view.skipped(), 0);
+  UF_TEST_EQUAL(checker.nscopes, 201);
+  UF_TEST_EQUAL(checker.nbroken, 0);
+}
+
+void test_live()
+{
+  test_live_hello();
+  test_live_named();
+  test_live_mismatch();
+  test_live_full();
+  test_live_heap_local();
+  test_live_concurrent();
+}
+
+#else
+
+void test_live() {}
+
+#endif
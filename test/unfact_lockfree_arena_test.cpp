@@ -0,0 +1,145 @@
+
+#ifdef UNFACT_USE_LOCKFREE_ARENA
+#include <unfact/lockfree_arena.hpp>
+#include <unfact/tree_set.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+
+namespace uf = unfact;
+typedef uf::lockfree_arena_t<uf::default_concurrent_t> lockfree_arena_type;
+
+static void
+test_lockfree_arena_hello()
+{
+  tracing_allocator_t allocator;
+  lockfree_arena_type arena(&allocator, 10, 100);
+  uf::byte_t* ptr = arena.allocate();
+  UF_TEST(ptr);
+  UF_TEST_EQUAL(1, arena.size());
+  arena.deallocate(ptr);
+  UF_TEST_EQUAL(0, arena.size());
+}
+
+static void
+test_lockfree_arena_allocate_from_page()
+{
+  tracing_allocator_t allocator;
+  std::vector<uf::byte_t*> items;
+
+  lockfree_arena_type arena(&allocator, 16, 64);
+  UF_TEST_EQUAL(0, arena.npages());
+  UF_TEST_EQUAL(0, arena.npacked());
+
+  items.push_back(arena.allocate());
+  UF_TEST_EQUAL(1, arena.npages());
+  UF_TEST_EQUAL(2, arena.npacked()); // 1 for page header
+  items.push_back(arena.allocate());
+  items.push_back(arena.allocate());
+  UF_TEST_EQUAL(1, arena.npages());
+  UF_TEST_EQUAL(4, arena.npacked());
+  items.push_back(arena.allocate());
+  UF_TEST_EQUAL(2, arena.npages());
+  UF_TEST_EQUAL(4, arena.size());
+  UF_TEST(!arena.has_slots());
+
+  arena.deallocate(items[1]);
+  UF_TEST( arena.has_slots());
+  UF_TEST_EQUAL(1, arena.nslots());
+  UF_TEST_EQUAL(items[1], arena.allocate()); // reuse the slot
+  UF_TEST(!arena.has_slots());
+  UF_TEST_EQUAL(2, arena.npages());
+
+  for (size_t i=0; i<items.size(); ++i) { arena.deallocate(items[i]); }
+  UF_TEST_EQUAL(0, arena.size());
+  UF_TEST_EQUAL(4, arena.nslots());
+}
+
+namespace
+{
+  struct lockfree_arena_worker_t
+  {
+	lockfree_arena_type* m_arena;
+	int m_nitems;
+  };
+
+  void* lockfree_arena_worker(void* p)
+  {
+	lockfree_arena_worker_t* w = reinterpret_cast<lockfree_arena_worker_t*>(p);
+	std::vector<uf::byte_t*> items;
+	for (int k=0; k<10; ++k) {
+	  for (int i=0; i<w->m_nitems; ++i) { items.push_back(w->m_arena->allocate()); }
+	  for (size_t i=0; i<items.size(); ++i) { memset(items[i], k, w->m_arena->item_size()); }
+	  for (size_t i=0; i<items.size(); ++i) { w->m_arena->deallocate(items[i]); }
+	  items.clear();
+	}
+
+	return 0;
+  }
+}
+
+static void
+test_lockfree_arena_threads()
+{
+  uf::stdlib_allocator_t allocator;
+  lockfree_arena_type arena(&allocator, 24, 1024);
+
+  enum { nthreads = 8 };
+  lockfree_arena_worker_t w = { &arena, 1000 };
+  pthread_t threads[nthreads];
+  for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, lockfree_arena_worker, &w); }
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+
+  UF_TEST_EQUAL(0, arena.size());
+
+  // every slot should be distinct after all
+  std::vector<uf::byte_t*> items;
+  for (size_t i=0; i<arena.nslots(); /* */) { items.push_back(arena.allocate()); }
+  std::sort(items.begin(), items.end());
+  UF_TEST(std::adjacent_find(items.begin(), items.end()) == items.end());
+  for (size_t i=0; i<items.size(); ++i) { arena.deallocate(items[i]); }
+}
+
+static void
+test_lockfree_arena_tree_set()
+{
+  typedef uf::tree_set_t<int, uf::less_t<int>, uf::lockfree_concurrent_t<uf::default_concurrent_t> > set_type;
+  tracing_allocator_t allocator;
+  set_type s(&allocator);
+  for (int i=0; i<100; ++i) { s.insert(i); }
+  UF_TEST_EQUAL(100, s.size());
+  s.remove(s.find(50));
+  UF_TEST_EQUAL(99, s.size());
+  UF_TEST(!s.contains(50));
+  s.clear();
+  UF_TEST_EQUAL(0, s.size());
+
+  for (int i=0; i<100; ++i) { s.insert(i); }
+  s.reset();
+  UF_TEST_EQUAL(0, s.size());
+  UF_TEST(s.empty());
+  for (int i=0; i<10; ++i) { s.insert(i); }
+  UF_TEST_EQUAL(10, s.size());
+}
+
+void test_lockfree_arena()
+{
+  test_lockfree_arena_hello();
+  test_lockfree_arena_allocate_from_page();
+  test_lockfree_arena_threads();
+  test_lockfree_arena_tree_set();
+}
+#else
+void test_lockfree_arena() {}
+#endif
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
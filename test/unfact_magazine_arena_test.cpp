@@ -0,0 +1,130 @@
+
+#include <unfact/magazine_arena.hpp>
+#include <unfact/tree_set.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <vector>
+#include <pthread.h>
+
+namespace uf = unfact;
+typedef uf::magazine_arena_t<uf::default_concurrent_t> magazine_arena_type;
+
+static void
+test_magazine_arena_hello()
+{
+  tracing_allocator_t allocator;
+  magazine_arena_type arena(&allocator, 10, 100);
+  uf::byte_t* ptr = arena.allocate();
+  UF_TEST(ptr);
+  UF_TEST_EQUAL(1, arena.size());
+  arena.deallocate(ptr);
+  UF_TEST_EQUAL(0, arena.size());
+}
+
+static void
+test_magazine_arena_depot()
+{
+  tracing_allocator_t allocator;
+  std::vector<uf::byte_t*> items;
+  magazine_arena_type arena(&allocator, 16, 1024, sizeof(void*), 
+														magazine_arena_type::base_arena_type::option_default, 4);
+
+  items.push_back(arena.allocate());
+  UF_TEST_EQUAL(3, arena.ncached()); // a magazine is loaded from the base arena
+  UF_TEST_EQUAL(4, arena.base().size());
+  for (int i=0; i<11; ++i) { items.push_back(arena.allocate()); }
+  UF_TEST_EQUAL(0, arena.ncached());
+  UF_TEST_EQUAL(12, arena.size());
+
+  for (size_t i=0; i<items.size(); ++i) { arena.deallocate(items[i]); }
+  // 8 slots reaches the limit and a magazine goes to the depot, then another 4 slots are cached.
+  UF_TEST_EQUAL(0, arena.size());
+  UF_TEST_EQUAL(4, arena.ncached()); 
+  UF_TEST_EQUAL(2, arena.nmagazines());
+
+  items.clear();
+  for (int i=0; i<8; ++i) { items.push_back(arena.allocate()); }
+  UF_TEST_EQUAL(1, arena.nmagazines());
+  UF_TEST_EQUAL(12, arena.base().size()); // no more allocation from base
+  for (size_t i=0; i<items.size(); ++i) { arena.deallocate(items[i]); }
+}
+
+namespace
+{
+  struct magazine_arena_worker_t
+  {
+	magazine_arena_type* m_arena;
+	int m_nitems;
+  };
+
+  void* magazine_arena_worker(void* p)
+  {
+	magazine_arena_worker_t* w = reinterpret_cast<magazine_arena_worker_t*>(p);
+	std::vector<uf::byte_t*> items;
+	for (int k=0; k<10; ++k) {
+	  for (int i=0; i<w->m_nitems; ++i) { items.push_back(w->m_arena->allocate()); }
+	  for (size_t i=0; i<items.size(); ++i) { memset(items[i], k, w->m_arena->item_size()); }
+	  for (size_t i=0; i<items.size(); ++i) { w->m_arena->deallocate(items[i]); }
+	  items.clear();
+	}
+
+	return 0;
+  }
+}
+
+static void
+test_magazine_arena_threads()
+{
+  uf::stdlib_allocator_t allocator;
+  magazine_arena_type arena(&allocator, 24, 1024);
+
+  enum { nthreads = 8 };
+  magazine_arena_worker_t w = { &arena, 1000 };
+  pthread_t threads[nthreads];
+  for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, magazine_arena_worker, &w); }
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+
+  // exited threads gave back their caches
+  UF_TEST_EQUAL(0, arena.size());
+  UF_TEST_EQUAL(0, arena.base().size() - arena.nmagazines()*arena.magazine_size());
+}
+
+static void
+test_magazine_arena_tree_set()
+{
+  typedef uf::tree_set_t<int, uf::less_t<int>, uf::magazine_concurrent_t<uf::default_concurrent_t> > set_type;
+  tracing_allocator_t allocator;
+  set_type s(&allocator);
+  for (int i=0; i<100; ++i) { s.insert(i); }
+  UF_TEST_EQUAL(100, s.size());
+  UF_TEST(s.contains(50));
+  s.remove(s.find(50));
+  UF_TEST_EQUAL(99, s.size());
+  UF_TEST(!s.contains(50));
+  s.clear();
+  UF_TEST_EQUAL(0, s.size());
+
+  for (int i=0; i<100; ++i) { s.insert(i); }
+  s.reset();
+  UF_TEST_EQUAL(0, s.size());
+  UF_TEST(s.empty());
+  for (int i=0; i<10; ++i) { s.insert(i); }
+  UF_TEST_EQUAL(10, s.size());
+}
+
+void test_magazine_arena()
+{
+  test_magazine_arena_hello();
+  test_magazine_arena_depot();
+  test_magazine_arena_threads();
+  test_magazine_arena_tree_set();
+}
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
@@ -0,0 +1,113 @@
+
+#include <unfact/mmap_allocator.hpp>
+#include <unfact/arena.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <vector>
+#include <string.h>
+
+namespace uf = unfact;
+
+#ifdef UNFACT_HAS_MMAP_ALLOCATOR
+
+static void
+test_mmap_allocator_hello()
+{
+  uf::mmap_allocator_t allocator;
+  UF_TEST_EQUAL(uf::size_t(uf::DEFAULT_MMAP_RESERVE_SIZE), allocator.reserved());
+
+  uf::byte_t* p = allocator.allocate(100);
+  UF_TEST(p);
+  memset(p, 0xab, 100);
+  allocator.deallocate(p);
+  UF_TEST_EQUAL(p, allocator.allocate(120)); // same class: reused
+  allocator.deallocate(p);
+}
+
+static void
+test_mmap_allocator_classes()
+{
+  uf::mmap_allocator_t allocator(1024*1024);
+  UF_TEST_EQUAL(0, allocator.class_of(1));
+  UF_TEST_EQUAL(0, allocator.class_of(16));
+  UF_TEST_EQUAL(1, allocator.class_of(17));
+  UF_TEST_EQUAL(uf::size_t(allocator.nclasses - 1), allocator.class_of(allocator.max_class_size));
+
+  std::vector<uf::byte_t*> items;
+  for (uf::size_t sz=1; sz<=allocator.max_class_size; sz*=3) {
+	uf::byte_t* p = allocator.allocate(sz);
+	UF_TEST(p);
+	UF_TEST(uf::address_aligned(p, allocator.class_size(allocator.class_of(sz))));
+	memset(p, 0, sz);
+	items.push_back(p);
+  }
+
+  for (size_t i=0; i<items.size(); ++i) { allocator.deallocate(items[i]); }
+  UF_TEST_EQUAL(0, allocator.nlarge());
+}
+
+static void
+test_mmap_allocator_large()
+{
+  uf::mmap_allocator_t allocator(1024*1024);
+  uf::byte_t* p = allocator.allocate(1024*1024);
+  UF_TEST(p);
+  memset(p, 0, 1024*1024);
+  UF_TEST_EQUAL(1, allocator.nlarge());
+
+  uf::byte_t* q = allocator.allocate_aligned(100*1024, 64*1024);
+  UF_TEST(uf::address_aligned(q, 64*1024));
+  UF_TEST_EQUAL(2, allocator.nlarge());
+
+  allocator.deallocate(p);
+  allocator.deallocate_aligned(q);
+  UF_TEST_EQUAL(0, allocator.nlarge());
+}
+
+static void
+test_mmap_allocator_exhausted()
+{
+  // 2 superblocks: 1 for the side table, 1 for blocks
+  uf::mmap_allocator_t allocator(2*uf::mmap_allocator_t::superblock_size);
+  std::vector<uf::byte_t*> items;
+  for (int i=0; i<3; ++i) { items.push_back(allocator.allocate(allocator.max_class_size)); }
+  UF_TEST_EQUAL(1, allocator.nlarge()); // last one falls back to individual mmap()
+  for (size_t i=0; i<items.size(); ++i) { allocator.deallocate(items[i]); }
+  UF_TEST_EQUAL(0, allocator.nlarge());
+}
+
+static void
+test_mmap_allocator_arena()
+{
+  uf::mmap_allocator_t allocator;
+  uf::arena_t arena(&allocator, 32, 4096, sizeof(void*), 
+					uf::arena_t::option_e(uf::arena_t::option_default|uf::arena_t::option_reclaim_pages));
+  std::vector<uf::byte_t*> items;
+  for (int i=0; i<1000; ++i) { items.push_back(arena.allocate()); }
+  for (size_t i=0; i<items.size(); ++i) { arena.deallocate(items[i]); }
+  UF_TEST_EQUAL(0, arena.size());
+}
+
+void test_mmap_allocator()
+{
+  test_mmap_allocator_hello();
+  test_mmap_allocator_classes();
+  test_mmap_allocator_large();
+  test_mmap_allocator_exhausted();
+  test_mmap_allocator_arena();
+}
+
+#else
+
+void test_mmap_allocator() {}
+
+#endif//UNFACT_HAS_MMAP_ALLOCATOR
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
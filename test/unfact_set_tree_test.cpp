@@ -209,6 +209,105 @@ void test_set_tree_ticket()
   UF_TEST_EQUAL(s.to_child_iterator(tend), s.child_end());
 }
 
+static void
+test_set_tree_depth_flags()
+{
+  tracing_allocator_t alloc;
+  int_set_tree s(0, &alloc, 1024);
+  int_set_tree::ticket_t root = s.to_ticket(s.child_begin());
+  int_set_tree::ticket_t t1 = s.to_ticket(s.insert(s.child_begin(), 1));
+  UF_TEST_EQUAL(0U, int_set_tree::depth_of(root));
+  UF_TEST_EQUAL(1U, int_set_tree::depth_of(t1));
+  UF_TEST_EQUAL(0U, int_set_tree::flags_of(t1));
+
+  int_set_tree::set_flags_of(t1, 0x5);
+  UF_TEST_EQUAL(0x5U, int_set_tree::flags_of(t1));
+  UF_TEST_EQUAL(1U, int_set_tree::depth_of(t1));
+  /* children inherit flags */
+  int_set_tree::ticket_t t2 = s.to_ticket(s.insert(s.to_child_iterator(t1), 2));
+  UF_TEST_EQUAL(2U, int_set_tree::depth_of(t2));
+  UF_TEST_EQUAL(0x5U, int_set_tree::flags_of(t2));
+  int_set_tree::set_flags_of(t2, 0);
+  UF_TEST_EQUAL(0U, int_set_tree::flags_of(t2));
+  UF_TEST_EQUAL(2U, int_set_tree::depth_of(t2));
+}
+
+typedef uf::set_tree_t<int, uf::less_t<int>, uf::default_concurrent_t, uf::hash_t<int> > int_hashed_set_tree;
+
+static void
+test_set_tree_hashed_index()
+{
+  tracing_allocator_t alloc;
+  int_hashed_set_tree s(0, &alloc, 1024, uf::less_t<int>(), 8);
+  int_hashed_set_tree::child_iterator_t p = s.insert(s.child_begin(), 1);
+
+  for (int i=0; i<7; ++i) { s.insert(p, i*10); }
+  UF_TEST(!p.node()->child_index()); // below the threshold
+  for (int i=7; i<100; ++i) { s.insert(p, i*10); }
+  UF_TEST( p.node()->child_index());
+  UF_TEST_EQUAL(p.node()->child_index()->size(), 100);
+
+  for (int i=0; i<100; ++i) {
+	int_hashed_set_tree::child_iterator_t found = s.find(p, i*10);
+	UF_TEST(!found.atend());
+	UF_TEST_EQUAL(*found, i*10);
+	UF_TEST_EQUAL(s.ensure(p, i*10), found);
+  }
+
+  UF_TEST(s.find(p, 5).atend());
+  UF_TEST(s.insert(p, 10).atend()); // already there
+
+  // iteration keeps the key order
+  int expected = 0;
+  for (int_hashed_set_tree::const_child_iterator_t i = s.child_begin_for(p); i != s.child_end_for(p); ++i) {
+	UF_TEST_EQUAL(*i, expected);
+	expected += 10;
+  }
+
+  UF_TEST_EQUAL(expected, 1000);
+
+  for (int i=0; i<100; i+=2) { s.remove(s.find(p, i*10)); }
+  UF_TEST_EQUAL(p.node()->child_index()->size(), 50);
+  UF_TEST_EQUAL(s.child_count(p), 50);
+  UF_TEST(s.find(p, 0).atend());
+  UF_TEST(!s.find(p, 10).atend());
+
+  // re-insertion reuses tombstones or grows the table
+  for (int i=0; i<200; i+=2) { s.ensure(p, i*10); }
+  UF_TEST_EQUAL(p.node()->child_index()->size(), 150);
+  UF_TEST_EQUAL(s.child_count(p), 150);
+  for (int i=0; i<200; ++i) { UF_TEST_EQUAL(s.find(p, i*10).atend(), (i%2 == 1 && 100 < i)); }
+
+  s.clear(p);
+  UF_TEST(!p.node()->child_index());
+  UF_TEST(s.child_empty(p));
+}
+
+static void
+test_set_tree_reset()
+{
+  tracing_allocator_t alloc; // finds leaked indices
+  int_hashed_set_tree s(0, &alloc, 1024, uf::less_t<int>(), 8);
+  int_hashed_set_tree::child_iterator_t p = s.insert(s.child_begin(), 1);
+  for (int i=0; i<100; ++i) { 
+	int_hashed_set_tree::child_iterator_t c = s.insert(p, i);
+	for (int j=0; j<10; ++j) { s.insert(c, j); }
+  }
+
+  UF_TEST(p.node()->child_index());
+  UF_TEST_EQUAL(1101, s.size());
+
+  s.reset();
+  UF_TEST_EQUAL(0, s.size());
+  UF_TEST(s.child_empty(s.child_begin()));
+  UF_TEST_EQUAL(*s.child_begin(), 0); // root survives
+
+  p = s.insert(s.child_begin(), 2);
+  for (int i=0; i<20; ++i) { s.insert(p, i); }
+  UF_TEST(p.node()->child_index());
+  UF_TEST_EQUAL(21, s.count());
+}
+
 void test_set_tree()
 {
   test_set_tree_hello();
@@ -219,6 +318,9 @@ void test_set_tree()
   test_set_tree_iterator();
   test_set_tree_empty_iterator();
   test_set_tree_ticket();
+  test_set_tree_depth_flags();
+  test_set_tree_hashed_index();
+  test_set_tree_reset();
 }
 
 
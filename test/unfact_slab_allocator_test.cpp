@@ -0,0 +1,189 @@
+
+#include <unfact/slab_allocator.hpp>
+#include <unfact/tree_set.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <vector>
+#include <string.h>
+#include <pthread.h>
+
+namespace uf = unfact;
+typedef uf::slab_allocator_t<> slab_allocator_type;
+
+static void
+test_slab_allocator_hello()
+{
+  slab_allocator_type allocator;
+  uf::byte_t* p = allocator.allocate(100);
+  UF_TEST(p);
+  memset(p, 0xab, 100);
+  UF_TEST_EQUAL(1, allocator.size());
+  allocator.deallocate(p);
+  UF_TEST_EQUAL(0, allocator.size());
+  allocator.deallocate(0);
+}
+
+static void
+test_slab_allocator_classes()
+{
+  UF_TEST_EQUAL(8, slab_allocator_type::class_size(0));
+  UF_TEST_EQUAL(uf::size_t(slab_allocator_type::max_class_size), 
+				slab_allocator_type::class_size(slab_allocator_type::nclasses - 1));
+  for (uf::size_t i=1; i<slab_allocator_type::nclasses; ++i) {
+	UF_TEST(slab_allocator_type::class_size(i-1) < slab_allocator_type::class_size(i));
+  }
+
+  slab_allocator_type allocator(0, slab_allocator_type::default_page_size, 0);
+  UF_TEST_EQUAL(0, allocator.class_of(0));
+  UF_TEST_EQUAL(0, allocator.class_of(8));
+  UF_TEST_EQUAL(1, allocator.class_of(9));
+  UF_TEST_EQUAL(uf::size_t(slab_allocator_type::nclasses - 1), allocator.class_of(slab_allocator_type::max_class_size));
+  for (uf::size_t sz=1; sz<=slab_allocator_type::max_class_size; ++sz) {
+	uf::size_t cls = allocator.class_of(sz);
+	UF_TEST(sz <= allocator.class_size(cls));
+	UF_TEST(0 == cls || allocator.class_size(cls-1) < sz);
+  }
+
+  std::vector<uf::byte_t*> items;
+  for (uf::size_t sz=1; sz<=slab_allocator_type::max_class_size; sz+=7) {
+	uf::byte_t* p = allocator.allocate(sz);
+	UF_TEST(p);
+	memset(p, 0, sz);
+	UF_TEST_EQUAL(uf::size_t(1), allocator.arena_of(allocator.class_of(sz))->size());
+	items.push_back(p);
+	allocator.deallocate(items.back());
+  }
+}
+
+static void
+test_slab_allocator_cache()
+{
+  enum { magazine = 4 };
+  slab_allocator_type allocator(0, slab_allocator_type::default_page_size, magazine);
+  uf::size_t cls = allocator.class_of(32);
+  uf::byte_t* p = allocator.allocate(32);
+  UF_TEST(p);
+  UF_TEST_EQUAL(uf::size_t(magazine), allocator.arena_of(cls)->base().size());
+  UF_TEST_EQUAL(uf::size_t(magazine-1), allocator.ncached(cls));
+  UF_TEST_EQUAL(1, allocator.size());
+
+  /* served by the cache: the arena is not touched */
+  uf::byte_t* q = allocator.allocate(32);
+  UF_TEST_EQUAL(uf::size_t(magazine), allocator.arena_of(cls)->base().size());
+  UF_TEST_EQUAL(2, allocator.size());
+  allocator.deallocate(q);
+  allocator.deallocate(p);
+  UF_TEST_EQUAL(uf::size_t(magazine), allocator.ncached(cls));
+  UF_TEST_EQUAL(0, allocator.size());
+
+  /* overflow gives a magazine back */
+  std::vector<uf::byte_t*> items;
+  for (uf::size_t i=0; i<magazine*3; ++i) { items.push_back(allocator.allocate(32)); }
+  for (uf::size_t i=0; i<items.size(); ++i) { allocator.deallocate(items[i]); }
+  UF_TEST(allocator.ncached(cls) < uf::size_t(magazine*2));
+  UF_TEST_EQUAL(0, allocator.size());
+}
+
+static void
+test_slab_allocator_large()
+{
+  tracing_allocator_t backing;
+  {
+	slab_allocator_type allocator(&backing);
+	uf::byte_t* p = allocator.allocate(100*1024);
+	UF_TEST(p);
+	UF_TEST(uf::address_aligned(p, 16));
+	memset(p, 0, 100*1024);
+	UF_TEST_EQUAL(0, allocator.size());
+
+	uf::byte_t* q = allocator.allocate_aligned(5000, 1024);
+	UF_TEST(uf::address_aligned(q, 1024));
+	allocator.deallocate(p);
+	allocator.deallocate_aligned(q);
+
+	/* small items never look like large ones, whatever their neighbours hold */
+	std::vector<uf::byte_t*> items;
+	for (int i=0; i<100; ++i) {
+	  items.push_back(allocator.allocate(16));
+	  memset(items.back(), 0xff, 16);
+	  items.push_back(allocator.allocate(4097));
+	}
+
+	for (uf::size_t i=0; i<items.size(); ++i) { allocator.deallocate(items[i]); }
+	UF_TEST_EQUAL(0, allocator.size());
+  }
+}
+
+static void
+test_slab_allocator_tree_set()
+{
+  typedef uf::tree_set_t<int> set_type;
+  slab_allocator_type allocator;
+  {
+	set_type s(&allocator);
+	for (int i=0; i<1000; ++i) { s.insert(i); }
+	UF_TEST_EQUAL(1000, s.size());
+	UF_TEST(0 < allocator.size());
+	s.clear();
+  }
+}
+
+namespace
+{
+  void* slab_allocator_worker(void* p)
+  {
+	uf::allocator_t* allocator = reinterpret_cast<uf::allocator_t*>(p);
+	std::vector<uf::byte_t*> items;
+	for (int k=0; k<10; ++k) {
+	  for (uf::size_t i=0; i<1000; ++i) { 
+		uf::size_t sz = 1 + (i*37)%(slab_allocator_type::max_class_size*2);
+		items.push_back(allocator->allocate(sz));
+		memset(items.back(), k, sz);
+	  }
+	  for (size_t i=0; i<items.size(); ++i) { allocator->deallocate(items[i]); }
+	  items.clear();
+	}
+
+	return 0;
+  }
+}
+
+static void
+test_slab_allocator_threads()
+{
+  slab_allocator_type allocator;
+  slab_allocator_type shared(0, slab_allocator_type::default_page_size, 0);
+
+  enum { nthreads = 8 };
+  pthread_t threads[nthreads];
+  for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, slab_allocator_worker, &allocator); }
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+  UF_TEST_EQUAL(0, allocator.size());
+  /* exited threads gave their caches back */
+  for (uf::size_t i=0; i<slab_allocator_type::nclasses; ++i) {
+	UF_TEST_EQUAL(uf::size_t(0), allocator.arena_of(i)->size());
+  }
+
+  for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, slab_allocator_worker, &shared); }
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+  UF_TEST_EQUAL(0, shared.size());
+}
+
+void test_slab_allocator()
+{
+  test_slab_allocator_hello();
+  test_slab_allocator_classes();
+  test_slab_allocator_cache();
+  test_slab_allocator_large();
+  test_slab_allocator_tree_set();
+  test_slab_allocator_threads();
+}
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   End:
+   -*- */
@@ -0,0 +1,241 @@
+
+#include <unfact/heap_tracer.hpp>
+#include <unfact/snapshot.hpp>
+#include <test/memory_support.hpp>
+#include <test/unit.hpp>
+#include <string>
+#include <pthread.h>
+#include <stdio.h>
+
+namespace uf = unfact;
+typedef uf::accumulative_heap_tracer_t tracer_type;
+typedef uf::accumulative_heap_snapshot_t snapshot_type;
+typedef uf::accumulative_heap_snapshot_formatter_t formatter_type;
+
+namespace {
+  struct snapshot_setup_t
+  {
+	snapshot_setup_t()
+	  : tr(&alloc), h1(0), h3(0), h5(0), h7(0)
+	{
+	  tr.trace_allocated(tr.root(), &h1, 10);
+	  t0 = tr.push(tr.root(), "hello");
+	  tr.trace_allocated(t0, &h3, 30);
+	  t1 = tr.push(t0, "howau");
+	  tr.trace_allocated(t1, &h5, 50);
+	  t2 = tr.push(t0, "imfine");
+	  tr.trace_allocated(t2, &h7, 70);
+	}
+
+	tracing_allocator_t alloc;
+	tracer_type tr;
+	uf::byte_t h1;
+	uf::byte_t h3;
+	uf::byte_t h5;
+	uf::byte_t h7;
+	tracer_type::ticket_type t0;
+	tracer_type::ticket_type t1;
+	tracer_type::ticket_type t2;
+  };
+}
+
+void test_snapshot_hello()
+{
+  snapshot_setup_t setup;
+  snapshot_type ss(&setup.alloc);
+  UF_TEST(ss.empty());
+  UF_TEST(ss.take(setup.tr.tracer()));
+  UF_TEST_EQUAL(ss.size(), 4);
+  UF_TEST_EQUAL(ss.epoch(), 1);
+
+  /* post-order */
+  UF_TEST_EQUAL(ss.name_of(0), "howau");
+  UF_TEST_EQUAL(ss.name_of(1), "imfine");
+  UF_TEST_EQUAL(ss.name_of(2), "hello");
+  UF_TEST_EQUAL(ss.root(), 3);
+  UF_TEST_EQUAL(ss.parent_of(0), 2);
+  UF_TEST_EQUAL(ss.parent_of(1), 2);
+  UF_TEST_EQUAL(ss.parent_of(2), 3);
+  UF_TEST_EQUAL(ss.parent_of(3), size_t(snapshot_type::npos));
+  UF_TEST_EQUAL(ss.depth_of(0), 2);
+  UF_TEST_EQUAL(ss.depth_of(3), 0);
+  UF_TEST_EQUAL(ss.subtree_size_of(0), 1);
+  UF_TEST_EQUAL(ss.subtree_size_of(2), 3);
+  UF_TEST_EQUAL(ss.subtree_size_of(3), 4);
+
+  UF_TEST_EQUAL(ss.value_of(2).final(), 30);
+  UF_TEST_EQUAL(ss.inclusive_of(2).final(), 30+50+70);
+  UF_TEST_EQUAL(ss.inclusive_of(3).final(), 10+30+50+70);
+
+  char buf[64];
+  size_t w = 0;
+  ss.format_name(1, buf, sizeof(buf), &w);
+  UF_TEST_EQUAL(std::string(buf), "hello.imfine");
+  UF_TEST_EQUAL(w, 12);
+
+  /* the copy never changes */
+  setup.tr.trace_deallocated(&(setup.h7));
+  UF_TEST_EQUAL(ss.inclusive_of(3).final(), 10+30+50+70);
+  UF_TEST(ss.take(setup.tr.tracer()));
+  UF_TEST_EQUAL(ss.epoch(), 2);
+  UF_TEST_EQUAL(ss.inclusive_of(3).final(), 10+30+50);
+}
+
+void test_snapshot_formatter()
+{
+  snapshot_setup_t setup;
+  setup.tr.trace_deallocated(&(setup.h7));
+  snapshot_type ss(&setup.alloc);
+  UF_TEST(ss.take(setup.tr.tracer()));
+
+  /* same as accumulation_formatter_t */
+  char buf[128];
+  formatter_type f(&ss, buf, sizeof(buf));
+  UF_TEST_EQUAL(f.c_str(), std::string("       50:hello.howau"));
+  f.increment();
+  UF_TEST_EQUAL(f.c_str(), std::string("       80:hello"));
+  f.increment();
+  UF_TEST_EQUAL(f.c_str(), std::string("       90:"));
+  UF_TEST(!f.atend());
+  f.increment();
+  UF_TEST(f.atend());
+  UF_TEST_EQUAL(f.c_str(), std::string(""));
+
+  /* subtree */
+  formatter_type g(&ss, buf, sizeof(buf), 2);
+  UF_TEST_EQUAL(g.c_str(), std::string("       50:hello.howau"));
+  g.increment();
+  UF_TEST_EQUAL(g.c_str(), std::string("       80:hello"));
+  g.increment();
+  UF_TEST(g.atend());
+}
+
+void test_snapshot_grow()
+{
+  tracing_allocator_t alloc;
+  tracer_type tr(&alloc);
+  snapshot_type ss(&alloc);
+  UF_TEST(ss.take(tr.tracer()));
+  UF_TEST_EQUAL(ss.size(), 1);
+
+  char name[16];
+  tracer_type::ticket_type t = tr.root();
+  for (int i=0; i<100; ++i) {
+	sprintf(name, "s%d", i);
+	t = tr.push(i%10 ? t : tr.root(), name);
+  }
+
+  UF_TEST(ss.take(tr.tracer()));
+  UF_TEST_EQUAL(ss.size(), 101);
+  UF_TEST_EQUAL(ss.subtree_size_of(ss.root()), 101);
+}
+
+void test_snapshot_arrays()
+{
+  snapshot_setup_t setup;
+  snapshot_type ss(&setup.alloc);
+  UF_TEST(ss.take(setup.tr.tracer()));
+
+  /* subtree is a range */
+  size_t hello = 2;
+  UF_TEST_EQUAL(ss.subtree_begin(hello), 0);
+  int sum = 0;
+  for (size_t i=ss.subtree_begin(hello); i<=hello; ++i) { sum += ss.values()[i].final(); }
+  UF_TEST_EQUAL(sum, ss.inclusives()[hello].final());
+  UF_TEST_EQUAL(ss.parents()[0], hello);
+  UF_TEST_EQUAL(ss.depths()[hello], 1);
+  UF_TEST_EQUAL(ss.subtree_sizes()[ss.root()], 4);
+  UF_TEST_EQUAL(ss.names()[hello], "hello");
+}
+
+void test_snapshot_top_n()
+{
+  snapshot_setup_t setup;
+  snapshot_type ss(&setup.alloc);
+  UF_TEST(ss.take(setup.tr.tracer()));
+
+  size_t top[3];
+  UF_TEST_EQUAL(ss.top_n(ss.values(), top, 3, uf::final_measure_t()), 3);
+  UF_TEST_EQUAL(ss.name_of(top[0]), "imfine");
+  UF_TEST_EQUAL(ss.name_of(top[1]), "howau");
+  UF_TEST_EQUAL(ss.name_of(top[2]), "hello");
+
+  UF_TEST_EQUAL(ss.top_n(ss.inclusives(), top, 2, uf::final_measure_t()), 2);
+  UF_TEST_EQUAL(top[0], ss.root());
+  UF_TEST_EQUAL(ss.name_of(top[1]), "hello");
+
+  size_t all[8];
+  UF_TEST_EQUAL(ss.top_n(ss.values(), all, 8, uf::final_measure_t()), 4);
+  UF_TEST_EQUAL(ss.name_of(all[3]), "");
+  UF_TEST_EQUAL(ss.top_n(ss.values(), all, 0, uf::final_measure_t()), 0);
+}
+
+namespace {
+  struct snapshot_threads_t
+  {
+	enum { iterations = 2000 };
+	snapshot_threads_t() : tr(&alloc), running(1) {}
+	tracing_allocator_t alloc;
+	tracer_type tr;
+	volatile int running;
+  };
+
+  void* snapshot_tracing_worker(void* p)
+  {
+	snapshot_threads_t* s = reinterpret_cast<snapshot_threads_t*>(p);
+	uf::byte_t heap[16];
+	char name[16];
+	for (int i=0; i<snapshot_threads_t::iterations; ++i) {
+	  sprintf(name, "s%d", i%50);
+	  tracer_type::ticket_type t = s->tr.push(s->tr.root(), name);
+	  uf::byte_t* h = &heap[i%16];
+	  s->tr.trace_allocated(t, h, 1);
+	  s->tr.trace_deallocated(h);
+	  s->tr.pop(t);
+	}
+
+	return 0;
+  }
+}
+
+void test_snapshot_threads()
+{
+  enum { nthreads = 4 };
+  snapshot_threads_t s;
+  snapshot_type ss(&s.alloc);
+
+  pthread_t threads[nthreads];
+  for (int i=0; i<nthreads; ++i) { pthread_create(&threads[i], 0, snapshot_tracing_worker, &s); }
+  for (int i=0; i<100; ++i) {
+	UF_TEST(ss.take(s.tr.tracer()));
+	UF_TEST_EQUAL(ss.subtree_size_of(ss.root()), ss.size());
+	UF_TEST(ss.inclusive_of(ss.root()).raised() <= size_t(nthreads*snapshot_threads_t::iterations));
+  }
+
+  for (int i=0; i<nthreads; ++i) { pthread_join(threads[i], 0); }
+  UF_TEST(ss.take(s.tr.tracer()));
+  UF_TEST_EQUAL(ss.size(), 51);
+  UF_TEST_EQUAL(ss.inclusive_of(ss.root()).raised(), nthreads*snapshot_threads_t::iterations);
+  UF_TEST_EQUAL(ss.inclusive_of(ss.root()).final(), 0);
+}
+
+void test_snapshot()
+{
+  test_snapshot_hello();
+  test_snapshot_formatter();
+  test_snapshot_grow();
+  test_snapshot_arrays();
+  test_snapshot_top_n();
+  test_snapshot_threads();
+}
+
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   tab-width:2
+   End:
+   -*- */
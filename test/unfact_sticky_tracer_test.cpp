@@ -87,6 +87,97 @@ void test_tick_tracer_format()
   UF_TEST_EQUAL("     0.0 (     0 times):bye", std::string(buf));
 }
 
+namespace
+{
+  struct manual_epoch_clock_t
+  {
+	enum { epoch_seconds = 10 };
+	static size_t epoch() { return s_epoch; }
+	static size_t s_epoch;
+  };
+
+  size_t manual_epoch_clock_t::s_epoch = 0;
+
+  /* 6 epochs a minute, and 30 buckets for 5 minutes */
+  typedef uf::windowed_accumulation_t<float, 30, manual_epoch_clock_t, 4> manual_windowed_type;
+  typedef uf::sticky_tracer_t<manual_windowed_type, uf::default_concurrent_t> manual_windowed_tracer_type;
+}
+
+void test_windowed_accumulation_hello()
+{
+  manual_epoch_clock_t::s_epoch = 100;
+  manual_windowed_type w;
+  w.trace(10.0f);
+  w.trace(10.0f);
+  UF_TEST_EQUAL(w.ewma(), 10.0f);
+
+  manual_epoch_clock_t::s_epoch = 103;
+  w.trace(20.0f);
+  UF_TEST_EQUAL(w.ewma(), 12.5f);
+  UF_TEST_EQUAL(w.samples(), size_t(3));
+  UF_TEST_EQUAL(w.last_minute().samples(), size_t(3));
+  UF_TEST_EQUAL(w.last_minute().total(), 40.0f);
+
+  /* epoch 100 goes out of the last minute, but stays in the last 5 minutes */
+  manual_epoch_clock_t::s_epoch = 107;
+  UF_TEST_EQUAL(w.last_minute().samples(), size_t(1));
+  UF_TEST_EQUAL(w.last_minute().average(), 20.0f);
+  UF_TEST_EQUAL(w.last_five_minutes().samples(), size_t(3));
+
+  /* the bucket of epoch 100 is reused */
+  manual_epoch_clock_t::s_epoch = 130;
+  w.trace(5.0f);
+  UF_TEST_EQUAL(w.last_five_minutes().samples(), size_t(2));
+  UF_TEST_EQUAL(w.last_five_minutes().total(), 25.0f);
+  UF_TEST_EQUAL(w.samples(), size_t(4));
+  UF_TEST_EQUAL(w.total(), 45.0f);
+
+  /* idle for long: recent figures go zero, lifetime ones stay */
+  manual_epoch_clock_t::s_epoch = 1000;
+  UF_TEST_EQUAL(w.last_minute().samples(), size_t(0));
+  UF_TEST_EQUAL(w.last_five_minutes().samples(), size_t(0));
+  UF_TEST_EQUAL(w.average(), 11.25f);
+
+  manual_windowed_type other;
+  other.trace(7.0f);
+  w.fold(other);
+  UF_TEST_EQUAL(w.last_minute().samples(), size_t(1));
+  UF_TEST_EQUAL(w.samples(), size_t(5));
+
+  w.clear();
+  UF_TEST_EQUAL(w.samples(), size_t(0));
+  UF_TEST_EQUAL(w.last_five_minutes().samples(), size_t(0));
+  UF_TEST_EQUAL(w.ewma(), 0.0f);
+}
+
+void test_windowed_tracer_format()
+{
+  tracing_allocator_t alloc;
+  manual_windowed_tracer_type tr(&alloc);
+  manual_windowed_tracer_type::ticket_type t0 = tr.push(tr.root(), "hello");
+
+  manual_epoch_clock_t::s_epoch = 200;
+  tr.trace(t0, 30.0f);
+  manual_epoch_clock_t::s_epoch = 220;
+  tr.trace(t0, 10.0f);
+
+  char buf[256];
+  uf::windowed_tracing_formatter_t<manual_windowed_tracer_type::tracer_type> f(&tr.tracer(), buf, 256, tr.root());
+  UF_TEST_EQUAL("    10.0     20.0     20.0 (     1/     2/     2 times):hello", std::string(buf));
+  f.increment();
+  UF_TEST_EQUAL("     0.0      0.0      0.0 (     0/     0/     0 times):", std::string(buf));
+
+  tr.fill();
+  UF_TEST_EQUAL(tr.at(t0).last_five_minutes().samples(), size_t(0));
+
+  /* the default one */
+  uf::windowed_tick_tracer_t wt(&alloc);
+  {
+	uf::windowed_tick_scope_t s(&wt, wt.push(wt.root(), "x"));
+  }
+  UF_TEST_EQUAL(wt.at(wt.push(wt.root(), "x")).last_minute().samples(), size_t(1));
+}
+
 namespace ufx = unfact::extras;
 
 void test_cta_init_fini()
@@ -113,10 +204,20 @@ namespace
 	UFX_TICK_TRACE_DECLARE();
 	UFX_TICK_TRACE_DEFINE();
 
+	struct tick_task_t
+	{
+		void operator()() { UFX_TICK_TRACE_SCOPE_COUNT(task); }
+	};
+
 	void test_cta_macros_count()
 	{
 		UFX_TICK_TRACE_INIT();
 		UFX_TICK_TRACE_PUSH(hello);
+		UFX_TICK_TRACE_WRAP(tick_task_t())();
+		{
+			ufx::default_tick_tracing_annotation_handoff_t h = UFX_TICK_TRACE_CAPTURE();
+			UFX_TICK_TRACE_ADOPT(h);
+		}
 		{
 			UFX_TICK_TRACE_SCOPE_COUNT(howareyou);
 			{
@@ -152,6 +253,7 @@ namespace
 	{
 		//UFX_TICK_TRACE_INIT();
 		UFX_TICK_TRACE_PUSH(hello);
+		UFX_TICK_TRACE_WRAP(tick_task_t())();
 		{
 		  UFX_TICK_TRACE_SCOPE_COUNT(howareyou);
 		  {
@@ -182,6 +284,8 @@ void test_sticky_tracer()
   test_tick_ops_hello();
   test_tick_tracer_hello();
   test_tick_tracer_format();
+  test_windowed_accumulation_hello();
+  test_windowed_tracer_format();
   test_cta_init_fini();
   test_cta_macros_count();
   test_cta_macros_nocount();
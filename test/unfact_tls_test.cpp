@@ -2,6 +2,7 @@
 #include <unfact/extras/thread_local.hpp>
 #include <test/memory_support.hpp>
 #include <test/unit.hpp>
+#include <pthread.h>
 
 namespace uf  = unfact;
 namespace uex = unfact::extras;
@@ -14,9 +15,56 @@ void test_tls_hello()
   UF_TEST_EQUAL(&x, tls.get());
 }
 
+void test_tls_successor()
+{
+  uf::byte_t x;
+  {
+	uex::default_thread_local_t<11>::type tls;
+	tls.set(&x);
+  }
+
+  /* should not see the value of dead one */
+  uex::default_thread_local_t<11>::type tls;
+  UF_TEST(0 == tls.get());
+  tls.set(&x);
+  UF_TEST_EQUAL(&x, tls.get());
+  tls.clear();
+  UF_TEST(0 == tls.get());
+}
+
+namespace
+{
+  typedef uex::default_thread_local_t<12>::type shared_tls_type;
+
+  void* tls_worker(void* p)
+  {
+	shared_tls_type* tls = reinterpret_cast<shared_tls_type*>(p);
+	if (0 != tls->get()) { return tls; }
+	uf::byte_t x;
+	tls->set(&x);
+	return (&x == tls->get()) ? 0 : tls;
+  }
+}
+
+void test_tls_threads()
+{
+  shared_tls_type tls;
+  uf::byte_t x;
+  tls.set(&x);
+
+  pthread_t thread;
+  void* result = &x;
+  pthread_create(&thread, 0, tls_worker, &tls);
+  pthread_join(thread, &result);
+  UF_TEST(0 == result);
+  UF_TEST_EQUAL(&x, tls.get());
+}
+
 void test_tls()
 {
   test_tls_hello();
+  test_tls_successor();
+  test_tls_threads();
 }
 
 /* -*-
@@ -1,12 +1,15 @@
 
 #include <unfact/tree_tracer.hpp>
+#include <unfact/delta.hpp>
 #include <test/memory_support.hpp>
 #include <test/tracer_support.hpp>
 #include <test/unit.hpp>
 #include <vector>
 #include <algorithm>
+#include <stdio.h>
 
 typedef unfact::tree_tracer_t<int> int_tree_tracer_type;
+typedef unfact::tree_tracer_t< unfact::delta_accumulation_t<size_t, int> > delta_tree_tracer_type;
 
 void test_tree_tracer_hello()
 {
@@ -103,6 +106,138 @@ void test_tree_tracer_pop()
   UF_TEST_EQUAL(pfoo, trac.root());
 }
 
+void test_tree_tracer_wide_push()
+{
+  tracing_allocator_t alloc;
+  int_tree_tracer_type trac(&alloc);
+  std::vector<int_tree_tracer_type::ticket_type> tickets;
+
+  char name[16];
+  for (int i=0; i<int_tree_tracer_type::default_index_threshold*4; ++i) {
+	sprintf(name, "s%03d", i);
+	tickets.push_back(trac.push(trac.root(), name));
+  }
+
+  for (int i=0; i<int_tree_tracer_type::default_index_threshold*4; ++i) {
+	sprintf(name, "s%03d", i);
+	UF_TEST_EQUAL(trac.push(trac.root(), name), tickets[i]);
+	UF_TEST_EQUAL(qualified_tracing_name(trac, tickets[i]), name);
+  }
+}
+
+void test_tree_tracer_budget()
+{
+  tracing_allocator_t alloc;
+  int_tree_tracer_type trac(&alloc);
+  trac.set_node_budget(3);
+
+  int_tree_tracer_type::ticket_type a = trac.push(trac.root(), "a");
+  int_tree_tracer_type::ticket_type b = trac.push(trac.root(), "b");
+  int_tree_tracer_type::ticket_type c = trac.push(a, "c");
+  UF_TEST_EQUAL(trac.size(), 3);
+
+  /* over the budget: new scopes collapse into "(other)", existing ones are still found */
+  int_tree_tracer_type::ticket_type d = trac.push(trac.root(), "d");
+  int_tree_tracer_type::ticket_type e = trac.push(trac.root(), "e");
+  int_tree_tracer_type::ticket_type f = trac.push(a, "f");
+  UF_TEST_EQUAL(d, e);
+  UF_TEST_EQUAL(qualified_tracing_name(trac, d), "(other)");
+  UF_TEST_EQUAL(qualified_tracing_name(trac, f), "a.(other)");
+  UF_TEST_EQUAL(trac.push(trac.root(), "b"), b);
+  UF_TEST_EQUAL(trac.push(a, "c"), c);
+  UF_TEST_EQUAL(trac.size(), 5);
+
+  /* budget can be changed, but not turned off on the non-empty tree */
+  trac.set_node_budget(0);
+  UF_TEST(trac.pinning());
+  trac.set_node_budget(10);
+  UF_TEST_EQUAL(trac.push(trac.root(), "g"), trac.push(trac.root(), "g"));
+  UF_TEST_EQUAL(qualified_tracing_name(trac, trac.push(trac.root(), "g")), "g");
+}
+
+namespace {
+	struct evict_all_t
+	{
+		template<class T> bool operator()(const T&) const { return true; }
+	};
+
+	struct evict_finished_t
+	{
+		template<class T> bool operator()(const T& t) const { return 0 == t.final(); }
+	};
+}
+
+void test_tree_tracer_evict()
+{
+  tracing_allocator_t alloc;
+  delta_tree_tracer_type trac(&alloc);
+  trac.set_node_budget(100);
+
+  delta_tree_tracer_type::ticket_type a = trac.push(trac.root(), "a");
+  delta_tree_tracer_type::ticket_type ax = trac.push(a, "x");
+  delta_tree_tracer_type::ticket_type b = trac.push(trac.root(), "b");
+  delta_tree_tracer_type::ticket_type c = trac.push(trac.root(), "c");
+  trac.at(ax).trace_raised(5);
+  trac.at(ax).trace_fallen(5);
+  trac.at(b).trace_raised(7);
+  trac.at(c).trace_raised(11);
+  trac.pop(ax);
+  trac.pop(a);
+  trac.pop(b);
+  UF_TEST_EQUAL(trac.size(), 4);
+
+  /* recently pushed scopes have the second chance */
+  UF_TEST_EQUAL(trac.evict(evict_finished_t()), 0);
+  UF_TEST_EQUAL(trac.size(), 4);
+
+	/* a.x goes, then a (now a leaf) goes. b has non-zero final, c is pinned */
+  UF_TEST_EQUAL(trac.evict(evict_finished_t()), 2);
+  UF_TEST_EQUAL(trac.size(), 2);
+  UF_TEST_EQUAL(trac.at(trac.root()).raised(), 5);
+  UF_TEST_EQUAL(trac.at(trac.root()).fallen(), 5);
+  UF_TEST_EQUAL(trac.at(trac.root()).samples(), 1);
+  UF_TEST_EQUAL(trac.at(c).raised(), 11);
+
+  /* b is folded into the root. c still stays */
+  UF_TEST_EQUAL(trac.evict(evict_all_t()), 1);
+  UF_TEST_EQUAL(trac.at(trac.root()).raised(), 5+7);
+  UF_TEST_EQUAL(qualified_tracing_name(trac, c), "c");
+
+	/* pushing again makes new one, that is counted on its parent */
+  delta_tree_tracer_type::ticket_type a2 = trac.push(trac.root(), "a");
+  delta_tree_tracer_type::ticket_type a2x = trac.push(a2, "x");
+  UF_TEST_EQUAL(trac.at(a2x).raised(), 0);
+  trac.pop(a2x);
+  trac.pop(a2);
+  trac.pop(c);
+  trac.evict(evict_all_t());
+  UF_TEST_EQUAL(trac.evict(evict_all_t(), 1), 1);
+  UF_TEST_EQUAL(trac.size(), 2);
+  UF_TEST_EQUAL(trac.evict(evict_all_t()), 2);
+  UF_TEST_EQUAL(trac.size(), 0);
+  UF_TEST_EQUAL(trac.at(trac.root()).raised(), 5+7+11);
+}
+
+void test_tree_tracer_trim()
+{
+  tracing_allocator_t alloc;
+  delta_tree_tracer_type trac(&alloc);
+  trac.set_node_budget(4);
+
+  char name[16];
+  for (int i=0; i<4; ++i) {
+	sprintf(name, "s%d", i);
+	trac.pop(trac.push(trac.root(), name));
+  }
+
+  UF_TEST_EQUAL(trac.trim(evict_all_t()), 0);
+  trac.set_node_budget(2);
+  trac.evict(evict_all_t(), 0); // nothing happens
+  UF_TEST_EQUAL(trac.trim(evict_all_t()), 0); // second chance
+  UF_TEST_EQUAL(trac.trim(evict_all_t()), 2);
+  UF_TEST_EQUAL(trac.size(), 2);
+}
+
 void test_tracing()
 {
   test_tree_tracer_hello();
@@ -110,6 +245,10 @@ void test_tracing()
 	test_tree_tracer_at();
   test_tree_tracer_push();
   test_tree_tracer_pop();
+  test_tree_tracer_wide_push();
+  test_tree_tracer_budget();
+  test_tree_tracer_evict();
+  test_tree_tracer_trim();
 }
 
 
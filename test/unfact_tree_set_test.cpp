@@ -87,6 +87,23 @@ test_tree_set_clear()
   UF_TEST_EQUAL(0, ts.count());
 }
 
+static void
+test_tree_set_reset()
+{
+  tracing_allocator_t alloc;
+  int_tree_set ts(&alloc, 1024);
+
+  for (int i=0; i<1000; ++i) { ts.insert(i); }
+  ts.reset();
+  UF_TEST(ts.empty());
+  UF_TEST_EQUAL(0, ts.size());
+  UF_TEST(!ts.contains(10));
+
+  for (int i=0; i<10; ++i) { ts.insert(i); }
+  UF_TEST_EQUAL(10, ts.size());
+  UF_TEST(ts.contains(5));
+}
+
 template<class Iterator>
 void
 do_test_tree_set_iterator_move_postfix()
@@ -274,6 +291,7 @@ void test_tree_set()
   test_tree_set_insert_remove_size();
   test_tree_set_empty();
   test_tree_set_clear();
+  test_tree_set_reset();
   test_tree_set_iterator_move_postfix();
   test_tree_set_iterator_move_prefix();
   test_tree_set_copy();
@@ -0,0 +1,531 @@
+
+/*
+ * unfact-report: offline analysis of binary snapshots. see unfact/binary_snapshot.hpp.
+ *
+ *   unfact-report info FILE
+ *   unfact-report top [-n N] [-f FIELD] [-s] FILE  : largest scopes by total (or self with -s)
+ *   unfact-report tree [-f FIELD] FILE             : indented tree with self and total
+ *   unfact-report folded [-f FIELD] FILE           : "a;b;c self" lines for flame graph tools
+ *   unfact-report diff [-n N] [-f FIELD] OLD NEW   : scopes whose total changed most
+ *   unfact-report merge -o OUT FILE...             : sums snapshots up by the scope path, like ones of
+ *                                                    dump_process_binary_snapshot() from forked workers
+ *
+ * FIELD defaults to the first field of the snapshot: "final" for heap tracers, "total" for tick tracers.
+ */
+
+#include <unfact/binary_snapshot_file.hpp>
+#include <unfact/memory.hpp>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+namespace uf = unfact;
+
+namespace
+{
+  struct options_t
+  {
+	options_t() : n(20), field(0), self(false), out(0) {}
+
+	size_t n;
+	const char* field;
+	bool self;
+	const char* out;
+	std::vector<const char*> files;
+  };
+
+  /* a mapped snapshot and its numbers of the picked field */
+  struct report_t
+  {
+	report_t() : field(0) {}
+
+	uf::mapped_binary_snapshot_t file;
+	size_t field;
+	std::vector<double> self;
+	std::vector<double> total;
+
+	const uf::binary_snapshot_view_t& view() const { return file.view(); }
+  };
+
+  bool load(const char* path, const options_t& opts, report_t* report)
+  {
+	if (!report->file.open(path)) {
+	  fprintf(stderr, "unfact-report: cannot load %s\n", path);
+	  return false;
+	}
+
+	const uf::binary_snapshot_view_t& view = report->view();
+	report->field = opts.field ? view.find_field(opts.field) : 0;
+	if (report->field >= view.field_count()) {
+	  fprintf(stderr, "unfact-report: %s has no field %s\n", path, opts.field ? opts.field : "");
+	  return false;
+	}
+
+	report->self.resize(view.size());
+	for (size_t i=0; i<view.size(); ++i) {
+	  report->self[i] = view.number_of(i, report->field);
+	}
+
+	/* children come before the parent */
+	report->total = report->self;
+	for (size_t i=0; i<view.size(); ++i) {
+	  size_t p = view.parent_of(i);
+	  if (uf::binary_snapshot_view_t::npos != p) {
+		report->total[p] += report->total[i];
+	  }
+	}
+
+	return true;
+  }
+
+  std::string path_of(const uf::binary_snapshot_view_t& view, size_t i, char separator)
+  {
+	std::vector<const char*> names;
+	for (size_t k = i; k != view.root(); k = view.parent_of(k)) {
+	  names.push_back(view.name_of(k));
+	}
+
+	std::string ret;
+	for (size_t k = names.size(); 0 < k; --k) {
+	  if (!ret.empty()) {
+		ret += separator;
+	  }
+
+	  ret += names[k-1];
+	}
+
+	return ret.empty() ? "(root)" : ret;
+  }
+
+  std::string format_value(const report_t& report, double x)
+  {
+	char buf[64];
+	if (uf::binary_field_f64 == report.view().field_type(report.field)) {
+	  snprintf(buf, sizeof(buf), "%.6g", x);
+	} else {
+	  snprintf(buf, sizeof(buf), "%.0f", x);
+	}
+
+	return buf;
+  }
+
+  struct greater_by_t
+  {
+	explicit greater_by_t(const std::vector<double>* values) : m_values(values) {}
+	bool operator()(size_t x, size_t y) const { return (*m_values)[x] > (*m_values)[y]; }
+	const std::vector<double>* m_values;
+  };
+
+  int report_info(const report_t& report)
+  {
+	const uf::binary_snapshot_view_t& view = report.view();
+	printf("version: %u\n", view.header().m_version);
+	printf("epoch: %llu\n", view.epoch());
+	printf("scopes: %d\n", int(view.size()));
+	for (size_t k=0; k<view.field_count(); ++k) {
+	  static const char* const types[] = { "?", "u64", "i64", "f64" };
+	  printf("field: %s (%s)\n", view.field_name(k), types[view.field_type(k) <= 3 ? view.field_type(k) : 0]);
+	}
+
+	return 0;
+  }
+
+  int report_top(const report_t& report, const options_t& opts)
+  {
+	const std::vector<double>& by = opts.self ? report.self : report.total;
+	std::vector<size_t> order(report.view().size());
+	for (size_t i=0; i<order.size(); ++i) { order[i] = i; }
+	std::stable_sort(order.begin(), order.end(), greater_by_t(&by));
+
+	printf("%14s %14s  %s\n", "self", "total", "scope");
+	for (size_t k=0; k<order.size() && k<opts.n; ++k) {
+	  size_t i = order[k];
+	  printf("%14s %14s  %s\n", format_value(report, report.self[i]).c_str(), 
+			 format_value(report, report.total[i]).c_str(), path_of(report.view(), i, '.').c_str());
+	}
+
+	return 0;
+  }
+
+  int report_tree(const report_t& report)
+  {
+	const uf::binary_snapshot_view_t& view = report.view();
+	if (view.empty()) {
+	  return 0;
+	}
+
+	/* children lists, then pre-order by the explicit stack */
+	std::vector< std::vector<size_t> > children(view.size());
+	for (size_t i=0; i<view.size(); ++i) {
+	  if (uf::binary_snapshot_view_t::npos != view.parent_of(i)) {
+		children[view.parent_of(i)].push_back(i);
+	  }
+	}
+
+	printf("%14s %14s  %s\n", "self", "total", "scope");
+	std::vector<size_t> stack(1, view.root());
+	while (!stack.empty()) {
+	  size_t i = stack.back();
+	  stack.pop_back();
+	  printf("%14s %14s  %*s%s\n", format_value(report, report.self[i]).c_str(), 
+			 format_value(report, report.total[i]).c_str(),
+			 int(view.depth_of(i)*2), "", i == view.root() ? "(root)" : view.name_of(i));
+	  stack.insert(stack.end(), children[i].rbegin(), children[i].rend());
+	}
+
+	return 0;
+  }
+
+  int report_folded(const report_t& report)
+  {
+	for (size_t i=0; i<report.view().size(); ++i) {
+	  if (0 < report.self[i]) {
+		printf("%s %s\n", path_of(report.view(), i, ';').c_str(), format_value(report, report.self[i]).c_str());
+	  }
+	}
+
+	return 0;
+  }
+
+  int report_diff(const report_t& before, const report_t& after, const options_t& opts)
+  {
+	/* match scopes by the path */
+	typedef std::map< std::string, std::pair<double, double> > totals_type;
+	totals_type totals;
+	for (size_t i=0; i<before.view().size(); ++i) {
+	  totals[path_of(before.view(), i, '.')].first = before.total[i];
+	}
+
+	for (size_t i=0; i<after.view().size(); ++i) {
+	  totals[path_of(after.view(), i, '.')].second = after.total[i];
+	}
+
+	std::vector<std::string> paths;
+	std::vector<double> changes;
+	for (totals_type::const_iterator i=totals.begin(); i!=totals.end(); ++i) {
+	  double change = i->second.second - i->second.first;
+	  if (0 != change) {
+		paths.push_back(i->first);
+		changes.push_back(change < 0 ? -change : change);
+	  }
+	}
+
+	std::vector<size_t> order(paths.size());
+	for (size_t i=0; i<order.size(); ++i) { order[i] = i; }
+	std::stable_sort(order.begin(), order.end(), greater_by_t(&changes));
+
+	printf("%14s %14s %14s  %s\n", "change", "before", "after", "scope");
+	for (size_t k=0; k<order.size() && k<opts.n; ++k) {
+	  const std::pair<double, double>& t = totals[paths[order[k]]];
+	  std::string change = format_value(after, t.second - t.first);
+	  printf("%14s %14s %14s  %s\n", (t.first < t.second ? "+" + change : change).c_str(), 
+			 format_value(before, t.first).c_str(), format_value(after, t.second).c_str(), paths[order[k]].c_str());
+	}
+
+	return 0;
+  }
+
+  /*
+   * merged scopes for binary_snapshot_encoder_t: the Snapshot concept over plain vectors.
+   * fields are summed up, but "average" is taken again from "total" and "samples" if they are there.
+   */
+  struct merged_field_t
+  {
+	std::string name;
+	uf::binary_u32_t type;
+  };
+
+  class merged_value_t
+  {
+  public:
+	merged_value_t(const std::vector<merged_field_t>* fields, const std::vector<double>* numbers) 
+	  : m_fields(fields), m_numbers(numbers) {}
+
+	template<class Visitor>
+	void visit_fields(Visitor& v) const
+	{
+	  for (size_t k=0; k<m_fields->size(); ++k) {
+		const merged_field_t& f = (*m_fields)[k];
+		switch (f.type) {
+		case uf::binary_field_u64: v(f.name.c_str(), static_cast<unsigned long long>((*m_numbers)[k])); break;
+		case uf::binary_field_i64: v(f.name.c_str(), static_cast<long long>((*m_numbers)[k])); break;
+		default: v(f.name.c_str(), (*m_numbers)[k]); break;
+		}
+	  }
+	}
+
+  private:
+	const std::vector<merged_field_t>* m_fields;
+	const std::vector<double>* m_numbers;
+  };
+
+  class merged_snapshot_t
+  {
+  public:
+	static const size_t npos = size_t(-1);
+
+	merged_snapshot_t() : m_epoch(0) {}
+
+	bool add(const uf::binary_snapshot_view_t& view, const char* path)
+	{
+	  if (m_fields.empty() && m_names.empty()) {
+		for (size_t k=0; k<view.field_count(); ++k) {
+		  merged_field_t f;
+		  f.name = view.field_name(k);
+		  f.type = view.field_type(k);
+		  m_fields.push_back(f);
+		}
+	  } else if (!same_fields(view)) {
+		fprintf(stderr, "unfact-report: %s has other fields\n", path);
+		return false;
+	  }
+
+	  if (view.empty()) {
+		return true;
+	  }
+
+	  /* records come in post-order: go down from the root */
+	  std::vector<size_t> merged(view.size(), npos);
+	  merged[view.root()] = ensure(npos, "");
+	  for (size_t i=view.size(); 0 < i; --i) {
+		size_t r = i - 1;
+		if (r != view.root()) {
+		  merged[r] = ensure(merged[view.parent_of(r)], view.name_of(r));
+		}
+
+		for (size_t k=0; k<m_fields.size(); ++k) {
+		  m_numbers[merged[r]][k] += view.number_of(r, k);
+		}
+	  }
+
+	  m_epoch = std::max(m_epoch, static_cast<size_t>(view.epoch()));
+	  return true;
+	}
+
+	/* renumbers scopes in post-order, as the encoder wants */
+	void finish()
+	{
+	  size_t total = find_field("total"), samples = find_field("samples"), average = find_field("average");
+	  if (npos != total && npos != samples && npos != average) {
+		for (size_t i=0; i<m_numbers.size(); ++i) {
+		  m_numbers[i][average] = (0 < m_numbers[i][samples]) ? m_numbers[i][total]/m_numbers[i][samples] : 0;
+		}
+	  }
+
+	  m_order.clear();
+	  m_index.assign(m_names.size(), npos);
+	  if (!m_names.empty()) {
+		post_order(0);
+	  }
+	}
+
+	bool empty() const { return m_order.empty(); }
+	size_t size() const { return m_order.size(); }
+	size_t root() const { return m_order.size() - 1; }
+	size_t epoch() const { return m_epoch; }
+	const std::string& name_of(size_t i) const { return m_names[m_order[i]]; }
+	size_t depth_of(size_t i) const { return m_depths[m_order[i]]; }
+
+	size_t parent_of(size_t i) const 
+	{
+	  size_t p = m_parents[m_order[i]];
+	  return npos == p ? npos : m_index[p];
+	}
+
+	merged_value_t value_of(size_t i) const { return merged_value_t(&m_fields, &m_numbers[m_order[i]]); }
+
+  private:
+	bool same_fields(const uf::binary_snapshot_view_t& view) const
+	{
+	  if (view.field_count() != m_fields.size()) {
+		return false;
+	  }
+
+	  for (size_t k=0; k<m_fields.size(); ++k) {
+		if (m_fields[k].name != view.field_name(k) || m_fields[k].type != view.field_type(k)) {
+		  return false;
+		}
+	  }
+
+	  return true;
+	}
+
+	size_t find_field(const char* name) const
+	{
+	  for (size_t k=0; k<m_fields.size(); ++k) {
+		if (m_fields[k].name == name) {
+		  return k;
+		}
+	  }
+
+	  return npos;
+	}
+
+	size_t ensure(size_t parent, const std::string& name)
+	{
+	  std::pair<size_t, std::string> key(parent, name);
+	  std::map<std::pair<size_t, std::string>, size_t>::const_iterator found = m_found.find(key);
+	  if (found != m_found.end()) {
+		return found->second;
+	  }
+
+	  size_t ret = m_names.size();
+	  m_names.push_back(name);
+	  m_parents.push_back(parent);
+	  m_depths.push_back(npos == parent ? 0 : m_depths[parent] + 1);
+	  m_numbers.push_back(std::vector<double>(m_fields.size(), 0));
+	  m_children.push_back(std::vector<size_t>());
+	  if (npos != parent) {
+		m_children[parent].push_back(ret);
+	  }
+
+	  m_found[key] = ret;
+	  return ret;
+	}
+
+	void post_order(size_t top)
+	{
+	  /* explicit stack: (scope, children visited) */
+	  std::vector< std::pair<size_t, bool> > stack(1, std::make_pair(top, false));
+	  while (!stack.empty()) {
+		std::pair<size_t, bool> here = stack.back();
+		stack.pop_back();
+		if (here.second) {
+		  m_index[here.first] = m_order.size();
+		  m_order.push_back(here.first);
+		  continue;
+		}
+
+		stack.push_back(std::make_pair(here.first, true));
+		const std::vector<size_t>& children = m_children[here.first];
+		for (size_t k=children.size(); 0 < k; --k) {
+		  stack.push_back(std::make_pair(children[k-1], false));
+		}
+	  }
+	}
+
+	std::vector<merged_field_t> m_fields;
+	std::vector<std::string> m_names;
+	std::vector<size_t> m_parents;
+	std::vector<size_t> m_depths;
+	std::vector< std::vector<double> > m_numbers;
+	std::vector< std::vector<size_t> > m_children;
+	std::map<std::pair<size_t, std::string>, size_t> m_found;
+	std::vector<size_t> m_order;
+	std::vector<size_t> m_index;
+	size_t m_epoch;
+  };
+
+  int report_merge(const options_t& opts)
+  {
+	merged_snapshot_t merged;
+	for (size_t i=0; i<opts.files.size(); ++i) {
+	  uf::mapped_binary_snapshot_t file;
+	  if (!file.open(opts.files[i])) {
+		fprintf(stderr, "unfact-report: cannot load %s\n", opts.files[i]);
+		return 2;
+	  }
+
+	  if (!merged.add(file.view(), opts.files[i])) {
+		return 2;
+	  }
+	}
+
+	merged.finish();
+	uf::stdlib_allocator_t alloc;
+	uf::binary_snapshot_encoder_t<merged_snapshot_t> encoder(&alloc);
+	FILE* out = fopen(opts.out, "wb");
+	if (!out || !encoder.encode(merged) ||
+		1 != fwrite(&encoder.header(), sizeof(uf::binary_snapshot_header_t), 1, out) ||
+		(0 < encoder.body_size() && 1 != fwrite(encoder.body(), encoder.body_size(), 1, out))) {
+	  fprintf(stderr, "unfact-report: cannot write %s\n", opts.out);
+	  if (out) { fclose(out); }
+	  return 2;
+	}
+
+	return 0 == fclose(out) ? 0 : 2;
+  }
+
+  int usage()
+  {
+	fprintf(stderr, 
+			"usage: unfact-report info FILE\n"
+			"       unfact-report top [-n N] [-f FIELD] [-s] FILE\n"
+			"       unfact-report tree [-f FIELD] FILE\n"
+			"       unfact-report folded [-f FIELD] FILE\n"
+			"       unfact-report diff [-n N] [-f FIELD] OLD NEW\n"
+			"       unfact-report merge -o OUT FILE...\n");
+	return 1;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+	return usage();
+  }
+
+  const char* command = argv[1];
+  options_t opts;
+  for (int i=2; i<argc; ++i) {
+	if (0 == strcmp(argv[i], "-n") && i+1 < argc) {
+	  opts.n = strtoul(argv[++i], 0, 10);
+	} else if (0 == strcmp(argv[i], "-f") && i+1 < argc) {
+	  opts.field = argv[++i];
+	} else if (0 == strcmp(argv[i], "-o") && i+1 < argc) {
+	  opts.out = argv[++i];
+	} else if (0 == strcmp(argv[i], "-s")) {
+	  opts.self = true;
+	} else if ('-' == argv[i][0]) {
+	  return usage();
+	} else {
+	  opts.files.push_back(argv[i]);
+	}
+  }
+
+  if (0 == strcmp(command, "merge")) {
+	return (opts.out && !opts.files.empty()) ? report_merge(opts) : usage();
+  }
+
+  size_t nfiles = (0 == strcmp(command, "diff")) ? 2 : 1;
+  if (opts.files.size() != nfiles) {
+	return usage();
+  }
+
+  report_t first;
+  if (!load(opts.files[0], opts, &first)) {
+	return 2;
+  }
+
+  if (0 == strcmp(command, "info")) {
+	return report_info(first);
+  } else if (0 == strcmp(command, "top")) {
+	return report_top(first, opts);
+  } else if (0 == strcmp(command, "tree")) {
+	return report_tree(first);
+  } else if (0 == strcmp(command, "folded")) {
+	return report_folded(first);
+  } else if (0 == strcmp(command, "diff")) {
+	report_t second;
+	if (!load(opts.files[1], opts, &second)) {
+	  return 2;
+	}
+
+	return report_diff(first, second, opts);
+  }
+
+  return usage();
+}
+
+/* -*-
+ Local Variables:
+ mode: c++
+ c-tab-always-indent: t
+ c-indent-level: 2
+ c-basic-offset: 2
+ End:
+ -*- */
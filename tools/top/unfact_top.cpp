@@ -0,0 +1,281 @@
+
+/*
+ * unfact-top: live scope statistics of a running process. see unfact/live_view.hpp.
+ *
+ *   unfact-top [-n N] [-f FIELD] [-s] [-i SECONDS] [-1] PATH
+ *
+ * PATH is live_tracer_t::path() of the process, like /proc/<pid>/fd/<fd> or /dev/shm/<name>.
+ * we map it read-only and copy scopes out: the process never formats nor locks anything for us.
+ * scopes are sorted by total (or self with -s) of FIELD, with the change since the last refresh.
+ * -1 prints once and exits. the region is of live_heap_tracer_t or live_tick_tracer_t.
+ */
+
+#include <unfact/heap_tracer.hpp>
+#include <unfact/tick_tracer.hpp>
+#include <unfact/live_region.hpp>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+namespace uf = unfact;
+
+namespace
+{
+  struct options_t
+  {
+	options_t() : n(20), field(0), self(false), interval(2), once(false), path(0) {}
+
+	size_t n;
+	const char* field;
+	bool self;
+	unsigned interval;
+	bool once;
+	const char* path;
+  };
+
+  /* Value::visit_fields() visitor: picks a field by the name, or the first one */
+  class field_picker_t
+  {
+  public:
+	explicit field_picker_t(const char* name) : m_name(name), m_value(0), m_found(false), m_floating(false) {}
+
+	void operator()(const char* name, int x) { pick(name, double(x), false); }
+	void operator()(const char* name, long x) { pick(name, double(x), false); }
+	void operator()(const char* name, unsigned int x) { pick(name, double(x), false); }
+	void operator()(const char* name, unsigned long x) { pick(name, double(x), false); }
+	void operator()(const char* name, float x) { pick(name, double(x), true); }
+	void operator()(const char* name, double x) { pick(name, x, true); }
+
+	double value() const { return m_value; }
+	bool found() const { return m_found; }
+	bool floating() const { return m_floating; }
+
+  private:
+	void pick(const char* name, double x, bool floating)
+	{
+	  if (!m_found && (!m_name || 0 == strcmp(m_name, name))) {
+		m_value = x;
+		m_found = true;
+		m_floating = floating;
+	  }
+	}
+
+	const char* m_name;
+	double m_value;
+	bool m_found;
+	bool m_floating;
+  };
+
+  struct row_t
+  {
+	std::string path;
+	double self;
+	double total;
+  };
+
+  /* builds rows from scopes in pre-order */
+  template<class View>
+  class row_collector_t
+  {
+  public:
+	typedef typename View::scope_t scope_type;
+
+	explicit row_collector_t(const char* field) : m_field(field), m_missing(false), m_floating(false) {}
+
+	void operator()(const scope_type& scope)
+	{
+	  field_picker_t picker(m_field);
+	  scope.value().visit_fields(picker);
+	  m_missing = m_missing || !picker.found();
+	  m_floating = picker.floating();
+
+	  /* the last scope at depth-1 is the parent */
+	  size_t depth = scope.depth();
+	  m_stack.resize(std::min(depth, m_stack.size()));
+	  row_t row;
+	  row.path = (0 == depth) ? "(root)" : (1 == depth || m_stack.empty()) ? scope.name() : rows[m_stack.back()].path + "." + scope.name();
+	  row.self = row.total = picker.value();
+	  for (size_t i=0; i<m_stack.size(); ++i) {
+		rows[m_stack[i]].total += row.self;
+	  }
+
+	  m_stack.push_back(rows.size());
+	  rows.push_back(row);
+	}
+
+	bool missing() const { return m_missing; }
+	bool floating() const { return m_floating; }
+
+	std::vector<row_t> rows;
+
+  private:
+	const char* m_field;
+	std::vector<size_t> m_stack;
+	bool m_missing;
+	bool m_floating;
+  };
+
+  struct greater_by_t
+  {
+	greater_by_t(const std::vector<row_t>* rows, bool self) : m_rows(rows), m_self(self) {}
+	bool operator()(size_t x, size_t y) const 
+	{
+	  return m_self ? (*m_rows)[x].self > (*m_rows)[y].self : (*m_rows)[x].total > (*m_rows)[y].total; 
+	}
+
+	const std::vector<row_t>* m_rows;
+	bool m_self;
+  };
+
+  std::string format_value(double x, bool floating)
+  {
+	char buf[64];
+	snprintf(buf, sizeof(buf), floating ? "%.6g" : "%.0f", x);
+	return buf;
+  }
+
+  bool writer_alive(size_t pid)
+  {
+	return 0 == kill(pid_t(pid), 0) || EPERM == errno;
+  }
+
+  template<class Tracer>
+  int run(const uf::live_region_t& region, const options_t& opts)
+  {
+	typedef uf::live_tracer_view_t<Tracer> view_type;
+	uf::stdlib_allocator_t alloc;
+	view_type view(&alloc);
+	if (!view.open(region.head(), region.size())) {
+	  fprintf(stderr, "unfact-top: cannot read %s\n", opts.path);
+	  return 2;
+	}
+
+	std::map<std::string, double> last;
+	while (true) {
+	  row_collector_t<view_type> collector(opts.field);
+	  if (!view.visit(collector)) {
+		return 2;
+	  }
+
+	  if (collector.missing()) {
+		fprintf(stderr, "unfact-top: no field %s\n", opts.field);
+		return 2;
+	  }
+
+	  const std::vector<row_t>& rows = collector.rows;
+	  std::vector<size_t> order(rows.size());
+	  for (size_t i=0; i<order.size(); ++i) { order[i] = i; }
+	  std::stable_sort(order.begin(), order.end(), greater_by_t(&rows, opts.self));
+
+	  if (!opts.once) {
+		printf("\033[H\033[2J");
+	  }
+
+	  printf("pid %d, %d scopes (%d skipped), schema %s\n", int(view.header().m_pid), int(rows.size()), 
+			 int(view.skipped()), view.header().m_schema);
+	  printf("%14s %14s %14s  %s\n", "self", "total", "change", "scope");
+	  for (size_t k=0; k<order.size() && k<opts.n; ++k) {
+		const row_t& row = rows[order[k]];
+		std::map<std::string, double>::const_iterator prev = last.find(row.path);
+		double change = row.total - (prev == last.end() ? 0 : prev->second);
+		std::string changed = format_value(change, collector.floating());
+		printf("%14s %14s %14s  %s\n", format_value(row.self, collector.floating()).c_str(),
+			   format_value(row.total, collector.floating()).c_str(),
+			   (0 < change ? "+" + changed : changed).c_str(), row.path.c_str());
+	  }
+
+	  fflush(stdout);
+	  if (opts.once) {
+		return 0;
+	  }
+
+	  if (!writer_alive(view.header().m_pid)) {
+		printf("unfact-top: process %d has gone\n", int(view.header().m_pid));
+		return 0;
+	  }
+
+	  last.clear();
+	  for (size_t i=0; i<rows.size(); ++i) {
+		last[rows[i].path] = rows[i].total;
+	  }
+
+	  sleep(opts.interval);
+	}
+  }
+
+  template<class Tracer>
+  bool schema_matches(const uf::live_header_t& header)
+  {
+	char schema[uf::live_schema_size];
+	uf::live_schema_t::make<typename Tracer::value_type>(schema, sizeof(schema));
+	return 0 == strncmp(schema, header.m_schema, sizeof(schema));
+  }
+
+  int usage()
+  {
+	fprintf(stderr, "usage: unfact-top [-n N] [-f FIELD] [-s] [-i SECONDS] [-1] PATH\n");
+	return 1;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  options_t opts;
+  for (int i=1; i<argc; ++i) {
+	if (0 == strcmp(argv[i], "-n") && i+1 < argc) {
+	  opts.n = strtoul(argv[++i], 0, 10);
+	} else if (0 == strcmp(argv[i], "-f") && i+1 < argc) {
+	  opts.field = argv[++i];
+	} else if (0 == strcmp(argv[i], "-i") && i+1 < argc) {
+	  opts.interval = strtoul(argv[++i], 0, 10);
+	} else if (0 == strcmp(argv[i], "-s")) {
+	  opts.self = true;
+	} else if (0 == strcmp(argv[i], "-1")) {
+	  opts.once = true;
+	} else if ('-' == argv[i][0] || opts.path) {
+	  return usage();
+	} else {
+	  opts.path = argv[i];
+	}
+  }
+
+  if (!opts.path) {
+	return usage();
+  }
+
+  uf::live_region_t region;
+  if (!region.attach(opts.path)) {
+	fprintf(stderr, "unfact-top: cannot map %s\n", opts.path);
+	return 2;
+  }
+
+  /* the header tells which tracer is there */
+  const uf::live_header_t* header = reinterpret_cast<const uf::live_header_t*>(region.head());
+  if (region.size() < sizeof(uf::live_header_t)) {
+	fprintf(stderr, "unfact-top: %s is not a live region\n", opts.path);
+	return 2;
+  } else if (schema_matches<uf::live_heap_tracer_t::tracer_type>(*header)) {
+	return run<uf::live_heap_tracer_t::tracer_type>(region, opts);
+  } else if (schema_matches<uf::live_tick_tracer_t::tracer_type>(*header)) {
+	return run<uf::live_tick_tracer_t::tracer_type>(region, opts);
+  }
+
+  fprintf(stderr, "unfact-top: unknown tracer in %s\n", opts.path);
+  return 2;
+}
+
+/* -*-
+ Local Variables:
+ mode: c++
+ c-tab-always-indent: t
+ c-indent-level: 2
+ c-basic-offset: 2
+ End:
+ -*- */
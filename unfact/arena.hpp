@@ -48,6 +48,16 @@ UNFACT_NAMESPACE_BEGIN
  * users are strongly encouraged that deallocate all items before arena destruction.
  * (we alert when we find such "item leakage")
  *
+ * page reclamation:
+ * with option_reclaim_pages, arena gives empty pages back to the allocator before its destruction.
+ * each page is aligned to its (power of 2) size and has a header that counts live items,
+ * so we find the page of an item by address masking. 
+ * slots are kept on the free list of each page, and pages with slots are listed
+ * partially used ones first, empty ones last. so we find an empty page and drop its slots in O(1).
+ * when empty pages outnumber the retention (see set_page_retention()), we release them
+ * from the back, leaving half of the retention for upcoming allocations.
+ * the tail page is never released.
+ *
  * theading model:
  * 
  * TODO: care concurrent access
@@ -63,22 +73,44 @@ public:
 	enum { page_alignment = 4 };
 
 	enum option_e {
-		option_none          = 0x0001,
-		option_fill_efnoise = 0x0001,
+		option_none          = 0x0000,
+		option_fill_efnoise  = 0x0001,
+		option_reclaim_pages = 0x0002,
 		option_default = option_fill_efnoise,
 		options,
 	};
 
+	enum { default_page_retention = 4 };
+
   struct chain_t
   {
 		chain_t* m_next;
   };
 
+	/* 
+	 * used only with option_reclaim_pages. m_prev points newer page.
+	 * m_free_next and m_free_prev link pages having slots on m_free.
+	 */
+	struct page_header_t
+	{
+		chain_t        m_chain;
+		page_header_t* m_prev;
+		size_t         m_nlive;
+		size_t         m_tag;
+		chain_t*       m_free;
+		page_header_t* m_free_next;
+		page_header_t* m_free_prev;
+	};
+
   struct stat_t
   {
-		stat_t() : m_npages(0), m_nslots(0) {}
+		stat_t() : m_npages(0), m_nslots(0), m_nempty(0), m_nreleased(0), m_peak_npages(0), m_peak_size(0) {}
 		size_t m_npages;
 		size_t m_nslots;
+		size_t m_nempty;      // pages without live items
+		size_t m_nreleased;   // pages given back to the allocator so far
+		size_t m_peak_npages;
+		size_t m_peak_size;
   };
 
   enum { chain_size = sizeof(chain_t) };
@@ -87,9 +119,11 @@ public:
 								size_t align=sizeof(void*), option_e opts=option_default)
 		: m_allocator(allocator), 
 			m_item_size(roundup_to_p2(max_of(item_size, to_size(chain_size)), align)),
-			m_page_size(max_of(m_item_size*2, page_size)),
+			m_header_slots((opts & option_reclaim_pages) ? (sizeof(page_header_t) + m_item_size - 1)/m_item_size : 1),
+			m_page_size(page_size_for(m_item_size*(m_header_slots + 1), page_size, opts)),
 			m_size(0), m_options(opts),
-			m_page_tail(0), m_slot_tail(0), m_npacked(0)
+			m_page_tail(0), m_slot_tail(0), m_spare_pages(0), m_free_front(0), m_free_back(0), 
+			m_npacked(0), m_retention(default_page_retention), m_page_tag(0)
   {
 		UF_ASSERT(sizeof(chain_t) <= m_item_size);
 		UF_ASSERT(m_item_size*2 <= m_page_size);
@@ -98,13 +132,10 @@ public:
 	/* dtor requires single mutual access! */
   ~basic_arena_t()
   {
-		if (0 < m_size) { UF_ERROR(("found possible leak (%d items) in basic_arena_t", m_size)); }
+		if (0 < m_size) { UF_ERROR(("found possible leak (%lu items) in basic_arena_t", static_cast<unsigned long>(m_size))); }
 
-		for (chain_t* ch = m_page_tail; 0 != ch;) {
-			chain_t* todie = ch;
-			ch = ch->m_next;
-			m_allocator->deallocate(reinterpret_cast<byte_t*>(todie));
-		}
+		free_pages(m_page_tail);
+		free_pages(m_spare_pages);
   }
 
 	template<class Synchronized>
@@ -137,23 +168,164 @@ public:
 			memset(ptr, 0xef, m_item_size);
 		}
 
-		chain_t* chain = reinterpret_cast<chain_t*>(ptr);
+		chain_t* released = 0;
 
-		lock_scope_t<self_type, Synchronized> l(this);
-		chain->m_next = m_slot_tail;
-		m_slot_tail = chain;
-		m_size--;
-		m_stat.m_nslots++;
+		{
+			lock_scope_t<self_type, Synchronized> l(this);
+			m_size--;
+			if (put_slot(reinterpret_cast<chain_t*>(ptr))) {
+				released = trim();
+			}
+		}
+
+		free_pages(released);
   }
 
   void deallocate(byte_t* ptr) { return deallocate(ptr, synchronized_t()); }
 
+	/*
+	 * bulk allocation for caching layer like magazine_arena_t:
+	 * allocates at most 'n' items, links them through chain_t, and takes the lock once per page.
+	 *
+	 * @return the number of allocated items. it is less than 'n' only when we run out of memory.
+	 */
+	size_t allocate_chain(chain_t** head, size_t n)
+	{
+		chain_t* ret = 0;
+		size_t got = 0;
+
+		while (got < n) {
+			{
+				lock_scope_t<self_type, synchronized_t> l(this);
+				while (got < n) {
+					chain_t* ch = take_slot();
+					if (!ch) {
+						break;
+					}
+
+					ch->m_next = ret;
+					ret = ch;
+					m_size++;
+					got++;
+				}
+
+				while (got < n && room_available(unsynchronized_t())) {
+					chain_t* ch = reinterpret_cast<chain_t*>(reinterpret_cast<byte_t*>(m_page_tail) + m_item_size*(m_npacked++));
+					ch->m_next = ret;
+					ret = ch;
+					m_size++;
+					live(reinterpret_cast<byte_t*>(ch));
+					got++;
+				}
+
+				update_peak();
+			}
+
+			if (got < n && !reserve_spare_page(synchronized_t())) {
+				byte_t* page = new_page();
+				if (!page) {
+					UF_ALERT(("can't allocate memory for new page!"));
+					break;
+				}
+
+				if (!reserve_page_with(page, synchronized_t())) {
+					free_page(page);
+				}
+			}
+		}
+
+		*head = ret;
+		return got;
+	}
+
+	/*
+	 * give back 'n' items chained from 'head' to 'tail', at once.
+	 * unlike deallocate(), we don't fill efnoise: caller should do it if needed.
+	 */
+	void deallocate_chain(chain_t* head, chain_t* tail, size_t n)
+	{
+		chain_t* released = 0;
+
+		{
+			lock_scope_t<self_type, synchronized_t> l(this);
+			m_size -= n;
+			if (m_options & option_reclaim_pages) {
+				bool emptied = false;
+				for (chain_t* ch = head; ch; /* */) {
+					chain_t* next = (ch == tail) ? 0 : ch->m_next;
+					emptied = put_slot(ch) || emptied;
+					ch = next;
+				}
+
+				if (emptied) {
+					released = trim();
+				}
+			} else {
+				tail->m_next = m_slot_tail;
+				m_slot_tail = head;
+				m_stat.m_nslots += n;
+			}
+		}
+
+		free_pages(released);
+	}
+
+	/*
+	 * region-reset: forget all items at once, without visiting them.
+	 * pages are kept for reuse. the tail page is rewound, and others become spare pages 
+	 * that we take before asking allocator_t for new one.
+	 * with option_reclaim_pages, spare pages beyond the retention are given back as usual.
+	 *
+	 * caller should ensure no one touches items of this arena anymore.
+	 * items are not filled even if option_fill_efnoise is set.
+	 */
+	template<class Synchronized>
+	void reset(const Synchronized&)
+	{
+		chain_t* released = 0;
+
+		{
+			lock_scope_t<self_type, Synchronized> l(this);
+			if (m_page_tail) {
+				chain_t* older = m_page_tail->m_next;
+				m_page_tail->m_next = 0;
+				if (older) {
+					chain_t* last = older;
+					while (last->m_next) { last = last->m_next; }
+					last->m_next = m_spare_pages;
+					m_spare_pages = older;
+				}
+
+				if (m_options & option_reclaim_pages) {
+					reinterpret_cast<page_header_t*>(m_page_tail)->m_prev = 0;
+					reinterpret_cast<page_header_t*>(m_page_tail)->m_nlive = 0;
+					reinterpret_cast<page_header_t*>(m_page_tail)->m_free = 0;
+				}
+			}
+
+			m_slot_tail = 0;
+			m_free_front = m_free_back = 0;
+			m_npacked = m_header_slots;
+			m_size = 0;
+			m_stat.m_nslots = 0;
+			m_stat.m_nempty = (m_options & option_reclaim_pages) ? m_stat.m_npages : 0;
+			if (m_retention < m_stat.m_nempty) {
+				released = trim();
+			}
+		}
+
+		free_pages(released);
+	}
+
+	void reset() { reset(synchronized_t()); }
+
 	/*
 	 * these values are immutable for each instance, so safely nolock.
 	 */
   size_t item_size() const { return m_item_size; }
   size_t page_size() const { return m_page_size; }
   allocator_t* allocator() const { return m_allocator; }
+	bool has_option(option_e opt) const { return 0 != (m_options & opt); }
 
 	template<class Synchronized>
   size_t size(const Synchronized&) const { return lock_scope_t<const self_type, Synchronized>(this)->m_size; }
@@ -165,7 +337,12 @@ public:
 public: // expose implementation detail for testing and inspection
 
 	template<class Synchronized>
-	bool has_slots(const Synchronized&) const { return 0 != lock_scope_t<const self_type, Synchronized>(this)->m_slot_tail; }
+	bool has_slots(const Synchronized&) const 
+	{ 
+		lock_scope_t<const self_type, Synchronized> l(this);
+		return 0 != m_slot_tail || 0 != m_free_front; 
+	}
+
 	bool has_slots() const { return has_slots(synchronized_t()); }
 	template<class Synchronized>
   size_t npages(const Synchronized&) const { return lock_scope_t<const self_type, Synchronized>(this)->m_stat.m_npages; }
@@ -176,6 +353,49 @@ public: // expose implementation detail for testing and inspection
 	template<class Synchronized>
   size_t npacked(const Synchronized&) const { return lock_scope_t<const self_type, Synchronized>(this)->m_npacked; }
   size_t npacked() const { return npacked(synchronized_t()); }
+	template<class Synchronized>
+	size_t nspares(const Synchronized&) const 
+	{ 
+		lock_scope_t<const self_type, Synchronized> l(this);
+		size_t n = 0;
+		for (const chain_t* ch = m_spare_pages; ch; ch = ch->m_next) { n++; }
+		return n;
+	}
+	size_t nspares() const { return nspares(synchronized_t()); }
+
+	template<class Synchronized>
+	stat_t stat(const Synchronized&) const { return lock_scope_t<const self_type, Synchronized>(this)->m_stat; }
+	stat_t stat() const { return stat(synchronized_t()); }
+
+	/*
+	 * how many empty pages we keep for later use. only meaningful with option_reclaim_pages.
+	 */
+	void set_page_retention(size_t n) 
+	{ 
+		chain_t* released = 0;
+		{
+			lock_scope_t<self_type, synchronized_t> l(this);
+			m_retention = n; 
+			if (m_retention < m_stat.m_nempty) {
+				released = trim();
+			}
+		}
+
+		free_pages(released);
+	}
+
+	size_t page_retention() const { return lock_scope_t<const self_type, synchronized_t>(this)->m_retention; }
+
+	/*
+	 * page tag is an user-defined value, written on each page header (option_reclaim_pages only.)
+	 * tag_of() gives the tag from an item address, so that users can tell the owner of the item.
+	 * set it before the first allocation.
+	 */
+	void set_page_tag(size_t tag) { lock_scope_t<self_type, synchronized_t>(this)->m_page_tag = tag; }
+	static size_t tag_of(const byte_t* ptr, size_t page_size)
+	{
+		return reinterpret_cast<const page_header_t*>(reinterpret_cast<size_t>(ptr) & ~(page_size - 1))->m_tag;
+	}
 
 private:
   basic_arena_t(const basic_arena_t&);
@@ -185,15 +405,13 @@ private:
   byte_t* allocate_from_slot(const Synchronized&)
   {
 		lock_scope_t<self_type, Synchronized> l(this);
-
-		if (!m_slot_tail) {
+		chain_t* ret = take_slot();
+		if (!ret) {
 			return 0;
 		}
 
-		chain_t* ret = m_slot_tail;
-		m_slot_tail = ret->m_next;
-		m_stat.m_nslots--;
 		m_size++;
+		update_peak();
 
 		return reinterpret_cast<byte_t*>(ret);
   }
@@ -210,7 +428,10 @@ private:
 		}
 
 		m_size++;
-		return reinterpret_cast<byte_t*>(m_page_tail) + m_item_size*(m_npacked++);
+		byte_t* ret = reinterpret_cast<byte_t*>(m_page_tail) + m_item_size*(m_npacked++);
+		live(ret);
+		update_peak();
+		return ret;
 	}
 
 	byte_t* allocate_from_tail_page() {	return allocate_from_tail_page(synchronized_t());	}
@@ -222,14 +443,14 @@ private:
 
 		while (!ret) {
 			ret = allocate_from_tail_page(sync);
-			if (!ret) {
-				byte_t* page = m_allocator->allocate(m_page_size);
+			if (!ret && !reserve_spare_page(sync)) {
+				byte_t* page = new_page();
 				UF_ASSERT(address_aligned(page, page_alignment));
 				UF_ALERT_AND_RETURN_UNLESS(page, 0, "can't allocate memory for new page!");
 				bool ok = reserve_page_with(page, sync);
 				if (!ok) {
 					/* reservation is already done by another thread; so memory here is not used.  */
-					m_allocator->deallocate(page);
+					free_page(page);
 				}
 			}
 		}
@@ -256,17 +477,64 @@ private:
 			return false; 
 		}
 
-		chain_t* tail = reinterpret_cast<chain_t*>(ptr);
-		tail->m_next = m_page_tail;
-		m_page_tail = tail;
-		m_stat.m_npages++;
-		m_npacked = 1; /* 1 for page chain */
+		if (m_options & option_reclaim_pages) {
+			m_stat.m_nempty++; // until its first item is allocated
+		}
 
+		m_stat.m_npages++;
+		m_stat.m_peak_npages = max_of(m_stat.m_peak_npages, m_stat.m_npages);
+		link_page(ptr);
 		return true;
 	}
 
 	bool reserve_page_with(byte_t* ptr)	{	return reserve_page_with(ptr, synchronized_t()); }
 
+	/*
+	 * make a spare page (kept by reset()) the new tail page.
+	 * spare pages are already counted as pages (and empty ones.)
+	 *
+	 * @return True if we have room on the tail page now.
+	 */
+	template<class Synchronized>
+	bool reserve_spare_page(const Synchronized&)
+	{
+		lock_scope_t<self_type, Synchronized> l(this);
+
+		if (room_available(unsynchronized_t())) {
+			return true;
+		}
+
+		if (!m_spare_pages) {
+			return false;
+		}
+
+		chain_t* spare = m_spare_pages;
+		m_spare_pages = spare->m_next;
+		link_page(reinterpret_cast<byte_t*>(spare));
+		return true;
+	}
+
+	/* should be called under the lock. */
+	void link_page(byte_t* ptr)
+	{
+		chain_t* tail = reinterpret_cast<chain_t*>(ptr);
+		if (m_options & option_reclaim_pages) {
+			page_header_t* header = reinterpret_cast<page_header_t*>(ptr);
+			header->m_prev = 0;
+			header->m_nlive = 0;
+			header->m_tag = m_page_tag;
+			header->m_free = 0;
+			header->m_free_next = header->m_free_prev = 0;
+			if (m_page_tail) {
+				reinterpret_cast<page_header_t*>(m_page_tail)->m_prev = header;
+			}
+		}
+
+		tail->m_next = m_page_tail;
+		m_page_tail = tail;
+		m_npacked = m_header_slots; /* for page chain (and header) */
+	}
+
 	template<class Synchronized>
 	bool room_available(const Synchronized&) const
 	{
@@ -274,16 +542,249 @@ private:
 		return m_page_tail && ((m_npacked + 1)*m_item_size <= m_page_size);
 	}
 
+	/*
+	 * reclaimable page should be power of 2 to find its header by address masking.
+	 */
+	static size_t page_size_for(size_t minimum, size_t page_size, option_e opts)
+	{
+		size_t ret = max_of(minimum, page_size);
+		if (opts & option_reclaim_pages) {
+			size_t p2 = page_alignment;
+			while (p2 < ret) { p2 *= 2; }
+			ret = p2;
+		}
+
+		return ret;
+	}
+
+	byte_t* new_page()
+	{
+		if (m_options & option_reclaim_pages) {
+			return m_allocator->allocate_aligned(m_page_size, m_page_size);
+		}
+
+		return m_allocator->allocate(m_page_size);
+	}
+
+	void free_page(byte_t* page)
+	{
+		if (m_options & option_reclaim_pages) {
+			m_allocator->deallocate_aligned(page);
+		} else {
+			m_allocator->deallocate(page);
+		}
+	}
+
+	void free_pages(chain_t* pages)
+	{
+		while (pages) {
+			chain_t* todie = pages;
+			pages = pages->m_next;
+			free_page(reinterpret_cast<byte_t*>(todie));
+		}
+	}
+
+	page_header_t* page_of(const byte_t* ptr) const
+	{
+		return reinterpret_cast<page_header_t*>(reinterpret_cast<size_t>(ptr) & ~(m_page_size - 1));
+	}
+
+	/*
+	 * live-item accounting for option_reclaim_pages. should be called under the lock.
+	 */
+	void live(const byte_t* ptr)
+	{
+		if (m_options & option_reclaim_pages) {
+			if (0 == page_of(ptr)->m_nlive++) {
+				m_stat.m_nempty--;
+			}
+		}
+	}
+
+	/*
+	 * slot list operations. should be called under the lock.
+	 * with option_reclaim_pages, slots go to the free list of their page instead of m_slot_tail.
+	 */
+	chain_t* take_slot()
+	{
+		if (!(m_options & option_reclaim_pages)) {
+			chain_t* ret = m_slot_tail;
+			if (ret) {
+				m_slot_tail = ret->m_next;
+				m_stat.m_nslots--;
+			}
+
+			return ret;
+		}
+
+		/* partially used pages are in front of empty ones: we leave empty ones as they are */
+		page_header_t* p = m_free_front;
+		if (!p) {
+			return 0;
+		}
+
+		chain_t* ret = p->m_free;
+		p->m_free = ret->m_next;
+		if (!p->m_free) {
+			unlink_free_page(p);
+		}
+
+		m_stat.m_nslots--;
+		live(reinterpret_cast<byte_t*>(ret));
+		return ret;
+	}
+
+	/* @return true if we should trim pages */
+	bool put_slot(chain_t* ch)
+	{
+		m_stat.m_nslots++;
+		if (!(m_options & option_reclaim_pages)) {
+			ch->m_next = m_slot_tail;
+			m_slot_tail = ch;
+			return false;
+		}
+
+		page_header_t* p = page_of(reinterpret_cast<byte_t*>(ch));
+		bool listed = (0 != p->m_free);
+		ch->m_next = p->m_free;
+		p->m_free = ch;
+		if (0 == --p->m_nlive) {
+			m_stat.m_nempty++;
+			if (listed) {
+				unlink_free_page(p);
+			}
+
+			link_free_page_back(p);
+			return m_retention < m_stat.m_nempty;
+		}
+
+		if (!listed) {
+			link_free_page_front(p);
+		}
+
+		return false;
+	}
+
+	void link_free_page_front(page_header_t* p)
+	{
+		p->m_free_prev = 0;
+		p->m_free_next = m_free_front;
+		if (m_free_front) {
+			m_free_front->m_free_prev = p;
+		} else {
+			m_free_back = p;
+		}
+
+		m_free_front = p;
+	}
+
+	void link_free_page_back(page_header_t* p)
+	{
+		p->m_free_next = 0;
+		p->m_free_prev = m_free_back;
+		if (m_free_back) {
+			m_free_back->m_free_next = p;
+		} else {
+			m_free_front = p;
+		}
+
+		m_free_back = p;
+	}
+
+	void unlink_free_page(page_header_t* p)
+	{
+		(p->m_free_prev ? p->m_free_prev->m_free_next : m_free_front) = p->m_free_next;
+		(p->m_free_next ? p->m_free_next->m_free_prev : m_free_back) = p->m_free_prev;
+		p->m_free_next = p->m_free_prev = 0;
+	}
+
+	void update_peak()
+	{
+		m_stat.m_peak_size = max_of(m_stat.m_peak_size, m_size);
+	}
+
+	/*
+	 * detach empty pages from the arena until we have retention/2 empty pages.
+	 * spare pages go first, because they are not linked from the page list.
+	 * should be called under the lock.
+	 *
+	 * @return detached pages chained through chain_t. caller should free them outside the lock.
+	 */
+	chain_t* trim()
+	{
+		size_t target = m_retention/2;
+		if (!(m_options & option_reclaim_pages) || m_stat.m_nempty <= target) {
+			return 0;
+		}
+
+		chain_t* spares = 0;
+		while (m_spare_pages && target < m_stat.m_nempty) {
+			chain_t* spare = m_spare_pages;
+			m_spare_pages = spare->m_next;
+			spare->m_next = spares;
+			spares = spare;
+			m_stat.m_nempty--;
+			m_stat.m_npages--;
+			m_stat.m_nreleased++;
+		}
+
+		if (m_stat.m_nempty <= target) {
+			return spares;
+		}
+
+		/* 
+		 * empty pages are at the back of the free page list. the tail page can be one of them:
+		 * we step over it. other pages are fully packed, so all their items are on m_free.
+		 */
+		chain_t* ret = spares;
+		const size_t items_per_page = m_page_size/m_item_size - m_header_slots;
+		page_header_t* p = m_free_back;
+		while (p && 0 == p->m_nlive && target < m_stat.m_nempty) {
+			page_header_t* prev = p->m_free_prev;
+			if (reinterpret_cast<chain_t*>(p) != m_page_tail) {
+				unlink_free_page(p);
+				/* not the tail page, so m_prev is always there */
+				page_header_t* next = page_next(p);
+				p->m_prev->m_chain.m_next = reinterpret_cast<chain_t*>(next);
+				if (next) {
+					next->m_prev = p->m_prev;
+				}
+
+				p->m_chain.m_next = ret;
+				ret = &(p->m_chain);
+				m_stat.m_nslots -= items_per_page;
+				m_stat.m_nempty--;
+				m_stat.m_npages--;
+				m_stat.m_nreleased++;
+			}
+
+			p = prev;
+		}
+
+		return ret;
+	}
+
+	static page_header_t* page_next(page_header_t* p) 
+	{ 
+		return p ? reinterpret_cast<page_header_t*>(p->m_chain.m_next) : 0; 
+	}
+
 private:
 	mutable lock_type m_lock;
   allocator_t* m_allocator;
   size_t m_item_size;
+  size_t m_header_slots;
   size_t m_page_size;
   size_t m_size;
 	option_e m_options;
   chain_t* m_page_tail;
   chain_t* m_slot_tail;
+  chain_t* m_spare_pages;
+	page_header_t* m_free_front;
+	page_header_t* m_free_back;
   size_t   m_npacked;
+	size_t   m_retention;
+	size_t   m_page_tag;
 
   stat_t m_stat;
 };
@@ -291,6 +792,16 @@ private:
 typedef basic_arena_t<null_concurrent_t> unconcurrent_arena_t;
 typedef basic_arena_t<default_concurrent_t> arena_t; 
 
+/*
+ * arena_select_t chooses arena implementation that collections use for given concurrent_t.
+ * concurrent policy can specialize it to plug another arena in. see magazine_arena.hpp for example.
+ */
+template<class Concurrent>
+struct arena_select_t
+{
+	typedef basic_arena_t<Concurrent> type;
+};
+
 UNFACT_NAMESPACE_END
 
 #endif//UNFACT_ARENA_HPP
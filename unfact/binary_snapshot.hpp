@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_BINARY_SNAPSHOT_HPP
+#define UNFACT_BINARY_SNAPSHOT_HPP
+
+#include <unfact/snapshot.hpp>
+#include <unfact/hash_index.hpp>
+#include <string.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * binary snapshot: tracing_snapshot_t on the disk, for analysis out of the process.
+ * see tools/report for the reader.
+ *
+ * the file is a header, field descriptors, node records, and the string table, in this order:
+ *
+ *   header  | binary_snapshot_header_t
+ *   fields  | binary_snapshot_field_t x field_count
+ *   records | (binary_snapshot_record_t + 8 bytes x field_count) x node_count, in post-order
+ *   strings | '\0' terminated names. each name appears once.
+ *
+ * - every value is in the native byte order of the writer. byte_order tells it.
+ * - fields come from Value::visit_fields(). each of them takes 8 bytes of the record:
+ *   unsigned integers as u64, signed ones as i64, and floating points as f64.
+ * - records keep raw counters of the scope itself. inclusive ones are left for the readers,
+ *   that is easy since children come before the parent.
+ * - names and field names are offsets to the string table. names are not truncated
+ *   like the text formatters do.
+ * - records start at 8 byte boundary, so binary_snapshot_view_t reads a mapped file as is.
+ *
+ * version goes up when the layout changes. readers reject unknown versions.
+ */
+typedef unsigned int binary_u32_t;
+typedef unsigned long long binary_u64_t;
+typedef long long binary_i64_t;
+
+enum {
+	binary_snapshot_version = 1,
+	binary_snapshot_byte_order = 0x01020304,
+	binary_snapshot_npos = 0xffffffff,
+	binary_snapshot_max_fields = 16
+};
+
+enum binary_field_type_e {
+	binary_field_u64 = 1,
+	binary_field_i64 = 2,
+	binary_field_f64 = 3
+};
+
+struct binary_snapshot_header_t
+{
+	char         m_magic[8];  // "UFSNAP\r\n"
+	binary_u32_t m_version;
+	binary_u32_t m_byte_order;
+	binary_u32_t m_header_size;
+	binary_u32_t m_field_count;
+	binary_u32_t m_record_size;
+	binary_u32_t m_reserved;
+	binary_u64_t m_node_count;
+	binary_u64_t m_epoch;
+	binary_u64_t m_records_offset;
+	binary_u64_t m_strings_offset;
+	binary_u64_t m_strings_size;
+	binary_u64_t m_total_size;
+
+	static const char* magic() { return "UFSNAP\r\n"; }
+};
+
+struct binary_snapshot_field_t
+{
+	binary_u32_t m_name;
+	binary_u32_t m_type;
+};
+
+/* followed by field slots */
+struct binary_snapshot_record_t
+{
+	binary_u32_t m_name;
+	binary_u32_t m_parent; // binary_snapshot_npos for the root and orphans
+	binary_u32_t m_depth;
+	binary_u32_t m_reserved;
+};
+
+/* Value::visit_fields() visitor: collects names and types of the fields */
+class binary_field_schema_t
+{
+public:
+	binary_field_schema_t() : m_count(0), m_overflow(false) {}
+
+	void operator()(const char* name, int) { add(name, binary_field_i64); }
+	void operator()(const char* name, long) { add(name, binary_field_i64); }
+	void operator()(const char* name, long long) { add(name, binary_field_i64); }
+	void operator()(const char* name, unsigned int) { add(name, binary_field_u64); }
+	void operator()(const char* name, unsigned long) { add(name, binary_field_u64); }
+	void operator()(const char* name, unsigned long long) { add(name, binary_field_u64); }
+	void operator()(const char* name, float) { add(name, binary_field_f64); }
+	void operator()(const char* name, double) { add(name, binary_field_f64); }
+
+	size_t size() const { return m_count; }
+	bool overflow() const { return m_overflow; }
+	const char* name_of(size_t i) const { return m_names[i]; }
+	binary_field_type_e type_of(size_t i) const { return m_types[i]; }
+
+private:
+	void add(const char* name, binary_field_type_e type)
+	{
+		if (binary_snapshot_max_fields <= m_count) {
+			m_overflow = true;
+			return;
+		}
+
+		m_names[m_count] = name;
+		m_types[m_count] = type;
+		m_count++;
+	}
+
+	const char* m_names[binary_snapshot_max_fields];
+	binary_field_type_e m_types[binary_snapshot_max_fields];
+	size_t m_count;
+	bool m_overflow;
+};
+
+/* Value::visit_fields() visitor: fills slots of a record */
+class binary_field_writer_t
+{
+public:
+	binary_field_writer_t(byte_t* slots, size_t count) : m_slots(slots), m_count(count), m_index(0) {}
+
+	void operator()(const char*, int x) { put(binary_i64_t(x)); }
+	void operator()(const char*, long x) { put(binary_i64_t(x)); }
+	void operator()(const char*, long long x) { put(binary_i64_t(x)); }
+	void operator()(const char*, unsigned int x) { put(binary_u64_t(x)); }
+	void operator()(const char*, unsigned long x) { put(binary_u64_t(x)); }
+	void operator()(const char*, unsigned long long x) { put(binary_u64_t(x)); }
+	void operator()(const char*, float x) { put(double(x)); }
+	void operator()(const char*, double x) { put(x); }
+
+private:
+	template<class T>
+	void put(T x)
+	{
+		if (m_index < m_count) {
+			memcpy(m_slots + sizeof(binary_u64_t)*m_index, &x, sizeof(binary_u64_t));
+		}
+
+		m_index++;
+	}
+
+	byte_t* m_slots;
+	size_t m_count;
+	size_t m_index;
+};
+
+/*
+ * encodes tracing_snapshot_t into the binary snapshot format.
+ * the body (fields, records and strings) goes in one block from the allocator,
+ * so we can write a file with the header and the body: two buffers by single writev().
+ *
+ * @param Snapshot tracing_snapshot_t
+ */
+template<class Snapshot>
+class binary_snapshot_encoder_t
+{
+public:
+	typedef Snapshot snapshot_type;
+	typedef binary_snapshot_encoder_t self_type;
+
+	explicit binary_snapshot_encoder_t(allocator_t* allocator)
+		: m_allocator(allocator), m_body(0), m_body_size(0)
+	{
+		memset(&m_header, 0, sizeof(m_header));
+	}
+
+	~binary_snapshot_encoder_t() { clear(); }
+
+	bool encode(const snapshot_type& snapshot)
+	{
+		clear();
+
+		binary_field_schema_t schema;
+		if (!snapshot.empty()) {
+			snapshot.value_of(snapshot.root()).visit_fields(schema);
+		}
+
+		UF_ALERT_AND_RETURN_UNLESS(!schema.overflow(), false, "too many fields for binary snapshot!");
+		UF_ALERT_AND_RETURN_UNLESS(snapshot.size() < size_t(binary_snapshot_npos), false, "too many scopes for binary snapshot!");
+
+		size_t nfields = schema.size();
+		size_t record_size = sizeof(binary_snapshot_record_t) + sizeof(binary_u64_t)*nfields;
+		size_t fields_size = sizeof(binary_snapshot_field_t)*nfields;
+		size_t records_size = record_size*snapshot.size();
+		/* upper bound. dedup makes it shorter */
+		size_t strings_capacity = 0;
+		for (size_t i=0; i<nfields; ++i) { strings_capacity += strlen(schema.name_of(i)) + 1; }
+		for (size_t i=0; i<snapshot.size(); ++i) { strings_capacity += strlen(snapshot.name_of(i).c_str()) + 1; }
+
+		/* +1 keeps empty snapshots away from zero-sized allocation */
+		m_body = m_allocator->allocate(fields_size + records_size + strings_capacity + 1);
+		UF_ALERT_AND_RETURN_UNLESS(m_body, false, "failed to allocate memory for binary snapshot!");
+		string_table_t strings(m_allocator, reinterpret_cast<char*>(m_body + fields_size + records_size),
+													 nfields + snapshot.size());
+		if (!strings.ready()) {
+			clear();
+			UF_ALERT(("failed to allocate memory for binary snapshot!"));
+			return false;
+		}
+
+		binary_snapshot_field_t* fields = reinterpret_cast<binary_snapshot_field_t*>(m_body);
+		for (size_t i=0; i<nfields; ++i) {
+			fields[i].m_name = strings.intern(schema.name_of(i));
+			fields[i].m_type = schema.type_of(i);
+		}
+
+		byte_t* records = m_body + fields_size;
+		for (size_t i=0; i<snapshot.size(); ++i) {
+			byte_t* r = records + record_size*i;
+			binary_snapshot_record_t head;
+			head.m_name = strings.intern(snapshot.name_of(i).c_str());
+			head.m_parent = (snapshot_type::npos == snapshot.parent_of(i)) ? 
+				binary_u32_t(binary_snapshot_npos) : binary_u32_t(snapshot.parent_of(i));
+			head.m_depth = binary_u32_t(snapshot.depth_of(i));
+			head.m_reserved = 0;
+			memcpy(r, &head, sizeof(head));
+
+			binary_field_writer_t w(r + sizeof(head), nfields);
+			snapshot.value_of(i).visit_fields(w);
+		}
+
+		m_body_size = fields_size + records_size + strings.size();
+
+		memcpy(m_header.m_magic, binary_snapshot_header_t::magic(), sizeof(m_header.m_magic));
+		m_header.m_version = binary_snapshot_version;
+		m_header.m_byte_order = binary_snapshot_byte_order;
+		m_header.m_header_size = sizeof(m_header);
+		m_header.m_field_count = binary_u32_t(nfields);
+		m_header.m_record_size = binary_u32_t(record_size);
+		m_header.m_node_count = snapshot.size();
+		m_header.m_epoch = snapshot.epoch();
+		m_header.m_records_offset = sizeof(m_header) + fields_size;
+		m_header.m_strings_offset = m_header.m_records_offset + records_size;
+		m_header.m_strings_size = strings.size();
+		m_header.m_total_size = sizeof(m_header) + m_body_size;
+		return true;
+	}
+
+	const binary_snapshot_header_t& header() const { return m_header; }
+	const byte_t* body() const { return m_body; }
+	size_t body_size() const { return m_body_size; }
+	size_t total_size() const { return sizeof(m_header) + m_body_size; }
+
+	/* copies the whole file image. @return false if it doesn't fit */
+	bool copy_to(byte_t* buf, size_t bufsize) const
+	{
+		if (bufsize < total_size()) {
+			return false;
+		}
+
+		memcpy(buf, &m_header, sizeof(m_header));
+		memcpy(buf + sizeof(m_header), m_body, m_body_size);
+		return true;
+	}
+
+private:
+	binary_snapshot_encoder_t(const binary_snapshot_encoder_t&);
+	const binary_snapshot_encoder_t& operator=(const binary_snapshot_encoder_t&);
+
+	/*
+	 * appends names to the table, once for each. open addressing over offsets.
+	 */
+	class string_table_t
+	{
+	public:
+		string_table_t(allocator_t* allocator, char* head, size_t nnames)
+			: m_allocator(allocator), m_head(head), m_size(0), m_mask(0), m_slots(0)
+		{
+			size_t n = 8;
+			while (n < nnames*2) { n <<= 1; }
+			m_slots = reinterpret_cast<binary_u32_t*>(m_allocator->allocate(sizeof(binary_u32_t)*n));
+			if (m_slots) {
+				m_mask = n - 1;
+				for (size_t i=0; i<n; ++i) { m_slots[i] = binary_snapshot_npos; }
+			}
+		}
+
+		~string_table_t() { m_allocator->deallocate(reinterpret_cast<byte_t*>(m_slots)); }
+
+		bool ready() const { return 0 != m_slots; }
+		size_t size() const { return m_size; }
+
+		binary_u32_t intern(const char* str)
+		{
+			for (size_t i = hash_string(str) & m_mask; /* */; i = (i + 1) & m_mask) {
+				if (binary_snapshot_npos == m_slots[i]) {
+					size_t len = strlen(str) + 1;
+					memcpy(m_head + m_size, str, len);
+					m_slots[i] = binary_u32_t(m_size);
+					m_size += len;
+					return m_slots[i];
+				}
+
+				if (0 == strcmp(m_head + m_slots[i], str)) {
+					return m_slots[i];
+				}
+			}
+		}
+
+	private:
+		string_table_t(const string_table_t&);
+		const string_table_t& operator=(const string_table_t&);
+
+		allocator_t* m_allocator;
+		char* m_head;
+		size_t m_size;
+		size_t m_mask;
+		binary_u32_t* m_slots;
+	};
+
+	void clear()
+	{
+		if (m_body) {
+			m_allocator->deallocate(m_body);
+		}
+
+		m_body = 0;
+		m_body_size = 0;
+	}
+
+	allocator_t* m_allocator;
+	binary_snapshot_header_t m_header;
+	byte_t* m_body;
+	size_t m_body_size;
+};
+
+/*
+ * read-only view over the binary snapshot image, like mapped file.
+ * open() checks everything once, then accessors don't.
+ * the image should be aligned to 8 bytes, as mmap() and malloc() give.
+ */
+class binary_snapshot_view_t
+{
+public:
+	enum { npos = size_t(-1) };
+
+	binary_snapshot_view_t() : m_head(0), m_header(0) {}
+
+	bool open(const void* head, size_t length)
+	{
+		m_head = 0;
+		m_header = 0;
+
+		const byte_t* bytes = reinterpret_cast<const byte_t*>(head);
+		const binary_snapshot_header_t* h = reinterpret_cast<const binary_snapshot_header_t*>(bytes);
+		UF_ALERT_AND_RETURN_UNLESS(sizeof(*h) <= length && 0 == (reinterpret_cast<size_t>(head) & 7), false, "broken binary snapshot!");
+		UF_ALERT_AND_RETURN_UNLESS(0 == memcmp(h->m_magic, binary_snapshot_header_t::magic(), sizeof(h->m_magic)), false,
+															 "not a binary snapshot!");
+		UF_ALERT_AND_RETURN_UNLESS(binary_snapshot_byte_order == h->m_byte_order, false, "binary snapshot in foreign byte order!");
+		UF_ALERT_AND_RETURN_UNLESS(binary_snapshot_version == h->m_version, false, "unknown binary snapshot version!");
+
+		binary_u64_t fields_end = h->m_header_size + binary_u64_t(sizeof(binary_snapshot_field_t))*h->m_field_count;
+		binary_u64_t records_size = binary_u64_t(h->m_record_size)*h->m_node_count;
+		bool ok = (sizeof(*h) <= h->m_header_size && h->m_field_count <= binary_snapshot_max_fields &&
+							 h->m_record_size == sizeof(binary_snapshot_record_t) + sizeof(binary_u64_t)*h->m_field_count &&
+							 h->m_node_count < binary_snapshot_npos &&
+							 fields_end <= h->m_records_offset && 0 == (h->m_records_offset & 7) &&
+							 h->m_records_offset + records_size <= h->m_strings_offset &&
+							 h->m_strings_offset + h->m_strings_size == h->m_total_size && h->m_total_size <= length &&
+							 (0 == h->m_strings_size || '\0' == bytes[h->m_total_size - 1]));
+		UF_ALERT_AND_RETURN_UNLESS(ok, false, "broken binary snapshot!");
+
+		m_head = bytes;
+		m_header = h;
+		for (size_t k=0; k<field_count(); ++k) {
+			ok = ok && string_p(field_at(k).m_name);
+		}
+
+		for (size_t i=0; ok && i<size(); ++i) {
+			const binary_snapshot_record_t& r = record_at(i);
+			/*
+			 * children come first. scopes which lost their parent to concurrent updates
+			 * are written parentless, so npos is fine anywhere. the last one (the root) can't have a parent.
+			 */
+			ok = (string_p(r.m_name) && 
+						(binary_snapshot_npos == r.m_parent || (i < r.m_parent && r.m_parent < size())));
+		}
+
+		if (!ok) {
+			m_head = 0;
+			m_header = 0;
+			UF_ALERT(("broken binary snapshot!"));
+		}
+
+		return ok;
+	}
+
+	bool opened() const { return 0 != m_header; }
+	const binary_snapshot_header_t& header() const { return *m_header; }
+	size_t size() const { return m_header ? size_t(m_header->m_node_count) : 0; }
+	bool empty() const { return 0 == size(); }
+	size_t root() const { return 0 < size() ? size() - 1 : size_t(npos); }
+	binary_u64_t epoch() const { return m_header->m_epoch; }
+
+	size_t field_count() const { return m_header->m_field_count; }
+	const char* field_name(size_t k) const { return string_at(field_at(k).m_name); }
+	binary_field_type_e field_type(size_t k) const { return binary_field_type_e(field_at(k).m_type); }
+
+	size_t find_field(const char* name) const
+	{
+		for (size_t k=0; k<field_count(); ++k) {
+			if (0 == strcmp(field_name(k), name)) {
+				return k;
+			}
+		}
+
+		return npos;
+	}
+
+	const char* name_of(size_t i) const { return string_at(record_at(i).m_name); }
+	size_t depth_of(size_t i) const { return record_at(i).m_depth; }
+
+	size_t parent_of(size_t i) const
+	{
+		binary_u32_t p = record_at(i).m_parent;
+		return binary_snapshot_npos == p ? size_t(npos) : size_t(p);
+	}
+
+	binary_u64_t u64_of(size_t i, size_t k) const { return slot_of<binary_u64_t>(i, k); }
+	binary_i64_t i64_of(size_t i, size_t k) const { return slot_of<binary_i64_t>(i, k); }
+	double f64_of(size_t i, size_t k) const { return slot_of<double>(i, k); }
+
+	/* any field as double. handy for sorting and summing */
+	double number_of(size_t i, size_t k) const
+	{
+		switch (field_type(k)) {
+		case binary_field_u64:
+			return double(u64_of(i, k));
+		case binary_field_i64:
+			return double(i64_of(i, k));
+		case binary_field_f64:
+			return f64_of(i, k);
+		default:
+			return 0;
+		}
+	}
+
+private:
+	const binary_snapshot_field_t& field_at(size_t k) const
+	{
+		return reinterpret_cast<const binary_snapshot_field_t*>(m_head + m_header->m_header_size)[k];
+	}
+
+	const binary_snapshot_record_t& record_at(size_t i) const
+	{
+		return *reinterpret_cast<const binary_snapshot_record_t*>(m_head + m_header->m_records_offset + m_header->m_record_size*i);
+	}
+
+	template<class T>
+	T slot_of(size_t i, size_t k) const
+	{
+		T ret;
+		memcpy(&ret, reinterpret_cast<const byte_t*>(&record_at(i) + 1) + sizeof(binary_u64_t)*k, sizeof(T));
+		return ret;
+	}
+
+	bool string_p(binary_u32_t off) const { return off < m_header->m_strings_size; }
+	const char* string_at(binary_u32_t off) const { return reinterpret_cast<const char*>(m_head + m_header->m_strings_offset + off); }
+
+	const byte_t* m_head;
+	const binary_snapshot_header_t* m_header;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_BINARY_SNAPSHOT_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_BINARY_SNAPSHOT_FILE_HPP
+#define UNFACT_BINARY_SNAPSHOT_FILE_HPP
+
+#include <unfact/binary_snapshot.hpp>
+#include <unfact/platform.hpp>
+
+/*
+ * select file i/o for binary snapshots: write_binary_snapshot(), dump_binary_snapshot(),
+ * dump_process_binary_snapshot() and mapped_binary_snapshot_t.
+ * it is available only on POSIX platforms for now.
+ */
+
+#if defined UNFACT_PLATFORM_LINUX
+# include <unfact/platform/posix/binary_snapshot_file.hpp>
+# define UNFACT_HAS_BINARY_SNAPSHOT_FILE
+#endif
+
+#endif//UNFACT_BINARY_SNAPSHOT_FILE_HPP
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   tab-width:2
+   End:
+   -*- */
@@ -27,6 +27,7 @@
 #define UNFACT_DELTA_HPP
 
 #include <unfact/tree_tracer.hpp>
+#include <unfact/snapshot.hpp>
 #include <unfact/keyed_value.hpp>
 #include <unfact/string_ops.hpp>
 
@@ -61,14 +62,59 @@ public:
   void trace_raised(delta_type sz) { m_raised += sz; m_samples++; }
   void trace_fallen(delta_type sz) { m_fallen += sz; }
 
+	/* merge the trace of evicted scope. see tree_tracer_t::evict() */
+	void fold(const delta_accumulation_t& that)
+	{
+		m_raised += that.m_raised;
+		m_fallen += that.m_fallen;
+		m_samples += that.m_samples;
+	}
+
+	/*
+	 * the trace between 'earlier' and this. see interval.hpp
+	 * counters never go back, so if they did, the scope was restarted after 'earlier'.
+	 */
+	delta_accumulation_t since(const delta_accumulation_t& earlier) const
+	{
+		if (m_raised < earlier.m_raised || m_fallen < earlier.m_fallen || m_samples < earlier.m_samples) {
+			return *this;
+		}
+
+		delta_accumulation_t ret;
+		ret.m_raised = m_raised - earlier.m_raised;
+		ret.m_fallen = m_fallen - earlier.m_fallen;
+		ret.m_samples = m_samples - earlier.m_samples;
+		return ret;
+	}
+
+	/* for exporters. see exporter.hpp */
+	template<class Visitor>
+	void visit_fields(Visitor& v) const
+	{
+		v("final", final());
+		v("raised", m_raised);
+		v("fallen", m_fallen);
+		v("samples", m_samples);
+	}
+
 private:
   delta_type m_raised;
   delta_type m_fallen;
   size_t m_samples;
 };
 
+/*
+ * Measure for exporters: final() of the trace. negative ones (racy snapshot) go zero.
+ */
+struct final_measure_t
+{
+	template<class Trace>
+	size_t operator()(const Trace& t) const { return 0 < t.final() ? static_cast<size_t>(t.final()) : 0; }
+};
+
 /*
  * sum up toal finals of accumulation_count sequence
+ * it is O(1) when the tracer is aggregating. see tree_tracer_t::set_aggregating()
  *
  * @todo think about thread safety
  */
@@ -77,6 +123,10 @@ inline size_t accumulation_count(const Tracer& tracer, typename Tracer::ticket_t
 {
   typedef typename Tracer::iterator iter_type;
 
+	if (tracer.aggregating()) {
+		return tracer.aggregate_of(t);
+	}
+
 	lock_scope_t<const Tracer, Synchronized> l(&tracer);
   size_t count = 0;
   iter_type beg = tracer.begin_for(t, unsynchronized_t());
@@ -103,8 +153,10 @@ inline size_t accumulation_count(const Tracer& tracer, typename Tracer::ticket_t
  * We know that IO ops including printing formatted text are typically slow and
  * synchronizations which containing such one have large performance penalty. 
  * So we should have non-blocking tree treversal in future version of unfact.
+ * -> accumulation_snapshot_formatter_t formats tracing_snapshot_t without locking the tracer.
  *
- * TODO: add thread-safe format printing function (which may require a heavy lock.)
+ * the tree should be lower than max_height, unless the tracer is aggregating: 
+ * then we just read the aggregate of each scope.
  *
  * @param Trace should be instance of accumulation_formatter_t Tracer.
  *        typically tree_tracer_t<accumulation_formatter_t>
@@ -143,7 +195,7 @@ public:
 	{
 		do { 
 			increment_one();
-		} while (0 == m_counts[m_height] && !atend());
+		} while (0 == m_count && !atend());
 	}
 
 public: // implementation detail
@@ -156,6 +208,11 @@ public: // implementation detail
 
 	void countup()
 	{
+		if (m_tracer->aggregating()) {
+			m_count = atend() ? 0 : m_tracer->aggregate_of(tracer_type::to_ticket(m_here));
+			return;
+		}
+
 		if (0 < m_height) { m_counts[m_height-1] += m_counts[m_height];	}
 		m_counts[m_height] = 0;
 
@@ -165,6 +222,8 @@ public: // implementation detail
 			m_height = h;
 			m_counts[m_height] += m_here->value().final();
 		}
+
+		m_count = m_counts[m_height];
 	}
 
   void format()
@@ -172,8 +231,7 @@ public: // implementation detail
 		if (atend()) {
 			m_buf[0] = '\0';
 		} else {
-			size_t count = m_counts[m_height];
-			int printed = snprintf(m_buf, m_bufsize, "%9d:", count);
+			int printed = snprintf(m_buf, m_bufsize, "%9lu:", static_cast<unsigned long>(m_count));
 			if (m_bufsize-1 <= static_cast<size_t>(printed)) {
 				return; // filled
 			}
@@ -201,6 +259,73 @@ private:
   iterator_type m_end;
 };
 
+/*
+ * accumulation_formatter_t on the tracing_snapshot_t:
+ * it formats the copy, so it needs no lock and has no height limit.
+ *
+ * @param Snapshot should be tracing_snapshot_t of delta_accumulation tree.
+ */
+template<class Snapshot>
+class accumulation_snapshot_formatter_t
+{
+public:
+	typedef Snapshot snapshot_type;
+
+	/*
+	 * @param root index of the subtree to format. whole snapshot by default.
+	 */
+  accumulation_snapshot_formatter_t(const snapshot_type* snapshot, char* buf, size_t bufsize,
+																		size_t root=snapshot_type::npos)
+		: m_snapshot(snapshot), m_buf(buf), m_bufsize(bufsize),
+			m_here(snapshot_type::npos == root ? 0 : root + 1 - snapshot->subtree_size_of(root)),
+			m_end(snapshot_type::npos == root ? snapshot->size() : root + 1)
+  {
+		UF_HONOR_OR_RETURN_VOID(1 <= m_bufsize); // we need at least '\0'
+		m_buf[0] = '\n';
+		format();
+  }
+
+  bool atend() const { return m_end <= m_here; }
+  const char* c_str() const { return m_buf; }
+	size_t count() const { return atend() ? 0 : m_snapshot->inclusive_of(m_here).final(); }
+
+  void increment_one()
+  {
+		++m_here;
+		format();
+  }
+
+	void increment()
+	{
+		do { 
+			increment_one();
+		} while (0 == count() && !atend());
+	}
+
+public: // implementation detail
+  void format()
+  {
+		if (atend()) {
+			m_buf[0] = '\0';
+		} else {
+			int printed = snprintf(m_buf, m_bufsize, "%9lu:", static_cast<unsigned long>(count()));
+			if (m_bufsize-1 <= static_cast<size_t>(printed)) {
+				return; // filled
+			}
+	
+			size_t dummy = 0;
+			m_snapshot->format_name(m_here, m_buf + printed, m_bufsize - printed, &dummy);
+		}
+  }
+
+private:
+  const snapshot_type* m_snapshot;
+  char*  m_buf;
+  size_t m_bufsize;
+  size_t m_here;
+  size_t m_end;
+};
+
 UNFACT_NAMESPACE_END
 
 #endif//UNFACT_DELTA_HPP
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_EXEMPLAR_HPP
+#define UNFACT_EXEMPLAR_HPP
+
+#include <unfact/base.hpp>
+#include <unfact/concurrent.hpp>
+#include <unfact/string_ops.hpp>
+#include <stdio.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * exemplar_t is a breakdown of one slow invocation: timings of child scopes that ran inside.
+ * entries are in the order they finished (children before their parent, like post-order),
+ * and their depths are relative to the invocation itself, that has depth 0.
+ * 'Capacity' bounds entries. we count ones beyond it as dropped().
+ *
+ * exemplar_t is a plain value: it is built on the stack of the invocation as the scratch buffer,
+ * and copied only when it is kept. see exemplar_store_t.
+ */
+template<class Key, class Value=float, size_t Capacity=32>
+class exemplar_t
+{
+public:
+	typedef Key key_type;
+	typedef Value value_type;
+	enum { capacity = Capacity };
+
+	struct entry_t
+	{
+		key_type m_name;
+		size_t m_depth;
+		value_type m_value;
+	};
+
+	exemplar_t() : m_total(0), m_size(0), m_dropped(0) {}
+
+	void clear()
+	{
+		m_total = value_type(0);
+		m_size = 0;
+		m_dropped = 0;
+	}
+
+	void record(const key_type& name, size_t depth, value_type value)
+	{
+		if (capacity <= m_size) {
+			m_dropped++;
+			return;
+		}
+
+		entry_t& e = m_entries[m_size++];
+		e.m_name = name;
+		e.m_depth = depth;
+		e.m_value = value;
+	}
+
+	void set_total(value_type total) { m_total = total; }
+	value_type total() const { return m_total; }
+	size_t size() const { return m_size; }
+	size_t dropped() const { return m_dropped; }
+	const entry_t& at(size_t i) const { return m_entries[i]; }
+
+private:
+	value_type m_total;
+	size_t m_size;
+	size_t m_dropped;
+	entry_t m_entries[Capacity];
+};
+
+/*
+ * exemplar_store_t keeps exemplars of one scope, in a bounded memory:
+ * - 'Slowest' slowest ones so far, in descending order of total().
+ * - 'Recent' latest ones over the threshold, in a ring. no threshold, no recent ones.
+ *
+ * offer() rejects most invocations without the lock, looking at the threshold and 
+ * the floor of the slowest ones. so the cost of fast invocations is a few loads.
+ * copy_slowest() and copy_recent() are for reporters: they copy under the lock.
+ *
+ * @param Exemplar exemplar_t
+ */
+template<class Exemplar, size_t Slowest=4, size_t Recent=4, class Concurrent=default_concurrent_t>
+class exemplar_store_t
+{
+public:
+	typedef Exemplar exemplar_type;
+	typedef typename exemplar_type::value_type value_type;
+	typedef Concurrent concurrent_type;
+	typedef exemplar_store_t self_type;
+	typedef typename concurrent_type::spin_lock_type spin_lock_type;
+	enum { slowest_capacity = Slowest, recent_capacity = Recent };
+
+	/* @param threshold 0 for no threshold */
+	explicit exemplar_store_t(value_type threshold=value_type(0))
+		: m_threshold(threshold), m_floor(0), m_slowest_size(0), m_recent_size(0), m_recent_next(0), m_offered(0) {}
+
+	void acquire() const { m_lock.acquire(); }
+	void release() const { m_lock.release(); }
+
+	value_type threshold() const { return m_threshold; }
+	void set_threshold(value_type threshold) { m_threshold = threshold; }
+
+	/* quick test without the lock. offer() may still reject it */
+	bool wants(value_type total) const
+	{
+		return (over(total) || m_slowest_size < slowest_capacity || m_floor < total);
+	}
+
+	/* @return true if we kept it */
+	bool offer(const exemplar_type& e)
+	{
+		value_type total = e.total();
+		if (!wants(total)) {
+			return false;
+		}
+
+		lock_scope_t<self_type> l(this);
+		m_offered++;
+		bool kept = false;
+		if (over(total)) {
+			m_recent[m_recent_next] = e;
+			m_recent_next = (m_recent_next + 1)%recent_capacity;
+			m_recent_size = min_of(m_recent_size + 1, to_size(recent_capacity));
+			kept = true;
+		}
+
+		if (m_slowest_size < slowest_capacity || m_slowest[m_slowest_size-1].total() < total) {
+			/* insertion: Slowest is small */
+			size_t i = (m_slowest_size < slowest_capacity) ? m_slowest_size++ : m_slowest_size-1;
+			while (0 < i && m_slowest[i-1].total() < total) {
+				m_slowest[i] = m_slowest[i-1];
+				i--;
+			}
+
+			m_slowest[i] = e;
+			kept = true;
+		}
+
+		if (slowest_capacity == m_slowest_size) {
+			m_floor = m_slowest[m_slowest_size-1].total();
+		}
+
+		return kept;
+	}
+
+	void clear()
+	{
+		lock_scope_t<self_type> l(this);
+		m_floor = value_type(0);
+		m_slowest_size = m_recent_size = m_recent_next = 0;
+		m_offered = 0;
+	}
+
+	/* copies slowest ones into 'out', slowest first. @return copied count */
+	size_t copy_slowest(exemplar_type* out, size_t n) const
+	{
+		lock_scope_t<const self_type> l(this);
+		size_t copied = min_of(n, static_cast<size_t>(m_slowest_size));
+		for (size_t i=0; i<copied; ++i) { out[i] = m_slowest[i]; }
+		return copied;
+	}
+
+	/* copies recent ones over the threshold into 'out', latest first. @return copied count */
+	size_t copy_recent(exemplar_type* out, size_t n) const
+	{
+		lock_scope_t<const self_type> l(this);
+		size_t copied = min_of(n, m_recent_size);
+		for (size_t i=0; i<copied; ++i) { 
+			out[i] = m_recent[(m_recent_next + recent_capacity - 1 - i)%recent_capacity]; 
+		}
+
+		return copied;
+	}
+
+	/* how many offers took the lock. for tuning the threshold */
+	size_t offered() const { return m_offered; }
+
+private:
+	bool over(value_type total) const { return value_type(0) < m_threshold && m_threshold <= total; }
+
+private:
+	exemplar_store_t(const exemplar_store_t&);
+	const exemplar_store_t& operator=(const exemplar_store_t&);
+
+private:
+	mutable spin_lock_type m_lock;
+	volatile value_type m_threshold;
+	/* total of the last slowest one once they are full. read without the lock */
+	volatile value_type m_floor;
+	volatile size_t m_slowest_size;
+	size_t m_recent_size;
+	size_t m_recent_next;
+	size_t m_offered;
+	exemplar_type m_slowest[Slowest];
+	exemplar_type m_recent[Recent];
+};
+
+/*
+ * formats the exemplar line by line: the header, then entries with parents before children.
+ *
+ *   exemplar:  120.0 (2 dropped)
+ *       80.0 query
+ *       60.0   parse
+ */
+template<class Exemplar>
+class exemplar_formatter_t
+{
+public:
+	typedef Exemplar exemplar_type;
+
+	exemplar_formatter_t(const exemplar_type* exemplar, char* buf, size_t bufsize)
+		: m_exemplar(exemplar), m_buf(buf), m_bufsize(bufsize), m_left(exemplar->size() + 1)
+	{ format(); }
+
+	bool atend() const { return 0 == m_left; }
+	const char* c_str() const { return m_buf; }
+
+	void increment()
+	{
+		--m_left;
+		format();
+	}
+
+	void format()
+	{
+		if (atend()) {
+			m_buf[0] = '\0';
+		} else if (m_left == m_exemplar->size() + 1) {
+			snprintf(m_buf, m_bufsize, "exemplar:%8.1f (%lu dropped)", 
+							 double(m_exemplar->total()), static_cast<unsigned long>(m_exemplar->dropped()));
+		} else {
+			/* backward from the end gives parents first */
+			const typename exemplar_type::entry_t& e = m_exemplar->at(m_left - 1);
+			int printed = snprintf(m_buf, m_bufsize, "%8.1f ", double(e.m_value));
+			for (size_t i=1; i<e.m_depth && static_cast<size_t>(printed) + 3 < m_bufsize; ++i) {
+				m_buf[printed++] = ' ';
+				m_buf[printed++] = ' ';
+			}
+
+			if (static_cast<size_t>(printed) < m_bufsize) {
+				string_ops_t<char>::copy(m_buf + printed, m_bufsize - printed, e.m_name.c_str());
+			}
+		}
+	}
+
+private:
+	const exemplar_type* m_exemplar;
+	char* m_buf;
+	size_t m_bufsize;
+	size_t m_left;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_EXEMPLAR_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
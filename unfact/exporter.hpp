@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_EXPORTER_HPP
+#define UNFACT_EXPORTER_HPP
+
+#include <unfact/snapshot.hpp>
+#include <stdio.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * exporters write tracing_snapshot_t out in some text formats:
+ * - export_text(): "count:qualified.name" lines in post-order, like accumulation_formatter_t.
+ * - export_folded(): "a;b;c count" lines, that flame graph tools take.
+ * - export_json(): nested objects with every field of the values.
+ *
+ * we measure scopes with Measure, that gives size_t from a value. see final_measure_t in delta.hpp.
+ * json needs Value::visit_fields(Visitor&) instead, that calls v("name", number) for each field.
+ *
+ * Sink concept gives:
+ * - bool write(const char* str, size_t size) : false on failure, then exporters stop and return false.
+ *
+ * JsonWriter concept, that export_json_tree() walks with, gives:
+ * - bool raw(const char* str, size_t size) and raw("literal") : fragments like brackets and commas.
+ * - bool string(const char* str) : quoted and escaped.
+ * - void begin_fields() : given before each visit_fields(), so the first field has no comma.
+ * - void operator()(const char* name, Number x) : Value::visit_fields() visitor.
+ * - bool ok() const, and bool finish() after the last token.
+ * json_sink_writer_t is the one over Sink. see also extras/ontree_exporter.hpp.
+ */
+
+/*
+ * Sink over the fixed size buffer. we keep the content '\0' terminated.
+ */
+class buffer_sink_t
+{
+public:
+	buffer_sink_t(char* buf, size_t bufsize)
+		: m_buf(buf), m_bufsize(bufsize), m_size(0), m_overflowed(false)
+	{
+		if (0 < m_bufsize) {
+			m_buf[0] = '\0';
+		}
+	}
+
+	bool write(const char* str, size_t size)
+	{
+		if (m_bufsize <= m_size + size) {
+			m_overflowed = true;
+			return false;
+		}
+
+		memcpy(m_buf + m_size, str, size);
+		m_size += size;
+		m_buf[m_size] = '\0';
+		return true;
+	}
+
+	const char* c_str() const { return m_buf; }
+	size_t size() const { return m_size; }
+	bool overflowed() const { return m_overflowed; }
+
+private:
+	char* m_buf;
+	size_t m_bufsize;
+	size_t m_size;
+	bool m_overflowed;
+};
+
+/* every trace value has samples() */
+struct samples_measure_t
+{
+	template<class Value>
+	size_t operator()(const Value& v) const { return v.samples(); }
+};
+
+enum { export_line_size = 1024 };
+
+template<class Sink>
+inline bool export_string(Sink& sink, const char* str)
+{
+	return sink.write(str, strlen(str));
+}
+
+/*
+ * @param root index of the subtree to export. whole snapshot by default.
+ */
+template<class Snapshot, class Sink, class Measure>
+inline bool export_text(const Snapshot& snapshot, Sink& sink, const Measure& measure, 
+												size_t root=Snapshot::npos)
+{
+	char line[export_line_size];
+	size_t beg = (Snapshot::npos == root) ? 0 : snapshot.subtree_begin(root);
+	size_t end = (Snapshot::npos == root) ? snapshot.size() : root + 1;
+	for (size_t i=beg; i<end; ++i) {
+		size_t count = measure(snapshot.inclusive_of(i));
+		if (0 == count) {
+			continue;
+		}
+
+		int printed = snprintf(line, export_line_size, "%9lu:", static_cast<unsigned long>(count));
+		size_t written = 0;
+		snapshot.format_name(i, line + printed, export_line_size - printed - 1, &written);
+		line[printed + written] = '\n';
+		if (!sink.write(line, printed + written + 1)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * we write the value of each scope, not inclusive one: the tools sum them up.
+ * the root has empty name, so we call it "(root)".
+ */
+template<class Snapshot, class Sink, class Measure>
+inline bool export_folded(const Snapshot& snapshot, Sink& sink, const Measure& measure)
+{
+	char line[export_line_size];
+	for (size_t i=0; i<snapshot.size(); ++i) {
+		size_t count = measure(snapshot.value_of(i));
+		if (0 == count) {
+			continue;
+		}
+
+		size_t written = 0;
+		snapshot.format_name(i, line, export_line_size - 32, &written, ';');
+		if (0 == written) {
+			written = strlen(strcpy(line, "(root)"));
+		}
+
+		int printed = snprintf(line + written, export_line_size - written, " %lu\n", static_cast<unsigned long>(count));
+		if (!sink.write(line, written + printed)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * json helpers
+ */
+inline int format_json_number(char* buf, size_t bufsize, int x) { return snprintf(buf, bufsize, "%d", x); }
+inline int format_json_number(char* buf, size_t bufsize, unsigned int x) { return snprintf(buf, bufsize, "%u", x); }
+inline int format_json_number(char* buf, size_t bufsize, long x) { return snprintf(buf, bufsize, "%ld", x); }
+inline int format_json_number(char* buf, size_t bufsize, unsigned long x) { return snprintf(buf, bufsize, "%lu", x); }
+inline int format_json_number(char* buf, size_t bufsize, long long x) { return snprintf(buf, bufsize, "%lld", x); }
+inline int format_json_number(char* buf, size_t bufsize, unsigned long long x) { return snprintf(buf, bufsize, "%llu", x); }
+inline int format_json_number(char* buf, size_t bufsize, double x) { return snprintf(buf, bufsize, "%g", x); }
+inline int format_json_number(char* buf, size_t bufsize, float x) { return snprintf(buf, bufsize, "%g", static_cast<double>(x)); }
+
+template<class Sink>
+inline bool export_json_string(Sink& sink, const char* str)
+{
+	char buf[8];
+	if (!sink.write("\"", 1)) {
+		return false;
+	}
+
+	for (const char* p = str; *p; ++p) {
+		unsigned char c = static_cast<unsigned char>(*p);
+		bool ok = true;
+		if ('"' == c || '\\' == c) {
+			buf[0] = '\\';
+			buf[1] = c;
+			ok = sink.write(buf, 2);
+		} else if (c < 0x20) {
+			int printed = snprintf(buf, sizeof(buf), "\\u%04x", c);
+			ok = sink.write(buf, printed);
+		} else {
+			ok = sink.write(p, 1);
+		}
+
+		if (!ok) {
+			return false;
+		}
+	}
+
+	return sink.write("\"", 1);
+}
+
+/* JsonWriter over Sink */
+template<class Sink>
+class json_sink_writer_t
+{
+public:
+	explicit json_sink_writer_t(Sink* sink) : m_sink(sink), m_nfields(0), m_ok(true) {}
+
+	bool raw(const char* str, size_t size) { return m_ok = m_ok && m_sink->write(str, size); }
+	template<size_t N>
+	bool raw(const char (&str)[N]) { return raw(str, N - 1); }
+	bool string(const char* str) { return m_ok = m_ok && export_json_string(*m_sink, str); }
+	bool ok() const { return m_ok; }
+	bool finish() { return m_ok; }
+
+	void begin_fields() { m_nfields = 0; }
+
+	template<class Number>
+	void operator()(const char* name, Number x)
+	{
+		char buf[64];
+		(0 == m_nfields++ || raw(",")) && string(name) && raw(":") && raw(buf, format_json_number(buf, sizeof(buf), x));
+	}
+
+private:
+	Sink* m_sink;
+	size_t m_nfields;
+	bool m_ok;
+};
+
+/* opens the object for the scope. the caller closes it after children, if any */
+template<class Snapshot, class JsonWriter>
+inline bool export_json_scope(const Snapshot& snapshot, JsonWriter& w, size_t i)
+{
+	if (!(w.raw("{\"name\":") && w.string(snapshot.name_of(i).c_str()) && w.raw(",\"self\":{"))) {
+		return false;
+	}
+
+	w.begin_fields();
+	snapshot.value_of(i).visit_fields(w);
+	if (!(w.ok() && w.raw("},\"total\":{"))) {
+		return false;
+	}
+
+	w.begin_fields();
+	snapshot.inclusive_of(i).visit_fields(w);
+	return w.ok() && w.raw("}");
+}
+
+/*
+ * the child of 'parent' whose subtree starts at 'beg'.
+ * its subtree starts at 'beg', and its ancestor chain reaches 'parent'.
+ */
+template<class Snapshot>
+inline size_t json_child_at(const Snapshot& snapshot, size_t beg, size_t parent)
+{
+	size_t c = beg;
+	while (Snapshot::npos != c && snapshot.parent_of(c) != parent) {
+		c = snapshot.parent_of(c);
+	}
+
+	return c;
+}
+
+/*
+ * {"name":"", "self":{...}, "total":{...}, "children":[{"name":"a", ...}, ...]}
+ * we walk in pre-order without recursion, so the tree can be arbitrary deep.
+ */
+template<class Snapshot, class JsonWriter>
+inline bool export_json_tree(const Snapshot& snapshot, JsonWriter& w, size_t root=Snapshot::npos)
+{
+	size_t top = (Snapshot::npos == root) ? snapshot.root() : root;
+	if (Snapshot::npos == top) {
+		return w.raw("{}") && w.finish();
+	}
+
+	size_t i = top;
+	if (!export_json_scope(snapshot, w, i)) {
+		return false;
+	}
+
+	for (;;) {
+		if (1 < snapshot.subtree_size_of(i)) {
+			i = json_child_at(snapshot, snapshot.subtree_begin(i), i);
+			if (!(w.raw(",\"children\":[") && export_json_scope(snapshot, w, i))) {
+				return false;
+			}
+
+			continue;
+		}
+
+		if (!w.raw("}")) {
+			return false;
+		}
+
+		/* close scopes until we find the next sibling */
+		for (;;) {
+			if (i == top) {
+				return w.finish();
+			}
+
+			size_t p = snapshot.parent_of(i);
+			if (i + 1 < p) {
+				i = json_child_at(snapshot, i + 1, p);
+				if (!(w.raw(",") && export_json_scope(snapshot, w, i))) {
+					return false;
+				}
+
+				break;
+			}
+
+			if (!w.raw("]}")) {
+				return false;
+			}
+
+			i = p;
+		}
+	}
+}
+
+template<class Snapshot, class Sink>
+inline bool export_json(const Snapshot& snapshot, Sink& sink, size_t root=Snapshot::npos)
+{
+	json_sink_writer_t<Sink> w(&sink);
+	return export_json_tree(snapshot, w, root);
+}
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_EXPORTER_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -29,6 +29,12 @@
 #include <unfact/base.hpp>
 #include <unfact/memory.hpp>
 #include <unfact/platform.hpp>
+#ifdef UNFACT_EXTRAS_USE_MMAP_BACKDOOR_ALLOCATOR
+# include <unfact/mmap_allocator.hpp>
+#endif
+#ifdef UNFACT_EXTRAS_USE_SLAB_BACKDOOR_ALLOCATOR
+# include <unfact/slab_allocator.hpp>
+#endif
 
 #define UNFACT_NAMESPACE_EXTRAS_BEGIN namespace unfact { namespace extras {
 #define UNFACT_NAMESPACE_EXTRAS_END   } }
@@ -41,7 +47,17 @@
 
 UNFACT_NAMESPACE_EXTRAS_BEGIN
 
-#ifndef UNFACT_EXTRAS_HAS_USER_BACKDOOR_ALLOCATOR
+/*
+ * backdoor_allocator_t is used for memory of annotations themselves.
+ * - UNFACT_EXTRAS_USE_MMAP_BACKDOOR_ALLOCATOR picks mmap_allocator_t, that bypasses malloc.
+ * - UNFACT_EXTRAS_USE_SLAB_BACKDOOR_ALLOCATOR picks slab_allocator_t, that takes pages from malloc.
+ * - or define UNFACT_EXTRAS_HAS_USER_BACKDOOR_ALLOCATOR and typedef your own.
+ */
+#if defined(UNFACT_EXTRAS_USE_MMAP_BACKDOOR_ALLOCATOR)
+typedef mmap_allocator_t backdoor_allocator_t;
+#elif defined(UNFACT_EXTRAS_USE_SLAB_BACKDOOR_ALLOCATOR)
+typedef slab_allocator_t<> backdoor_allocator_t;
+#elif !defined(UNFACT_EXTRAS_HAS_USER_BACKDOOR_ALLOCATOR)
 typedef stdlib_allocator_t backdoor_allocator_t;
 #endif
 
@@ -46,8 +46,11 @@ public:
 	typedef tracing_chain_t<tracer_type, StorageID> chain_type;
 	typedef typename chain_type::scope_t scope_type;
 	typedef typename chain_type::disjoint_t disjoint_type;
+	typedef typename chain_type::handoff_t handoff_type;
+	typedef typename chain_type::adopt_scope_t adopt_scope_type;
+	typedef word_ops_t<typename tracer_type::concurrent_type::atomic_ops_type> word_ops_type;
 
-	heap_tracing_annotation_t() : m_tracer(&m_allocator), m_chain(&m_tracer) {}
+	heap_tracing_annotation_t() : m_tracer(&m_allocator), m_chain(&m_tracer), m_skipped(0) {}
 	
 	tracer_type& tracer(){ return m_tracer; }
 	chain_type& chain() { return m_chain; }
@@ -56,14 +59,28 @@ public:
 
   void* trace_allocated(void* ptr, size_t size)
   {
+		if (!m_chain.accounting()) {
+			word_ops_type::add(&m_skipped, 1);
+			return ptr;
+		}
+
 		return m_tracer.trace_allocated(chain().ticket(), reinterpret_cast<byte_t*>(ptr), size);
 	}
 
+	/*
+	 * while skipped allocations live, unknown pointer is no longer an error: we take it for one of them.
+	 * once they are all freed, it is the error again.
+	 */
   void trace_deallocated(void* ptr)
   {
-		return m_tracer.trace_deallocated(reinterpret_cast<byte_t*>(ptr));
+		if (!m_tracer.trace_deallocated(reinterpret_cast<byte_t*>(ptr), 0 == m_skipped)) {
+			word_ops_type::decrement_if_positive(&m_skipped);
+		}
 	}
 
+	/* allocations skipped and not freed yet */
+	size_t skipped() const { return m_skipped; }
+
 	void report(const char* file, int line)
 	{
 		char buf[128];
@@ -87,6 +104,7 @@ private:
 	allocator_type m_allocator;
 	tracer_type m_tracer;
 	chain_type m_chain;
+	volatile size_t m_skipped;
 };
 
 typedef heap_tracing_annotation_t<thead_local_id_heap_tracing_annotation,
@@ -98,12 +116,17 @@ typedef default_heap_tracing_annotation_type::scope_type
         default_heap_tracing_annotation_scope_t;
 typedef default_heap_tracing_annotation_type::disjoint_type
         default_heap_tracing_annotation_disjoint_t;
+typedef default_heap_tracing_annotation_type::handoff_type
+        default_heap_tracing_annotation_handoff_t;
+typedef default_heap_tracing_annotation_type::adopt_scope_type
+        default_heap_tracing_annotation_adopt_scope_t;
 
 UNFACT_NAMESPACE_EXTRAS_END
 
 #ifndef UFX_USE_NO_HEAP_TRACE
 # define UFX_HEAP_TRACE_DEFINE_X(name) unfact::extras::default_heap_tracing_annotation_context_t name
 # define UFX_HEAP_TRACE_INIT_X(name) name.init()
+# define UFX_HEAP_TRACE_INIT_REPORTING_X(name, reporter, sink) name.init(reporter, sink)
 # define UFX_HEAP_TRACE_FINI_X(name) name.fini()
 # define UFX_HEAP_TRACE_TRACER_X(name) name.self
 # define UFX_HEAP_TRACE_CHAIN_X(name) (name.good() ? &(name->chain()) : 0)
@@ -115,14 +138,22 @@ UNFACT_NAMESPACE_EXTRAS_END
 # define UFX_HEAP_TRACE_PUSH_STR_X(name, scope) if (name.good()) name->chain().push(scope)
 # define UFX_HEAP_TRACE_POP_X(name) if (name.good()) name->chain().pop()
 # define UFX_HEAP_TRACE_TICKET_X(name) (name.good() ? name->chain().ticket() : 0)
+# define UFX_HEAP_TRACE_CAPTURE_X(name) (name.good() ? name->chain().capture() : unfact::extras::default_heap_tracing_annotation_handoff_t())
+# define UFX_HEAP_TRACE_ADOPT_X(name, handoff) unfact::extras::default_heap_tracing_annotation_adopt_scope_t ufx_hta_adopt_heap(UFX_HEAP_TRACE_CHAIN_X(name), handoff)
+# define UFX_HEAP_TRACE_WRAP_X(name, function) unfact::extras::adopting(UFX_HEAP_TRACE_CHAIN_X(name), function)
 # define UFX_HEAP_TRACE_DECLARE_X(name) extern unfact::extras::default_heap_tracing_annotation_context_t name
 # define UFX_HEAP_TRACE_MALLOC_X(name, ptr, sz)  ((name.good()) ? name->trace_allocated(ptr, sz) : ptr)
 # define UFX_HEAP_TRACE_FREE_X(name, ptr) if (name.good()) name->trace_deallocated(ptr)
 # define UFX_HEAP_TRACE_REPORT_X(name) if (name.good()) name->report(__FILE__, __LINE__)
 # define UFX_HEAP_TRACE_ASSERT_NO_LEAKAGE_X(name) if (name.good()) name->assert_no_leakage(__FILE__, __LINE__)
+# define UFX_HEAP_TRACE_ENABLE_X(name) if (name.good()) name->chain().enable()
+# define UFX_HEAP_TRACE_DISABLE_X(name) if (name.good()) name->chain().disable()
+# define UFX_HEAP_TRACE_MUTE_X(name) if (name.good()) name->chain().mute()
+# define UFX_HEAP_TRACE_UNMUTE_X(name) if (name.good()) name->chain().unmute()
 #else
 # define UFX_HEAP_TRACE_DEFINE_X(name) ((void)0)
 # define UFX_HEAP_TRACE_INIT_X(name) ((void)0)
+# define UFX_HEAP_TRACE_INIT_REPORTING_X(name, reporter, sink) ((void)0)
 # define UFX_HEAP_TRACE_FINI_X(name) ((void)0)
 # define UFX_HEAP_TRACE_SCOPE_X(name, scope) ((void)0)
 # define UFX_HEAP_TRACE_SCOPE_STR_X(name, var, scope) ((void)0)
@@ -132,18 +163,26 @@ UNFACT_NAMESPACE_EXTRAS_END
 # define UFX_HEAP_TRACE_PUSH_STR_X(name, scope) ((void)0)
 # define UFX_HEAP_TRACE_POP_X(name) ((void)0)
 # define UFX_HEAP_TRACE_TICKET_X(name) (0)
+# define UFX_HEAP_TRACE_CAPTURE_X(name) (unfact::extras::default_heap_tracing_annotation_handoff_t())
+# define UFX_HEAP_TRACE_ADOPT_X(name, handoff) ((void)0)
+# define UFX_HEAP_TRACE_WRAP_X(name, function) (function)
 # define UFX_HEAP_TRACE_DECLARE_X(name) ((void)0)
 # define UFX_HEAP_TRACE_MALLOC_X(name, ptr, sz) (ptr)
 # define UFX_HEAP_TRACE_FREE_X(name, ptr) ((void)0)
 # define UFX_HEAP_TRACE_TRACER_X(name) (0)
 # define UFX_HEAP_TRACE_REPORT_X(name) ((void)0)
 # define UFX_HEAP_TRACE_ASSERT_NO_LEAKAGE_X(name) ((void)0)
+# define UFX_HEAP_TRACE_ENABLE_X(name) ((void)0)
+# define UFX_HEAP_TRACE_DISABLE_X(name) ((void)0)
+# define UFX_HEAP_TRACE_MUTE_X(name) ((void)0)
+# define UFX_HEAP_TRACE_UNMUTE_X(name) ((void)0)
 #endif
 
 #define UFX_HEAP_TRACE_NAME g_ufx_hta_context
 #define UFX_HEAP_TRACE_DECLARE() UFX_HEAP_TRACE_DECLARE_X(UFX_HEAP_TRACE_NAME)
 #define UFX_HEAP_TRACE_DEFINE() UFX_HEAP_TRACE_DEFINE_X(UFX_HEAP_TRACE_NAME)
 #define UFX_HEAP_TRACE_INIT() UFX_HEAP_TRACE_INIT_X(UFX_HEAP_TRACE_NAME)
+#define UFX_HEAP_TRACE_INIT_REPORTING(reporter, sink) UFX_HEAP_TRACE_INIT_REPORTING_X(UFX_HEAP_TRACE_NAME, reporter, sink)
 #define UFX_HEAP_TRACE_FINI() UFX_HEAP_TRACE_FINI_X(UFX_HEAP_TRACE_NAME)
 #define UFX_HEAP_TRACE_SCOPE(scope) UFX_HEAP_TRACE_SCOPE_X(UFX_HEAP_TRACE_NAME, scope)
 #define UFX_HEAP_TRACE_SCOPE_STR(var, scope) UFX_HEAP_TRACE_SCOPE_STR_X(UFX_HEAP_TRACE_NAME, var, scope)
@@ -153,11 +192,18 @@ UNFACT_NAMESPACE_EXTRAS_END
 #define UFX_HEAP_TRACE_PUSH_STR(scope) UFX_HEAP_TRACE_PUSH_STR_X(UFX_HEAP_TRACE_NAME, (scope))
 #define UFX_HEAP_TRACE_POP() UFX_HEAP_TRACE_POP_X(UFX_HEAP_TRACE_NAME)
 #define UFX_HEAP_TRACE_TICKET() UFX_HEAP_TRACE_TICKET_X(UFX_HEAP_TRACE_NAME)
+#define UFX_HEAP_TRACE_CAPTURE() UFX_HEAP_TRACE_CAPTURE_X(UFX_HEAP_TRACE_NAME)
+#define UFX_HEAP_TRACE_ADOPT(handoff) UFX_HEAP_TRACE_ADOPT_X(UFX_HEAP_TRACE_NAME, handoff)
+#define UFX_HEAP_TRACE_WRAP(function) UFX_HEAP_TRACE_WRAP_X(UFX_HEAP_TRACE_NAME, function)
 #define UFX_HEAP_TRACE_MALLOC(ptr, sz)  UFX_HEAP_TRACE_MALLOC_X(UFX_HEAP_TRACE_NAME, ptr, sz) 
 #define UFX_HEAP_TRACE_FREE(ptr) UFX_HEAP_TRACE_FREE_X(UFX_HEAP_TRACE_NAME, ptr) 
 #define UFX_HEAP_TRACE_TRACER() UFX_HEAP_TRACE_TRACER_X(UFX_HEAP_TRACE_NAME)
 #define UFX_HEAP_TRACE_REPORT() UFX_HEAP_TRACE_REPORT_X(UFX_HEAP_TRACE_NAME)
 #define UFX_HEAP_TRACE_ASSERT_NO_LEAKAGE() UFX_HEAP_TRACE_ASSERT_NO_LEAKAGE_X(UFX_HEAP_TRACE_NAME)
+#define UFX_HEAP_TRACE_ENABLE() UFX_HEAP_TRACE_ENABLE_X(UFX_HEAP_TRACE_NAME)
+#define UFX_HEAP_TRACE_DISABLE() UFX_HEAP_TRACE_DISABLE_X(UFX_HEAP_TRACE_NAME)
+#define UFX_HEAP_TRACE_MUTE() UFX_HEAP_TRACE_MUTE_X(UFX_HEAP_TRACE_NAME)
+#define UFX_HEAP_TRACE_UNMUTE() UFX_HEAP_TRACE_UNMUTE_X(UFX_HEAP_TRACE_NAME)
 
 #endif//UNFACT_EXTRAS_HEAP_TRACING_ANNOTATION_HPP
 
@@ -0,0 +1,453 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_EXTRAS_ONTREE_EXPORTER_HPP
+#define UNFACT_EXTRAS_ONTREE_EXPORTER_HPP
+
+#include <unfact/extras/base.hpp>
+#include <unfact/exporter.hpp>
+#include <ontree/writer.hpp>
+#include <string.h>
+#include <errno.h>
+#ifdef UNFACT_PLATFORM_WINDOWS
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+UNFACT_NAMESPACE_EXTRAS_BEGIN
+
+/*
+ * streams tracing_snapshot_t as nested JSON through ontree::writer_t:
+ *
+ *   {"name":"","self":{...},"total":{...},"children":[{"name":"a", ...}, ...]}
+ *
+ * same walk as export_json() in exporter.hpp, but numbers and escaping are ontree's,
+ * so the output reads back with ontree::build_tree(). we never build ontree::tree_t here:
+ * tokens go straight into the Output, and nothing is allocated per scope. see ontree_json_writer_t.
+ * the output has no depth limit. ontree::build_tree() reads it back up to reader_t::scope_depth_limit/2 levels.
+ *
+ * Output concept gives:
+ * - bool start(ontree::writer_t* w) : hands the first buffer to w.
+ * - bool make_room(ontree::writer_t* w) : called when the buffer runs short. grows or drains it.
+ * - bool finish(ontree::writer_t* w) : called after the last token.
+ * every one returns false on failure, then we stop and return false.
+ */
+
+/*
+ * Output growing a buffer with allocator_t. it starts on the caller's buffer, if any,
+ * and moves to the allocator only when the buffer runs short.
+ * the output is '\0' terminated after finish().
+ */
+class ontree_buffer_output_t
+{
+public:
+	enum { initial_size = 4096 };
+
+	explicit ontree_buffer_output_t(allocator_t* allocator, char* buf=0, size_t bufsize=0)
+		: m_allocator(allocator), m_head(buf), m_capacity(bufsize), m_size(0), m_owned(false) {}
+
+	~ontree_buffer_output_t()
+	{
+		if (m_owned) {
+			m_allocator->deallocate(reinterpret_cast<byte_t*>(m_head));
+		}
+	}
+
+	bool start(ontree::writer_t* w)
+	{
+		m_size = 0;
+		if (0 == m_capacity && !grow(initial_size)) {
+			return false;
+		}
+
+		w->set_buffer(m_head, m_capacity);
+		return true;
+	}
+
+	bool make_room(ontree::writer_t* w)
+	{
+		m_size = w->buffer().head() - m_head;
+		if (!grow(m_capacity*2)) {
+			return false;
+		}
+
+		w->set_buffer(m_head + m_size, m_capacity - m_size);
+		return true;
+	}
+
+	bool finish(ontree::writer_t* w)
+	{
+		m_size = w->buffer().head() - m_head;
+		if (m_size == m_capacity && !grow(m_capacity + 1)) {
+			return false;
+		}
+
+		m_head[m_size] = '\0';
+		return true;
+	}
+
+	const char* c_str() const { return m_head; }
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_capacity; }
+	/* false while we are still on the caller's buffer */
+	bool owned() const { return m_owned; }
+
+private:
+	ontree_buffer_output_t(const ontree_buffer_output_t&);
+	const ontree_buffer_output_t& operator=(const ontree_buffer_output_t&);
+
+	bool grow(size_t capacity)
+	{
+		char* head = reinterpret_cast<char*>(m_allocator->allocate(capacity));
+		UF_ALERT_AND_RETURN_UNLESS(head, false, "cannot grow the export buffer!");
+
+		if (0 < m_size) {
+			memcpy(head, m_head, m_size);
+		}
+
+		if (m_owned) {
+			m_allocator->deallocate(reinterpret_cast<byte_t*>(m_head));
+		}
+
+		m_head = head;
+		m_capacity = capacity;
+		m_owned = true;
+		return true;
+	}
+
+	allocator_t* m_allocator;
+	char* m_head;
+	size_t m_capacity;
+	size_t m_size;
+	bool m_owned;
+};
+
+/*
+ * Output draining a scratch buffer into the file descriptor.
+ * the scratch should be larger than the longest token, that is mostly a quoted scope name.
+ */
+class ontree_fd_output_t
+{
+public:
+	ontree_fd_output_t(int fd, char* scratch, size_t scratch_size)
+		: m_fd(fd), m_scratch(scratch), m_scratch_size(scratch_size), m_written(0) {}
+
+	bool start(ontree::writer_t* w)
+	{
+		w->set_buffer(m_scratch, m_scratch_size);
+		return true;
+	}
+
+	bool make_room(ontree::writer_t* w)
+	{
+		size_t pending = w->buffer().head() - m_scratch;
+		/* the token doesn't fit even in the empty scratch */
+		UF_ALERT_AND_RETURN_UNLESS(0 < pending, false, "export scratch is too small!");
+		return drain(w);
+	}
+
+	bool finish(ontree::writer_t* w) { return drain(w); }
+
+	/* bytes we gave to the fd so far */
+	size_t written() const { return m_written; }
+
+private:
+	bool drain(ontree::writer_t* w)
+	{
+		const char* p = m_scratch;
+		const char* end = w->buffer().head();
+		while (p < end) {
+#ifdef UNFACT_PLATFORM_WINDOWS
+			int n = ::_write(m_fd, p, static_cast<unsigned int>(end - p));
+#else
+			ssize_t n = ::write(m_fd, p, end - p);
+#endif
+			if (n < 0 && EINTR == errno) {
+				continue;
+			}
+
+			UF_ALERT_AND_RETURN_UNLESS(0 < n, false, "cannot write the export!");
+			p += n;
+			m_written += n;
+		}
+
+		w->set_buffer(m_scratch, m_scratch_size);
+		return true;
+	}
+
+	int m_fd;
+	char* m_scratch;
+	size_t m_scratch_size;
+	size_t m_written;
+};
+
+/*
+ * JsonWriter (see exporter.hpp) that writes tokens into the buffer of writer_t, that the Output hands over.
+ * we borrow writer_t for its buffer and its token writers (quoting, escaping and numbers),
+ * but not for its scope stack: the walk of export_json_tree() knows where commas and brackets go,
+ * so fixed fragments like ",\"total\":{" go in with one copy, and split over make_room() if needed.
+ * names, numbers and keys of fields are tokens: each one should fit in the empty buffer.
+ *
+ * keys of Value::visit_fields() come in the same order for every scope.
+ * we quote each of them once, and cache the result by the position.
+ */
+template<class Output>
+class ontree_json_writer_t
+{
+public:
+	enum { max_cached_keys = 16, max_cached_key_size = 32, max_integer_size = 24 };
+
+	explicit ontree_json_writer_t(Output* output)
+		: m_output(output), m_ok(output->start(&m_writer)), m_nfields(0)
+	{
+		load();
+		for (size_t i=0; i<max_cached_keys; ++i) { m_keys[i].m_name = 0; }
+	}
+
+	bool ok() const { return m_ok; }
+
+	bool raw(const char* str, size_t len)
+	{
+		/* fragments are short: a loop beats the call to memcpy() */
+		if (len <= size_t(m_end - m_cur)) {
+			for (size_t i=0; i<len; ++i) { m_cur[i] = str[i]; }
+			m_cur += len;
+			return m_ok;
+		}
+
+		while (m_ok && 0 < len) {
+			if (m_cur == m_end) {
+				make_room();
+				continue;
+			}
+
+			size_t n = len < size_t(m_end - m_cur) ? len : size_t(m_end - m_cur);
+			memcpy(m_cur, str, n);
+			m_cur += n;
+			str += n;
+			len -= n;
+		}
+
+		return m_ok;
+	}
+
+	template<size_t N>
+	bool raw(const char (&str)[N]) { return raw(str, N - 1); }
+
+	bool string(const char* str)
+	{
+		ontree::range_t to;
+		while (m_ok && settle(ontree::writer_t::write_string(ontree::range_t(m_cur, m_end - m_cur), &to, str))) {}
+		m_cur = to.head();
+		return m_ok;
+	}
+
+	/* integers skip writer_t: they are the most of the output */
+	bool value(unsigned long x) { return integer(x, false); }
+	bool value(unsigned int x) { return integer(x, false); }
+	bool value(long x) { return integer(x < 0 ? 0UL - static_cast<unsigned long>(x) : static_cast<unsigned long>(x), x < 0); }
+	bool value(int x) { return value(static_cast<long>(x)); }
+
+	bool value(ontree::real_t x)
+	{
+		ontree::range_t to;
+		while (m_ok && settle(ontree::writer_t::write_value_literal(ontree::range_t(m_cur, m_end - m_cur), &to, x))) {}
+		m_cur = to.head();
+		return m_ok;
+	}
+
+	bool finish()
+	{
+		store();
+		m_ok = m_ok && m_output->finish(&m_writer);
+		return m_ok;
+	}
+
+	/* give it before each visit_fields(): the first field has no comma */
+	void begin_fields() { m_nfields = 0; }
+
+	/* Value::visit_fields() visitor */
+	void operator()(const char* name, int x) { field(name) && value(x); }
+	void operator()(const char* name, unsigned int x) { field(name) && value(x); }
+	void operator()(const char* name, long x) { field(name) && value(x); }
+	void operator()(const char* name, unsigned long x) { field(name) && value(x); }
+	void operator()(const char* name, float x) { field(name) && value(static_cast<ontree::real_t>(x)); }
+	void operator()(const char* name, double x) { field(name) && value(static_cast<ontree::real_t>(x)); }
+
+private:
+	struct cached_key_t
+	{
+		const char* m_name;
+		size_t m_size;
+		char m_text[max_cached_key_size]; // ,"name":
+	};
+
+	/* writes the separator and the key */
+	bool field(const char* name)
+	{
+		size_t i = m_nfields++;
+		if (i < size_t(max_cached_keys)) {
+			cached_key_t& k = m_keys[i];
+			if (k.m_name == name || cache_key(&k, name)) {
+				/* the first field skips the comma */
+				return 0 == i ? raw(k.m_text + 1, k.m_size - 1) : raw(k.m_text, k.m_size);
+			}
+		}
+
+		return (0 == i || raw(",")) && string(name) && raw(":");
+	}
+
+	/* @return false if the key doesn't fit in the cache. keys with escapes never do */
+	static bool cache_key(cached_key_t* k, const char* name)
+	{
+		size_t len = 0;
+		while (ontree::writer_t::plain_char_p(name[len])) {
+			++len;
+		}
+
+		if ('\0' != name[len] || size_t(max_cached_key_size) < len + 4) {
+			return false;
+		}
+
+		k->m_text[0] = ',';
+		k->m_text[1] = '"';
+		memcpy(k->m_text + 2, name, len);
+		k->m_text[len + 2] = '"';
+		k->m_text[len + 3] = ':';
+		k->m_size = len + 4;
+		k->m_name = name;
+		return true;
+	}
+
+	/* two digits for each division */
+	bool integer(unsigned long magnitude, bool negative)
+	{
+		static const char pairs[] =
+			"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+			"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+			"8081828384858687888990919293949596979899";
+		char buf[max_integer_size];
+		char* p = buf + sizeof(buf);
+		while (100 <= magnitude) {
+			const char* d = pairs + (magnitude%100)*2;
+			magnitude /= 100;
+			*--p = d[1];
+			*--p = d[0];
+		}
+
+		if (10 <= magnitude) {
+			const char* d = pairs + magnitude*2;
+			*--p = d[1];
+			*--p = d[0];
+		} else {
+			*--p = static_cast<char>('0' + magnitude);
+		}
+
+		if (negative) {
+			*--p = '-';
+		}
+
+		return raw(p, buf + sizeof(buf) - p);
+	}
+
+	/* our cursor lives apart from writer_t while we write: sync them around the Output */
+	void load()
+	{
+		m_cur = m_writer.buffer().head();
+		m_end = m_cur + m_writer.buffer().size();
+	}
+
+	void store() { m_writer.set_buffer(m_cur, m_end - m_cur); }
+
+	void make_room()
+	{
+		store();
+		m_ok = m_output->make_room(&m_writer);
+		load();
+	}
+
+	/* @return true if we should retry */
+	bool settle(ontree::error_e err)
+	{
+		if (ontree::error_need_buffer == err) {
+			make_room();
+			return m_ok;
+		}
+
+		if (!ontree::is_ok(err)) {
+			UF_ALERT(("ontree writer failed!"));
+			m_ok = false;
+		}
+
+		return false;
+	}
+
+	ontree::writer_t m_writer;
+	Output* m_output;
+	bool m_ok;
+	char* m_cur;
+	char* m_end;
+	size_t m_nfields;
+	cached_key_t m_keys[max_cached_keys];
+};
+
+/*
+ * writes the subtree of 'root' (the whole tree by default) to the Output.
+ * the walk is export_json_tree(), shared with export_json().
+ */
+template<class Snapshot, class Output>
+inline bool export_ontree_json(const Snapshot& snapshot, Output& output, size_t root=Snapshot::npos)
+{
+	ontree_json_writer_t<Output> w(&output);
+	return export_json_tree(snapshot, w, root);
+}
+
+/*
+ * takes a snapshot of the tracer and streams it. the snapshot is the only allocation,
+ * flat arrays for all the scopes at once. see tracing_snapshot_t.
+ * @param Tracer tree_tracer_t, like accumulative_heap_tracer_t::tracer_type.
+ */
+template<class Tracer, class Output>
+inline bool export_tracer_ontree_json(const Tracer& tracer, allocator_t* allocator, Output& output)
+{
+	tracing_snapshot_t<Tracer> snapshot(allocator);
+	UF_ALERT_AND_RETURN_UNLESS(snapshot.take(tracer), false, "cannot take the tracing snapshot!");
+	return export_ontree_json(snapshot, output);
+}
+
+UNFACT_NAMESPACE_EXTRAS_END
+
+#endif//UNFACT_EXTRAS_ONTREE_EXPORTER_HPP
+
+/* -*-
+ Local Variables:
+ mode: c++
+ c-tab-always-indent: t
+ c-indent-level: 2
+ c-basic-offset: 2
+ tab-width: 2
+ End:
+ -*- */
@@ -35,9 +35,12 @@ UNFACT_NAMESPACE_EXTRAS_BEGIN
 #ifdef UNFACT_PLATFORM_WINDOWS
 template<size_t StorageID>
 struct default_thread_local_t { typedef windows_thread_local_t<StorageID> type; };
-#elif defined(UNFACT_PLATFORM_LINUX)
+#elif defined(UNFACT_PLATFORM_LINUX) && defined(UNFACT_USE_PTHREAD_KEY_THREAD_LOCAL)
 template<size_t StorageID>
 struct default_thread_local_t { typedef posix_thread_local_t<StorageID> type; };
+#elif defined(UNFACT_PLATFORM_LINUX)
+template<size_t StorageID>
+struct default_thread_local_t { typedef native_thread_local_t<StorageID> type; };
 #elif defined(UNFACT_PLATFORM_EXTERNAL)
 /* you should define default_thread_local_t somewhere */
 #else
@@ -27,6 +27,7 @@
 #define UNFACT_EXTRAS_TICK_TRACING_ANNOTATION_HPP
 
 #include <unfact/tick_tracer.hpp>
+#include <unfact/exemplar.hpp>
 #include <unfact/extras/base.hpp>
 #include <unfact/extras/tracing_chain.hpp>
 
@@ -46,19 +47,84 @@ public:
 	typedef tracing_chain_t<tracer_type, StorageID> chain_type;
 	typedef typename chain_type::scope_t scope_type;
 	typedef typename chain_type::disjoint_t disjoint_type;
+	typedef typename chain_type::handoff_t handoff_type;
+	typedef typename chain_type::adopt_scope_t adopt_scope_type;
 	typedef tick_scope_t<tracer_type> tick_scope_type;
 	typedef tick_scope_t<tracer_type, duration_while_tag_t> while_tick_scope_type;
   typedef tree_set_t<while_tick_scope_type> while_tick_scope_set_type;
 	typedef typename while_tick_scope_type::initializer_t while_tick_scope_initializer_type;
  
+	/* counting scopes measure nothing when the push is skipped. see tracing_chain_t */
+	static tracer_type* counting_tracer_of(chain_type* chain)
+	{
+		return (chain && chain->accounting_here()) ? chain->tracer() : 0;
+	}
+
+	/*
+	 * exemplars: breakdowns of slow invocations. see exemplar.hpp
+	 * the recorder lives on the stack of exemplar_scope_t, and the chain points it on each thread.
+	 * counting scopes inside record their timings there. disjoint ones go where they are entered,
+	 * and their subtrees under them, although the tree keeps them apart.
+	 */
+	typedef exemplar_t<typename tracer_type::trace_key_type, float> exemplar_type;
+	typedef exemplar_store_t<exemplar_type> exemplar_store_type;
+
+	/* scopes at depth 'm_base' of the tree are at 'm_shift' in the exemplar. see depth_in() */
+	struct recorder_t
+	{
+		exemplar_type m_exemplar;
+		size_t m_base;
+		size_t m_shift;
+
+		/* 0 for the scope above the base. scopes out of the chain go right under the exemplar */
+		size_t depth_in(size_t depth, bool above_is_zero) const
+		{
+			if (depth < m_base) {
+				return above_is_zero ? 0 : 1;
+			}
+
+			return m_shift + depth - m_base;
+		}
+	};
+
+	static recorder_t* recorder_of(chain_type* chain) { return reinterpret_cast<recorder_t*>(chain->recorder()); }
+
+	static void record_to(chain_type* chain, ticket_type here, float ms)
+	{
+		recorder_t* r = recorder_of(chain);
+		if (r) {
+			r->m_exemplar.record(chain->tracer()->name_of(here), r->depth_in(chain->tracer()->depth_of(here), false), ms);
+		}
+	}
+
 	class counting_scope_t : public scope_type
 	{
 	public:
 		counting_scope_t(chain_type* chain, const char* name)
-			: scope_type(chain, name), 
-				m_tick_scope(chain ? chain->tracer() : 0, chain ? chain->ticket() : 0) 
+			: scope_type(chain, name), m_chain(chain),
+				m_tick_scope(counting_tracer_of(chain), chain ? chain->ticket() : 0) 
 		{}
+
+		~counting_scope_t() { finish(); }
+
+		/* @return traced milliseconds, or 0 if nothing */
+		float finish()
+		{
+			if (!m_tick_scope.tracer()) {
+				return 0;
+			}
+
+			float ms = m_tick_scope.finish();
+			record_to(m_chain, m_tick_scope.here(), ms);
+			return ms;
+		}
+
+		chain_type* chain() const { return m_chain; }
+		ticket_type here() const { return m_tick_scope.here(); }
+		bool counting() const { return 0 != m_tick_scope.tracer(); }
+
 	private:
+		chain_type* m_chain;
 		tick_scope_type m_tick_scope;
 	};
 
@@ -66,15 +132,81 @@ public:
 	{
 	public:
 		counting_disjoint_t(chain_type* chain, const char* name)
-			: disjoint_type(chain, name), 
-				m_tick_scope(chain ? chain->tracer() : 0, chain ? chain->ticket() : 0)
-		{}
+			: disjoint_type(chain, name), m_chain(chain),
+				m_tick_scope(counting_tracer_of(chain), chain ? chain->ticket() : 0),
+				m_recorder(m_tick_scope.tracer() ? recorder_of(chain) : 0), m_outer_base(0), m_outer_shift(0)
+		{
+			/* our subtree goes under where we left the chain */
+			if (m_recorder) {
+				ticket_type last = this->last() ? this->last() : chain->root();
+				size_t entered = m_recorder->depth_in(chain->tracer()->depth_of(last), true) + 1;
+				m_outer_base = m_recorder->m_base;
+				m_outer_shift = m_recorder->m_shift;
+				m_recorder->m_base = chain->tracer()->depth_of(m_tick_scope.here());
+				m_recorder->m_shift = entered;
+			}
+		}
+
+		~counting_disjoint_t()
+		{
+			if (m_tick_scope.tracer()) {
+				record_to(m_chain, m_tick_scope.here(), m_tick_scope.finish());
+			}
+
+			if (m_recorder) {
+				m_recorder->m_base = m_outer_base;
+				m_recorder->m_shift = m_outer_shift;
+			}
+		}
+
 	private:
+		chain_type* m_chain;
 		tick_scope_type m_tick_scope;
+		recorder_t* m_recorder;
+		size_t m_outer_base;
+		size_t m_outer_shift;
+	};
+
+	/*
+	 * counting scope that records the breakdown of its invocation, and offers it to 'store'.
+	 * invocations that the store doesn't want just leave the buffer on the stack.
+	 * nested exemplar scopes keep their own breakdowns: the outer one sees them as single entries.
+	 */
+	class exemplar_scope_t : public counting_scope_t
+	{
+	public:
+		exemplar_scope_t(chain_type* chain, const char* name, exemplar_store_type* store)
+			: counting_scope_t(chain, name), m_store(store), m_outer(0)
+		{
+			if (m_store && this->counting()) {
+				m_outer = chain->recorder();
+				/* our children are at 1 */
+				m_recorder.m_base = chain->tracer()->depth_of(this->here()) + 1;
+				m_recorder.m_shift = 1;
+				chain->set_recorder(reinterpret_cast<byte_t*>(&m_recorder));
+			} else {
+				m_store = 0;
+			}
+		}
+
+		~exemplar_scope_t()
+		{
+			if (m_store) {
+				this->chain()->set_recorder(m_outer);
+				m_recorder.m_exemplar.set_total(this->finish());
+				m_store->offer(m_recorder.m_exemplar);
+			}
+		}
+
+	private:
+		exemplar_store_type* m_store;
+		byte_t* m_outer;
+		recorder_t m_recorder;
 	};
 
 	typedef counting_scope_t counting_scope_type;
 	typedef counting_disjoint_t counting_disjoint_type;
+	typedef exemplar_scope_t exemplar_scope_type;
 
 	tick_tracing_annotation_t()
 		: m_tracer(&m_allocator), m_chain(&m_tracer),	m_countings(&m_allocator) {}
@@ -116,6 +248,23 @@ report_tick_tracing_annotation(const tick_tracing_annotation_t<StorageID, Alloca
 	}
 }
 
+/* slowest exemplars first, then recent ones over the threshold */
+template<class Store>
+inline void report_tick_exemplars(const Store& store)
+{
+	typedef typename Store::exemplar_type exemplar_type;
+	exemplar_type copied[Store::slowest_capacity + Store::recent_capacity];
+	size_t n = store.copy_slowest(copied, Store::slowest_capacity);
+	n += store.copy_recent(copied + n, Store::recent_capacity);
+
+	char buf[256];
+	for (size_t i=0; i<n; ++i) {
+		for (exemplar_formatter_t<exemplar_type> f(&copied[i], buf, 256); !f.atend(); f.increment()) {
+			UF_TRACE((buf));
+		}
+	}
+}
+
 typedef tick_tracing_annotation_t<thead_local_id_tick_tracing_annotation,
 																	backdoor_allocator_t> 
         default_tick_tracing_annotation_type;
@@ -125,21 +274,33 @@ typedef default_tick_tracing_annotation_type::counting_scope_type
         default_tick_tracing_annotation_counting_scope_t;
 typedef default_tick_tracing_annotation_type::counting_disjoint_type
         default_tick_tracing_annotation_counting_disjoint_t;
+typedef default_tick_tracing_annotation_type::exemplar_scope_type
+        default_tick_tracing_annotation_exemplar_scope_t;
+typedef default_tick_tracing_annotation_type::exemplar_store_type
+        default_tick_tracing_annotation_exemplar_store_t;
 typedef default_tick_tracing_annotation_type::scope_type
         default_tick_tracing_annotation_scope_t;
 typedef default_tick_tracing_annotation_type::disjoint_type
         default_tick_tracing_annotation_disjoint_t;
+typedef default_tick_tracing_annotation_type::handoff_type
+        default_tick_tracing_annotation_handoff_t;
+typedef default_tick_tracing_annotation_type::adopt_scope_type
+        default_tick_tracing_annotation_adopt_scope_t;
 
 UNFACT_NAMESPACE_EXTRAS_END
 
 #ifndef UFX_USE_NO_TICK_TRACE
 # define UFX_TICK_TRACE_DEFINE_X(name) unfact::extras::default_tick_tracing_annotation_context_t name
 # define UFX_TICK_TRACE_INIT_X(name) name.init()
+# define UFX_TICK_TRACE_INIT_REPORTING_X(name, reporter, sink) name.init(reporter, sink)
+# define UFX_TICK_TRACE_INIT_RESETTING_X(name, reporter, sink) name.init(reporter, sink, unfact::interval_reset_tag_t())
 # define UFX_TICK_TRACE_FINI_X(name) name.fini()
 # define UFX_TICK_TRACE_SCOPE_COUNT_X(name, scope) unfact::extras::default_tick_tracing_annotation_counting_scope_t ufx_hta_scope_##scope(UFX_TICK_TRACE_CHAIN_X(name), #scope)
 # define UFX_TICK_TRACE_SCOPE_COUNT_STR_X(name, var, scope) unfact::extras::default_tick_tracing_annotation_counting_scope_t ufx_hta_scope_##var(UFX_TICK_TRACE_CHAIN_X(name), scope)
 # define UFX_TICK_TRACE_DISJOIN_COUNT_STR_X(name, var, scope) unfact::extras::default_tick_tracing_annotation_counting_disjoint_t ufx_hta_disjoin_##var(UFX_TICK_TRACE_CHAIN_X(name), scope)
 # define UFX_TICK_TRACE_DISJOIN_COUNT_X(name, scope) unfact::extras::default_tick_tracing_annotation_counting_disjoint_t ufx_hta_disjoin_##scope(UFX_TICK_TRACE_CHAIN_X(name), #scope)
+# define UFX_TICK_TRACE_SCOPE_EXEMPLAR_X(name, scope, store) unfact::extras::default_tick_tracing_annotation_exemplar_scope_t ufx_hta_scope_##scope(UFX_TICK_TRACE_CHAIN_X(name), #scope, &(store))
+# define UFX_TICK_TRACE_REPORT_EXEMPLARS_X(name, store) if (name.good()) report_tick_exemplars(store)
 # define UFX_TICK_TRACE_SCOPE_X(name, scope) unfact::extras::default_tick_tracing_annotation_scope_t ufx_hta_scope_##scope(UFX_TICK_TRACE_CHAIN_X(name), #scope)
 # define UFX_TICK_TRACE_SCOPE_STR_X(name, var, scope) unfact::extras::default_tick_tracing_annotation_scope_t ufx_hta_scope_##var(UFX_TICK_TRACE_CHAIN_X(name), scope)
 # define UFX_TICK_TRACE_DISJOIN_STR_X(name, var, scope) unfact::extras::default_tick_tracing_annotation_disjoint_t ufx_hta_disjoin_##var(UFX_TICK_TRACE_CHAIN_X(name), scope)
@@ -150,20 +311,31 @@ UNFACT_NAMESPACE_EXTRAS_END
 # define UFX_TICK_TRACE_CLEAR_X(name) if (name.good()) name->clear()
 # define UFX_TICK_TRACE_CLEAR_HERE_X(name) if (name.good()) name->clear_here()
 # define UFX_TICK_TRACE_TICKET_X(name) (name.good() ? name->chain().ticket() : 0)
+# define UFX_TICK_TRACE_CAPTURE_X(name) (name.good() ? name->chain().capture() : unfact::extras::default_tick_tracing_annotation_handoff_t())
+# define UFX_TICK_TRACE_ADOPT_X(name, handoff) unfact::extras::default_tick_tracing_annotation_adopt_scope_t ufx_hta_adopt_tick(UFX_TICK_TRACE_CHAIN_X(name), handoff)
+# define UFX_TICK_TRACE_WRAP_X(name, function) unfact::extras::adopting(UFX_TICK_TRACE_CHAIN_X(name), function)
 # define UFX_TICK_TRACE_TRACER_X(name) name.self
 # define UFX_TICK_TRACE_CHAIN_X(name) (name.good() ? &(name->chain()) : 0)
 # define UFX_TICK_TRACE_START_X(name)  if (name.good()) name->start_counting()
 # define UFX_TICK_TRACE_STOP_X(name) if (name.good()) name->stop_counting()
 # define UFX_TICK_TRACE_DECLARE_X(name) extern unfact::extras::default_tick_tracing_annotation_context_t name
 # define UFX_TICK_TRACE_REPORT_X(name) if (name.good()) report_tick_tracing_annotation(*(name.self))
+# define UFX_TICK_TRACE_ENABLE_X(name) if (name.good()) name->chain().enable()
+# define UFX_TICK_TRACE_DISABLE_X(name) if (name.good()) name->chain().disable()
+# define UFX_TICK_TRACE_MUTE_X(name) if (name.good()) name->chain().mute()
+# define UFX_TICK_TRACE_UNMUTE_X(name) if (name.good()) name->chain().unmute()
 #else
 # define UFX_TICK_TRACE_DEFINE_X(name) ((void)0)
 # define UFX_TICK_TRACE_INIT_X(name) ((void)0)
+# define UFX_TICK_TRACE_INIT_REPORTING_X(name, reporter, sink) ((void)0)
+# define UFX_TICK_TRACE_INIT_RESETTING_X(name, reporter, sink) ((void)0)
 # define UFX_TICK_TRACE_FINI_X(name) ((void)0)
 # define UFX_TICK_TRACE_SCOPE_COUNT_X(name, scope) ((void)0)
 # define UFX_TICK_TRACE_SCOPE_COUNT_STR_X(name, var, scope) ((void)0)
 # define UFX_TICK_TRACE_DISJOIN_COUNT_STR_X(name, var, scope) ((void)0)
 # define UFX_TICK_TRACE_DISJOIN_COUNT_X(name, scope) ((void)0)
+# define UFX_TICK_TRACE_SCOPE_EXEMPLAR_X(name, scope, store) ((void)0)
+# define UFX_TICK_TRACE_REPORT_EXEMPLARS_X(name, store) ((void)0)
 # define UFX_TICK_TRACE_SCOPE_X(name, scope) ((void)0)
 # define UFX_TICK_TRACE_SCOPE_STR_X(name, var, scope) ((void)0)
 # define UFX_TICK_TRACE_DISJOIN_STR_X(name, var, scope) ((void)0)
@@ -174,23 +346,34 @@ UNFACT_NAMESPACE_EXTRAS_END
 # define UFX_TICK_TRACE_CLEAR_X(name) ((void)0)
 # define UFX_TICK_TRACE_CLEAR_HERE_X(name) ((void)0)
 # define UFX_TICK_TRACE_TICKET_X(name) (0)
+# define UFX_TICK_TRACE_CAPTURE_X(name) (unfact::extras::default_tick_tracing_annotation_handoff_t())
+# define UFX_TICK_TRACE_ADOPT_X(name, handoff) ((void)0)
+# define UFX_TICK_TRACE_WRAP_X(name, function) (function)
 # define UFX_TICK_TRACE_TRACER_X(name) (0)
 # define UFX_TICK_TRACE_CHAIN_X(name) (0)
 # define UFX_TICK_TRACE_START_X(name)  ((void)0)
 # define UFX_TICK_TRACE_STOP_X(name) ((void)0)
 # define UFX_TICK_TRACE_DECLARE_X(name) ((void)0)
 # define UFX_TICK_TRACE_REPORT_X(name) ((void)0)
+# define UFX_TICK_TRACE_ENABLE_X(name) ((void)0)
+# define UFX_TICK_TRACE_DISABLE_X(name) ((void)0)
+# define UFX_TICK_TRACE_MUTE_X(name) ((void)0)
+# define UFX_TICK_TRACE_UNMUTE_X(name) ((void)0)
 #endif
 
 #define UFX_TICK_TRACE_NAME g_ufx_tta_context
 #define UFX_TICK_TRACE_DECLARE() UFX_TICK_TRACE_DECLARE_X(UFX_TICK_TRACE_NAME)
 #define UFX_TICK_TRACE_DEFINE() UFX_TICK_TRACE_DEFINE_X(UFX_TICK_TRACE_NAME)
 #define UFX_TICK_TRACE_INIT() UFX_TICK_TRACE_INIT_X(UFX_TICK_TRACE_NAME)
+#define UFX_TICK_TRACE_INIT_REPORTING(reporter, sink) UFX_TICK_TRACE_INIT_REPORTING_X(UFX_TICK_TRACE_NAME, reporter, sink)
+#define UFX_TICK_TRACE_INIT_RESETTING(reporter, sink) UFX_TICK_TRACE_INIT_RESETTING_X(UFX_TICK_TRACE_NAME, reporter, sink)
 #define UFX_TICK_TRACE_FINI() UFX_TICK_TRACE_FINI_X(UFX_TICK_TRACE_NAME)
 #define UFX_TICK_TRACE_SCOPE_COUNT(scope) UFX_TICK_TRACE_SCOPE_COUNT_X(UFX_TICK_TRACE_NAME, scope)
 #define UFX_TICK_TRACE_SCOPE_COUNT_STR(var, scope) UFX_TICK_TRACE_SCOPE_COUNT_STR_X(UFX_TICK_TRACE_NAME, var, scope)
 #define UFX_TICK_TRACE_DISJOIN_COUNT(disjoin) UFX_TICK_TRACE_DISJOIN_COUNT_X(UFX_TICK_TRACE_NAME, disjoin)
 #define UFX_TICK_TRACE_DISJOIN_COUNT_STR(var, disjoin) UFX_TICK_TRACE_DISJOIN_COUNT_STR_X(UFX_TICK_TRACE_NAME, var, disjoin)
+#define UFX_TICK_TRACE_SCOPE_EXEMPLAR(scope, store) UFX_TICK_TRACE_SCOPE_EXEMPLAR_X(UFX_TICK_TRACE_NAME, scope, store)
+#define UFX_TICK_TRACE_REPORT_EXEMPLARS(store) UFX_TICK_TRACE_REPORT_EXEMPLARS_X(UFX_TICK_TRACE_NAME, store)
 #define UFX_TICK_TRACE_SCOPE(scope) UFX_TICK_TRACE_SCOPE_X(UFX_TICK_TRACE_NAME, scope)
 #define UFX_TICK_TRACE_SCOPE_STR(var, scope) UFX_TICK_TRACE_SCOPE_STR_X(UFX_TICK_TRACE_NAME, var, scope)
 #define UFX_TICK_TRACE_DISJOIN(disjoin) UFX_TICK_TRACE_DISJOIN_X(UFX_TICK_TRACE_NAME, disjoin)
@@ -201,10 +384,17 @@ UNFACT_NAMESPACE_EXTRAS_END
 #define UFX_TICK_TRACE_CLEAR() UFX_TICK_TRACE_CLEAR_X(UFX_TICK_TRACE_NAME)
 #define UFX_TICK_TRACE_CLEAR_HERE() UFX_TICK_TRACE_CLEAR_HERE_X(UFX_TICK_TRACE_NAME)
 #define UFX_TICK_TRACE_TICKET() UFX_TICK_TRACE_TICKET_X(UFX_TICK_TRACE_NAME)
+#define UFX_TICK_TRACE_CAPTURE() UFX_TICK_TRACE_CAPTURE_X(UFX_TICK_TRACE_NAME)
+#define UFX_TICK_TRACE_ADOPT(handoff) UFX_TICK_TRACE_ADOPT_X(UFX_TICK_TRACE_NAME, handoff)
+#define UFX_TICK_TRACE_WRAP(function) UFX_TICK_TRACE_WRAP_X(UFX_TICK_TRACE_NAME, function)
 #define UFX_TICK_TRACE_TRACER() UFX_TICK_TRACE_TRACER_X(UFX_TICK_TRACE_NAME)
 #define UFX_TICK_TRACE_START() UFX_TICK_TRACE_START_X(UFX_TICK_TRACE_NAME)
 #define UFX_TICK_TRACE_STOP() UFX_TICK_TRACE_STOP_X(UFX_TICK_TRACE_NAME)
 #define UFX_TICK_TRACE_REPORT() UFX_TICK_TRACE_REPORT_X(UFX_TICK_TRACE_NAME)
+#define UFX_TICK_TRACE_ENABLE() UFX_TICK_TRACE_ENABLE_X(UFX_TICK_TRACE_NAME)
+#define UFX_TICK_TRACE_DISABLE() UFX_TICK_TRACE_DISABLE_X(UFX_TICK_TRACE_NAME)
+#define UFX_TICK_TRACE_MUTE() UFX_TICK_TRACE_MUTE_X(UFX_TICK_TRACE_NAME)
+#define UFX_TICK_TRACE_UNMUTE() UFX_TICK_TRACE_UNMUTE_X(UFX_TICK_TRACE_NAME)
 
 #endif//UNFACT_EXTRAS_TICK_TRACING_ANNOTATION_HPP
 
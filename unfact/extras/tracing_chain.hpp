@@ -28,6 +28,7 @@
 
 #include <unfact/extras/base.hpp>
 #include <unfact/extras/thread_local.hpp>
+#include <unfact/interval.hpp>
 
 UNFACT_NAMESPACE_EXTRAS_BEGIN
 
@@ -42,6 +43,25 @@ UNFACT_NAMESPACE_EXTRAS_BEGIN
  * Stack top is kept in thread local storage. So tracing_chain is thread-safe 
  * as the ticket container (set_tree) is.
  * 
+ * runtime controls:
+ * - enable()/disable() is the global switch, checked with one plain load.
+ * - mute()/unmute() work only on the calling thread.
+ * - set_max_depth() bounds the depth of scopes. 0 means unbounded.
+ * - mute_scope() mutes the scope and its descendants (see tree_tracer_t::set_muted())
+ * push() under disabled or muted thread, beyond the max depth or into a muted scope is skipped:
+ * we just count it for matching pop(), and the stack top stays on the last traced scope.
+ * annotations ask accounting() before they trace anything.
+ *
+ * handoff to other threads (thread pools, work-stealing executors):
+ * capture() takes the stack top when a task is enqueued, and adopt_scope_t makes it the top
+ * of the worker while the task runs. that costs two thread local writes per task.
+ * the handoff pins its scope under the node budget, so it outlives the capturing scope.
+ * then each copy of the handoff costs one atomic add on the pin word of the scope, and so does its destruction.
+ * mute() and skipped pushes stay with each thread: they are not handed off.
+ * see also adopting_t for wrapping callables.
+ *
+ * besides 'StorageID', we use 'StorageID + thead_local_ids' for per-thread state,
+ * and 'StorageID + 2*thead_local_ids' for the recorder of exemplars (see tick_tracing_annotation_t).
  */
 template<class Tracer, size_t StorageID>
 class tracing_chain_t
@@ -51,6 +71,11 @@ public:
 	typedef tracing_chain_t self_type;
 	typedef typename Tracer::ticket_type ticket_type;
 	typedef typename default_thread_local_t<StorageID>::type thread_local_type;
+	typedef typename default_thread_local_t<StorageID + thead_local_ids>::type state_local_type;
+	typedef typename default_thread_local_t<StorageID + 2*thead_local_ids>::type recorder_local_type;
+
+	/* per-thread state is a word: (skipped pushes)*state_skip_unit | state_muted */
+	enum { state_muted = 0x1, state_skip_unit = 0x2 };
 
 	class scope_t
 	{
@@ -68,17 +93,80 @@ public:
 	{
 	public:
 		disjoint_t(self_type* self, const char* name)
-			: m_self(self), m_last(self ? self->disjoin(name) : 0) {}
-		~disjoint_t() { if (m_self) { m_self->set_top(m_last); } }
+			: m_self(self), m_pushed(false), m_last(self ? self->disjoin(name, &m_pushed) : 0) {}
+		~disjoint_t() { if (m_self) { m_self->rejoin(m_last, m_pushed); } }
+		/* where we left the chain, that we go back at the end */
+		ticket_type last() const { return m_last; }
 	private:
 		disjoint_t(const disjoint_t& that);
 		const disjoint_t& operator=(const disjoint_t& that);
+	private:
+		self_type* m_self;
+		bool m_pushed;
+		ticket_type m_last;
+	};
+
+	/* copyable value: keep it in the task. the null one adopts the root */
+	class handoff_t
+	{
+	public:
+		handoff_t() : m_self(0), m_top(0), m_pinned(false) {}
+		handoff_t(self_type* self, ticket_type top) : m_self(self), m_top(top), m_pinned(false) { pin(); }
+		handoff_t(const handoff_t& that) : m_self(that.m_self), m_top(that.m_top), m_pinned(false) { pin(); }
+		~handoff_t() { unpin(); }
+
+		const handoff_t& operator=(const handoff_t& that)
+		{
+			if (this != &that) {
+				unpin();
+				m_self = that.m_self;
+				m_top = that.m_top;
+				pin();
+			}
+
+			return *this;
+		}
+
+		self_type* chain() const { return m_self; }
+		/* 0 for the root, like top() */
+		ticket_type top() const { return m_top; }
+		bool good() const { return 0 != m_self; }
+
+		/* whether we hold a pin on top(). only under the node budget */
+		bool pinned() const { return m_pinned; }
+
+	private:
+		void pin() { m_pinned = (m_self && m_top && m_self->tracer()->pin(m_top)); }
+
+		void unpin()
+		{
+			if (m_pinned) {
+				m_self->tracer()->unpin(m_top);
+				m_pinned = false;
+			}
+		}
+
+	private:
+		self_type* m_self;
+		ticket_type m_top;
+		bool m_pinned;
+	};
+
+	class adopt_scope_t
+	{
+	public:
+		adopt_scope_t(self_type* self, const handoff_t& handoff)
+			: m_self(self), m_last(self ? self->adopt(handoff) : 0) {}
+		~adopt_scope_t() { if (m_self) { m_self->set_top(m_last); } }
+	private:
+		adopt_scope_t(const adopt_scope_t& that);
+		const adopt_scope_t& operator=(const adopt_scope_t& that);
 	private:
 		self_type* m_self;
 		ticket_type m_last;
 	};
 
-	tracing_chain_t(tracer_type* tracer) : m_tracer(tracer) {}
+	tracing_chain_t(tracer_type* tracer) : m_tracer(tracer), m_enabled(1), m_max_depth(0) {}
 
 	ticket_type top() const
 	{
@@ -109,18 +197,24 @@ public:
 
 	void push(const char* scope)
 	{
-		ticket_type last = top();
-		ticket_type t = 0;
-		if (last) {
-			t = m_tracer->push(last, scope);
-		} else {
-			t = m_tracer->push(m_tracer->root(), scope);
+		size_t s = state();
+		ticket_type here = ticket();
+		if (skipping(s, here)) {
+			set_state(s + state_skip_unit);
+			return;
 		}
-		set_top(t);
+
+		set_top(m_tracer->push(here, scope));
 	}
 
 	void pop()
 	{
+		size_t s = state();
+		if (state_skip_unit <= s) {
+			set_state(s - state_skip_unit);
+			return;
+		}
+
 		ticket_type last = top();
 		ticket_type t = m_tracer->pop(last);
 		if (t == m_tracer->root()) {
@@ -130,11 +224,43 @@ public:
 		}
 	}
 
-	ticket_type disjoin(const char* scope)
+	/*
+	 * @param pushed tells whether we pushed the scope or not. give it to rejoin().
+	 */
+	ticket_type disjoin(const char* scope, bool* pushed=0)
 	{
 		ticket_type last = top();
+		if (0 != state() || !enabled()) {
+			return last;
+		}
+
 		ticket_type t = m_tracer->push(m_tracer->root(), scope);
 		set_top(t);
+		if (pushed) {
+			*pushed = true;
+		}
+
+		return last;
+	}
+
+	/* pops the disjoined scope (it unpins the scope under the node budget), and restores 'last' */
+	void rejoin(ticket_type last, bool pushed)
+	{
+		if (pushed) {
+			m_tracer->pop(top());
+		}
+
+		set_top(last);
+	}
+
+	handoff_t capture() { return handoff_t(this, top()); }
+
+	/* makes the captured top ours. @return the last top, to give set_top() back */
+	ticket_type adopt(const handoff_t& handoff)
+	{
+		ticket_type last = top();
+		UF_HONOR_OR_RETURN(!handoff.good() || handoff.chain() == this, last);
+		set_top(handoff.top());
 		return last;
 	}
 
@@ -142,9 +268,126 @@ public:
 
 	tracer_type* tracer() const { return m_tracer; }
 
+	void enable() { m_enabled = 1; }
+	void disable() { m_enabled = 0; }
+	bool enabled() const { return 0 != m_enabled; }
+
+	void mute() { set_state(state() | state_muted); }
+	void unmute() { set_state(state() & ~size_t(state_muted)); }
+	bool muted() const { return 0 != (state() & state_muted); }
+
+	void set_max_depth(size_t depth) { m_max_depth = depth; }
+	size_t max_depth() const { return m_max_depth; }
+
+	void mute_scope(ticket_type t) { m_tracer->set_muted(t, true); }
+	void unmute_scope(ticket_type t) { m_tracer->set_muted(t, false); }
+
+	/* should we trace allocations, ticks, etc. on ticket()? */
+	bool accounting() const { return enabled() && !muted() && !m_tracer->muted(ticket()); }
+
+	/* accounting(), and the innermost push is on the tree. for scopes that measure themselves. */
+	bool accounting_here() const { return state() < state_skip_unit && accounting(); }
+
+	/* opaque per-thread recorder. annotations give it its meaning */
+	byte_t* recorder() const { return m_recorder.get(); }
+	void set_recorder(byte_t* recorder) { m_recorder.set(recorder); }
+
+private:
+	size_t state() const { return reinterpret_cast<size_t>(m_state.get()); }
+	void set_state(size_t s) { m_state.set(reinterpret_cast<typename state_local_type::value_type>(s)); }
+
+	bool skipping(size_t s, ticket_type here) const
+	{
+		return (0 != s || !enabled() || 
+						(0 != m_max_depth && m_max_depth <= m_tracer->depth_of(here)) || 
+						m_tracer->muted(here));
+	}
+
 private:
 	thread_local_type m_local;
+	state_local_type m_state;
+	recorder_local_type m_recorder;
 	tracer_type* m_tracer;	
+	volatile int m_enabled;
+	size_t m_max_depth;
+};
+
+/*
+ * wraps a callable to run under the handoff captured at the construction.
+ * for executors taking function objects. see adopting()
+ */
+template<class Chain, class Function>
+class adopting_t
+{
+public:
+	typedef Chain chain_type;
+	typedef Function function_type;
+	typedef typename chain_type::handoff_t handoff_type;
+	typedef typename chain_type::adopt_scope_t adopt_scope_type;
+
+	adopting_t(chain_type* chain, const function_type& function)
+		: m_handoff(chain ? chain->capture() : handoff_type()), m_function(function) {}
+
+	void operator()()
+	{
+		adopt_scope_type s(m_handoff.chain(), m_handoff);
+		m_function();
+	}
+
+	template<class Arg>
+	void operator()(Arg& arg)
+	{
+		adopt_scope_type s(m_handoff.chain(), m_handoff);
+		m_function(arg);
+	}
+
+	const handoff_type& handoff() const { return m_handoff; }
+	function_type& function() { return m_function; }
+
+private:
+	handoff_type m_handoff;
+	function_type m_function;
+};
+
+template<class Chain, class Function>
+inline adopting_t<Chain, Function> adopting(Chain* chain, const Function& function)
+{
+	return adopting_t<Chain, Function>(chain, function);
+}
+
+/*
+ * the same for C-style executors taking void (*)(void*) and its argument:
+ *
+ *   adopting_call_t<chain_type> call(chain, work, arg);
+ *   pool_submit(&adopting_call_t<chain_type>::run, &call);
+ *
+ * 'call' should live until the task runs.
+ */
+template<class Chain>
+class adopting_call_t
+{
+public:
+	typedef Chain chain_type;
+	typedef void (*function_type)(void*);
+	typedef typename chain_type::handoff_t handoff_type;
+	typedef typename chain_type::adopt_scope_t adopt_scope_type;
+
+	adopting_call_t(chain_type* chain, function_type function, void* arg)
+		: m_handoff(chain ? chain->capture() : handoff_type()), m_function(function), m_arg(arg) {}
+
+	static void run(void* self)
+	{
+		adopting_call_t* call = reinterpret_cast<adopting_call_t*>(self);
+		adopt_scope_type s(call->m_handoff.chain(), call->m_handoff);
+		call->m_function(call->m_arg);
+	}
+
+	const handoff_type& handoff() const { return m_handoff; }
+
+private:
+	handoff_type m_handoff;
+	function_type m_function;
+	void* m_arg;
 };
 
 
@@ -159,7 +402,15 @@ struct tracing_annotation_context_t
 	typedef Annotation annotation_type;
 	typedef typename annotation_type::chain_type chain_type;
 
-	enum { size = sizeof(annotation_type) };
+	/* what init() builds on 'bytes'. 'reporter' lives here, so that { 0, {0} } still initializes us */
+	struct body_t
+	{
+		body_t() : reporter(0) {}
+		annotation_type annotation;
+		interval_reporter_base_t* reporter;
+	};
+
+	enum { size = sizeof(body_t) };
 
 	/*
 	 * intentionally leave ctor and detor undefined to make class POD.
@@ -176,16 +427,40 @@ struct tracing_annotation_context_t
 	void init()
 	{
 		UF_ASSERT(!this->self);
-		this->self = new (bytes) annotation_type();
+		this->self = &(new (bytes) body_t())->annotation;
+	}
+
+	/*
+	 * also attaches our tracer to 'reporter', like reporter_thread_t, until fini().
+	 * give interval_reset_tag_t as 'reset' to clear the tracer on each interval.
+	 * the reporter may go first: it forgets us then. see reporter_thread_t::attach()
+	 */
+	template<class Reporter, class Sink>
+	void init(Reporter* reporter, Sink* sink) { init(reporter, sink, interval_keep_tag_t()); }
+
+	template<class Reporter, class Sink, class Reset>
+	void init(Reporter* reporter, Sink* sink, const Reset& reset)
+	{
+		init();
+		if (reporter->attach(&(this->self->tracer()), sink, reset, &(body()->reporter))) {
+			body()->reporter = reporter;
+		}
 	}
 
 	void fini()
 	{
-		this->self->~annotation_type();
+		if (body()->reporter) {
+			body()->reporter->detach(&(this->self->tracer()));
+		}
+
+		body()->~body_t();
 		this->self = 0; // for safe.
 	}
 
 	bool good() const { return 0 != this->self; }
+	/* the reporter we are attached to, or 0 */
+	interval_reporter_base_t* reporter() const { return good() ? body()->reporter : 0; }
+	body_t* body() const { return reinterpret_cast<body_t*>(const_cast<byte_t*>(bytes)); }
 
 	annotation_type* operator->() { return self; }
 	const annotation_type* operator->() const { return self; }
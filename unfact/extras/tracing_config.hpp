@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_EXTRAS_TRACING_CONFIG_HPP
+#define UNFACT_EXTRAS_TRACING_CONFIG_HPP
+
+#include <unfact/extras/base.hpp>
+#include <ontree/ontree.hpp>
+#include <stdio.h>
+#include <string.h>
+
+UNFACT_NAMESPACE_EXTRAS_BEGIN
+
+/*
+ * configure tracing_chain_t runtime controls from JSON like:
+ *
+ *   { "enabled": true, "max_depth": 16, "muted": ["render.text", "idle"] }
+ *
+ * every member is optional. "muted" names scopes by dot-separated path from the root,
+ * as formatters print them. named scopes are created if they are not there yet.
+ * this header depends on ontree, so it is not included from annotations.
+ */
+template<class Chain>
+inline typename Chain::ticket_type ensure_tracing_path(Chain* chain, const char* path)
+{
+	typedef typename Chain::ticket_type ticket_type;
+
+	char name[256];
+	ticket_type here = chain->root();
+	while (*path) {
+		size_t len = 0;
+		while (path[len] && '.' != path[len]) {
+			len++;
+		}
+
+		size_t copied = min_of(len, sizeof(name) - 1);
+		memcpy(name, path, copied);
+		name[copied] = '\0';
+		here = chain->tracer()->push(here, name);
+		path += (path[len] ? len + 1 : len);
+	}
+
+	return here;
+}
+
+/*
+ * @return false if json is broken. members of wrong type are just ignored.
+ */
+template<class Chain>
+inline bool configure_tracing(Chain* chain, const char* json)
+{
+	ontree::tree_t tree;
+	ontree::error_e err = ontree::build_tree(&tree, json);
+	UF_ALERT_AND_RETURN_UNLESS(ontree::is_ok(err), false, "tracing config is ill-formed!");
+
+	ontree::var_t root = tree.root();
+	if (ontree::type_object != root.type()) {
+		UF_ALERT(("tracing config should be an object!"));
+		return false;
+	}
+
+	ontree::var_t enabled = root["enabled"];
+	if (ontree::type_predicate == enabled.type()) {
+		if (enabled.to_p()) {
+			chain->enable();
+		} else {
+			chain->disable();
+		}
+	}
+
+	ontree::var_t max_depth = root["max_depth"];
+	if (max_depth.number_p()) {
+		chain->set_max_depth(max_depth.to_size());
+	}
+
+	ontree::var_t muted = root["muted"];
+	if (ontree::type_array == muted.type() && 0 < muted.size()) {
+		for (ontree::var_t i = muted.first(); i.defined(); ++i) {
+			if (i.string_p()) {
+				chain->mute_scope(ensure_tracing_path(chain, i.c_str()));
+			}
+		}
+	}
+
+	return true;
+}
+
+template<class Chain>
+inline bool configure_tracing_from_file(Chain* chain, const char* filename, allocator_t* allocator)
+{
+	FILE* file = fopen(filename, "rb");
+	UF_ALERT_AND_RETURN_UNLESS(file, false, "cannot open tracing config!");
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size < 0) {
+		fclose(file);
+		UF_ALERT(("cannot read tracing config!"));
+		return false;
+	}
+
+	char* buf = reinterpret_cast<char*>(allocator->allocate(size + 1));
+	if (!buf) {
+		fclose(file);
+		UF_ALERT_AND_RETURN_UNLESS(buf, false, "failed to allocate memory for tracing config!");
+	}
+
+	size_t read = fread(buf, 1, size, file);
+	fclose(file);
+	buf[read] = '\0';
+
+	bool ok = configure_tracing(chain, buf);
+	allocator->deallocate(reinterpret_cast<byte_t*>(buf));
+	return ok;
+}
+
+UNFACT_NAMESPACE_EXTRAS_END
+
+#endif//UNFACT_EXTRAS_TRACING_CONFIG_HPP
+
+/* -*-
+ Local Variables:
+ mode: c++
+ c-tab-always-indent: t
+ c-indent-level: 2
+ c-basic-offset: 2
+ tab-width: 2
+ End:
+ -*- */
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_HASH_INDEX_HPP
+#define UNFACT_HASH_INDEX_HPP
+
+#include <unfact/base.hpp>
+#include <unfact/memory.hpp>
+#include <unfact/static_string.hpp>
+#include <unfact/keyed_value.hpp>
+#include <string.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * hash_t is a functor that computes hash value of the key.
+ * we give only a few specializations that unfact itself needs.
+ * you can add your own for your key type.
+ */
+template<class Key>
+struct hash_t;
+
+/* FNV-1a: simple, and good enough for short names like scope names */
+template<class Char>
+inline size_t hash_string(const Char* str)
+{
+	size_t h = static_cast<size_t>(2166136261u);
+	for (const Char* p = str; *p; ++p) {
+		h ^= static_cast<size_t>(*p);
+		h *= static_cast<size_t>(16777619u);
+	}
+
+	return h;
+}
+
+template<class Char, size_t Capacity>
+struct hash_t< basic_static_string_t<Char, Capacity> >
+{
+	size_t operator()(const basic_static_string_t<Char, Capacity>& x) const { return hash_string(x.c_str()); }
+};
+
+template<class K, class V>
+struct hash_t< keyed_value_t<K, V> >
+{
+	size_t operator()(const keyed_value_t<K, V>& x) const { return hash_t<K>()(x.key()); }
+	size_t operator()(const K& k) const { return hash_t<K>()(k); }
+};
+
+template<>
+struct hash_t<int>
+{
+	size_t operator()(int x) const { return static_cast<size_t>(x)*static_cast<size_t>(2654435761u); }
+};
+
+/*
+ * hash_index_t is an open-addressing hash table of node pointers.
+ * it is designed as a secondary index over an ordered container like tree_set_skeleton_t:
+ * the container keeps the order for iteration, and the index makes the lookup a probe.
+ *
+ * each entry keeps precomputed hash of the node, so we compare keys only when hashes matched.
+ * whole table (header and entries) is a single memory block from allocator_t.
+ *
+ * thread-safety:
+ * hash_index_t is NOT thread-safe. the owner should protect it with the container lock.
+ */
+template<class Node>
+class hash_index_t
+{
+public:
+	typedef Node node_type;
+	typedef hash_index_t self_type;
+
+	enum { min_capacity = 16 };
+
+	struct entry_t
+	{
+		size_t     m_hash;
+		node_type* m_node;
+	};
+
+	/*
+	 * @param capacity should be power of 2
+	 */
+	static self_type* create(allocator_t* allocator, size_t capacity)
+	{
+		size_t cap = max_of(capacity, to_size(min_capacity));
+		byte_t* mem = allocator->allocate(sizeof(self_type) + sizeof(entry_t)*cap);
+		UF_ALERT_AND_RETURN_UNLESS(mem, 0, "failed to allocate memory for hash index!");
+		self_type* ret = new (mem) self_type(cap);
+		memset(ret->entries(), 0, sizeof(entry_t)*cap);
+		return ret;
+	}
+
+	static void destroy(allocator_t* allocator, self_type* index)
+	{
+		if (index) {
+			index->~self_type();
+			allocator->deallocate(reinterpret_cast<byte_t*>(index));
+		}
+	}
+
+	/* power of 2 capacity which holds 'n' entries under load factor 1/2 */
+	static size_t capacity_for(size_t n)
+	{
+		size_t cap = min_capacity;
+		while (cap < n*2) { cap *= 2; }
+		return cap;
+	}
+
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_capacity; }
+
+	template<class FindKey, class Comparator>
+	node_type* find(size_t hash, const FindKey& key, const Comparator& compare) const
+	{
+		size_t mask = m_capacity - 1;
+		for (size_t i = hash & mask; /* */; i = (i + 1) & mask) {
+			const entry_t& e = entries()[i];
+			if (0 == e.m_node) {
+				return 0;
+			}
+
+			if (e.m_node != tombstone() && e.m_hash == hash &&
+					!compare(key, e.m_node->key()) && !compare(e.m_node->key(), key)) {
+				return e.m_node;
+			}
+		}
+	}
+
+	/*
+	 * @return false if the table has no room. caller should grow() it then retry.
+	 */
+	bool insert(size_t hash, node_type* node)
+	{
+		if (m_capacity*3 <= (m_size + m_ntombs + 1)*4) {
+			return false;
+		}
+
+		size_t mask = m_capacity - 1;
+		size_t i = hash & mask;
+		while (0 != entries()[i].m_node && tombstone() != entries()[i].m_node) {
+			i = (i + 1) & mask;
+		}
+
+		if (tombstone() == entries()[i].m_node) {
+			m_ntombs--;
+		}
+
+		entries()[i].m_hash = hash;
+		entries()[i].m_node = node;
+		m_size++;
+		return true;
+	}
+
+	void remove(size_t hash, const node_type* node)
+	{
+		size_t mask = m_capacity - 1;
+		for (size_t i = hash & mask; 0 != entries()[i].m_node; i = (i + 1) & mask) {
+			if (entries()[i].m_node == node) {
+				entries()[i].m_node = tombstone();
+				m_size--;
+				m_ntombs++;
+				return;
+			}
+		}
+	}
+
+	/*
+	 * make a larger (or tombstone-free) copy of this index.
+	 * the caller is responsible to destroy old one.
+	 */
+	self_type* grow(allocator_t* allocator) const
+	{
+		/* keep load factor under 1/2 after rebuilding */
+		self_type* ret = create(allocator, max_of(m_capacity, capacity_for(m_size + 1)));
+		if (!ret) {
+			return 0;
+		}
+
+		for (size_t i=0; i<m_capacity; ++i) {
+			const entry_t& e = entries()[i];
+			if (0 != e.m_node && tombstone() != e.m_node) {
+				ret->insert(e.m_hash, e.m_node);
+			}
+		}
+
+		return ret;
+	}
+
+	static node_type* tombstone() { return reinterpret_cast<node_type*>(~size_t(0)); }
+
+	/*
+	 * the owner can chain its indices into a list, to destroy them at once 
+	 * without visiting nodes (see set_tree_t::reset().) the list is guarded by the owner.
+	 */
+	void link_to(self_type** head)
+	{
+		m_prev = 0;
+		m_next = *head;
+		if (m_next) { m_next->m_prev = this; }
+		*head = this;
+	}
+
+	void unlink_from(self_type** head)
+	{
+		if (m_prev) { 
+			m_prev->m_next = m_next; 
+		} else if (*head == this) { 
+			*head = m_next; 
+		}
+
+		if (m_next) { m_next->m_prev = m_prev; }
+		m_prev = m_next = 0;
+	}
+
+private:
+	explicit hash_index_t(size_t capacity) : m_capacity(capacity), m_size(0), m_ntombs(0), m_prev(0), m_next(0) {}
+	hash_index_t(const hash_index_t&);
+	const hash_index_t& operator=(const hash_index_t&);
+
+	entry_t* entries() { return reinterpret_cast<entry_t*>(this + 1); }
+	const entry_t* entries() const { return reinterpret_cast<const entry_t*>(this + 1); }
+
+private:
+	size_t m_capacity;
+	size_t m_size;
+	size_t m_ntombs;
+	self_type* m_prev;
+	self_type* m_next;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_HASH_INDEX_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
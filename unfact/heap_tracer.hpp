@@ -75,11 +75,18 @@ public:
   typedef tree_set_t<heap_set_node_type, less_t<heap_set_node_type>, concurrent_type> heap_set_type;
   typedef typename heap_set_type::const_iterator heap_iterator;
 
+	/*
+	 * @param heap_allocator for the heap set, that no one reads but us. 'allocator' if 0.
+	 */
   heap_tracer_t(allocator_t* allocator, 
 								size_t tracing_page_size=DEFAULT_PAGE_SIZE,
-								size_t heap_page_size=DEFAULT_PAGE_SIZE)
+								size_t heap_page_size=DEFAULT_PAGE_SIZE,
+								allocator_t* heap_allocator=0)
 		: m_tracer(allocator, tracing_page_size), 
-			m_heaps(allocator, heap_page_size),
+			/* heap set can grow and shrink a lot. we give its pages back after the spike. */
+			m_heaps(heap_allocator ? heap_allocator : allocator, heap_page_size, less_t<heap_set_node_type>(),
+							typename basic_arena_t<concurrent_type>::option_e(basic_arena_t<concurrent_type>::option_default|
+																												basic_arena_t<concurrent_type>::option_reclaim_pages)),
 			m_size(0)
   {}
 
@@ -97,13 +104,24 @@ public:
 
 		raise_size(size);
 
-		scalar_lock_scope_t<typename tracer_type::iterator, synchronized_t> l(tracer_type::to_iterator(here));
-		m_tracer.at(here).trace_raised(size);
+		{
+			typename tracer_type::write_section_type w;
+			{
+				scalar_lock_scope_t<typename tracer_type::iterator, synchronized_t> l(tracer_type::to_iterator(here));
+				m_tracer.at(here).trace_raised(size);
+			}
+
+			m_tracer.advance_aggregate(here, size);
+		}
 
 		return ptr;
   }
 
-  void trace_deallocated(byte_t* ptr)
+	/*
+	 * @param must_be_traced false if the caller may have skipped trace_allocated() for some blocks
+	 * @return false if 'ptr' is not traced
+	 */
+  bool trace_deallocated(byte_t* ptr, bool must_be_traced=true)
   {
 		/*
 		 * It may appear t that find() following remove() has a race at first glance.
@@ -111,14 +129,30 @@ public:
 		 * and should never be deleted simultaneously.
 		 */
 		heap_iterator hi = m_heaps.find(ptr);
-		UF_HONOR_OR_RETURN_VOID(hi != m_heaps.end());
+		if (!must_be_traced && hi == m_heaps.end()) {
+			return false;
+		}
+
+		UF_HONOR_OR_RETURN(hi != m_heaps.end(), false);
 		heap_node_t h = hi->value();
 		m_heaps.remove(hi);
+		if (!h.ticket()) {
+			return true; // inherited. see restart()
+		}
 
 		fall_size(h.size());
 
-		scalar_lock_scope_t<typename tracer_type::iterator, synchronized_t> l(tracer_type::to_iterator(h.ticket()));
-		m_tracer.at(h.ticket()).trace_fallen(h.size());
+		{
+			typename tracer_type::write_section_type w;
+			{
+				scalar_lock_scope_t<typename tracer_type::iterator, synchronized_t> l(tracer_type::to_iterator(h.ticket()));
+				m_tracer.at(h.ticket()).trace_fallen(h.size());
+			}
+
+			m_tracer.advance_aggregate(h.ticket(), size_t(0) - h.size());
+		}
+
+		return true;
   }
 
   size_t size() const { return m_size; }
@@ -127,6 +161,17 @@ public:
   ticket_type parent(ticket_type here) const { return m_tracer.parent(here); }
   ticket_type push(ticket_type ticket, const trace_key_type& key) { return m_tracer.push(ticket, key); }
   ticket_type pop(ticket_type ticket) { return m_tracer.pop(ticket); }
+  bool pin(ticket_type ticket) { return m_tracer.pin(ticket); }
+  void unpin(ticket_type ticket) { m_tracer.unpin(ticket); }
+  size_t depth_of(ticket_type ticket) const { return m_tracer.depth_of(ticket); }
+  bool muted(ticket_type ticket) const { return m_tracer.muted(ticket); }
+  void set_muted(ticket_type ticket, bool muted) { m_tracer.set_muted(ticket, muted); }
+  void set_node_budget(size_t budget) { m_tracer.set_node_budget(budget); }
+  /* keeps live bytes of each subtree. see accumulation_count() */
+  void set_aggregating(bool aggregating) { m_tracer.set_aggregating(aggregating); }
+  size_t aggregate_of(ticket_type ticket) const { return m_tracer.aggregate_of(ticket); }
+  size_t evict(size_t limit=size_t(-1)) { return m_tracer.evict(no_live_block_t(), limit); }
+  size_t trim() { return m_tracer.trim(no_live_block_t()); }
   const trace_key_type& name_of(ticket_type ticket) const { return m_tracer.name_of(ticket); }
   const trace_value_type& at(ticket_type ticket) const { return m_tracer.at(ticket); }
   /* NOTE: we does not provide mutable at(). the data structure is read-only for outsiders. */
@@ -134,7 +179,33 @@ public:
 	void acquire() const { m_heaps.acquire(); }
 	void release() const { m_heaps.release(); }
 
+	/* every lock we have, for fork(). see fork_guard_t */
+	void acquire_all() const { m_tracer.acquire_all(); m_heaps.acquire_all(); }
+	void release_all() const { m_heaps.release_all(); m_tracer.release_all(); }
+
+	/*
+	 * starts counting from zero, keeping scopes. for a child process after fork().
+	 * living blocks are kept as inherited ones: freeing them is not traced, 
+	 * so the parent alone accounts them. no one should be tracing.
+	 */
+	void restart()
+	{
+		for (typename heap_set_type::iterator i=m_heaps.begin(); i!=m_heaps.end(); ++i) {
+			i->set_value(heap_node_t(0, 0));
+		}
+
+		m_tracer.fill(trace_value_type());
+		m_tracer.clear_aggregates();
+		m_size = 0;
+	}
+
 public: // implementation detail
+	/* heap nodes keep tickets of the scope where the blocks are allocated. such scopes should stay. */
+	struct no_live_block_t
+	{
+		bool operator()(const trace_value_type& v) const { return 0 == v.final(); }
+	};
+
 	void raise_size(size_t sz) { lock_scope_t<self_type, synchronized_t> l(this); m_size += sz; }
 	void fall_size(size_t sz) {  lock_scope_t<self_type, synchronized_t> l(this); m_size -= sz; }
 
@@ -149,7 +220,11 @@ private:
  */
 typedef delta_accumulation_t<size_t, int> heap_accumulation_t;
 typedef heap_tracer_t<heap_accumulation_t, default_concurrent_t> accumulative_heap_tracer_t;
+/* readable out of the process. see live_tracer_t */
+typedef heap_tracer_t<heap_accumulation_t, optimistic_concurrent_t<default_concurrent_t> > live_heap_tracer_t;
 typedef accumulation_formatter_t<accumulative_heap_tracer_t::tracer_type> accumulative_heap_tracing_formatter_t;
+typedef tracing_snapshot_t<accumulative_heap_tracer_t::tracer_type> accumulative_heap_snapshot_t;
+typedef accumulation_snapshot_formatter_t<accumulative_heap_snapshot_t> accumulative_heap_snapshot_formatter_t;
 
 UNFACT_NAMESPACE_END
 
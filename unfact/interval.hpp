@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_INTERVAL_HPP
+#define UNFACT_INTERVAL_HPP
+
+#include <unfact/snapshot.hpp>
+#include <unfact/exporter.hpp>
+#include <unfact/hash_index.hpp>
+#include <stdio.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * interval_tracker_t turns lifetime totals of the tracer into time-series:
+ * each take() copies the tree (see tracing_snapshot_t::take()), and report() gives
+ * what every scope gained since the previous take(), matching scopes by their paths.
+ *
+ * Value should have since(const Value& earlier), that gives the trace between two.
+ * if the tracer was reset right after take(), like sticky_tracer_t::fill(), call forget():
+ * the interval after that starts from zero, not from the snapshot.
+ *
+ * IntervalSink concept gives:
+ * - bool begin(size_t sequence, double seconds) : at the start of each report.
+ * - bool scope(const char* path, const Value& delta, double seconds) : for each scope that moved.
+ * - bool end() : at the end of each report.
+ * false stops the report.
+ *
+ * thread safety:
+ * take() is thread safe against the tracer. the tracker itself is NOT thread safe.
+ *
+ * @param Tracer tree_tracer_t
+ */
+template<class Tracer>
+class interval_tracker_t
+{
+public:
+	typedef Tracer tracer_type;
+	typedef interval_tracker_t self_type;
+	typedef tracing_snapshot_t<tracer_type> snapshot_type;
+	typedef typename snapshot_type::key_type key_type;
+	typedef typename snapshot_type::value_type value_type;
+
+	enum { npos = snapshot_type::npos };
+
+	explicit interval_tracker_t(allocator_t* allocator)
+		: m_allocator(allocator), m_a(allocator), m_b(allocator), m_current(&m_a), m_previous(&m_b),
+			m_taken(false), m_based(false), m_forgotten(false), m_sequence(0),
+			m_matches(0), m_match_capacity(0), m_slots(0), m_slot_capacity(0) {}
+	~interval_tracker_t()
+	{
+		m_allocator->deallocate(reinterpret_cast<byte_t*>(m_matches));
+		m_allocator->deallocate(reinterpret_cast<byte_t*>(m_slots));
+	}
+
+	/* @return false if we couldn't copy the tree. then the last snapshot stays as it is. */
+	bool take(const tracer_type& tracer)
+	{
+		swap_of(m_current, m_previous);
+		if (!m_current->take(tracer)) {
+			swap_of(m_current, m_previous);
+			return false;
+		}
+
+		m_based = m_taken && !m_forgotten;
+		m_taken = true;
+		m_forgotten = false;
+		return true;
+	}
+
+	/* the tracer restarted after the last take() */
+	void forget() { m_forgotten = true; }
+
+	const snapshot_type& current() const { return *m_current; }
+	size_t sequence() const { return m_sequence; }
+
+	/*
+	 * reports the interval between last two take()s to 'sink'. scopes that didn't move are skipped.
+	 * @param seconds the length of the interval, that the sink would use to compute rates.
+	 * @return false if the sink stopped us, or we have nothing taken.
+	 */
+	template<class Sink>
+	bool report(double seconds, Sink& sink)
+	{
+		if (!m_taken || !match()) {
+			return false;
+		}
+
+		if (!sink.begin(m_sequence++, seconds)) {
+			return false;
+		}
+
+		char path[export_line_size];
+		const snapshot_type& now = *m_current;
+		for (size_t i=0; i<now.size(); ++i) {
+			value_type delta = (npos == m_matches[i]) ? now.value_of(i) : now.value_of(i).since(m_previous->value_of(m_matches[i]));
+			if (!moved(delta)) {
+				continue;
+			}
+
+			size_t written = 0;
+			now.format_name(i, path, export_line_size, &written);
+			if (0 == written) {
+				strcpy(path, "(root)");
+			}
+
+			if (!sink.scope(path, delta, seconds)) {
+				return false;
+			}
+		}
+
+		return sink.end();
+	}
+
+public: // implementation detail
+	struct moved_t
+	{
+		moved_t() : m_moved(false) {}
+
+		template<class Number>
+		void operator()(const char*, Number x) { m_moved = m_moved || (Number(0) != x); }
+
+		bool m_moved;
+	};
+
+	static bool moved(const value_type& v)
+	{
+		moved_t m;
+		v.visit_fields(m);
+		return m.m_moved;
+	}
+
+	static size_t hash_of(size_t parent, const key_type& name)
+	{
+		return hash_t<key_type>()(name) ^ (parent*static_cast<size_t>(2654435761u));
+	}
+
+	/*
+	 * m_matches[i] gets the index of current scope i in the previous snapshot, or npos.
+	 * the previous snapshot is hashed by (parent index, name), then we look scopes up from the root:
+	 * in post-order, parents come after children, so we go backward.
+	 */
+	bool match()
+	{
+		const snapshot_type& now = *m_current;
+		const snapshot_type& then = *m_previous;
+		if (!reserve(&m_matches, &m_match_capacity, now.size())) {
+			return false;
+		}
+
+		if (!m_based || then.empty()) {
+			for (size_t i=0; i<now.size(); ++i) { m_matches[i] = npos; }
+			return true;
+		}
+
+		size_t cap = hash_index_t<void>::capacity_for(then.size());
+		if (!reserve(&m_slots, &m_slot_capacity, cap)) {
+			return false;
+		}
+
+		/* slots keep index+1, so 0 is empty */
+		size_t mask = cap - 1;
+		for (size_t i=0; i<cap; ++i) { m_slots[i] = 0; }
+		for (size_t i=0; i<then.size(); ++i) {
+			size_t s = hash_of(then.parent_of(i), then.name_of(i)) & mask;
+			while (0 != m_slots[s]) { s = (s + 1) & mask; }
+			m_slots[s] = i + 1;
+		}
+
+		for (size_t n=now.size(); 0 < n; --n) {
+			size_t i = n - 1;
+			size_t parent = now.parent_of(i);
+			if (npos == parent) {
+				m_matches[i] = (i == now.root() && now.name_of(i) == then.name_of(then.root())) ? then.root() : size_t(npos);
+				continue;
+			}
+
+			m_matches[i] = npos;
+			size_t p = m_matches[parent];
+			if (npos == p) {
+				continue;
+			}
+
+			for (size_t s = hash_of(p, now.name_of(i)) & mask; 0 != m_slots[s]; s = (s + 1) & mask) {
+				size_t j = m_slots[s] - 1;
+				if (then.parent_of(j) == p && then.name_of(j) == now.name_of(i)) {
+					m_matches[i] = j;
+					break;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool reserve(size_t** arr, size_t* capacity, size_t n)
+	{
+		if (n <= *capacity) {
+			return true;
+		}
+
+		m_allocator->deallocate(reinterpret_cast<byte_t*>(*arr));
+		*capacity = 0;
+		*arr = reinterpret_cast<size_t*>(m_allocator->allocate(sizeof(size_t)*(n + n/2)));
+		UF_ALERT_AND_RETURN_UNLESS(*arr, false, "failed to allocate memory for interval tracker!");
+		*capacity = n + n/2;
+		return true;
+	}
+
+	static void swap_of(snapshot_type*& x, snapshot_type*& y)
+	{
+		snapshot_type* t = x;
+		x = y;
+		y = t;
+	}
+
+private:
+	interval_tracker_t(const interval_tracker_t&);
+	const interval_tracker_t& operator=(const interval_tracker_t&);
+
+private:
+	allocator_t* m_allocator;
+	snapshot_type m_a;
+	snapshot_type m_b;
+	snapshot_type* m_current;
+	snapshot_type* m_previous;
+	bool m_taken;
+	bool m_based;
+	bool m_forgotten;
+	size_t m_sequence;
+	size_t* m_matches;
+	size_t m_match_capacity;
+	size_t* m_slots;
+	size_t m_slot_capacity;
+};
+
+/*
+ * Visitor for Value::visit_fields(): writes " name=delta name/s=rate" pairs.
+ */
+class interval_fields_writer_t
+{
+public:
+	interval_fields_writer_t(FILE* file, double seconds) : m_file(file), m_seconds(seconds), m_ok(true) {}
+
+	template<class Number>
+	void operator()(const char* name, Number x)
+	{
+		char buf[64];
+		format_json_number(buf, sizeof(buf), x);
+		double rate = (0 < m_seconds) ? static_cast<double>(x)/m_seconds : 0;
+		m_ok = m_ok && (0 <= fprintf(m_file, " %s=%s %s/s=%g", name, buf, name, rate));
+	}
+
+	bool ok() const { return m_ok; }
+
+private:
+	FILE* m_file;
+	double m_seconds;
+	bool m_ok;
+};
+
+/*
+ * IntervalSink that appends lines to a text file like:
+ *
+ *   #3 1.000s
+ *   #3 render.text final=1024 final/s=1024 raised=4096 raised/s=4096 ...
+ *
+ * the file is rotated when it grows over 'max_bytes': "path" goes "path.1", "path.1" goes "path.2", 
+ * and so on, keeping 'max_files' old ones. no rotation for 0 'max_bytes'.
+ */
+class interval_file_sink_t
+{
+public:
+	enum { path_size = 1024 };
+
+	interval_file_sink_t(const char* path, size_t max_bytes=0, size_t max_files=1)
+		: m_file(0), m_max_bytes(max_bytes), m_max_files(max_files), m_sequence(0)
+	{
+		string_ops_t<char>::copy(m_path, path_size, path);
+	}
+
+	~interval_file_sink_t() { close(); }
+
+	const char* path() const { return m_path; }
+
+	void close()
+	{
+		if (m_file) {
+			fclose(m_file);
+			m_file = 0;
+		}
+	}
+
+	bool begin(size_t sequence, double seconds)
+	{
+		if (m_file && 0 < m_max_bytes && m_max_bytes <= size_t(ftell(m_file))) {
+			rotate();
+		}
+
+		if (!m_file) {
+			m_file = fopen(m_path, "a");
+			UF_ALERT_AND_RETURN_UNLESS(m_file, false, "cannot open interval report file!");
+		}
+
+		m_sequence = sequence;
+		return 0 <= fprintf(m_file, "#%lu %.3fs\n", static_cast<unsigned long>(sequence), seconds);
+	}
+
+	template<class Value>
+	bool scope(const char* path, const Value& delta, double seconds)
+	{
+		interval_fields_writer_t writer(m_file, seconds);
+		if (fprintf(m_file, "#%lu %s", static_cast<unsigned long>(m_sequence), path) < 0) {
+			return false;
+		}
+
+		delta.visit_fields(writer);
+		return writer.ok() && 0 <= fprintf(m_file, "\n");
+	}
+
+	bool end() { return 0 == fflush(m_file); }
+
+	void rotate()
+	{
+		close();
+
+		char from[path_size + 32];
+		char to[path_size + 32];
+		for (size_t k=m_max_files; 0 < k; --k) {
+			snprintf(to, sizeof(to), "%s.%lu", m_path, static_cast<unsigned long>(k));
+			if (1 < k) {
+				snprintf(from, sizeof(from), "%s.%lu", m_path, static_cast<unsigned long>(k - 1));
+			} else {
+				snprintf(from, sizeof(from), "%s", m_path);
+			}
+
+			rename(from, to);
+		}
+
+		/* no old ones to keep */
+		if (0 == m_max_files) {
+			remove(m_path);
+		}
+	}
+
+private:
+	interval_file_sink_t(const interval_file_sink_t&);
+	const interval_file_sink_t& operator=(const interval_file_sink_t&);
+
+private:
+	char m_path[path_size];
+	FILE* m_file;
+	size_t m_max_bytes;
+	size_t m_max_files;
+	size_t m_sequence;
+};
+
+/* tags for interval_job_t: reset the tracer right after each take(), or keep it going */
+struct interval_reset_tag_t {};
+struct interval_keep_tag_t {};
+
+class interval_reporter_base_t;
+
+/*
+ * the job of the reporter, that reports one tracer in intervals. see reporter_thread_t.
+ */
+class interval_job_base_t
+{
+public:
+	explicit interval_job_base_t(const void* tracer) : m_next(0), m_stamp(0), m_link(0), m_tracer(tracer) {}
+	virtual ~interval_job_base_t() {}
+
+	/* takes the base of the first interval */
+	virtual bool prime() = 0;
+	/* @param seconds since the last run() or prime() */
+	virtual bool run(double seconds) = 0;
+
+	const void* tracer() const { return m_tracer; }
+
+public: // implementation detail
+	interval_job_base_t* m_next;
+	/* when the last interval ended, on the reporter clock */
+	double m_stamp;
+	/* the attacher's pointer to the reporter, that goes 0 when the job is gone. see tracing_annotation_context_t */
+	interval_reporter_base_t** m_link;
+
+private:
+	const void* m_tracer;
+};
+
+/*
+ * @param Tracer heap_tracer_t or sticky_tracer_t, that have tracer() of tree_tracer_t.
+ *               for interval_reset_tag_t, it should have fill() too.
+ * @param Sink IntervalSink
+ */
+template<class Tracer, class Sink, class Reset=interval_keep_tag_t>
+class interval_job_t : public interval_job_base_t
+{
+public:
+	typedef Tracer tracer_type;
+	typedef Sink sink_type;
+	typedef interval_tracker_t<typename tracer_type::tracer_type> tracker_type;
+
+	interval_job_t(tracer_type* tracer, sink_type* sink, allocator_t* allocator)
+		: interval_job_base_t(tracer), m_tracer(tracer), m_sink(sink), m_tracker(allocator) {}
+
+	virtual bool prime()
+	{
+		if (!m_tracker.take(m_tracer->tracer())) {
+			return false;
+		}
+
+		reset(Reset());
+		return true;
+	}
+
+	virtual bool run(double seconds)
+	{
+		if (!m_tracker.take(m_tracer->tracer())) {
+			return false;
+		}
+
+		/* right after the copy: samples between these two go nowhere, but it's a short moment */
+		reset(Reset());
+		return m_tracker.report(seconds, *m_sink);
+	}
+
+	const tracker_type& tracker() const { return m_tracker; }
+
+private:
+	void reset(const interval_keep_tag_t&) {}
+
+	void reset(const interval_reset_tag_t&)
+	{
+		m_tracer->fill();
+		m_tracker.forget();
+	}
+
+private:
+	tracer_type* m_tracer;
+	sink_type* m_sink;
+	tracker_type m_tracker;
+};
+
+/*
+ * what tracing_annotation_context_t knows about reporters: it detaches its tracer at fini().
+ */
+class interval_reporter_base_t
+{
+public:
+	virtual ~interval_reporter_base_t() {}
+	virtual bool detach(const void* tracer) = 0;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_INTERVAL_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
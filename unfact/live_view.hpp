@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_LIVE_VIEW_HPP
+#define UNFACT_LIVE_VIEW_HPP
+
+#include <unfact/tree_tracer.hpp>
+#include <string.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * live region: a tracer placed on shared memory with a header in front,
+ * so that other processes can read it while it runs. see live_tracer_t for the writer side.
+ *
+ *   header | live_header_t
+ *   rest   | the tracer object and its arena pages
+ *
+ * nodes keep raw pointers of the writer. readers map the region at another address,
+ * so they rebase each link by its distance from m_base, and reject ones out of the region.
+ * the writer never moves the region, so it is as good as offsets, and the tracer is untouched.
+ *
+ * readers never lock anything nor write to the region:
+ * - the tracer should be on optimistic_concurrent_t. then its arena keeps pages (removed nodes stay readable),
+ *   children sets bump their counter on each change, and nodes bump theirs while they are locked.
+ * - children of a scope are copied out together, and kept only if the counter of the set stays.
+ *   each of them is copied under its node counter. torn copies are retried a few times, then skipped.
+ * - the header is published by m_magic, after the root is there.
+ *
+ * readers should be built with the same tracer type. m_node_size and m_schema catch a mismatch.
+ */
+enum {
+	live_version = 1,
+	live_schema_size = 128
+};
+
+struct live_header_t
+{
+	char   m_magic[8];  // "UFLIVE\r\n"
+	size_t m_version;
+	size_t m_header_size;
+	size_t m_node_size;
+	size_t m_value_size;
+	size_t m_base;      // address of the region in the writer
+	size_t m_size;      // size of the whole region
+	size_t m_root;      // address of the root node in the writer
+	size_t m_pid;
+	char   m_schema[live_schema_size]; // field names of the value, separated by ','
+
+	static const char* magic() { return "UFLIVE\r\n"; }
+};
+
+/* Value::visit_fields() visitor: joins field names */
+class live_schema_t
+{
+public:
+	live_schema_t(char* buf, size_t size) : m_buf(buf), m_size(size), m_used(0) { m_buf[0] = '\0'; }
+
+	template<class T>
+	void operator()(const char* name, T)
+	{
+		if (0 < m_used) { append(","); }
+		append(name);
+	}
+
+	template<class Value>
+	static void make(char* buf, size_t size)
+	{
+		live_schema_t schema(buf, size);
+		Value().visit_fields(schema);
+	}
+
+private:
+	void append(const char* str)
+	{
+		for (; *str && m_used + 1 < m_size; ++str) {
+			m_buf[m_used++] = *str;
+		}
+
+		m_buf[m_used] = '\0';
+	}
+
+	char* m_buf;
+	size_t m_size;
+	size_t m_used;
+};
+
+/*
+ * live_tracer_view_t reads a live region mapped read-only, without disturbing the writer.
+ * see live_header_t for how it stays consistent.
+ *
+ * @param Tracer tree_tracer_t on optimistic_concurrent_t, like live_heap_tracer_t::tracer_type
+ */
+template<class Tracer>
+class live_tracer_view_t
+{
+public:
+	typedef Tracer tracer_type;
+	typedef typename tracer_type::value_type value_type;
+	typedef typename tracer_type::concurrent_type concurrent_type;
+	typedef typename tracer_type::tree_type::node_type node_type;
+	typedef seqlock_ops_t<concurrent_type> seqlock_type;
+	typedef live_tracer_view_t self_type;
+
+	enum {
+		key_size = tracer_type::key_size,
+		max_node_retries = 64,
+		max_set_retries = 8
+	};
+
+	/* a copy of the scope */
+	struct scope_t
+	{
+		char       m_name[key_size + 1];
+		size_t     m_depth;
+		value_type m_value;
+		size_t     m_node; // address in the writer
+
+		const char* name() const { return m_name; }
+		size_t depth() const { return m_depth; }
+		const value_type& value() const { return m_value; }
+	};
+
+	explicit live_tracer_view_t(allocator_t* allocator)
+		: m_allocator(allocator), m_head(0), m_base(0), m_size(0), m_header_size(0), m_root(0),
+			m_scopes(0), m_nscopes(0), m_scope_capacity(0),
+			m_walk(0), m_walk_capacity(0), m_skipped(0) {}
+
+	~live_tracer_view_t()
+	{
+		m_allocator->deallocate(reinterpret_cast<byte_t*>(m_scopes));
+		m_allocator->deallocate(reinterpret_cast<byte_t*>(m_walk));
+	}
+
+	/*
+	 * @param head the region, mapped at any address
+	 * @return false if it is not (yet) a live region of this tracer type
+	 */
+	bool open(const void* head, size_t size)
+	{
+		UF_ALERT_AND_RETURN_UNLESS(seqlock_type::enabled, false, "live view needs optimistic_concurrent_t!");
+		m_head = 0;
+
+		const live_header_t* header = reinterpret_cast<const live_header_t*>(head);
+		if (!head || size < sizeof(live_header_t) || 
+				0 != memcmp(header->m_magic, live_header_t::magic(), sizeof(header->m_magic))) {
+			return false; // not published yet
+		}
+
+		concurrent_type::atomic_ops_type::barrier(); // the magic comes first
+		UF_ALERT_AND_RETURN_UNLESS(live_version == header->m_version, false, "unknown live region version!");
+		UF_ALERT_AND_RETURN_UNLESS(sizeof(live_header_t) <= header->m_header_size && 
+															 header->m_header_size + sizeof(node_type) <= header->m_size && header->m_size <= size,
+															 false, "broken live region!");
+		UF_ALERT_AND_RETURN_UNLESS(sizeof(node_type) == header->m_node_size && sizeof(value_type) == header->m_value_size,
+															 false, "live region of another tracer type!");
+
+		char schema[live_schema_size];
+		live_schema_t::make<value_type>(schema, sizeof(schema));
+		UF_ALERT_AND_RETURN_UNLESS(0 == strncmp(schema, header->m_schema, sizeof(schema)),
+															 false, "live region of another value type!");
+
+		m_head = reinterpret_cast<const byte_t*>(head);
+		m_base = header->m_base;
+		m_size = header->m_size;
+		m_root = header->m_root;
+		m_header_size = header->m_header_size;
+		if (!to_local(m_root)) {
+			m_head = 0;
+			UF_ALERT_AND_RETURN_UNLESS(false, false, "broken live region root!");
+		}
+
+		return true;
+	}
+
+	bool opened() const { return 0 != m_head; }
+	const live_header_t& header() const { return *reinterpret_cast<const live_header_t*>(m_head); }
+
+	/*
+	 * copies scopes out, and gives them to v(const scope_t&) in pre-order.
+	 * children of a scope come in no particular order.
+	 * @return false if we run out of memory for the copies
+	 */
+	template<class Visitor>
+	bool visit(Visitor& v)
+	{
+		UF_ALERT_AND_RETURN_UNLESS(opened(), false, "live view is not opened!");
+		m_nscopes = 0;
+		m_skipped = 0;
+
+		if (!reserve_scopes(1)) {
+			return false;
+		}
+
+		if (!read_scope(m_root, &m_scopes[0])) {
+			m_skipped++;
+			return true;
+		}
+
+		m_nscopes = 1;
+		while (0 < m_nscopes) {
+			scope_t here = m_scopes[--m_nscopes];
+			v(static_cast<const scope_t&>(here));
+			if (!push_children(here.m_node)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/* subtrees dropped by the last visit(), since they were torn too many times */
+	size_t skipped() const { return m_skipped; }
+
+private:
+	live_tracer_view_t(const live_tracer_view_t&);
+	const live_tracer_view_t& operator=(const live_tracer_view_t&);
+
+	const node_type* to_local(size_t addr) const
+	{
+		if (addr < m_base + m_header_size || m_size - sizeof(node_type) < addr - m_base || 0 != addr % sizeof(void*)) {
+			return 0;
+		}
+
+		return reinterpret_cast<const node_type*>(m_head + (addr - m_base));
+	}
+
+	size_t to_addr(const node_type* node) const { return reinterpret_cast<size_t>(node); }
+
+	bool read_scope(size_t addr, scope_t* scope) const
+	{
+		const node_type* node = to_local(addr);
+		if (!node) {
+			return false;
+		}
+
+		for (size_t i=0; i<max_node_retries; ++i) {
+			size_t began = seqlock_type::read_begin(node->seq());
+			const char* name = node->key().key().c_str();
+			size_t n = 0;
+			for (; n<key_size && name[n]; ++n) {
+				scope->m_name[n] = name[n];
+			}
+
+			scope->m_name[n] = '\0';
+			scope->m_depth = node->depth();
+			scope->m_value = node->key().value();
+			scope->m_node = addr;
+			if (seqlock_type::read_validate(node->seq(), began)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/* copies all children of the node to the top of m_scopes, or nothing if they keep torn. */
+	bool push_children(size_t addr)
+	{
+		const node_type* node = to_local(addr);
+		const volatile size_t* seq = node->children().seq();
+		size_t mark = m_nscopes;
+		for (size_t i=0; i<max_set_retries; ++i) {
+			size_t began = seqlock_type::read_begin(seq);
+			int copied = copy_children(node);
+			if (copied < 0) {
+				m_nscopes = mark;
+				return false;
+			}
+
+			if (0 < copied && seqlock_type::read_validate(seq, began)) {
+				return true;
+			}
+
+			m_nscopes = mark;
+		}
+
+		m_skipped++;
+		return true;
+	}
+
+	/* @return 1 if copied, 0 if torn, -1 if no memory */
+	int copy_children(const node_type* node)
+	{
+		size_t nwalk = 0;
+		size_t limit = m_size / sizeof(node_type);
+		size_t top = to_addr(node->children().root(unsynchronized_t()));
+		if (!top) {
+			return 1;
+		}
+
+		if (!reserve_walk(1, 0)) {
+			return -1;
+		}
+
+		m_walk[nwalk++] = top;
+		for (size_t n=0; 0 < nwalk; ++n) {
+			size_t here = m_walk[--nwalk];
+			const node_type* local = to_local(here);
+			if (!local || limit <= n) {
+				return 0;
+			}
+
+			if (!reserve_scopes(m_nscopes + 1) || !reserve_walk(nwalk + 2, nwalk)) {
+				return -1;
+			}
+
+			if (!read_scope(here, &m_scopes[m_nscopes])) {
+				return 0;
+			}
+
+			m_nscopes++;
+			if (local->left())  { m_walk[nwalk++] = to_addr(local->left()); }
+			if (local->right()) { m_walk[nwalk++] = to_addr(local->right()); }
+		}
+
+		return 1;
+	}
+
+	bool reserve_scopes(size_t n) { return reserve(&m_scopes, &m_scope_capacity, n, m_nscopes); }
+	bool reserve_walk(size_t n, size_t used) { return reserve(&m_walk, &m_walk_capacity, n, used); }
+
+	template<class T>
+	bool reserve(T** arr, size_t* capacity, size_t n, size_t tocopy)
+	{
+		if (n <= *capacity) {
+			return true;
+		}
+
+		size_t newcap = max_of(size_t(64), *capacity*2);
+		while (newcap < n) { newcap *= 2; }
+		T* grown = reinterpret_cast<T*>(m_allocator->allocate(newcap*sizeof(T)));
+		UF_ALERT_AND_RETURN_UNLESS(grown, false, "cannot allocate memory for live view!");
+		for (size_t i=0; i<tocopy; ++i) {
+			grown[i] = (*arr)[i];
+		}
+
+		m_allocator->deallocate(reinterpret_cast<byte_t*>(*arr));
+		*arr = grown;
+		*capacity = newcap;
+		return true;
+	}
+
+	allocator_t* m_allocator;
+	const byte_t* m_head;
+	size_t m_base;
+	size_t m_size;
+	size_t m_header_size;
+	size_t m_root;
+	scope_t* m_scopes;
+	size_t m_nscopes;
+	size_t m_scope_capacity;
+	size_t* m_walk;
+	size_t m_walk_capacity;
+	size_t m_skipped;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_LIVE_VIEW_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_LOCKFREE_ARENA_HPP
+#define UNFACT_LOCKFREE_ARENA_HPP
+
+#ifndef UNFACT_USE_LOCKFREE_ARENA
+# error "define UNFACT_USE_LOCKFREE_ARENA to build src/unfact_atomic_ops.cpp, that lockfree_arena_t needs."
+#endif
+
+#include <unfact/arena.hpp>
+#include <unfact/platform/posix/ao_atomic_ops.hpp>
+#include <atomic_ops_stack.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * lockfree_arena_t is a variant of basic_arena_t whose allocate() and deallocate() never take a lock.
+ *
+ * - free slots are kept in AO_stack_t of bundled libatomic_ops, that is ABA-safe.
+ * - each page has its header (page_t) on its first slot(s), 
+ *   and we bump-allocate from the tail page with CAS on the header's counter.
+ *   when the tail page is full, threads race to install a new page with CAS on the tail pointer.
+ *   losers just give their page back to allocator_t and retry on the winner's page.
+ *
+ * notes:
+ * - on targets without double-width CAS (x86_64 for libatomic_ops 1.2), AO_stack_t is
+ *   "almost lock-free": a popping thread can wait for another thread on rare collisions.
+ *   and items should be aligned to 1<<AO_N_BITS, that we ensure by the item size.
+ * - new page still comes from allocator_t, that can block by itself.
+ * - pages are never freed until the destruction, as basic_arena_t.
+ *   AO_stack_t relies on this: a stale slot might be read after pop.
+ * - acquire()/release() use a lock that is independent from allocation:
+ *   that is for collections that use the arena lock as their own lock.
+ * - you should link out-of-line part of libatomic_ops (src/unfact_atomic_ops.cpp,)
+ *   that is built only if UNFACT_USE_LOCKFREE_ARENA is defined.
+ */
+template<class Concurrent>
+class lockfree_arena_t
+{
+public:
+	typedef Concurrent concurrent_type;
+	typedef typename concurrent_type::spin_lock_type lock_type;
+	typedef typename basic_arena_t<concurrent_type>::option_e option_e;
+	typedef lockfree_arena_t self_type;
+
+	enum { page_alignment = basic_arena_t<concurrent_type>::page_alignment };
+
+	struct page_t
+	{
+		page_t* m_next;
+		volatile AO_t m_npacked;
+	};
+
+	lockfree_arena_t(allocator_t* allocator, size_t item_size, size_t page_size=DEFAULT_PAGE_SIZE, 
+									 size_t align=sizeof(void*), option_e opts=basic_arena_t<concurrent_type>::option_default)
+		: m_allocator(allocator), 
+			m_item_size(roundup_to_p2(max_of(item_size, sizeof(AO_t)), max_of(align, sizeof(AO_t)))),
+			m_header_slots((sizeof(page_t) + m_item_size - 1)/m_item_size),
+			m_page_size(max_of(m_item_size*(m_header_slots + 1), page_size)),
+			m_capacity(m_page_size/m_item_size),
+			m_options(opts), m_page_tail(0), m_size(0), m_npages(0), m_nslots(0)
+	{
+		AO_stack_init(&m_slots);
+	}
+
+	/* dtor requires single mutual access! */
+	~lockfree_arena_t()
+	{
+		if (0 < m_size) { UF_ERROR(("found possible leak (%lu items) in lockfree_arena_t", static_cast<unsigned long>(m_size))); }
+
+		for (page_t* p = reinterpret_cast<page_t*>(m_page_tail); 0 != p;) {
+			page_t* todie = p;
+			p = p->m_next;
+			m_allocator->deallocate(reinterpret_cast<byte_t*>(todie));
+		}
+	}
+
+	/* exchange requires single mutual access for both! */
+	template<class Synchronized>
+	void exchange(lockfree_arena_t& other, const Synchronized&)
+	{
+		if (this == &other)  { return; }
+		exchange_bytes(this, &other);
+	}
+
+	void exchange(lockfree_arena_t& other) { exchange(other, synchronized_t()); }
+
+	byte_t* allocate()
+	{
+		AO_t* slot = AO_stack_pop_acquire(&m_slots);
+		if (slot) {
+			advance<ao_atomic_ops_t>(&m_nslots, -1);
+			advance<ao_atomic_ops_t>(&m_size, 1);
+			return reinterpret_cast<byte_t*>(slot);
+		}
+
+		return allocate_from_page();
+	}
+
+	void deallocate(byte_t* ptr)
+	{
+		if (m_options & basic_arena_t<concurrent_type>::option_fill_efnoise) {
+			memset(ptr, 0xef, m_item_size);
+		}
+
+		AO_stack_push_release(&m_slots, reinterpret_cast<AO_t*>(ptr));
+		advance<ao_atomic_ops_t>(&m_nslots, 1);
+		advance<ao_atomic_ops_t>(&m_size, -1);
+	}
+
+	template<class Synchronized>
+	void deallocate(byte_t* ptr, const Synchronized&) { deallocate(ptr); }
+
+	/*
+	 * region-reset: forget all items at once. 
+	 * unlike basic_arena_t::reset(), we keep only the tail page and free others,
+	 * because it requires single mutual access anyway.
+	 */
+	template<class Synchronized>
+	void reset(const Synchronized&)
+	{
+		page_t* tail = reinterpret_cast<page_t*>(m_page_tail);
+		if (tail) {
+			for (page_t* p = tail->m_next; 0 != p;) {
+				page_t* todie = p;
+				p = p->m_next;
+				m_allocator->deallocate(reinterpret_cast<byte_t*>(todie));
+				m_npages--;
+			}
+
+			tail->m_next = 0;
+			tail->m_npacked = m_header_slots;
+		}
+
+		AO_stack_init(&m_slots);
+		m_size = 0;
+		m_nslots = 0;
+	}
+
+	void reset() { reset(synchronized_t()); }
+
+	/*
+	 * these values are immutable for each instance, so safely nolock.
+	 */
+	size_t item_size() const { return m_item_size; }
+	size_t page_size() const { return m_page_size; }
+	allocator_t* allocator() const { return m_allocator; }
+	bool has_option(option_e opt) const { return 0 != (m_options & opt); }
+
+	/* counters are updated separately from the list, so they are just snapshots */
+	template<class Synchronized>
+	size_t size(const Synchronized&) const { return m_size; }
+	size_t size() const { return m_size; }
+
+	void acquire() const { m_lock.acquire(); }
+	void release() const { m_lock.release(); }
+
+public: // expose implementation detail for testing and inspection
+
+	bool has_slots() const { return 0 != AO_REAL_HEAD_PTR(m_slots); }
+	size_t npages() const { return m_npages; }
+	size_t nslots() const { return m_nslots; }
+	size_t npacked() const 
+	{ 
+		const page_t* p = reinterpret_cast<const page_t*>(m_page_tail);
+		return p ? p->m_npacked : 0;
+	}
+
+private:
+	lockfree_arena_t(const lockfree_arena_t&);
+	const lockfree_arena_t& operator=(const lockfree_arena_t&);
+
+	byte_t* allocate_from_page()
+	{
+		for (;;) {
+			page_t* tail = reinterpret_cast<page_t*>(AO_load_acquire(&m_page_tail));
+			if (tail) {
+				for (AO_t n = tail->m_npacked; n < m_capacity; n = tail->m_npacked) {
+					if (AO_compare_and_swap_full(&(tail->m_npacked), n, n + 1)) {
+						advance<ao_atomic_ops_t>(&m_size, 1);
+						return reinterpret_cast<byte_t*>(tail) + m_item_size*n;
+					}
+				}
+			}
+
+			/* tail page is full: install new one, whose first item is ours. */
+			byte_t* page = m_allocator->allocate(m_page_size);
+			UF_ALERT_AND_RETURN_UNLESS(page, 0, "can't allocate memory for new page!");
+			UF_ASSERT(address_aligned(page, page_alignment));
+			page_t* fresh = reinterpret_cast<page_t*>(page);
+			fresh->m_next = tail;
+			fresh->m_npacked = m_header_slots + 1;
+
+			if (AO_compare_and_swap_full(&m_page_tail, reinterpret_cast<AO_t>(tail), reinterpret_cast<AO_t>(fresh))) {
+				advance<ao_atomic_ops_t>(&m_npages, 1);
+				advance<ao_atomic_ops_t>(&m_size, 1);
+				return page + m_item_size*m_header_slots;
+			}
+
+			/* another thread have installed a page: retry on it. */
+			m_allocator->deallocate(page);
+		}
+	}
+
+private:
+	mutable lock_type m_lock;
+	allocator_t* m_allocator;
+	size_t m_item_size;
+	size_t m_header_slots;
+	size_t m_page_size;
+	size_t m_capacity;
+	option_e m_options;
+	AO_stack_t m_slots;
+	volatile AO_t m_page_tail;
+	volatile AO_t m_size;
+	volatile AO_t m_npages;
+	volatile AO_t m_nslots;
+};
+
+/*
+ * lockfree_concurrent_t is a concurrent policy to use lockfree_arena_t.
+ * it is same as 'Base' except the arena. for example: 
+ *
+ *   tree_tracer_t<value_type, lockfree_concurrent_t<default_concurrent_t> > tracer(...);
+ */
+template<class Base>
+struct lockfree_concurrent_t : public Base
+{
+	typedef Base base_type;
+};
+
+template<class Base>
+struct arena_select_t< lockfree_concurrent_t<Base> >
+{
+	typedef lockfree_arena_t< lockfree_concurrent_t<Base> > type;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_LOCKFREE_ARENA_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -31,7 +31,7 @@ log_printf(const char* file, size_t line, unfact::log_level_e lv,
 {
   namespace uf = unfact;
 
-  fprintf(stderr, "%s:%d:UNFACT[%s] ", strip_directory(file), line, uf::log_level_str(lv));
+  fprintf(stderr, "%s:%lu:UNFACT[%s] ", strip_directory(file), static_cast<unsigned long>(line), uf::log_level_str(lv));
   vfprintf(stderr, format, ap);
   fprintf(stderr, "\n");
 
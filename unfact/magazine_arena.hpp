@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_MAGAZINE_ARENA_HPP
+#define UNFACT_MAGAZINE_ARENA_HPP
+
+#include <unfact/arena.hpp>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * magazine_arena_t is a thread-caching layer over basic_arena_t.
+ *
+ * each thread keeps its own cache of free slots, and allocate()/deallocate() touch only that cache.
+ * when the cache runs dry or overflows, we move a "magazine" - a chain of magazine_size slots - 
+ * from/to the shared "depot" under one lock. if the depot is empty, we refill the magazine
+ * from underlying basic_arena_t, also with one lock per page.
+ * this idea is borrowed from Bonwick's magazine allocator.
+ *
+ * a cache is held by TLS, and is given back to the arena when the thread exits.
+ * (on platforms whose TLS has no destructor, caches are kept until the arena dies.)
+ * give 0 as 'magazine_size' to go to the base arena on each call, without caches.
+ *
+ * the interface is same as basic_arena_t so collections can use this through arena_select_t.
+ * see magazine_concurrent_t.
+ *
+ * restrictions:
+ * - each instance consumes a TLS key. don't make too many of them.
+ * - dtor and exchange() require that no other thread touches the arena,
+ *   and also no thread that has used the arena exits during them.
+ * - size() is just a snapshot under concurrent access.
+ */
+template<class Concurrent>
+class magazine_arena_t
+{
+public:
+	typedef Concurrent concurrent_type;
+	typedef basic_arena_t<concurrent_type> base_arena_type;
+	typedef typename concurrent_type::spin_lock_type lock_type;
+	typedef typename concurrent_type::thread_local_type thread_local_type;
+	typedef typename base_arena_type::option_e option_e;
+	typedef typename base_arena_type::chain_t chain_t;
+	typedef magazine_arena_t self_type;
+
+	enum { default_magazine_size = 32 };
+
+	/*
+	 * slot layout for cached items. m_next_magazine is used only by the first slot of the magazine in the depot.
+	 */
+	struct slot_t
+	{
+		slot_t* m_next;
+		slot_t* m_next_magazine;
+	};
+
+	/*
+	 * per-thread cache. it holds up to magazine_size*2 slots, 
+	 * so that alternating allocate()/deallocate() never goes to the depot.
+	 */
+	struct cache_t
+	{
+		self_type* m_owner;
+		cache_t*   m_next;
+		slot_t*    m_slots;
+		size_t     m_nslots;
+	};
+
+	/*
+	 * shared part: the list of full magazines, and the list of all caches.
+	 */
+	struct depot_t
+	{
+		depot_t() : m_caches(0), m_magazines(0), m_nmagazines(0) {}
+		void acquire() const { m_lock.acquire(); }
+		void release() const { m_lock.release(); }
+
+		mutable lock_type m_lock;
+		cache_t* m_caches;
+		slot_t*  m_magazines;
+		size_t   m_nmagazines;
+	};
+
+	magazine_arena_t(allocator_t* allocator, size_t item_size, size_t page_size=DEFAULT_PAGE_SIZE, 
+									 size_t align=sizeof(void*), option_e opts=base_arena_type::option_default,
+									 size_t magazine_size=default_magazine_size)
+		: m_base(allocator, max_of(item_size, sizeof(slot_t)), page_size, align, opts),
+			m_local(&magazine_arena_t::thread_exited),
+			m_magazine_size(magazine_size)
+	{}
+
+	/* dtor requires single mutual access! */
+	~magazine_arena_t()
+	{
+		m_local.clear();
+		drain(true);
+	}
+
+	template<class Synchronized>
+	void exchange(magazine_arena_t& other, const Synchronized& sync)
+	{
+		if (this == &other)  { return; } // ESSENTIAL: deadlock in such case
+
+		/* caches are bound to TLS of each instance, so we give all slots back, then swap the bodies. */
+		drain(false);
+		other.drain(false);
+		m_base.exchange(other.m_base, sync);
+	}
+
+	void exchange(magazine_arena_t& other) { exchange(other, synchronized_t()); }
+
+	byte_t* allocate()
+	{
+		cache_t* cache = local_cache();
+		if (!cache) {
+			return m_base.allocate();
+		}
+
+		if (!cache->m_slots && !refill(cache)) {
+			return 0;
+		}
+
+		slot_t* ret = cache->m_slots;
+		cache->m_slots = ret->m_next;
+		cache->m_nslots--;
+		return reinterpret_cast<byte_t*>(ret);
+	}
+
+	void deallocate(byte_t* ptr)
+	{
+		cache_t* cache = local_cache();
+		if (!cache) {
+			m_base.deallocate(ptr);
+			return;
+		}
+
+		if (m_base.has_option(base_arena_type::option_fill_efnoise)) {
+			memset(ptr, 0xef, m_base.item_size());
+		}
+
+		slot_t* slot = reinterpret_cast<slot_t*>(ptr);
+		slot->m_next = cache->m_slots;
+		cache->m_slots = slot;
+		cache->m_nslots++;
+
+		if (m_magazine_size*2 <= cache->m_nslots) {
+			flush(cache);
+		}
+	}
+
+	template<class Synchronized>
+	void deallocate(byte_t* ptr, const Synchronized&) { deallocate(ptr); }
+
+	/*
+	 * region-reset. see basic_arena_t::reset().
+	 * cached slots of every thread are just forgotten, so this requires single mutual access.
+	 */
+	template<class Synchronized>
+	void reset(const Synchronized& sync)
+	{
+		{
+			lock_scope_t<depot_t> l(&m_depot);
+			for (cache_t* c = m_depot.m_caches; c; c = c->m_next) {
+				c->m_slots = 0;
+				c->m_nslots = 0;
+			}
+
+			m_depot.m_magazines = 0;
+			m_depot.m_nmagazines = 0;
+		}
+
+		m_base.reset(sync);
+	}
+
+	void reset() { reset(synchronized_t()); }
+
+	/*
+	 * these values are immutable for each instance, so safely nolock.
+	 */
+	size_t item_size() const { return m_base.item_size(); }
+	size_t page_size() const { return m_base.page_size(); }
+	size_t magazine_size() const { return m_magazine_size; }
+	allocator_t* allocator() const { return m_base.allocator(); }
+	bool has_option(option_e opt) const { return m_base.has_option(opt); }
+	void set_page_tag(size_t tag) { m_base.set_page_tag(tag); }
+
+	/* items in caches and depot are not counted */
+	template<class Synchronized>
+	size_t size(const Synchronized&) const
+	{
+		lock_scope_t<const depot_t> l(&m_depot);
+		size_t cached = m_depot.m_nmagazines*m_magazine_size;
+		for (const cache_t* c = m_depot.m_caches; c; c = c->m_next) {
+			cached += c->m_nslots;
+		}
+
+		return m_base.size() - cached;
+	}
+
+	size_t size() const { return size(synchronized_t()); }
+
+	void acquire() const { m_base.acquire(); }
+	void release() const { m_base.release(); }
+
+public: // expose implementation detail for testing and inspection
+
+	size_t nmagazines() const { return lock_scope_t<const depot_t>(&m_depot)->m_nmagazines; }
+	size_t ncached() const
+	{
+		const cache_t* cache = reinterpret_cast<const cache_t*>(m_local.get());
+		return cache ? cache->m_nslots : 0;
+	}
+
+	const base_arena_type& base() const { return m_base; }
+
+private:
+	magazine_arena_t(const magazine_arena_t&);
+	const magazine_arena_t& operator=(const magazine_arena_t&);
+
+	cache_t* local_cache()
+	{
+		cache_t* cache = reinterpret_cast<cache_t*>(m_local.get());
+		if (cache || 0 == m_magazine_size) {
+			return cache;
+		}
+
+		byte_t* mem = m_base.allocator()->allocate(sizeof(cache_t));
+		UF_ALERT_AND_RETURN_UNLESS(mem, 0, "failed to allocate thread cache: fallback to shared arena");
+		cache = reinterpret_cast<cache_t*>(mem);
+		cache->m_owner = this;
+		cache->m_slots = 0;
+		cache->m_nslots = 0;
+		{
+			lock_scope_t<depot_t> l(&m_depot);
+			cache->m_next = m_depot.m_caches;
+			m_depot.m_caches = cache;
+		}
+
+		m_local.set(mem);
+		return cache;
+	}
+
+	/*
+	 * load a magazine into empty cache: from the depot if any, or from the base arena.
+	 */
+	bool refill(cache_t* cache)
+	{
+		slot_t* magazine = 0;
+		{
+			lock_scope_t<depot_t> l(&m_depot);
+			if (m_depot.m_magazines) {
+				magazine = m_depot.m_magazines;
+				m_depot.m_magazines = magazine->m_next_magazine;
+				m_depot.m_nmagazines--;
+			}
+		}
+
+		if (magazine) {
+			cache->m_slots = magazine;
+			cache->m_nslots = m_magazine_size;
+			return true;
+		}
+
+		chain_t* head = 0;
+		size_t got = m_base.allocate_chain(&head, m_magazine_size);
+		cache->m_slots = reinterpret_cast<slot_t*>(head);
+		cache->m_nslots = got;
+		return 0 < got;
+	}
+
+	/*
+	 * move a magazine from the cache to the depot.
+	 */
+	void flush(cache_t* cache)
+	{
+		slot_t* magazine = cache->m_slots;
+		slot_t* last = magazine;
+		for (size_t i=1; i<m_magazine_size; ++i) {
+			last = last->m_next;
+		}
+
+		cache->m_slots = last->m_next;
+		cache->m_nslots -= m_magazine_size;
+		last->m_next = 0;
+
+		lock_scope_t<depot_t> l(&m_depot);
+		magazine->m_next_magazine = m_depot.m_magazines;
+		m_depot.m_magazines = magazine;
+		m_depot.m_nmagazines++;
+	}
+
+	/*
+	 * give cached slots back to the base arena.
+	 */
+	void give_back(slot_t* head, size_t n)
+	{
+		if (!head) {
+			return;
+		}
+
+		slot_t* last = head;
+		while (last->m_next) {
+			last = last->m_next;
+		}
+
+		m_base.deallocate_chain(reinterpret_cast<chain_t*>(head), reinterpret_cast<chain_t*>(last), n);
+	}
+
+	/*
+	 * give all cached slots back to the base arena.
+	 * if 'free_caches' is true, we also free caches itself.
+	 */
+	void drain(bool free_caches)
+	{
+		lock_scope_t<depot_t> l(&m_depot);
+		for (cache_t* c = m_depot.m_caches; c;) {
+			cache_t* next = c->m_next;
+			give_back(c->m_slots, c->m_nslots);
+			c->m_slots = 0;
+			c->m_nslots = 0;
+			if (free_caches) {
+				m_base.allocator()->deallocate(reinterpret_cast<byte_t*>(c));
+			}
+
+			c = next;
+		}
+
+		if (free_caches) {
+			m_depot.m_caches = 0;
+		}
+
+		while (m_depot.m_magazines) {
+			slot_t* magazine = m_depot.m_magazines;
+			m_depot.m_magazines = magazine->m_next_magazine;
+			give_back(magazine, m_magazine_size);
+		}
+
+		m_depot.m_nmagazines = 0;
+	}
+
+	/*
+	 * called at thread exit for each thread that has its cache.
+	 */
+	void retire(cache_t* cache)
+	{
+		lock_scope_t<depot_t> l(&m_depot);
+		for (cache_t** c = &m_depot.m_caches; *c; c = &((*c)->m_next)) {
+			if (*c == cache) {
+				*c = cache->m_next;
+				break;
+			}
+		}
+
+		give_back(cache->m_slots, cache->m_nslots);
+		m_base.allocator()->deallocate(reinterpret_cast<byte_t*>(cache));
+	}
+
+	static void thread_exited(void* p)
+	{
+		cache_t* cache = reinterpret_cast<cache_t*>(p);
+		cache->m_owner->retire(cache);
+	}
+
+private:
+	base_arena_type m_base;
+	thread_local_type m_local;
+	size_t m_magazine_size;
+	depot_t m_depot;
+};
+
+/*
+ * magazine_concurrent_t is a concurrent policy to use magazine_arena_t.
+ * it is same as 'Base' except the arena. for example: 
+ *
+ *   tree_tracer_t<value_type, magazine_concurrent_t<default_concurrent_t> > tracer(...);
+ */
+template<class Base>
+struct magazine_concurrent_t : public Base
+{
+	typedef Base base_type;
+};
+
+template<class Base>
+struct arena_select_t< magazine_concurrent_t<Base> >
+{
+	typedef magazine_arena_t< magazine_concurrent_t<Base> > type;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_MAGAZINE_ARENA_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -46,6 +46,32 @@ public:
   virtual ~allocator_t() {}
   virtual byte_t* allocate(size_t size) = 0;
   virtual void    deallocate(byte_t* ptr) = 0;
+
+	/*
+	 * allocate memory aligned to 'align', that should be power of 2.
+	 * memory from allocate_aligned() should be released by deallocate_aligned().
+	 *
+	 * default implementation over-allocates and keeps original address just before the block.
+	 * it wastes 'align' bytes at most, so subclasses had better override them if they can.
+	 */
+	virtual byte_t* allocate_aligned(size_t size, size_t align)
+	{
+		byte_t* raw = allocate(size + align + sizeof(byte_t*));
+		if (!raw) {
+			return 0;
+		}
+
+		byte_t* ret = reinterpret_cast<byte_t*>(roundup_to_p2(reinterpret_cast<size_t>(raw + sizeof(byte_t*)), align));
+		reinterpret_cast<byte_t**>(ret)[-1] = raw;
+		return ret;
+	}
+
+	virtual void deallocate_aligned(byte_t* ptr)
+	{
+		if (ptr) {
+			deallocate(reinterpret_cast<byte_t**>(ptr)[-1]);
+		}
+	}
 };
 
 class stdlib_allocator_t : public allocator_t
@@ -53,6 +79,16 @@ class stdlib_allocator_t : public allocator_t
 public:
   virtual byte_t* allocate(size_t size) { return reinterpret_cast<byte_t*>(malloc(size)); }
   virtual void    deallocate(byte_t* ptr) { free(ptr); }
+
+#ifdef UNFACT_PLATFORM_LINUX
+	virtual byte_t* allocate_aligned(size_t size, size_t align)
+	{
+		void* ret = 0;
+		return 0 == posix_memalign(&ret, max_of(align, sizeof(void*)), size) ? reinterpret_cast<byte_t*>(ret) : 0;
+	}
+
+	virtual void deallocate_aligned(byte_t* ptr) { free(ptr); }
+#endif
 };
 
 UNFACT_NAMESPACE_END
@@ -51,15 +51,97 @@ inline To atomic_value_cast(From x) { return reinterpret_cast<To>(x); }
 # pragma warning(pop)
 #endif
 
+/*
+ * AtomicOps concept gives:
+ * - value_type
+ * - compare_and_swap() (full barrier), compare_and_swap_acquire()
+ * - fetch_and_add() (full barrier)
+ * - fetch_and_add_relaxed() and load_relaxed(), with no ordering: for counters and statistics.
+ *   the delta of fetch_and_add_relaxed() is a size_t, that wraps around.
+ * - load_acquire(), store_release()
+ * - barrier()
+ * - thread_hint() and yield_nth(), that are not atomic but handy for spinning.
+ */
+
 template<class AtomicOps>
 inline void advance(volatile typename AtomicOps::value_type* value, int delta)
 {
-  typename AtomicOps::value_type x;
-  do {
-		x = *value;
-  } while (!AtomicOps::compare_and_swap(value, x, x+delta));
+	AtomicOps::fetch_and_add(value, delta);
+}
+
+/* same as advance(), but gives the value before the addition */
+template<class AtomicOps>
+inline typename AtomicOps::value_type fetch_and_add(volatile typename AtomicOps::value_type* value, int delta)
+{
+	return AtomicOps::fetch_and_add(value, delta);
 }
 
+/*
+ * word_ops_t updates a size_t word in place: atomically by AtomicOps,
+ * or just plainly if AtomicOps is none_t (that is, the policy is not concurrent.)
+ * each returns the value before the update.
+ * add() is a single relaxed fetch-and-add for counters and statistics. it takes any delta, wrapping around like unsigned.
+ * add_full() is a full barrier for the counts that guard object lifetime. others are compare_and_swap() loops.
+ */
+template<class AtomicOps>
+struct word_ops_t
+{
+	typedef typename AtomicOps::value_type value_type;
+
+	static size_t add(volatile size_t* word, size_t delta)
+	{
+		return atomic_value_cast<size_t>(AtomicOps::fetch_and_add_relaxed(reinterpret_cast<volatile value_type*>(word), delta));
+	}
+
+	static size_t add_full(volatile size_t* word, int delta)
+	{
+		return atomic_value_cast<size_t>(AtomicOps::fetch_and_add(reinterpret_cast<volatile value_type*>(word), delta));
+	}
+
+	static size_t set_bits(volatile size_t* word, size_t bits)
+	{
+		for (;;) {
+			size_t old = *word;
+			if (swap(word, old, old | bits)) { return old; }
+		}
+	}
+
+	static size_t clear_bits(volatile size_t* word, size_t bits)
+	{
+		for (;;) {
+			size_t old = *word;
+			if (swap(word, old, old & ~bits)) { return old; }
+		}
+	}
+
+	/* @return false if the word is zero: we never go below it */
+	static bool decrement_if_positive(volatile size_t* word)
+	{
+		for (;;) {
+			size_t old = *word;
+			if (0 == old) { return false; }
+			if (swap(word, old, old - 1)) { return true; }
+		}
+	}
+
+private:
+	static bool swap(volatile size_t* word, size_t oldval, size_t newval)
+	{
+		return AtomicOps::compare_and_swap(reinterpret_cast<volatile value_type*>(word),
+																			 atomic_value_cast<value_type>(oldval), atomic_value_cast<value_type>(newval));
+	}
+};
+
+template<>
+struct word_ops_t<none_t>
+{
+	static size_t add(volatile size_t* word, size_t delta) { size_t old = *word; *word = old + delta; return old; }
+	static size_t add_full(volatile size_t* word, int delta) { return add(word, size_t(delta)); }
+	static size_t set_bits(volatile size_t* word, size_t bits) { size_t old = *word; *word = old | bits; return old; }
+	static size_t clear_bits(volatile size_t* word, size_t bits) { size_t old = *word; *word = old & ~bits; return old; }
+	static bool decrement_if_positive(volatile size_t* word) { return 0 != *word && (--(*word), true); }
+};
+
 /*
  * spinlock implementation:
  * logic is cloned from boost/detail/spinlock_w32.hpp
@@ -80,11 +162,9 @@ public:
   }
 
   bool try_acquire() volatile {
-		bool ok = ops_type::compare_and_swap(&m_value, 
-																				 atomic_value_cast<value_type>(0), 
-																				 atomic_value_cast<value_type>(1));
-		ops_type::barrier(); // i don't know why this fence is required...
-		return ok;
+		return ops_type::compare_and_swap_acquire(&m_value, 
+																							atomic_value_cast<value_type>(0), 
+																							atomic_value_cast<value_type>(1));
   }
 
   void acquire() volatile
@@ -92,13 +172,16 @@ public:
 		size_t n = 0;
 		while (!try_acquire()) {
 			ops_type::yield_nth(n++);
+			/* wait by reading, not to bounce the cache line with CAS */
+			while (atomic_value_cast<value_type>(0) != m_value) {
+				ops_type::yield_nth(n++);
+			}
 		}
   }
 
   void release() volatile
   {
-		ops_type::barrier();
-		m_value = 0;
+		ops_type::store_release(&m_value, atomic_value_cast<value_type>(0));
   }
 
 private:
@@ -109,6 +192,63 @@ private:
   volatile value_type m_value;
 };
 
+/*
+ * ticket lock: a FIFO spin lock. 
+ * each waiter takes a ticket, then waits until the ticket is served,
+ * so the lock is handed to waiters in arrival order even under heavy contention.
+ * note that a preempted waiter blocks all later ones, so don't use it with many more threads than CPUs.
+ */
+template<class AtomicOps>
+class ticket_lock_t
+{
+public:
+  typedef AtomicOps ops_type;
+  typedef typename ops_type::value_type value_type;
+
+  /* yield_nth() gives short yield, not a sleep, until this count (see posix_atomic_ops_base_t) */
+	enum { short_yield_count = 31 };
+
+  ticket_lock_t() : m_next(0), m_serving(0) {}
+
+  ~ticket_lock_t()
+  {
+		ops_type::barrier();
+		UF_HONOR_OR_RETURN_VOID(m_next == m_serving);
+  }
+
+  bool try_acquire() volatile 
+	{
+		value_type serving = ops_type::load_acquire(&m_serving);
+		return ops_type::compare_and_swap_acquire(&m_next, serving, serving + 1);
+	}
+
+  void acquire() volatile
+  {
+		value_type mine = fetch_and_add<ops_type>(&m_next, 1);
+		size_t n = 0;
+		while (ops_type::load_acquire(&m_serving) != mine) {
+			/* 
+			 * we don't back off to long sleeps: the lock is handed to us, not taken.
+			 * sleeping waiter stalls all waiters behind it.
+			 */
+			ops_type::yield_nth(min_of(n++, to_size(short_yield_count)));
+		}
+  }
+
+  void release() volatile
+  {
+		ops_type::store_release(&m_serving, m_serving + 1); // only the holder writes it
+  }
+
+private:
+  ticket_lock_t(const ticket_lock_t&);
+  ticket_lock_t& operator=(const ticket_lock_t&);
+
+private:
+  volatile value_type m_next;
+  volatile value_type m_serving;
+};
+
 template<class AtomicOps, class Lock>
 class rw_lock_t
 {
@@ -154,8 +294,8 @@ private:
 public: // impl detail
   void wait_until_readers_gone() volatile
   {
+		/* readers count up under m_writing, that we hold: no fence needed to see them */
 		size_t n = 0;
-		ops_type::barrier();
 		while (atomic_value_cast<value_type>(0) < m_nreaders) {
 			ops_type::yield_nth(n++);
 			ops_type::barrier();
@@ -167,6 +307,143 @@ private:
   volatile lock_type m_writing;
 };
 
+/*
+ * distributed_rw_lock_t is a scalable reader-writer lock, that prefers writers.
+ *
+ * - readers never share a lock: each reader counts itself up on one of 'NSlots' counters,
+ *   that is picked by the thread and placed on its own cache line.
+ * - a writer raises the flag, then waits until all counters go zero.
+ *   readers that see the flag back off, so no new reader comes in until the writer is done.
+ * - writers are serialized by 'Lock'.
+ *
+ * AtomicOps should give thread_hint(), a number that distinguishes threads.
+ */
+template<class AtomicOps, class Lock, size_t NSlots=16>
+class distributed_rw_lock_t
+{
+public:
+  typedef AtomicOps ops_type;
+  typedef typename ops_type::value_type value_type;
+  typedef Lock lock_type;
+
+	enum { nslots = NSlots, cache_line_size = 64 };
+
+	struct slot_t
+	{
+		volatile value_type m_nreaders;
+		byte_t m_padding[cache_line_size - sizeof(value_type)];
+	};
+
+  distributed_rw_lock_t() : m_writer(0)
+	{
+		for (size_t i=0; i<nslots; ++i) { m_slots[i].m_nreaders = 0; }
+	}
+
+  ~distributed_rw_lock_t()
+  {
+		ops_type::barrier();
+		for (size_t i=0; i<nslots; ++i) { UF_HONOR_OR_RETURN_VOID(0 == m_slots[i].m_nreaders); }
+  }
+
+  void read_acquire() volatile
+  {
+		volatile value_type* count = &(m_slots[slot_index()].m_nreaders);
+		for (;;) {
+			wait_until_writer_gone();
+			advance<ops_type>(count,  1); // full barrier: the count goes out before we look at the flag
+			if (0 == m_writer) {
+				return;
+			}
+
+			/* a writer came after we checked: give way to it */
+			advance<ops_type>(count, -1);
+		}
+  }
+
+  void read_release() volatile
+  {
+		advance<ops_type>(&(m_slots[slot_index()].m_nreaders), -1); // full barrier
+  }
+
+  void write_acquire() volatile
+  {
+		m_writing.acquire();
+		m_writer = 1;
+		ops_type::barrier();
+		for (size_t i=0; i<nslots; ++i) {
+			size_t n = 0;
+			while (atomic_value_cast<value_type>(0) != m_slots[i].m_nreaders) {
+				ops_type::yield_nth(n++);
+				ops_type::barrier();
+			}
+		}
+  }
+
+  void write_release() volatile
+  {
+		ops_type::barrier();
+		m_writer = 0;
+		m_writing.release();
+  }
+
+private:
+  distributed_rw_lock_t(const distributed_rw_lock_t&);
+  distributed_rw_lock_t& operator=(const distributed_rw_lock_t&);
+
+	static size_t slot_index()
+	{
+		/* thread hints can be aligned addresses: mix upper bits down */
+		size_t h = ops_type::thread_hint();
+		h ^= (h >> 7) ^ (h >> 13) ^ (h >> 23);
+		return h % nslots;
+	}
+
+	void wait_until_writer_gone() volatile
+	{
+		/* only a hint: read_acquire() checks m_writer again after its count goes out */
+		size_t n = 0;
+		while (0 != m_writer) {
+			ops_type::yield_nth(n++);
+			ops_type::barrier();
+		}
+	}
+
+private:
+	slot_t m_slots[nslots];
+	volatile int m_writer;
+  volatile lock_type m_writing;
+};
+
+/*
+ * Quiescence concept keeps writers of the containers out of the way of fork():
+ * - enter() and leave() bracket a write section on the calling thread. sections nest.
+ * - quiesce() waits until no thread is in a section, and keeps new sections waiting until resume().
+ *   quiesce() and resume() nest on the calling thread.
+ * sections should not wait for the locks that quiesce() callers hold.
+ *
+ * null_quiescence_t is for platforms without fork(). 
+ */
+struct null_quiescence_t
+{
+	static void enter() {}
+	static void leave() {}
+	static void quiesce() {}
+	static void resume() {}
+};
+
+template<class Quiescence>
+class quiescent_section_t
+{
+public:
+	typedef Quiescence quiescence_type;
+	quiescent_section_t() { quiescence_type::enter(); }
+	~quiescent_section_t() { quiescence_type::leave(); }
+
+private:
+	quiescent_section_t(const quiescent_section_t&);
+	const quiescent_section_t& operator=(const quiescent_section_t&);
+};
+
 /*
  * concurrent_t is a facade/traits to platform specific concurrent operations and datatypes
  * like synchronziation primitives and thread related APIs.
@@ -179,6 +456,23 @@ struct concurrent_t
 {
   typedef none_t spin_lock_t; // should be overriden
   typedef none_t rw_lock_t;   // should be overriden
+  typedef none_t thread_local_type; // should be overriden
+  typedef none_t atomic_ops_type; // should be overriden
+  typedef none_t quiescence_type; // should be overriden
+};
+
+/*
+ * ticket_concurrent_t is a concurrent policy that replaces locks of 'Base' with ticket_lock_t.
+ * containers lock their nodes with fair handoff. for example: 
+ *
+ *   tree_tracer_t<value_type, ticket_concurrent_t<default_concurrent_t> > tracer(...);
+ */
+template<class Base>
+struct ticket_concurrent_t : public Base
+{
+	typedef Base base_type;
+	typedef ticket_lock_t<typename base_type::atomic_ops_type> spin_lock_type;
+	typedef distributed_rw_lock_t<typename base_type::atomic_ops_type, spin_lock_type> rw_lock_type;
 };
 
 /*
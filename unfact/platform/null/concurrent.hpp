@@ -58,11 +58,38 @@ private:
 	const null_rw_lock_t& operator=(const null_rw_lock_t&);
 };
 
+/*
+ * there is only one thread, that never exits. so we never call 'destructor'
+ */
+template<size_t StorageID>
+class null_thread_local_t
+{
+public:
+  typedef byte_t* value_type;
+	typedef void (*destructor_type)(void*);
+
+	explicit null_thread_local_t(destructor_type /*destructor*/=0) : m_value(0) {}
+
+	value_type get() const { return m_value; }
+	void set(value_type value) { m_value = value; }
+	void clear() { m_value = 0; }
+
+private:
+	null_thread_local_t(const null_thread_local_t&);
+	const null_thread_local_t& operator=(const null_thread_local_t&);
+
+private:
+	value_type m_value;
+};
+
 template<>
 struct concurrent_t<null_platform_tag_t>
 {
   typedef null_lock_t spin_lock_type;
   typedef null_rw_lock_t rw_lock_type;
+	typedef null_thread_local_t<0> thread_local_type;
+	typedef none_t atomic_ops_type;
+	typedef null_quiescence_t quiescence_type;
 };
 
 UNFACT_NAMESPACE_END
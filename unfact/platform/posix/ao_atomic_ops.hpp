@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_POSIX_PLATFORM_AO_ATOMIC_OPS_HPP
+#define UNFACT_POSIX_PLATFORM_AO_ATOMIC_OPS_HPP
+
+#include <unfact/base.hpp>
+#include <unfact/platform/posix/atomic_ops.hpp>
+#include <atomic_ops.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * ao_atomic_ops_t implements AtomicOps with bundled libatomic_ops.
+ * it is no longer the default (see gcc_atomic_ops_t.) define UNFACT_USE_AO_ATOMIC_OPS to pick it,
+ * for the compiler without __atomic builtins.
+ * lockfree_arena_t always uses this because it needs AO_stack_t.
+ * either needs the out-of-line part of libatomic_ops: see src/unfact_atomic_ops.cpp.
+ */
+struct ao_atomic_ops_t : public posix_atomic_ops_base_t
+{
+  typedef AO_t value_type;
+
+  static bool compare_and_swap(volatile value_type* addr, value_type oldval, value_type newval)
+  {
+		return 0 != AO_compare_and_swap_full(addr, oldval, newval);
+  }
+
+  static bool compare_and_swap_acquire(volatile value_type* addr, value_type oldval, value_type newval)
+  {
+		return 0 != AO_compare_and_swap_acquire(addr, oldval, newval);
+  }
+
+  static value_type fetch_and_add(volatile value_type* addr, int delta)
+  {
+		return AO_fetch_and_add_full(addr, static_cast<value_type>(delta));
+  }
+
+  static value_type fetch_and_add_relaxed(volatile value_type* addr, size_t delta)
+  {
+		return AO_fetch_and_add(addr, static_cast<value_type>(delta));
+  }
+
+  static value_type load_relaxed(const volatile value_type* addr)
+  {
+		return AO_load(addr);
+  }
+
+  static value_type load_acquire(const volatile value_type* addr)
+  {
+		return AO_load_acquire(addr);
+  }
+
+  static void store_release(volatile value_type* addr, value_type value)
+  {
+		AO_store_release(addr, value);
+  }
+
+  static void barrier()
+  {
+		AO_nop_full();
+  }
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_POSIX_PLATFORM_AO_ATOMIC_OPS_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
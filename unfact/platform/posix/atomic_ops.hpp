@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_POSIX_PLATFORM_ATOMIC_OPS_HPP
+#define UNFACT_POSIX_PLATFORM_ATOMIC_OPS_HPP
+
+#include <unfact/base.hpp>
+#include <unfact/platform/concurrent.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * non-atomic part of AtomicOps concept, that every posix backend shares.
+ */
+struct posix_atomic_ops_base_t
+{
+	/* distinguishes threads. see distributed_rw_lock_t */
+	static size_t thread_hint() { return static_cast<size_t>(pthread_self()); }
+
+  /*
+   * yielding with backoff: 
+   * logic is cloned from boost/detail/spinlock_w32.hpp and slightly modied
+   */
+  static void yield_nth(size_t n)
+  {
+    if (n <  8) {
+			return;
+		} else if (n < 32) {
+			/* Sleep(0) equivalent. nanosleep() with zero still sleeps by timer slack */
+			sched_yield();
+			return;
+		} else {
+			struct timespec tosleep;
+			tosleep.tv_sec = 0;
+			tosleep.tv_nsec = 1000;
+			nanosleep(&tosleep, 0);
+			return;
+		}
+  }
+};
+
+/*
+ * gcc_atomic_ops_t implements AtomicOps with compiler builtins (gcc 4.7+, clang.)
+ * unlike libatomic_ops 1.2, we can ask the ordering we actually need:
+ * lock acquisition is acquire, lock release is release, failed CAS and counters are relaxed.
+ * compiler knows the target, so this works on aarch64 too.
+ */
+struct gcc_atomic_ops_t : public posix_atomic_ops_base_t
+{
+  typedef size_t value_type;
+
+  static bool compare_and_swap(volatile value_type* addr, value_type oldval, value_type newval)
+  {
+		return __atomic_compare_exchange_n(addr, &oldval, newval, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  }
+
+  static bool compare_and_swap_acquire(volatile value_type* addr, value_type oldval, value_type newval)
+  {
+		return __atomic_compare_exchange_n(addr, &oldval, newval, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+  }
+
+  static value_type fetch_and_add(volatile value_type* addr, int delta)
+  {
+		return __atomic_fetch_add(addr, static_cast<value_type>(delta), __ATOMIC_SEQ_CST);
+  }
+
+  static value_type fetch_and_add_relaxed(volatile value_type* addr, size_t delta)
+  {
+		return __atomic_fetch_add(addr, delta, __ATOMIC_RELAXED);
+  }
+
+  static value_type load_relaxed(const volatile value_type* addr)
+  {
+		return __atomic_load_n(addr, __ATOMIC_RELAXED);
+  }
+
+  static value_type load_acquire(const volatile value_type* addr)
+  {
+		return __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+  }
+
+  static void store_release(volatile value_type* addr, value_type value)
+  {
+		__atomic_store_n(addr, value, __ATOMIC_RELEASE);
+  }
+
+  static void barrier()
+  {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+  }
+};
+
+/* AO_t is also size_t, so libatomic_ops backend shares this */
+template<>
+inline size_t
+atomic_value_cast<size_t, int>(int x)
+{
+	return static_cast<size_t>(x);
+}
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_POSIX_PLATFORM_ATOMIC_OPS_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_POSIX_PLATFORM_BINARY_SNAPSHOT_FILE_HPP
+#define UNFACT_POSIX_PLATFORM_BINARY_SNAPSHOT_FILE_HPP
+
+#include <unfact/binary_snapshot.hpp>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * writes the snapshot to 'fd' by single writev(): the header and the encoded body.
+ * short writes go on from where they stopped.
+ */
+template<class Snapshot>
+inline bool write_binary_snapshot(int fd, const Snapshot& snapshot, allocator_t* allocator)
+{
+	binary_snapshot_encoder_t<Snapshot> encoder(allocator);
+	if (!encoder.encode(snapshot)) {
+		return false;
+	}
+
+	struct iovec iov[2];
+	iov[0].iov_base = const_cast<binary_snapshot_header_t*>(&encoder.header());
+	iov[0].iov_len  = sizeof(binary_snapshot_header_t);
+	iov[1].iov_base = const_cast<byte_t*>(encoder.body());
+	iov[1].iov_len  = encoder.body_size();
+
+	struct iovec* v = iov;
+	int nv = 2;
+	while (0 < nv) {
+		ssize_t n = writev(fd, v, nv);
+		if (n < 0 && EINTR == errno) {
+			continue;
+		}
+
+		UF_ALERT_AND_RETURN_UNLESS(0 <= n, false, "cannot write binary snapshot!");
+		while (0 < nv && v->iov_len <= size_t(n)) {
+			n -= v->iov_len;
+			++v;
+			--nv;
+		}
+
+		if (0 < nv) {
+			v->iov_base = reinterpret_cast<char*>(v->iov_base) + n;
+			v->iov_len -= n;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * takes a snapshot of the tracer and writes it to 'path'.
+ * we write "path.tmp" then rename it, so readers never see a half-written file.
+ * @param Tracer tree_tracer_t
+ */
+template<class Tracer>
+inline bool dump_binary_snapshot(const char* path, const Tracer& tracer, allocator_t* allocator)
+{
+	tracing_snapshot_t<Tracer> snapshot(allocator);
+	UF_ALERT_AND_RETURN_UNLESS(snapshot.take(tracer), false, "cannot take the tracing snapshot!");
+
+	char tmp[1024];
+	int len = snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	UF_ALERT_AND_RETURN_UNLESS(0 < len && size_t(len) < sizeof(tmp), false, "too long snapshot path!");
+
+	int fd = ::open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	UF_ALERT_AND_RETURN_UNLESS(0 <= fd, false, "cannot open binary snapshot file!");
+
+	bool ok = write_binary_snapshot(fd, snapshot, allocator);
+	ok = (0 == ::close(fd)) && ok;
+	if (!ok || 0 != rename(tmp, path)) {
+		unlink(tmp);
+		UF_ALERT(("cannot dump binary snapshot!"));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * dump_binary_snapshot() to "path.<pid>": for workers of pre-fork servers, 
+ * that share 'path' and dump by themselves. unfact-report merge sums them up.
+ */
+template<class Tracer>
+inline bool dump_process_binary_snapshot(const char* path, const Tracer& tracer, allocator_t* allocator)
+{
+	char mine[1024];
+	int len = snprintf(mine, sizeof(mine), "%s.%d", path, int(getpid()));
+	UF_ALERT_AND_RETURN_UNLESS(0 < len && size_t(len) < sizeof(mine), false, "too long snapshot path!");
+	return dump_binary_snapshot(mine, tracer, allocator);
+}
+
+/*
+ * maps the binary snapshot file read-only, and views it as is.
+ */
+class mapped_binary_snapshot_t
+{
+public:
+	mapped_binary_snapshot_t() : m_head(0), m_size(0) {}
+	~mapped_binary_snapshot_t() { close(); }
+
+	bool open(const char* path)
+	{
+		close();
+
+		int fd = ::open(path, O_RDONLY);
+		UF_ALERT_AND_RETURN_UNLESS(0 <= fd, false, "cannot open binary snapshot file!");
+
+		struct stat st;
+		void* head = MAP_FAILED;
+		if (0 == fstat(fd, &st) && 0 < st.st_size) {
+			head = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+
+		::close(fd);
+		UF_ALERT_AND_RETURN_UNLESS(MAP_FAILED != head, false, "cannot map binary snapshot file!");
+
+		m_head = head;
+		m_size = st.st_size;
+		if (!m_view.open(m_head, m_size)) {
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void close()
+	{
+		if (m_head) {
+			munmap(m_head, m_size);
+		}
+
+		m_head = 0;
+		m_size = 0;
+		m_view = binary_snapshot_view_t();
+	}
+
+	bool opened() const { return m_view.opened(); }
+	const binary_snapshot_view_t& view() const { return m_view; }
+
+private:
+	mapped_binary_snapshot_t(const mapped_binary_snapshot_t&);
+	const mapped_binary_snapshot_t& operator=(const mapped_binary_snapshot_t&);
+
+	void* m_head;
+	size_t m_size;
+	binary_snapshot_view_t m_view;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_POSIX_PLATFORM_BINARY_SNAPSHOT_FILE_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
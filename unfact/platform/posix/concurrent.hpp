@@ -28,69 +28,41 @@
 
 #include <unfact/base.hpp>
 #include <unfact/platform/concurrent.hpp>
+#include <unfact/platform/posix/atomic_ops.hpp>
+#ifdef UNFACT_USE_AO_ATOMIC_OPS
+# include <unfact/platform/posix/ao_atomic_ops.hpp>
+#endif
 #include <pthread.h>
-#include <atomic_ops.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/membarrier.h>
 
 UNFACT_NAMESPACE_BEGIN
 
 /*
- * 
+ * AtomicOps for default_concurrent_t. 
+ * define UNFACT_USE_AO_ATOMIC_OPS to go back to libatomic_ops.
  */
-struct ao_atomic_ops_t
-{
-  typedef AO_t value_type;
-
-  static bool compare_and_swap(volatile value_type* addr, value_type oldval, value_type newval)
-  {
-		return 0 != AO_compare_and_swap_full(addr, oldval, newval);
-  }
-
-  static void barrier()
-  {
-		AO_nop_full();
-  }
-
-  /*
-   * yielding with backoff: 
-   * logic is cloned from boost/detail/spinlock_w32.hpp and slightly modied
-   */
-  static void yield_nth(size_t n)
-  {
-    if (n <  8) {
-			return;
-		} else if (n < 32) {
-			struct timespec tosleep;
-			tosleep.tv_sec = 0;
-			tosleep.tv_nsec = 0;
-			nanosleep(&tosleep, 0);
-			return;
-		} else {
-			struct timespec tosleep;
-			tosleep.tv_sec = 0;
-			tosleep.tv_nsec = 1000;
-			nanosleep(&tosleep, 0);
-			return;
-		}
-  }
-};
-
-template<>
-inline ao_atomic_ops_t::value_type
-atomic_value_cast<ao_atomic_ops_t::value_type, int>(int x)
-{
-	return static_cast<ao_atomic_ops_t::value_type>(x);
-}
-
+#ifdef UNFACT_USE_AO_ATOMIC_OPS
+typedef ao_atomic_ops_t posix_atomic_ops_t;
+#else
+typedef gcc_atomic_ops_t posix_atomic_ops_t;
+#endif
 
+/*
+ * @param destructor is called with non-null value at thread exit.
+ */
 template<size_t StorageID>
 class posix_thread_local_t
 {
 public:
   typedef byte_t* value_type;
+	typedef void (*destructor_type)(void*);
 	
-	posix_thread_local_t()
+	explicit posix_thread_local_t(destructor_type destructor=0)
 	{
-		int err = pthread_key_create(&m_key, NULL);
+		int err = pthread_key_create(&m_key, destructor);
 		UF_ALERT_AND_RETURN_VOID_UNLESS(0 == err, "cannot allocate TLS key!");
 	}
 
@@ -107,11 +79,359 @@ private:
 	pthread_key_t m_key;
 };
 
+/*
+ * native_thread_local_t keeps the value in compiler TLS (__thread), one slot for each 'StorageID'.
+ * get() and set() are plain memory accesses with initial-exec model: no library call, no lazy allocation.
+ *
+ * - initial-exec TLS comes from the static TLS block, so a module that is dlopen()ed
+ *   may fail to load. define UNFACT_USE_PTHREAD_KEY_THREAD_LOCAL for such module.
+ * - 'destructor' is not supported. use posix_thread_local_t if you need it.
+ * - instances of same 'StorageID' share the slot. the slot remembers the epoch of its writer,
+ *   so the value left by destroyed instance never leaks to its successor.
+ *   but live instances of same 'StorageID' should not be used on one thread at a time.
+ */
+template<size_t StorageID>
+class native_thread_local_t
+{
+public:
+  typedef byte_t* value_type;
+	typedef void (*destructor_type)(void*);
+
+	struct slot_t
+	{
+		size_t m_epoch;
+		value_type m_value;
+	};
+
+	explicit native_thread_local_t(destructor_type destructor=0)
+		: m_epoch(fetch_and_add<posix_atomic_ops_t>(&s_epochs, 1) + 1)
+	{
+		UF_ALERT_AND_RETURN_VOID_UNLESS(0 == destructor, "native TLS has no destructor!");
+	}
+
+	value_type get() const { return s_slot.m_epoch == m_epoch ? s_slot.m_value : 0; }
+
+	void set(value_type value) 
+	{ 
+		s_slot.m_epoch = m_epoch;
+		s_slot.m_value = value; 
+	}
+
+	void clear() { set(0); }
+
+private:
+	native_thread_local_t(const native_thread_local_t&);
+	native_thread_local_t& operator=(const native_thread_local_t&);
+
+private:
+	static __thread slot_t s_slot __attribute__((tls_model("initial-exec")));
+	static volatile posix_atomic_ops_t::value_type s_epochs;
+	size_t m_epoch;
+};
+
+template<size_t StorageID>
+__thread typename native_thread_local_t<StorageID>::slot_t native_thread_local_t<StorageID>::s_slot;
+template<size_t StorageID>
+volatile posix_atomic_ops_t::value_type native_thread_local_t<StorageID>::s_epochs = 0;
+
+/*
+ * futex_lock_t is an adaptive mutex: it spins a while, then sleeps in the kernel.
+ * waiters never burn CPU for long, so it behaves well under oversubscription.
+ *
+ * m_state is 0 (unlocked), 1 (locked) or 2 (locked, and someone may be sleeping).
+ * see Ulrich Drepper, "Futexes Are Tricky", mutex3.
+ * futex word should be 32bit, so we use gcc builtins directly instead of AtomicOps.
+ */
+class futex_lock_t
+{
+public:
+	enum { spin_count = 100 };
+
+	futex_lock_t() : m_state(0) {}
+
+	~futex_lock_t()
+	{
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		UF_HONOR_OR_RETURN_VOID(0 == m_state);
+	}
+
+	bool try_acquire() volatile { return 0 == cas_acquire(0, 1); }
+
+	void acquire() volatile
+	{
+		/* spinning phase: read first, not to bounce the cache line */
+		for (size_t i=0; i<spin_count; ++i) {
+			if (0 == m_state && try_acquire()) {
+				return;
+			}
+		}
+
+		int c = cas_acquire(0, 1);
+		if (0 == c) {
+			return;
+		}
+
+		if (2 != c) {
+			c = __atomic_exchange_n(&m_state, 2, __ATOMIC_ACQUIRE);
+		}
+
+		while (0 != c) {
+			futex(FUTEX_WAIT_PRIVATE, 2);
+			c = __atomic_exchange_n(&m_state, 2, __ATOMIC_ACQUIRE);
+		}
+	}
+
+	void release() volatile
+	{
+		if (1 != __atomic_fetch_sub(&m_state, 1, __ATOMIC_RELEASE)) {
+			__atomic_store_n(&m_state, 0, __ATOMIC_RELEASE);
+			futex(FUTEX_WAKE_PRIVATE, 1);
+		}
+	}
+
+private:
+	futex_lock_t(const futex_lock_t&);
+	futex_lock_t& operator=(const futex_lock_t&);
+
+	/* @return the value we saw */
+	int cas_acquire(int oldval, int newval) volatile
+	{
+		__atomic_compare_exchange_n(&m_state, &oldval, newval, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+		return oldval;
+	}
+
+	void futex(int op, int val) volatile
+	{
+		syscall(SYS_futex, const_cast<int*>(&m_state), op, val, 0, 0, 0);
+	}
+
+private:
+	volatile int m_state;
+};
+
+#define UNFACT_HAS_FUTEX_LOCK
+
+/*
+ * posix_quiescence_t implements Quiescence with an in-flight depth for each thread.
+ * enter() and leave() touch only the record of the calling thread: no lock, no shared cache line.
+ * quiesce() raises the closing flag, then waits every registered thread out of its section.
+ * with membarrier(), quiesce() pays the fence that enter() would need. see light_barrier().
+ *
+ * - a thread registers its record on its first enter(), and the key destructor unregisters it at thread exit.
+ * - quiesce() keeps the registry lock until resume(), so no thread comes or goes while fork() is prepared.
+ *   in the child, resume() forgets the records of the threads that fork() left behind.
+ */
+template<class Dummy=void>
+class posix_quiescence_t
+{
+public:
+	typedef posix_atomic_ops_t ops_type;
+	typedef ops_type::value_type value_type;
+	typedef spin_lock_t<ops_type> lock_type;
+
+	struct record_t
+	{
+		volatile value_type m_depth;
+		size_t m_quiescing;
+		record_t* m_prev;
+		record_t* m_next;
+		bool m_linked;
+	};
+
+	static void enter()
+	{
+		record_t* r = &s_record;
+		/* the quiescing thread has the tree to itself: see fork_guard_t::resume_child() */
+		if (0 != r->m_depth || 0 != r->m_quiescing) {
+			r->m_depth = r->m_depth + 1;
+			return;
+		}
+
+		if (!r->m_linked) {
+			link(r);
+		}
+
+		size_t n = 0;
+		while (true) {
+			r->m_depth = 1;
+			/* the depth should be seen before we see the flag: pairs with quiesce() */
+			light_barrier();
+			if (0 == ops_type::load_relaxed(&s_closing)) {
+				return;
+			}
+
+			ops_type::store_release(&r->m_depth, 0);
+			while (0 != ops_type::load_acquire(&s_closing)) {
+				ops_type::yield_nth(n++);
+			}
+		}
+	}
+
+	static void leave()
+	{
+		record_t* r = &s_record;
+		ops_type::store_release(&r->m_depth, r->m_depth - 1);
+	}
+
+	static void quiesce()
+	{
+		record_t* r = &s_record;
+		if (0 != r->m_quiescing++) {
+			return;
+		}
+
+		s_lock.acquire();
+		s_pid = getpid();
+		s_closing = 1;
+		heavy_barrier();
+		for (record_t* i = s_head; 0 != i; i = i->m_next) {
+			if (i == r) {
+				continue;
+			}
+
+			size_t n = 0;
+			while (0 != ops_type::load_acquire(&i->m_depth)) {
+				ops_type::yield_nth(n++);
+			}
+		}
+	}
+
+	static void resume()
+	{
+		record_t* r = &s_record;
+		UF_HONOR_OR_RETURN_VOID(0 < r->m_quiescing);
+		if (0 != --r->m_quiescing) {
+			return;
+		}
+
+		if (getpid() != s_pid) {
+			s_head = 0;
+			if (r->m_linked) {
+				r->m_prev = r->m_next = 0;
+				s_head = r;
+			}
+		}
+
+		ops_type::store_release(&s_closing, 0);
+		s_lock.release();
+	}
+
+private:
+	static void initialize()
+	{
+		long cmds = syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+		s_asymmetric = (0 < cmds && (cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+										0 == syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0));
+		int err = pthread_key_create(&s_key, &unlink_at_exit);
+		UF_ALERT_AND_RETURN_VOID_UNLESS(0 == err, "cannot allocate TLS key!");
+	}
+
+	/*
+	 * asymmetric fences: membarrier() runs a full fence on every running thread of the process,
+	 * so the writer side needs only to keep the compiler from reordering. registration survives fork().
+	 */
+	static void light_barrier()
+	{
+		if (s_asymmetric) {
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		} else {
+			ops_type::barrier();
+		}
+	}
+
+	static void heavy_barrier()
+	{
+		ops_type::barrier();
+		if (s_asymmetric) {
+			long err = syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+			UF_ALERT_AND_RETURN_VOID_UNLESS(0 == err, "membarrier() failed!");
+		}
+	}
+
+	static void link(record_t* r)
+	{
+		pthread_once(&s_once, &initialize);
+		s_lock.acquire();
+		r->m_prev = 0;
+		r->m_next = s_head;
+		if (0 != s_head) {
+			s_head->m_prev = r;
+		}
+		s_head = r;
+		r->m_linked = true;
+		s_lock.release();
+		pthread_setspecific(s_key, r);
+	}
+
+	static void unlink_at_exit(void* p)
+	{
+		record_t* r = reinterpret_cast<record_t*>(p);
+		s_lock.acquire();
+		if (0 != r->m_prev) {
+			r->m_prev->m_next = r->m_next;
+		} else {
+			s_head = r->m_next;
+		}
+		if (0 != r->m_next) {
+			r->m_next->m_prev = r->m_prev;
+		}
+		r->m_linked = false;
+		s_lock.release();
+	}
+
+private:
+	static __thread record_t s_record;
+	static lock_type s_lock;
+	static record_t* s_head;
+	static volatile value_type s_closing;
+	static pid_t s_pid;
+	static bool s_asymmetric;
+	static pthread_once_t s_once;
+	static pthread_key_t s_key;
+};
+
+template<class Dummy>
+__thread typename posix_quiescence_t<Dummy>::record_t posix_quiescence_t<Dummy>::s_record;
+template<class Dummy>
+typename posix_quiescence_t<Dummy>::lock_type posix_quiescence_t<Dummy>::s_lock;
+template<class Dummy>
+typename posix_quiescence_t<Dummy>::record_t* posix_quiescence_t<Dummy>::s_head = 0;
+template<class Dummy>
+volatile typename posix_quiescence_t<Dummy>::value_type posix_quiescence_t<Dummy>::s_closing = 0;
+template<class Dummy>
+pid_t posix_quiescence_t<Dummy>::s_pid = 0;
+template<class Dummy>
+bool posix_quiescence_t<Dummy>::s_asymmetric = false;
+template<class Dummy>
+pthread_once_t posix_quiescence_t<Dummy>::s_once = PTHREAD_ONCE_INIT;
+template<class Dummy>
+pthread_key_t posix_quiescence_t<Dummy>::s_key;
+
 template<>
 struct concurrent_t<posix_platform_tag_t>
 {
-  typedef spin_lock_t<ao_atomic_ops_t> spin_lock_type;
-  typedef rw_lock_t<ao_atomic_ops_t, spin_lock_type> rw_lock_type;
+  typedef spin_lock_t<posix_atomic_ops_t> spin_lock_type;
+  typedef distributed_rw_lock_t<posix_atomic_ops_t, spin_lock_type> rw_lock_type;
+	typedef posix_thread_local_t<0> thread_local_type;
+	typedef posix_atomic_ops_t atomic_ops_type;
+	typedef posix_quiescence_t<> quiescence_type;
+};
+
+/*
+ * futex_concurrent_t is a concurrent policy that replaces locks of 'Base' with futex_lock_t.
+ * for example: 
+ *
+ *   tree_tracer_t<value_type, futex_concurrent_t<default_concurrent_t> > tracer(...);
+ *
+ * note that arena_select_t sees only the outermost policy, 
+ * so it doesn't compose with magazine_concurrent_t or lockfree_concurrent_t.
+ */
+template<class Base>
+struct futex_concurrent_t : public Base
+{
+	typedef Base base_type;
+	typedef futex_lock_t spin_lock_type;
+	typedef distributed_rw_lock_t<typename base_type::atomic_ops_type, spin_lock_type> rw_lock_type;
 };
 
 UNFACT_NAMESPACE_END
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_POSIX_PLATFORM_FORK_HPP
+#define UNFACT_POSIX_PLATFORM_FORK_HPP
+
+#include <unfact/base.hpp>
+#include <unfact/concurrent.hpp>
+#include <pthread.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * fork_guard_t keeps a tracer sane over fork() of multi-threaded processes.
+ * before fork(), the guard quiesces writers and closes the tracer (acquire_all(): the gate of its tree and a few global locks),
+ * so that no half-done change nor held lock is copied to the child. then both processes give them back.
+ * the child also restart()s the tracer by default: scopes stay, but counts start from zero.
+ * pre-fork counts belong to the parent alone, and summing snapshots of the workers never counts them twice.
+ * give option_keep to let the child keep them.
+ *
+ * - guards are chained on the global list. pthread_atfork() handlers are installed at the first guard.
+ * - tracing threads just wait at their next write section during fork(). see posix_quiescence_t.
+ * - iterations over the tracer by hand lock nodes out of write sections: don't run them across fork().
+ *   copy_scopes() (and so snapshots) are fine.
+ * - forks without atfork handlers (vfork(), raw clone()) are not guarded.
+ * - items cached by other threads in magazine_arena_t leak in the child.
+ * - live_tracer_t shares its region with the child. don't trace on it in the child.
+ *
+ * @param Tracer heap_tracer_t or sticky_tracer_t
+ */
+class fork_guard_base_t
+{
+public:
+	fork_guard_base_t() : m_next(0), m_prev(0) {}
+	virtual ~fork_guard_base_t() {}
+
+	virtual void prepare_fork() = 0;
+	virtual void resume_parent() = 0;
+	virtual void resume_child() = 0;
+
+public: // implementation detail
+	fork_guard_base_t* m_next;
+	fork_guard_base_t* m_prev;
+
+private:
+	fork_guard_base_t(const fork_guard_base_t&);
+	const fork_guard_base_t& operator=(const fork_guard_base_t&);
+};
+
+/* template just to define static members in the header */
+template<class Dummy=void>
+class basic_fork_registry_t
+{
+public:
+	struct list_t
+	{
+		list_t() : m_head(0), m_installed(false) {}
+		void acquire() const { m_lock.acquire(); }
+		void release() const { m_lock.release(); }
+
+		mutable default_concurrent_t::spin_lock_type m_lock;
+		fork_guard_base_t* m_head;
+		bool m_installed;
+	};
+
+	static bool add(fork_guard_base_t* guard)
+	{
+		lock_scope_t<list_t> l(&s_list);
+		if (!s_list.m_installed) {
+			int err = pthread_atfork(&prepare_all, &parent_all, &child_all);
+			UF_ALERT_AND_RETURN_UNLESS(0 == err, false, "cannot install fork handlers!");
+			s_list.m_installed = true;
+		}
+
+		guard->m_next = s_list.m_head;
+		guard->m_prev = 0;
+		if (s_list.m_head) { s_list.m_head->m_prev = guard; }
+		s_list.m_head = guard;
+		return true;
+	}
+
+	static void remove(fork_guard_base_t* guard)
+	{
+		lock_scope_t<list_t> l(&s_list);
+		if (guard->m_prev) { 
+			guard->m_prev->m_next = guard->m_next; 
+		} else if (s_list.m_head == guard) {
+			s_list.m_head = guard->m_next;
+		}
+
+		if (guard->m_next) { guard->m_next->m_prev = guard->m_prev; }
+		guard->m_next = guard->m_prev = 0;
+	}
+
+private:
+	/* the list lock is held over fork(), so that guards don't come nor go */
+	static void prepare_all()
+	{
+		s_list.acquire();
+		for (fork_guard_base_t* g = s_list.m_head; g; g = g->m_next) { g->prepare_fork(); }
+	}
+
+	static void parent_all()
+	{
+		for (fork_guard_base_t* g = s_list.m_head; g; g = g->m_next) { g->resume_parent(); }
+		s_list.release();
+	}
+
+	static void child_all()
+	{
+		for (fork_guard_base_t* g = s_list.m_head; g; g = g->m_next) { g->resume_child(); }
+		s_list.release();
+	}
+
+	static list_t s_list;
+};
+
+template<class Dummy> typename basic_fork_registry_t<Dummy>::list_t basic_fork_registry_t<Dummy>::s_list;
+
+typedef basic_fork_registry_t<> fork_registry_t;
+
+template<class Tracer>
+class fork_guard_t : public fork_guard_base_t
+{
+public:
+	typedef Tracer tracer_type;
+
+	enum option_e {
+		option_restart = 0x0000,
+		option_keep    = 0x0001,
+		option_default = option_restart
+	};
+
+	explicit fork_guard_t(tracer_type* tracer, option_e opts=option_default)
+		: m_tracer(tracer), m_options(opts)
+	{
+		fork_registry_t::add(this);
+	}
+
+	virtual ~fork_guard_t() { fork_registry_t::remove(this); }
+
+	virtual void prepare_fork() { m_tracer->acquire_all(); }
+	virtual void resume_parent() { m_tracer->release_all(); }
+
+	virtual void resume_child()
+	{
+		m_tracer->release_all();
+		if (!(m_options & option_keep)) {
+			m_tracer->restart();
+		}
+	}
+
+private:
+	tracer_type* m_tracer;
+	option_e m_options;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_POSIX_PLATFORM_FORK_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_POSIX_PLATFORM_LIVE_REGION_HPP
+#define UNFACT_POSIX_PLATFORM_LIVE_REGION_HPP
+
+#include <unfact/live_view.hpp>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <new>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * live_region_t is a shared memory region of a fixed size.
+ * the writer create()s it, and readers attach() it read-only, from other processes.
+ *
+ * - without a name, the region is anonymous: memfd_create(), or shm_open() and unlink() if it is missing.
+ *   readers open it by "/proc/<pid>/fd/<fd>", that is given by path().
+ * - with a name like "/foo", it is shm_open()-ed and readers open "/dev/shm/foo".
+ *   we unlink the name at close().
+ */
+class live_region_t
+{
+public:
+	live_region_t() : m_fd(-1), m_head(0), m_size(0), m_owner(false) { m_name[0] = m_path[0] = '\0'; }
+	~live_region_t() { close(); }
+
+	bool create(size_t size, const char* name=0)
+	{
+		close();
+
+		if (name) {
+			UF_ALERT_AND_RETURN_UNLESS('/' == name[0] && copy(m_name, name), false, "bad live region name!");
+			m_fd = shm_open(m_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+			UF_ALERT_AND_RETURN_UNLESS(0 <= m_fd, false, "cannot create live region!");
+			m_owner = true;
+			snprintf(m_path, sizeof(m_path), "/dev/shm%s", m_name);
+		} else {
+#ifdef MFD_CLOEXEC
+			m_fd = memfd_create("unfact-live", MFD_CLOEXEC);
+#endif
+			if (m_fd < 0) {
+				char tmp[64];
+				snprintf(tmp, sizeof(tmp), "/unfact-live.%d.%p", int(getpid()), static_cast<void*>(this));
+				m_fd = shm_open(tmp, O_RDWR | O_CREAT | O_EXCL, 0600);
+				if (0 <= m_fd) { shm_unlink(tmp); }
+			}
+
+			UF_ALERT_AND_RETURN_UNLESS(0 <= m_fd, false, "cannot create live region!");
+			snprintf(m_path, sizeof(m_path), "/proc/%d/fd/%d", int(getpid()), m_fd);
+		}
+
+		void* head = MAP_FAILED;
+		if (0 == ftruncate(m_fd, size)) {
+			head = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		}
+
+		if (MAP_FAILED == head) {
+			close();
+			UF_ALERT_AND_RETURN_UNLESS(false, false, "cannot map live region!");
+		}
+
+		m_head = reinterpret_cast<byte_t*>(head);
+		m_size = size;
+		return true;
+	}
+
+	bool attach(const char* path)
+	{
+		close();
+
+		int fd = ::open(path, O_RDONLY);
+		UF_ALERT_AND_RETURN_UNLESS(0 <= fd, false, "cannot open live region!");
+
+		struct stat st;
+		void* head = MAP_FAILED;
+		if (0 == fstat(fd, &st) && 0 < st.st_size) {
+			head = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		}
+
+		::close(fd);
+		UF_ALERT_AND_RETURN_UNLESS(MAP_FAILED != head, false, "cannot map live region!");
+		m_head = reinterpret_cast<byte_t*>(head);
+		m_size = st.st_size;
+		copy(m_path, path);
+		return true;
+	}
+
+	void close()
+	{
+		if (m_head) {
+			munmap(m_head, m_size);
+		}
+
+		if (0 <= m_fd) {
+			::close(m_fd);
+		}
+
+		if (m_owner) {
+			shm_unlink(m_name);
+		}
+
+		m_fd = -1;
+		m_head = 0;
+		m_size = 0;
+		m_owner = false;
+		m_name[0] = m_path[0] = '\0';
+	}
+
+	bool opened() const { return 0 != m_head; }
+	byte_t* head() const { return m_head; }
+	size_t size() const { return m_size; }
+	/* the path for readers. */
+	const char* path() const { return m_path; }
+
+private:
+	live_region_t(const live_region_t&);
+	const live_region_t& operator=(const live_region_t&);
+
+	template<size_t N>
+	static bool copy(char (&to)[N], const char* from)
+	{
+		int len = snprintf(to, N, "%s", from);
+		return 0 <= len && size_t(len) < N;
+	}
+
+	int m_fd;
+	byte_t* m_head;
+	size_t m_size;
+	bool m_owner;
+	char m_name[256];
+	char m_path[1024];
+};
+
+/*
+ * live_region_allocator_t carves blocks from [begin, end) of the region. 
+ * blocks have its size in front of them, and freed ones go to the free list
+ * of its power-of-2 class. we don't split nor coalesce: tracers on optimistic_concurrent_t
+ * never give arena pages back, so most blocks live until the end.
+ */
+class live_region_allocator_t : public allocator_t
+{
+public:
+	typedef default_concurrent_t::spin_lock_type lock_type;
+	typedef live_region_allocator_t self_type;
+
+	enum {
+		block_header_size = 16,
+		nclasses = sizeof(size_t)*8,
+		max_fit_walk = 8
+	};
+
+	struct block_t
+	{
+		size_t   m_size;
+		block_t* m_next;
+	};
+
+	live_region_allocator_t() : m_begin(0), m_end(0), m_top(0) 
+	{
+		for (size_t i=0; i<nclasses; ++i) { m_free[i] = 0; }
+	}
+
+	void assign(byte_t* begin, byte_t* end)
+	{
+		m_begin = m_top = reinterpret_cast<byte_t*>(roundup_to_p2(reinterpret_cast<size_t>(begin), block_header_size));
+		m_end = end;
+		for (size_t i=0; i<nclasses; ++i) { m_free[i] = 0; }
+	}
+
+	virtual byte_t* allocate(size_t size)
+	{
+		size_t bsize = roundup_to_p2(size + block_header_size, block_header_size);
+		lock_scope_t<self_type> l(this);
+		block_t* block = pop_fit(bsize);
+		if (!block) {
+			UF_ALERT_AND_RETURN_UNLESS(bsize <= size_t(m_end - m_top), 0, "live region is full!");
+			block = reinterpret_cast<block_t*>(m_top);
+			block->m_size = bsize;
+			m_top += bsize;
+		}
+
+		return reinterpret_cast<byte_t*>(block) + block_header_size;
+	}
+
+	virtual void deallocate(byte_t* ptr)
+	{
+		if (!ptr) {
+			return;
+		}
+
+		block_t* block = reinterpret_cast<block_t*>(ptr - block_header_size);
+		UF_HONOR_OR_RETURN_VOID(m_begin <= reinterpret_cast<byte_t*>(block) && ptr < m_top);
+		lock_scope_t<self_type> l(this);
+		size_t cls = class_of(block->m_size);
+		block->m_next = m_free[cls];
+		m_free[cls] = block;
+	}
+
+	size_t used() const { return lock_scope_t<const self_type>(this)->m_top - m_begin; }
+	size_t capacity() const { return m_end - m_begin; }
+
+	void acquire() const { m_lock.acquire(); }
+	void release() const { m_lock.release(); }
+
+	/* floor(log2(size)) */
+	static size_t class_of(size_t size)
+	{
+		size_t cls = 0;
+		while (size >>= 1) { ++cls; }
+		return cls;
+	}
+
+private:
+	live_region_allocator_t(const live_region_allocator_t&);
+	const live_region_allocator_t& operator=(const live_region_allocator_t&);
+
+	/* first fit in own class for a while, then any block of larger classes */
+	block_t* pop_fit(size_t size)
+	{
+		size_t cls = class_of(size);
+		block_t** prev = &m_free[cls];
+		for (size_t i=0; *prev && i<max_fit_walk; ++i, prev = &(*prev)->m_next) {
+			if (size <= (*prev)->m_size) {
+				block_t* ret = *prev;
+				*prev = ret->m_next;
+				return ret;
+			}
+		}
+
+		for (size_t c=cls+1; c<nclasses; ++c) {
+			if (m_free[c]) {
+				block_t* ret = m_free[c];
+				m_free[c] = ret->m_next;
+				return ret;
+			}
+		}
+
+		return 0;
+	}
+
+	mutable lock_type m_lock;
+	byte_t* m_begin;
+	byte_t* m_end;
+	byte_t* m_top;
+	block_t* m_free[nclasses];
+};
+
+template<class DeltaTrace, class Concurrent> class heap_tracer_t;
+
+/*
+ * only the tree goes on the region, that is of a fixed size. the rest of a tracer,
+ * like the heap set of heap_tracer_t, is private to the writer and comes from 'local'.
+ */
+template<class Tracer>
+struct live_tracer_traits_t
+{
+	static Tracer* make(byte_t* mem, allocator_t* shared, allocator_t* /*local*/, size_t page_size)
+	{
+		return new (mem) Tracer(shared, page_size);
+	}
+};
+
+template<class DeltaTrace, class Concurrent>
+struct live_tracer_traits_t< heap_tracer_t<DeltaTrace, Concurrent> >
+{
+	typedef heap_tracer_t<DeltaTrace, Concurrent> tracer_type;
+
+	static tracer_type* make(byte_t* mem, allocator_t* shared, allocator_t* local, size_t page_size)
+	{
+		return new (mem) tracer_type(shared, page_size, DEFAULT_PAGE_SIZE, local);
+	}
+};
+
+/*
+ * live_tracer_t puts a tracer and its tree on live_region_t, for live_tracer_view_t of other processes.
+ * the region has a fixed size: the tracer can't grow after the region is full.
+ *
+ * @param Tracer heap_tracer_t or sticky_tracer_t on optimistic_concurrent_t, like live_heap_tracer_t
+ */
+template<class Tracer>
+class live_tracer_t
+{
+public:
+	typedef Tracer tracer_type;
+	typedef typename tracer_type::tracer_type tree_tracer_type;
+	typedef live_tracer_view_t<tree_tracer_type> view_type;
+	typedef typename view_type::node_type node_type;
+	typedef typename tree_tracer_type::value_type value_type;
+	typedef typename tree_tracer_type::concurrent_type concurrent_type;
+
+	enum { header_size = 256 };
+
+	live_tracer_t() : m_tracer(0) {}
+	~live_tracer_t() { close(); }
+
+	/*
+	 * creates the region and the tracer on it. see live_region_t::create() for 'name'.
+	 */
+	bool open(size_t size, const char* name=0, size_t page_size=DEFAULT_PAGE_SIZE)
+	{
+		close();
+		UF_ALERT_AND_RETURN_UNLESS(sizeof(live_header_t) <= size_t(header_size) && header_size < size, false, "too small live region!");
+		if (!m_region.create(size, name)) {
+			return false;
+		}
+
+		m_allocator.assign(m_region.head() + header_size, m_region.head() + size);
+		byte_t* mem = m_allocator.allocate(sizeof(tracer_type));
+		if (!mem) {
+			close();
+			return false;
+		}
+
+		m_tracer = live_tracer_traits_t<tracer_type>::make(mem, &m_allocator, &m_local, page_size);
+
+		live_header_t* header = reinterpret_cast<live_header_t*>(m_region.head());
+		header->m_version = live_version;
+		header->m_header_size = header_size;
+		header->m_node_size = sizeof(node_type);
+		header->m_value_size = sizeof(value_type);
+		header->m_base = reinterpret_cast<size_t>(m_region.head());
+		header->m_size = size;
+		header->m_root = reinterpret_cast<size_t>(m_tracer->root());
+		header->m_pid = getpid();
+		live_schema_t::make<value_type>(header->m_schema, sizeof(header->m_schema));
+		concurrent_type::atomic_ops_type::barrier();
+		memcpy(header->m_magic, live_header_t::magic(), sizeof(header->m_magic));
+		return true;
+	}
+
+	/* no one should be tracing */
+	void close()
+	{
+		if (m_tracer) {
+			m_tracer->~tracer_type();
+			m_allocator.deallocate(reinterpret_cast<byte_t*>(m_tracer));
+			m_tracer = 0;
+		}
+
+		m_region.close();
+	}
+
+	bool opened() const { return 0 != m_tracer; }
+	tracer_type* tracer() const { return m_tracer; }
+	const live_region_t& region() const { return m_region; }
+	const live_region_allocator_t& allocator() const { return m_allocator; }
+	/* readers attach() this */
+	const char* path() const { return m_region.path(); }
+
+private:
+	live_tracer_t(const live_tracer_t&);
+	const live_tracer_t& operator=(const live_tracer_t&);
+
+	live_region_t m_region;
+	live_region_allocator_t m_allocator;
+	stdlib_allocator_t m_local;
+	tracer_type* m_tracer;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_POSIX_PLATFORM_LIVE_REGION_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_POSIX_PLATFORM_MMAP_ALLOCATOR_HPP
+#define UNFACT_POSIX_PLATFORM_MMAP_ALLOCATOR_HPP
+
+#include <unfact/base.hpp>
+#include <unfact/memory.hpp>
+#include <unfact/concurrent.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+enum {
+	DEFAULT_MMAP_RESERVE_SIZE =
+#ifdef UNFACT_HAS_DEFAULT_MMAP_RESERVE_SIZE
+	UNFACT_DEFAULT_MMAP_RESERVE_SIZE
+#else
+	64*1024*1024
+#endif
+};
+
+/*
+ * mmap_allocator_t gets memory directly from the kernel, bypassing malloc.
+ * it keeps profiler-internal memory away from the heap we are profiling.
+ *
+ * - at construction, we reserve a large virtual region (MAP_NORESERVE), 
+ *   and advise the kernel to back it by transparent huge pages.
+ *   with option_hugetlb, we first try MAP_HUGETLB, that requires preallocated huge pages.
+ * - small blocks (up to max_class_size) are carved from "superblocks" of the region.
+ *   each superblock serves single power-of-2 size class, and the class of each superblock
+ *   is recorded in the side table at the head of the region. 
+ *   freed blocks go to the free list of its class.
+ * - large blocks, and any blocks after the region runs out, are mapped by mmap() individually
+ *   with a header page in front of them.
+ *
+ * blocks of a size class are aligned to the class size, so allocate_aligned() is cheap.
+ * the region is given back at destruction, regardless of living blocks.
+ */
+class mmap_allocator_t : public allocator_t
+{
+public:
+	typedef default_concurrent_t::spin_lock_type lock_type;
+	typedef mmap_allocator_t self_type;
+
+	enum option_e {
+		option_none    = 0x0000,
+		option_hugetlb = 0x0001,
+		option_default = option_none
+	};
+
+	enum {
+		superblock_size = 64*1024,
+		min_class_shift = 4,  // 16 bytes
+		max_class_shift = 15, // 32K bytes
+		nclasses = max_class_shift - min_class_shift + 1,
+		max_class_size = 1 << max_class_shift,
+		huge_page_size = 2*1024*1024,
+		unused_class = 0xff
+	};
+
+	/* we put it on the header page of large blocks */
+	struct large_header_t
+	{
+		byte_t* m_base;
+		size_t  m_length;
+	};
+
+	struct chain_t
+	{
+		chain_t* m_next;
+	};
+
+	explicit mmap_allocator_t(size_t reserve_size=DEFAULT_MMAP_RESERVE_SIZE, option_e opts=option_default)
+		: m_raw(0), m_raw_size(0), m_base(0), m_nsuperblocks(0), m_nused(0), 
+			m_page_size(sysconf(_SC_PAGESIZE)), m_nlarge(0), m_hugetlb(false)
+	{
+		for (size_t i=0; i<nclasses; ++i) {
+			m_free[i] = 0;
+			m_bump[i] = 0;
+			m_bump_end[i] = 0;
+		}
+
+		reserve(roundup_to_p2(reserve_size, superblock_size), opts);
+	}
+
+	virtual ~mmap_allocator_t()
+	{
+		if (0 < m_nlarge) { UF_ERROR(("found possible leak (%lu large blocks) in mmap_allocator_t", static_cast<unsigned long>(m_nlarge))); }
+		if (m_raw) {
+			munmap(m_raw, m_raw_size);
+		}
+	}
+
+	virtual byte_t* allocate(size_t size)
+	{
+		if (size <= max_class_size) {
+			byte_t* ret = allocate_small(class_of(size));
+			if (ret) {
+				return ret;
+			}
+		}
+
+		return allocate_large(size, m_page_size);
+	}
+
+	virtual void deallocate(byte_t* ptr)
+	{
+		if (!ptr) {
+			return;
+		}
+
+		if (in_region(ptr)) {
+			deallocate_small(ptr);
+		} else {
+			deallocate_large(ptr);
+		}
+	}
+
+	virtual byte_t* allocate_aligned(size_t size, size_t align)
+	{
+		/* small blocks are aligned to their class size */
+		size_t sz = max_of(size, align);
+		if (sz <= max_class_size) {
+			byte_t* ret = allocate_small(class_of(sz));
+			if (ret) {
+				return ret;
+			}
+		}
+
+		return allocate_large(size, max_of(align, m_page_size));
+	}
+
+	virtual void deallocate_aligned(byte_t* ptr) { deallocate(ptr); }
+
+	size_t reserved() const { return m_nsuperblocks*superblock_size; }
+	size_t nused_superblocks() const { return lock_scope_t<const self_type>(this)->m_nused; }
+	size_t nlarge() const { return lock_scope_t<const self_type>(this)->m_nlarge; }
+	bool hugetlb() const { return m_hugetlb; }
+
+	void acquire() const { m_lock.acquire(); }
+	void release() const { m_lock.release(); }
+
+	static size_t class_size(size_t cls) { return size_t(1) << (cls + min_class_shift); }
+
+	static size_t class_of(size_t size)
+	{
+		size_t cls = 0;
+		while (class_size(cls) < size) { ++cls; }
+		return cls;
+	}
+
+private:
+	mmap_allocator_t(const mmap_allocator_t&);
+	const mmap_allocator_t& operator=(const mmap_allocator_t&);
+
+	void reserve(size_t size, option_e opts)
+	{
+		/* one extra superblock to align the region */
+		size_t raw_size = size + superblock_size;
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+		void* raw = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+		if (opts & option_hugetlb) {
+			size_t huge_size = roundup_to_p2(raw_size, huge_page_size);
+			raw = mmap(0, huge_size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+			if (MAP_FAILED != raw) {
+				m_hugetlb = true;
+				raw_size = huge_size;
+			}
+		}
+#else
+		(void)opts;
+#endif
+
+		if (MAP_FAILED == raw) {
+			raw = mmap(0, raw_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		}
+
+		UF_ALERT_AND_RETURN_VOID_UNLESS(MAP_FAILED != raw, "failed to reserve the region: fallback to individual mmap()");
+
+#ifdef MADV_HUGEPAGE
+		if (!m_hugetlb) {
+			madvise(raw, raw_size, MADV_HUGEPAGE); // it's just an advice: ignore failure.
+		}
+#endif
+
+		m_raw = reinterpret_cast<byte_t*>(raw);
+		m_raw_size = raw_size;
+		m_base = reinterpret_cast<byte_t*>(roundup_to_p2(reinterpret_cast<size_t>(m_raw), superblock_size));
+		m_nsuperblocks = size/superblock_size;
+
+		/* side table occupies first superblock(s) */
+		m_nused = (m_nsuperblocks + superblock_size - 1)/superblock_size;
+		for (size_t i=0; i<m_nused; ++i) {
+			table()[i] = unused_class;
+		}
+	}
+
+	byte_t* table() const { return m_base; }
+
+	bool in_region(const byte_t* ptr) const
+	{
+		return m_base <= ptr && ptr < m_base + m_nsuperblocks*superblock_size;
+	}
+
+	byte_t* allocate_small(size_t cls)
+	{
+		lock_scope_t<self_type> l(this);
+
+		if (m_free[cls]) {
+			chain_t* ret = m_free[cls];
+			m_free[cls] = ret->m_next;
+			return reinterpret_cast<byte_t*>(ret);
+		}
+
+		if (m_bump[cls] == m_bump_end[cls]) {
+			if (m_nused == m_nsuperblocks) {
+				return 0;
+			}
+
+			size_t sb = m_nused++;
+			table()[sb] = static_cast<byte_t>(cls);
+			m_bump[cls] = m_base + sb*superblock_size;
+			m_bump_end[cls] = m_bump[cls] + superblock_size;
+		}
+
+		byte_t* ret = m_bump[cls];
+		m_bump[cls] += class_size(cls);
+		return ret;
+	}
+
+	void deallocate_small(byte_t* ptr)
+	{
+		lock_scope_t<self_type> l(this);
+		size_t cls = table()[(ptr - m_base)/superblock_size];
+		UF_HONOR_OR_RETURN_VOID(cls < nclasses);
+		chain_t* ch = reinterpret_cast<chain_t*>(ptr);
+		ch->m_next = m_free[cls];
+		m_free[cls] = ch;
+	}
+
+	/*
+	 * large block layout: [padding][header page][block...]
+	 */
+	byte_t* allocate_large(size_t size, size_t align)
+	{
+		size_t length = roundup_to_p2(size, m_page_size) + m_page_size + (align - m_page_size);
+		void* raw = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		UF_ALERT_AND_RETURN_UNLESS(MAP_FAILED != raw, 0, "mmap() failed!");
+
+		byte_t* base = reinterpret_cast<byte_t*>(raw);
+		byte_t* ret = reinterpret_cast<byte_t*>(roundup_to_p2(reinterpret_cast<size_t>(base + m_page_size), align));
+		large_header_t* header = reinterpret_cast<large_header_t*>(ret - m_page_size);
+		header->m_base = base;
+		header->m_length = length;
+
+		lock_scope_t<self_type> l(this);
+		m_nlarge++;
+		return ret;
+	}
+
+	void deallocate_large(byte_t* ptr)
+	{
+		large_header_t* header = reinterpret_cast<large_header_t*>(ptr - m_page_size);
+		munmap(header->m_base, header->m_length);
+
+		lock_scope_t<self_type> l(this);
+		m_nlarge--;
+	}
+
+private:
+	mutable lock_type m_lock;
+	byte_t* m_raw;
+	size_t  m_raw_size;
+	byte_t* m_base;
+	size_t  m_nsuperblocks;
+	size_t  m_nused;
+	size_t  m_page_size;
+	size_t  m_nlarge;
+	bool    m_hugetlb;
+	chain_t* m_free[nclasses];
+	byte_t*  m_bump[nclasses];
+	byte_t*  m_bump_end[nclasses];
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_POSIX_PLATFORM_MMAP_ALLOCATOR_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_POSIX_PLATFORM_REPORTER_THREAD_HPP
+#define UNFACT_POSIX_PLATFORM_REPORTER_THREAD_HPP
+
+#include <unfact/base.hpp>
+#include <unfact/memory.hpp>
+#include <unfact/interval.hpp>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * reporter_thread_t reports attached tracers in intervals from its own thread, 
+ * so that nobody has to call UFX_*_TRACE_REPORT() from application code.
+ * every interval, each job takes a snapshot of its tracer (per-node locks only, see tracing_snapshot_t::take()),
+ * and gives what changed since the last one to its IntervalSink. see interval_tracker_t.
+ * attach with interval_reset_tag_t to fill() the tracer right after the snapshot,
+ * that makes counters of sticky_tracer_t per interval instead of lifetime.
+ *
+ * - jobs run under the reporter lock: attach() and detach() wait for a report in progress.
+ * - tracers and sinks should outlive their jobs. detach() them, or destroy the reporter first.
+ *   tracing_annotation_context_t can be fini()-ed after the reporter is gone: see attach() with 'link'.
+ * - the thread is not copied to the child of fork(). start() it again there if you need it.
+ */
+class reporter_thread_t : public interval_reporter_base_t
+{
+public:
+	explicit reporter_thread_t(allocator_t* allocator)
+		: m_allocator(allocator), m_head(0), m_interval_ms(0), m_running(false), m_stopping(false)
+	{
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&m_cond, &attr);
+		pthread_condattr_destroy(&attr);
+		pthread_mutex_init(&m_mutex, 0);
+	}
+
+	virtual ~reporter_thread_t()
+	{
+		stop();
+		while (m_head) {
+			detach(m_head->tracer());
+		}
+
+		pthread_cond_destroy(&m_cond);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	template<class Tracer, class Sink>
+	bool attach(Tracer* tracer, Sink* sink) { return attach(tracer, sink, interval_keep_tag_t()); }
+
+	/*
+	 * starts reporting 'tracer' to 'sink'. the first interval begins here.
+	 * @param Reset interval_reset_tag_t or interval_keep_tag_t
+	 */
+	template<class Tracer, class Sink, class Reset>
+	bool attach(Tracer* tracer, Sink* sink, const Reset& reset) { return attach(tracer, sink, reset, 0); }
+
+	/*
+	 * @param link is set to 0 when the job goes away, by detach() or by our destructor.
+	 *        attachers that keep a pointer to us give it, so that they never call a dead reporter.
+	 */
+	template<class Tracer, class Sink, class Reset>
+	bool attach(Tracer* tracer, Sink* sink, const Reset&, interval_reporter_base_t** link)
+	{
+		typedef interval_job_t<Tracer, Sink, Reset> job_type;
+		byte_t* mem = m_allocator->allocate(sizeof(job_type));
+		UF_ALERT_AND_RETURN_UNLESS(mem, false, "failed to allocate memory for reporter job!");
+		job_type* job = new (mem) job_type(tracer, sink, m_allocator);
+		job->m_link = link;
+
+		pthread_mutex_lock(&m_mutex);
+		bool ok = job->prime();
+		if (ok) {
+			job->m_stamp = now();
+			job->m_next = m_head;
+			m_head = job;
+		}
+
+		pthread_mutex_unlock(&m_mutex);
+		if (!ok) {
+			destroy(job);
+			UF_ALERT(("cannot take the base of the interval!"));
+		}
+
+		return ok;
+	}
+
+	/* @return false if 'tracer' is not attached */
+	virtual bool detach(const void* tracer)
+	{
+		pthread_mutex_lock(&m_mutex);
+		interval_job_base_t* found = 0;
+		for (interval_job_base_t** p = &m_head; *p; p = &((*p)->m_next)) {
+			if ((*p)->tracer() == tracer) {
+				found = *p;
+				*p = found->m_next;
+				break;
+			}
+		}
+
+		pthread_mutex_unlock(&m_mutex);
+		if (found) {
+			destroy(found);
+		}
+
+		return 0 != found;
+	}
+
+	bool start(size_t interval_ms)
+	{
+		UF_ALERT_AND_RETURN_UNLESS(!m_running, false, "reporter thread is already running!");
+		UF_ALERT_AND_RETURN_UNLESS(0 < interval_ms, false, "reporting interval should be positive!");
+		m_interval_ms = interval_ms;
+		m_stopping = false;
+		int err = pthread_create(&m_thread, 0, &main_of, this);
+		UF_ALERT_AND_RETURN_UNLESS(0 == err, false, "cannot create reporter thread!");
+		m_running = true;
+		return true;
+	}
+
+	void stop()
+	{
+		if (!m_running) {
+			return;
+		}
+
+		pthread_mutex_lock(&m_mutex);
+		m_stopping = true;
+		pthread_cond_signal(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+		pthread_join(m_thread, 0);
+		m_running = false;
+	}
+
+	bool running() const { return m_running; }
+	size_t interval_ms() const { return m_interval_ms; }
+
+	/* reports all jobs here, without waiting for the thread. @return false if any of them failed */
+	bool report_now()
+	{
+		pthread_mutex_lock(&m_mutex);
+		bool ok = report_all();
+		pthread_mutex_unlock(&m_mutex);
+		return ok;
+	}
+
+public: // implementation detail
+	static double now()
+	{
+		struct timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return double(t.tv_sec) + double(t.tv_nsec)*1e-9;
+	}
+
+	static void* main_of(void* self)
+	{
+		reinterpret_cast<reporter_thread_t*>(self)->loop();
+		return 0;
+	}
+
+	void loop()
+	{
+		pthread_mutex_lock(&m_mutex);
+		while (!m_stopping) {
+			struct timespec deadline;
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			deadline.tv_sec += m_interval_ms/1000;
+			deadline.tv_nsec += long(m_interval_ms%1000)*1000000;
+			if (1000000000 <= deadline.tv_nsec) {
+				deadline.tv_sec += 1;
+				deadline.tv_nsec -= 1000000000;
+			}
+
+			/* spurious wakeups just wait again */
+			while (!m_stopping && ETIMEDOUT != pthread_cond_timedwait(&m_cond, &m_mutex, &deadline)) {}
+			if (!m_stopping) {
+				report_all();
+			}
+		}
+
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	/* under m_mutex */
+	bool report_all()
+	{
+		bool ok = true;
+		for (interval_job_base_t* j = m_head; j; j = j->m_next) {
+			double stamp = now();
+			ok = j->run(stamp - j->m_stamp) && ok;
+			j->m_stamp = stamp;
+		}
+
+		return ok;
+	}
+
+	void destroy(interval_job_base_t* job)
+	{
+		if (job->m_link) {
+			*(job->m_link) = 0;
+		}
+
+		job->~interval_job_base_t();
+		m_allocator->deallocate(reinterpret_cast<byte_t*>(job));
+	}
+
+private:
+	reporter_thread_t(const reporter_thread_t&);
+	const reporter_thread_t& operator=(const reporter_thread_t&);
+
+private:
+	allocator_t* m_allocator;
+	interval_job_base_t* m_head;
+	size_t m_interval_ms;
+	bool m_running;
+	volatile bool m_stopping;
+	pthread_t m_thread;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_POSIX_PLATFORM_REPORTER_THREAD_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
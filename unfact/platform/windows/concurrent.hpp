@@ -37,7 +37,7 @@ extern "C" void _ReadWriteBarrier();
 UNFACT_NAMESPACE_BEGIN
 
 /*
- * ao_atomic_ops_t implements imaginary AtomicOps concept that provides CPU depenent atomic operation.
+ * windows_atomic_ops_t implements imaginary AtomicOps concept that provides CPU depenent atomic operation.
  * Such atomic operations are mainly used to implement lightweight synchronization primitive like spin locks.
  *
  * although yield_nth() is not an atomic operation, we give it here for convenience.
@@ -52,11 +52,56 @@ struct windows_atomic_ops_t
 			(oldval == ::InterlockedCompareExchangePointer(reinterpret_cast<volatile PVOID*>(addr), newval, oldval));
   }
 
+  /* Interlocked* are full barriers. we have nothing weaker */
+  static bool compare_and_swap_acquire(volatile value_type* addr, value_type oldval, value_type newval)
+  {
+		return compare_and_swap(addr, oldval, newval);
+  }
+
+  static value_type fetch_and_add(volatile value_type* addr, int delta)
+  {
+		value_type x;
+		do {
+			x = *addr;
+		} while (!compare_and_swap(addr, x, x+delta));
+
+		return x;
+  }
+
+  static value_type fetch_and_add_relaxed(volatile value_type* addr, size_t delta)
+  {
+		value_type x;
+		do {
+			x = *addr;
+		} while (!compare_and_swap(addr, x, x+delta));
+
+		return x;
+  }
+
+  static value_type load_relaxed(const volatile value_type* addr) { return *addr; }
+
+  /* x86/x64 never reorders loads with loads, nor stores with stores: compiler barrier is enough */
+  static value_type load_acquire(const volatile value_type* addr)
+  {
+		value_type x = *addr;
+		barrier();
+		return x;
+  }
+
+  static void store_release(volatile value_type* addr, value_type value)
+  {
+		barrier();
+		*addr = value;
+  }
+
   static void barrier()
   {
 		::_ReadWriteBarrier();
   }
 
+	/* distinguishes threads. see distributed_rw_lock_t */
+	static size_t thread_hint() { return static_cast<size_t>(::GetCurrentThreadId()); }
+
   /*
    * yielding with backoff: 
    * logic is cloned from boost/detail/spinlock_w32.hpp and slightly modied
@@ -75,39 +120,130 @@ struct windows_atomic_ops_t
   }
 };
 
+/*
+ * windows_fls_destructors_t adapts destructor_type of thread locals to PFLS_CALLBACK_FUNCTION,
+ * that has WINAPI calling convention and no room for context: 
+ * each live thread local with a destructor occupies one of 'nslots' static trampolines.
+ *
+ * FlsFree() calls the callback for every thread that has a value, unlike pthread_key_delete().
+ * so we disarm the trampoline before FlsFree() and recycle it only after that.
+ */
+template<class Dummy=void>
+struct windows_fls_destructors_t
+{
+	typedef void (*destructor_type)(void*);
+	enum { nslots = 128 }; // as many as FLS indices of older windows. slab_allocator_t takes one per class
+
+	/* @return nslots if all trampolines are busy */
+	static size_t claim(destructor_type destructor)
+	{
+		for (size_t i=0; i<nslots; ++i) {
+			if (0 == InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&s_destructors[i]), 
+																								 reinterpret_cast<PVOID>(destructor), 0)) {
+				return i;
+			}
+		}
+
+		return nslots;
+	}
+
+	static void disarm(size_t i) { InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&s_destructors[i]), reinterpret_cast<PVOID>(&disarmed)); }
+	static void recycle(size_t i) { InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&s_destructors[i]), 0); }
+	static PFLS_CALLBACK_FUNCTION callback(size_t i) { return s_callbacks[i]; }
+
+	template<size_t I>
+	static VOID WINAPI call(PVOID value)
+	{
+		destructor_type destructor = s_destructors[I];
+		if (destructor && value) {
+			destructor(value);
+		}
+	}
+
+	static void disarmed(void*) {}
+
+	static destructor_type volatile s_destructors[nslots];
+	static const PFLS_CALLBACK_FUNCTION s_callbacks[nslots];
+};
+
+template<class Dummy>
+typename windows_fls_destructors_t<Dummy>::destructor_type volatile 
+windows_fls_destructors_t<Dummy>::s_destructors[windows_fls_destructors_t<Dummy>::nslots];
+
+#define UNFACT_FLS_CALL_8(b) \
+	&windows_fls_destructors_t<Dummy>::template call<(b)+0>, &windows_fls_destructors_t<Dummy>::template call<(b)+1>, \
+	&windows_fls_destructors_t<Dummy>::template call<(b)+2>, &windows_fls_destructors_t<Dummy>::template call<(b)+3>, \
+	&windows_fls_destructors_t<Dummy>::template call<(b)+4>, &windows_fls_destructors_t<Dummy>::template call<(b)+5>, \
+	&windows_fls_destructors_t<Dummy>::template call<(b)+6>, &windows_fls_destructors_t<Dummy>::template call<(b)+7>
+
+template<class Dummy>
+const PFLS_CALLBACK_FUNCTION windows_fls_destructors_t<Dummy>::s_callbacks[windows_fls_destructors_t<Dummy>::nslots] = {
+	UNFACT_FLS_CALL_8(0),  UNFACT_FLS_CALL_8(8),  UNFACT_FLS_CALL_8(16), UNFACT_FLS_CALL_8(24),
+	UNFACT_FLS_CALL_8(32), UNFACT_FLS_CALL_8(40), UNFACT_FLS_CALL_8(48), UNFACT_FLS_CALL_8(56),
+	UNFACT_FLS_CALL_8(64), UNFACT_FLS_CALL_8(72), UNFACT_FLS_CALL_8(80), UNFACT_FLS_CALL_8(88),
+	UNFACT_FLS_CALL_8(96), UNFACT_FLS_CALL_8(104), UNFACT_FLS_CALL_8(112), UNFACT_FLS_CALL_8(120)
+};
+
+#undef UNFACT_FLS_CALL_8
+
+/*
+ * windows_thread_local_t is built on fiber local storage (Vista or later), 
+ * whose callback gives us the destructor that TlsAlloc() lacks.
+ * @param destructor is called with non-null value at thread exit, as posix_thread_local_t.
+ */
 template<size_t StorageID>
 class windows_thread_local_t
 {
 public:
   typedef byte_t* value_type;
+	typedef void (*destructor_type)(void*);
+	typedef windows_fls_destructors_t<> destructors_type;
 	
-	windows_thread_local_t()
-		: m_index(TlsAlloc())
+	explicit windows_thread_local_t(destructor_type destructor=0)
+		: m_index(FLS_OUT_OF_INDEXES), m_slot(destructors_type::nslots)
 	{
-		UF_ALERT_AND_RETURN_VOID_UNLESS(TLS_OUT_OF_INDEXES != m_index, "cannot allocate TLS!");
+		if (destructor) {
+			m_slot = destructors_type::claim(destructor);
+			UF_ALERT_AND_RETURN_VOID_UNLESS(destructors_type::nslots != m_slot, "too many TLS destructors!");
+		}
+
+		m_index = FlsAlloc(destructor ? destructors_type::callback(m_slot) : 0);
+		UF_ALERT_AND_RETURN_VOID_UNLESS(FLS_OUT_OF_INDEXES != m_index, "cannot allocate TLS!");
 	}
 
 	~windows_thread_local_t()
 	{
-		if (m_index != TLS_OUT_OF_INDEXES) {
-			BOOL ok = TlsFree(m_index);
-			UF_ALERT_AND_RETURN_VOID_UNLESS(ok, "TlsFree() failed!");
+		if (destructors_type::nslots != m_slot) {
+			destructors_type::disarm(m_slot);
+		}
+
+		if (m_index != FLS_OUT_OF_INDEXES) {
+			BOOL ok = FlsFree(m_index);
+			UF_ALERT_AND_RETURN_VOID_UNLESS(ok, "FlsFree() failed!");
+		}
+
+		if (destructors_type::nslots != m_slot) {
+			destructors_type::recycle(m_slot);
 		}
 	}
 
-	value_type get() const { return reinterpret_cast<value_type>(TlsGetValue(m_index)); }
-	void set(value_type value) { TlsSetValue(m_index, reinterpret_cast<LPVOID>(value)); }
-	void clear() { TlsSetValue(m_index, 0); }
+	value_type get() const { return reinterpret_cast<value_type>(FlsGetValue(m_index)); }
+	void set(value_type value) { FlsSetValue(m_index, reinterpret_cast<PVOID>(value)); }
+	void clear() { FlsSetValue(m_index, 0); }
 
 private:
 	DWORD m_index;
+	size_t m_slot;
 };
 
 template<>
 struct concurrent_t<windows_platform_tag_t>
 {
   typedef spin_lock_t<windows_atomic_ops_t> spin_lock_type;
-  typedef rw_lock_t<windows_atomic_ops_t, spin_lock_type> rw_lock_type;
+  typedef distributed_rw_lock_t<windows_atomic_ops_t, spin_lock_type> rw_lock_type;
+	typedef windows_thread_local_t<0> thread_local_type;
+	typedef windows_atomic_ops_t atomic_ops_type;
+	typedef null_quiescence_t quiescence_type;
 };
 
 UNFACT_NAMESPACE_END
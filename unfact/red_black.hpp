@@ -309,23 +309,29 @@ struct red_black_t
   {
 		self_type* here = root;
 		self_type* last = 0;
+		self_type* last_right = 0; /* greatest node that is not greater than the node */
 		bool    last_compare = false;
 
 		while (here) {
 			last = here;
 			last_compare = compare(node->key(), here->key());
-			here = last_compare ? here->left() : here->right();
+			if (last_compare) {
+				here = here->left();
+			} else {
+				last_right = here;
+				here = here->right();
+			}
+		}
+
+		if (last_right && !compare(last_right->key(), node->key())) {
+			/* found same key: insertion failed */
+			return false;
 		}
 	  
 		if (last) {
 			if (last_compare) {
 				last->set_left(node);
 			} else{
-				if (!compare(last->key(), node->key())) {
-					/* found same key: insertion failed */
-					return false;
-				}
-
 				last->set_right(node);
 			}
 		}
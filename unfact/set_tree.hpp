@@ -31,6 +31,7 @@
 #include <unfact/algorithm.hpp>
 #include <unfact/red_black.hpp>
 #include <unfact/tree_set.hpp>
+#include <unfact/hash_index.hpp>
 
 UNFACT_NAMESPACE_BEGIN
 
@@ -44,6 +45,10 @@ UNFACT_NAMESPACE_BEGIN
  * thread safety:
  * - TBD
  *
+ * wide nodes:
+ * when Hasher is given, a node that has many children gets hashed child index (hash_index_t)
+ * in addition to its ordered child set. lookup goes the index, and iteration goes the set.
+ *
  * IDEA: currently node on set_tree is 7 word : it seems large a bit.
  *       we can implement ordered_chain_t (that has same interface to red_black_t) and 
  *       parameterize node implementation to save a memory
@@ -52,6 +57,15 @@ UNFACT_NAMESPACE_BEGIN
 /*
  * set node:
  * it hold children set (m_children) and back-reference to containing node (m_parnt)
+ * m_index is an optional hashed index of m_children. it is guarded by the lock of m_children.
+ * m_bits packs the depth (root is 0) and small flags for users, to keep node small.
+ * a new node inherits flags of its parent.
+ * m_pins counts pins (see set_tree_t::ensure_pinned()) and keeps 'referenced' bit at its bottom.
+ * it is updated atomically, so pinning takes no lock. the caller should keep the node alive instead.
+ * m_aggregate is an inclusive scalar sum over the subtree. see set_tree_t::advance_aggregate_of()
+ * m_seq is bumped while the node is locked, if the policy is optimistic_concurrent_t.
+ * lock-free readers (see live_tracer_view_t) copy the key out and validate it by m_seq.
+ * it is not the counter of m_children: seqlocks on one counter cannot nest.
  *
  * thread-safety:
  * nested_red_black_t is NOT thread safe as its superclass,
@@ -69,6 +83,12 @@ struct set_tree_node_t :
 	typedef red_black_t<key_type, comparator_type, set_tree_node_t> base_type;
 	typedef tree_set_skeleton_t<key_type, comparator_type, set_tree_node_t, concurrent_type> child_set_type;
 	typedef typename base_type::self_type self_type;
+	typedef hash_index_t<self_type> child_index_type;
+	typedef seqlock_ops_t<concurrent_type> seqlock_type;
+	typedef word_ops_t<typename concurrent_type::atomic_ops_type> word_ops_type;
+
+	enum { flag_bits = 8, flag_mask = (1 << flag_bits) - 1 };
+	enum { pin_referenced = 0x1, pin_unit = 0x2 };
 
   typedef typename child_set_type::iterator_t child_iterator_t;
   typedef typename child_set_type::const_iterator_t const_child_iterator_t;
@@ -85,18 +105,75 @@ struct set_tree_node_t :
 	};
 
 	explicit set_tree_node_t(const initializer_t& init)
-		: base_type(init.key()), m_parent(init.parent()) {}
+		: base_type(init.key()), m_parent(init.parent()), m_index(0),
+			m_bits(init.parent() ? (((init.parent()->depth() + 1) << flag_bits) | init.parent()->flags()) : 0),
+			m_pins(0), m_aggregate(0), m_seq(0) {}
 
 	/* following accessors are stateless (although its content is not) */
 	self_type* parent() const { return m_parent; }
 	child_set_type& children() { return m_children; }
 	const child_set_type& children() const { return m_children; }
 
-	void acquire() const { m_children.acquire(); }
-	void release() const { m_children.release(); }
+	/* these are NOT stateless: lock the node before use */
+	child_index_type* child_index() const { return m_index; }
+	void set_child_index(child_index_type* index) { m_index = index; }
+
+	/* depth never changes. flags are a single word: readers see old or new one without locking. */
+	size_t depth() const { return m_bits >> flag_bits; }
+	size_t flags() const { return m_bits & flag_mask; }
+	void set_flags(size_t flags) { m_bits = (m_bits & ~size_t(flag_mask)) | (flags & flag_mask); }
+
+	/* pins are atomic words: no lock is needed, but the node should not go away meanwhile */
+	size_t pins() const { return m_pins / pin_unit; }
+	bool referenced() const { return 0 != (m_pins & pin_referenced); }
+	void pin()
+	{
+		if (0 == (word_ops_type::add_full(&m_pins, pin_unit) & pin_referenced)) {
+			word_ops_type::set_bits(&m_pins, pin_referenced);
+		}
+	}
+
+	void unpin() { UF_HONOR_OR_RETURN_VOID(pin_unit <= m_pins); word_ops_type::add_full(&m_pins, -int(pin_unit)); }
+	void unreference() { word_ops_type::clear_bits(&m_pins, pin_referenced); }
+
+	/* aggregate is an atomic word: readers see old or new one, and writers need no lock. */
+	size_t aggregate() const { return m_aggregate; }
+	void advance_aggregate(size_t delta) { word_ops_type::add(&m_aggregate, delta); }
+	void clear_aggregate() { m_aggregate = 0; }
+
+	void acquire() const { m_children.acquire(); seqlock_type::begin_write(&m_seq); }
+	void release() const { seqlock_type::end_write(&m_seq); m_children.release(); }
+
+	/* for lock-free readers. see seqlock_ops_t */
+	const volatile size_t* seq() const { return &m_seq; }
 private:
 	self_type* m_parent;
 	child_set_type m_children;
+	child_index_type* m_index;
+	volatile size_t m_bits;
+	volatile size_t m_pins;
+	volatile size_t m_aggregate;
+	mutable volatile size_t m_seq;
+};
+
+/*
+ * hash computation for hashed child index.
+ * Hasher=none_t disables the index, then we never require hash_t<> for the key.
+ */
+template<class Hasher>
+struct child_index_ops_t
+{
+	enum { enabled = 1 };
+	template<class HashKey>
+	static size_t hash(const HashKey& k) { return Hasher()(k); }
+};
+
+template<>
+struct child_index_ops_t<none_t>
+{
+	enum { enabled = 0 };
+	template<class HashKey>
+	static size_t hash(const HashKey&) { return 0; }
 };
 
 /*
@@ -250,20 +327,36 @@ public:
 
 /*
  * collection body
+ *
+ * @param Hasher hash function for keys (typically hash_t<Key>.)
+ *        if given, nodes whose children count reached 'index_threshold' get hashed child index.
+ *        none_t disables it.
  */
-template<class Key, class Comparator=less_t<Key>, class Concurrent=null_concurrent_t>
+template<class Key, class Comparator=less_t<Key>, class Concurrent=null_concurrent_t, class Hasher=none_t>
 class set_tree_t
 {
 public:
   typedef Key key_type;
   typedef Comparator comparator_type;
 	typedef Concurrent concurrent_type;
+	typedef Hasher hasher_type;
 	typedef set_tree_t self_type;
-	typedef basic_arena_t<concurrent_type> arena_type;
+	typedef typename arena_select_t<concurrent_type>::type arena_type;
 
 	typedef set_tree_node_t<key_type, comparator_type, concurrent_type> node_type;
   typedef typename node_type::child_set_type child_set_type;
+	typedef typename node_type::child_index_type child_index_type;
 	typedef typename node_type::initializer_t node_initializer_type;
+	typedef child_index_ops_t<hasher_type> index_ops_type;
+
+	/*
+	 * writers stay in a write section while they lock nodes or change the shape:
+	 * insertions and lookups under the lock here, and value updates of tracers (see tree_tracer_t.)
+	 * optimistic hits take no lock, and need no section. removals close the gate instead.
+	 * acquire_all() waits all sections out. sections never take the gate.
+	 */
+	typedef typename concurrent_type::quiescence_type quiescence_type;
+	typedef quiescent_section_t<quiescence_type> write_section_type;
 
   class ticket_handle;
   typedef ticket_handle* ticket_t;
@@ -377,6 +470,28 @@ public:
   static const_iterator_type to_const_iterator(ticket_t ticket) { return const_iterator_type(reinterpret_cast<node_type*>(ticket)); }
   static iterator_type to_iterator(ticket_t ticket) { return iterator_type(reinterpret_cast<node_type*>(ticket)); }
 
+	/* node attributes through the ticket. see set_tree_node_t */
+  static size_t depth_of(ticket_t ticket) { return reinterpret_cast<node_type*>(ticket)->depth(); }
+  static size_t flags_of(ticket_t ticket) { return reinterpret_cast<node_type*>(ticket)->flags(); }
+  static void set_flags_of(ticket_t ticket, size_t flags) { reinterpret_cast<node_type*>(ticket)->set_flags(flags); }
+
+	/*
+	 * inclusive aggregates: advance_aggregate_of() adds 'delta' to the node and all of its ancestors,
+	 * so that aggregate_of() gives the sum over the subtree in O(1).
+	 * each node is advanced by a relaxed atomic add while walking up, with no lock and no fence:
+	 * readers may see the parent not updated yet. negative deltas just wrap around. remove(), clear() and reset() don't take back the aggregates.
+	 * clear_aggregate_of() is a plain store: adds racing with it may be lost or kept.
+	 */
+  static size_t aggregate_of(ticket_t ticket) { return reinterpret_cast<node_type*>(ticket)->aggregate(); }
+  static void advance_aggregate_of(ticket_t ticket, size_t delta)
+	{
+		for (node_type* n = reinterpret_cast<node_type*>(ticket); 0 != n; n = n->parent()) {
+			n->advance_aggregate(delta);
+		}
+	}
+
+	static void clear_aggregate_of(ticket_t ticket) { reinterpret_cast<node_type*>(ticket)->clear_aggregate(); }
+
 	// does need nolock?
   size_t size() const { return m_arena.size(); }
   bool empty() const { return 0 == size(); }
@@ -388,14 +503,24 @@ public:
   child_iterator_t find(Iterator parent, const FindKey& key)
   {
 		UF_HONOR_OR_RETURN(parent.good(), child_iterator_t(0));
-		return children(parent).find(m_compare, key);
+		node_type* found = 0;
+		if (indexing() && parent.node()->children().try_find_node(m_compare, key, &found)) {
+			return child_iterator_t(found);
+		}
+
+		write_section_type w;
+		if (!indexing()) {
+			return children(parent).find(m_compare, key);
+		}
+
+		lock_scope_t<node_type, synchronized_t> l(parent.node());
+		return child_iterator_t(find_child_node(parent.node(), key, index_ops_type::hash(key)));
   }
 
   template<class Iterator, class FindKey>
   const_child_iterator_t find(Iterator parent, const FindKey& key) const
   {
-		UF_HONOR_OR_RETURN(parent.good(), child_iterator_t(0));
-		return children(parent).find(m_compare, key);
+		return const_cast<self_type*>(this)->find(parent, key);
   }
 
   /*
@@ -407,8 +532,14 @@ public:
   child_iterator_t insert(Iterator parent, const NewKey& key)
   {
 		UF_HONOR_OR_RETURN(parent.good(), child_iterator_t(0));
-		return children(parent).insert
-			(&m_arena, m_compare, node_initializer_type(key, parent.node())); 
+		write_section_type w;
+		if (!indexing()) {
+			return children(parent).insert
+				(&m_arena, m_compare, node_initializer_type(key, parent.node())); 
+		}
+
+		lock_scope_t<node_type, synchronized_t> l(parent.node());
+		return insert_child_node(parent.node(), key, index_ops_type::hash(key));
   }
 
   /*
@@ -420,10 +551,113 @@ public:
   child_iterator_t ensure(Iterator parent, const NewKey& key)
   {
 		UF_HONOR_OR_RETURN(parent.good(), child_iterator_t(0));
-		return children(parent).ensure
-			(&m_arena, m_compare, node_initializer_type(key, parent.node())); 
+		if (!indexing()) {
+			write_section_type w;
+			return children(parent).ensure
+				(&m_arena, m_compare, node_initializer_type(key, parent.node())); 
+		}
+
+		/* hits go without the lock if the policy is optimistic. see try_find_node() */
+		node_type* found = 0;
+		if (parent.node()->children().try_find_node(m_compare, key, &found) && found) {
+			return child_iterator_t(found);
+		}
+
+		/* we hash the key before locking: keep the critical section short */
+		size_t hash = index_ops_type::hash(key);
+		write_section_type w;
+		lock_scope_t<node_type, synchronized_t> l(parent.node());
+		found = find_child_node(parent.node(), key, hash);
+		if (found) {
+			return child_iterator_t(found);
+		}
+
+		return insert_child_node(parent.node(), key, hash);
   }
 
+	/*
+	 * pinning: lookup that pins the found (or inserted) child.
+	 * pinned nodes are never removed until unpin(): remove_cold_leaf() checks pins under the parent lock,
+	 * and pinners keep the child alive until the pin is on, in one of two ways:
+	 * - optimistic hit: the validated lookup and the pin are made inside the gate, that removals close.
+	 *   no node is locked (see try_find_node().) it is the common path of tree_tracer_t::push().
+	 * - otherwise: we look up (and insert) under the parent lock, as ensure() does.
+	 * each pin also marks the node 'referenced'. see remove_cold_leaf().
+	 */
+	template<class Iterator, class FindKey>
+	child_iterator_t find_pinned(Iterator parent, const FindKey& key) { return pin_child(parent, key, false); }
+	template<class Iterator, class NewKey>
+	child_iterator_t ensure_pinned(Iterator parent, const NewKey& key) { return pin_child(parent, key, true); }
+
+	/* one more pin on a node that can't go away meanwhile: pinned already, or the root */
+	template<class Iterator>
+	static void pin(Iterator iter)
+	{
+		UF_HONOR_OR_RETURN_VOID(iter.good());
+		iter.node()->pin();
+	}
+
+	template<class Iterator>
+	static void unpin(Iterator iter)
+	{
+		UF_HONOR_OR_RETURN_VOID(iter.good());
+		iter.node()->unpin();
+	}
+
+	template<class Iterator>
+	static size_t pins_of(Iterator iter) { return iter.node()->pins(); }
+
+	/*
+	 * removes 'iter' if it is a cold leaf, giving it the second chance like CLOCK algorithm:
+	 * - pinned nodes and the root are kept.
+	 * - referenced nodes are kept, but unreferenced here. they are cold at the next call.
+	 * - nodes with children are kept.
+	 * - otherwise we ask pred(parent, iter) under the locks of both, and remove it on true.
+	 *   pred may move the value of 'iter' to 'parent' there.
+	 * @return true if removed. iter goes invalid then.
+	 */
+	template<class Iterator, class Predicate>
+	bool remove_cold_leaf(Iterator iter, Predicate& pred)
+	{
+		UF_HONOR_OR_RETURN(iter.good(), false);
+		node_type* c = iter.node();
+		node_type* p = c->parent();
+		if (!p) {
+			return false;
+		}
+
+		/* closing the gate waits for optimistic pinners in flight. see pin_child() */
+		lock_scope_t<const gate_t> g(&m_gate);
+		lock_scope_t<node_type, synchronized_t> l(p);
+		{
+			lock_scope_t<node_type, synchronized_t> cl(c);
+			if (0 < c->pins()) {
+				return false;
+			}
+
+			if (c->referenced()) {
+				c->unreference();
+				return false;
+			}
+
+			if (!c->children().empty(unsynchronized_t())) {
+				return false;
+			}
+
+			if (!pred(child_iterator_t(p), child_iterator_t(c))) {
+				return false;
+			}
+		}
+
+		/* nobody can pin 'c' here: the gate is closed and we hold the lock of 'p'. see pin_child() */
+		if (p->child_index()) {
+			p->child_index()->remove(index_ops_type::hash(c->key()), c);
+		}
+
+		p->children().remove(&m_arena, child_iterator_t(c), unsynchronized_t());
+		return true;
+	}
+
 	/*
 	 * We assume you have exclusive access to the 'iter' node.
 	 * concurrent access to the node causes undefined catastrophic behaviour.
@@ -435,8 +669,16 @@ public:
 			return;
 		}
 
-		clear(iter);
-		parent_node(iter)->children().remove(&m_arena, iter);
+		write_section_type w;
+		clear(iter, synchronized_t());
+
+		node_type* p = parent_node(iter);
+		lock_scope_t<node_type, synchronized_t> l(p);
+		if (p->child_index()) {
+			p->child_index()->remove(index_ops_type::hash(iter.node()->key()), iter.node());
+		}
+
+		p->children().remove(&m_arena, iter, unsynchronized_t());
   }
 
   void clear() { clear(child_begin()); }
@@ -451,10 +693,19 @@ public:
 	 * @todo: doc assumed concurrency restriction
 	 */
   template<class Iterator, class Syncronized>
-  void clear(Iterator iter, const Syncronized& sync)
+  void clear(Iterator iter, const Syncronized&)
   {
 		child_set_type last_children;
-		children(iter).exchange(last_children, sync);
+		child_index_type* last_index = 0;
+		{
+			lock_scope_t<node_type, Syncronized> l(iter.node());
+			/* unsynchronized: last_children is local, and we have locked the node. */
+			children(iter).exchange(last_children, unsynchronized_t());
+			last_index = iter.node()->child_index();
+			iter.node()->set_child_index(0);
+		}
+
+		destroy_index(last_index);
 
 		// unsynchronized: because we've detached the children and now exclusively own it.
 		for (dfs_iterator_type i = last_children.dfs_begin(unsynchronized_t());
@@ -466,19 +717,74 @@ public:
   }
 
   template<class Iterator>
-  void clear(Iterator iter) { clear(iter, synchronized_t()); }
+  void clear(Iterator iter)
+	{
+		write_section_type w;
+		clear(iter, synchronized_t());
+	}
+
+	/*
+	 * region-reset: drop all nodes but the root at once, by resetting the arena.
+	 * we never visit nodes, so it is much faster than clear() for large trees. but:
+	 * - node destructors are not called. keys should not own any resource.
+	 * - requires single mutual access. iterators and tickets other than the root go invalid.
+	 */
+	void reset()
+	{
+		{
+			lock_scope_t<index_list_t> l(&m_indices);
+			while (m_indices.m_head) {
+				child_index_type* todie = m_indices.m_head;
+				todie->unlink_from(&m_indices.m_head);
+				child_index_type::destroy(m_arena.allocator(), todie);
+			}
+		}
+
+		m_root.set_child_index(0);
+		m_root.children().reset();
+		m_arena.reset();
+	}
 
 	void acquire() const { m_arena.acquire(); }
 	void release() const { m_arena.release(); }
 
+	/*
+	 * acquire_all() is for fork(): see fork_guard_t. it quiesces writers (see write_section_type),
+	 * closes the gate for removals, then takes the index list and the arena.
+	 * then no writer is in the tree: no node is locked by them, nor half-changed.
+	 * nodes locked by plain iterations are not waited for.
+	 */
+	void acquire_all() const
+	{
+		quiescence_type::quiesce();
+		m_gate.acquire();
+		m_indices.acquire();
+		m_arena.acquire();
+	}
+
+	void release_all() const
+	{
+		m_arena.release();
+		m_indices.release();
+		m_gate.release();
+		quiescence_type::resume();
+	}
+
   allocator_t* allocator() const { return m_arena.allocator(); }
 
+  /*
+   * @param index_threshold children count to build hashed child index for the node. 
+   *        zero disables indexing. ignored if Hasher is none_t.
+   */
   explicit set_tree_t(const Key& root_key, 
 											allocator_t* allocator, 
 											size_t page_size=DEFAULT_PAGE_SIZE, 
-											const comparator_type& compare=less_t<key_type>())
-		: m_arena(allocator, sizeof(node_type), page_size), m_compare(compare), 
-			m_root(node_initializer_type(root_key, 0)) {}
+											const comparator_type& compare=less_t<key_type>(),
+											size_t index_threshold=0)
+		: m_arena(allocator, sizeof(node_type), page_size, sizeof(void*),
+							seqlock_ops_t<concurrent_type>::arena_options(basic_arena_t<concurrent_type>::option_default)), 
+			m_compare(compare), 
+			m_root(node_initializer_type(root_key, 0)), m_index_threshold(index_threshold) {}
 
   ~set_tree_t() { clear(); }
  
@@ -525,14 +831,182 @@ public: // implementation detail: export just for testing and debugging
 
   const node_type* root() const { return &m_root; }
 
+  size_t index_threshold() const { return m_index_threshold; }
+  bool indexing() const { return index_ops_type::enabled && 0 < m_index_threshold; }
+
+	/*
+	 * index-aware child lookup and insertion.
+	 * caller should lock the parent node 'p' before calling them.
+	 */
+	template<class FindKey>
+	node_type* find_child_node(node_type* p, const FindKey& key, size_t hash) const
+	{
+		if (p->child_index()) {
+			return p->child_index()->find(hash, key, m_compare);
+		}
+
+		return p->children().find_node(m_compare, key, unsynchronized_t());
+	}
+
+	template<class NewKey>
+	child_iterator_t insert_child_node(node_type* p, const NewKey& key, size_t hash)
+	{
+		child_iterator_t ret = p->children().insert
+			(&m_arena, m_compare, node_initializer_type(key, p), unsynchronized_t()); 
+		if (ret.good()) {
+			index_child_node(p, ret.node(), hash);
+		}
+
+		return ret;
+	}
+
+	/*
+	 * we build the index lazily when the node gets wide.
+	 * if we fail to allocate the index, we just continue without it (lookup falls back to rb-tree.)
+	 */
+	void index_child_node(node_type* p, node_type* child, size_t hash)
+	{
+		child_index_type* index = p->child_index();
+		if (!index) {
+			if (p->children().count(unsynchronized_t()) < m_index_threshold) {
+				return;
+			}
+
+			index = child_index_type::create(m_arena.allocator(), child_index_type::capacity_for(m_index_threshold));
+			if (!index) {
+				return;
+			}
+
+			track_index(index);
+
+			for (child_iterator_t i = p->children().begin(unsynchronized_t()); i.good(); ++i) {
+				index->insert(index_ops_type::hash(i.node()->key()), i.node());
+			}
+
+			p->set_child_index(index);
+			return;
+		}
+
+		if (!index->insert(hash, child)) {
+			child_index_type* grown = index->grow(m_arena.allocator());
+			if (!grown) {
+				/* keep lookup consistent: the index without this child is unusable */
+				destroy_index(index);
+				p->set_child_index(0);
+				return;
+			}
+
+			track_index(grown);
+			grown->insert(hash, child);
+			destroy_index(index);
+			p->set_child_index(grown);
+		}
+	}
+
+	template<class Iterator, class NewKey>
+	child_iterator_t pin_child(Iterator parent, const NewKey& key, bool create)
+	{
+		UF_HONOR_OR_RETURN(parent.good(), child_iterator_t(0));
+		{
+			gate_reader_t g(&m_gate);
+			node_type* found = 0;
+			if (parent.node()->children().try_find_node(m_compare, key, &found)) {
+				if (found) {
+					found->pin();
+					return child_iterator_t(found);
+				}
+
+				if (!create) {
+					return child_iterator_t(0);
+				}
+			}
+		}
+
+		size_t hash = indexing() ? index_ops_type::hash(key) : 0;
+		write_section_type w;
+		lock_scope_t<node_type, synchronized_t> l(parent.node());
+		node_type* found = find_child_node(parent.node(), key, hash);
+		if (!found && create) {
+			child_iterator_t inserted = indexing() ?
+				insert_child_node(parent.node(), key, hash) :
+				parent.node()->children().insert
+				(&m_arena, m_compare, node_initializer_type(key, parent.node()), unsynchronized_t());
+			found = inserted.node();
+		}
+
+		if (!found) {
+			return child_iterator_t(0);
+		}
+
+		found->pin();
+		return child_iterator_t(found);
+	}
+
+	/*
+	 * all living indices are chained, so that reset() can destroy them without visiting nodes.
+	 * the list lock is taken inside node locks, and never the other way.
+	 */
+	void track_index(child_index_type* index)
+	{
+		lock_scope_t<index_list_t> l(&m_indices);
+		index->link_to(&m_indices.m_head);
+	}
+
+	void destroy_index(child_index_type* index)
+	{
+		if (!index) {
+			return;
+		}
+
+		{
+			lock_scope_t<index_list_t> l(&m_indices);
+			index->unlink_from(&m_indices.m_head);
+		}
+
+		child_index_type::destroy(m_arena.allocator(), index);
+	}
+
 private:
   set_tree_t(const set_tree_t& other);
   set_tree_t& operator=(const set_tree_t& other);
 
+	struct index_list_t
+	{
+		index_list_t() : m_head(0) {}
+		void acquire() const { m_lock.acquire(); }
+		void release() const { m_lock.release(); }
+
+		mutable typename concurrent_type::spin_lock_type m_lock;
+		child_index_type* m_head;
+	};
+
+	/* removals and acquire_all() close the gate (acquire()), optimistic pinners pass it together (gate_reader_t) */
+	struct gate_t
+	{
+		void acquire() const { m_lock.write_acquire(); }
+		void release() const { m_lock.write_release(); }
+
+		mutable typename concurrent_type::rw_lock_type m_lock;
+	};
+
+	class gate_reader_t
+	{
+	public:
+		explicit gate_reader_t(const gate_t* gate) : m_gate(gate) { m_gate->m_lock.read_acquire(); }
+		~gate_reader_t() { m_gate->m_lock.read_release(); }
+	private:
+		gate_reader_t(const gate_reader_t&);
+		const gate_reader_t& operator=(const gate_reader_t&);
+		const gate_t* m_gate;
+	};
+
 private:
   arena_type m_arena;
   comparator_type m_compare;
   node_type m_root;
+	size_t m_index_threshold;
+	index_list_t m_indices;
+	gate_t m_gate;
 };
 
 UNFACT_NAMESPACE_END
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_SLAB_ALLOCATOR_HPP
+#define UNFACT_SLAB_ALLOCATOR_HPP
+
+#include <unfact/base.hpp>
+#include <unfact/memory.hpp>
+#include <unfact/magazine_arena.hpp>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * slab_allocator_t is an allocator_t built from arenas, one for each size class.
+ *
+ * - sizes up to max_class_size go to the arena of its class. 
+ *   the class is looked up from a table indexed by (size+7)/8, so it is O(1).
+ * - every page is aligned to the page size, and its header holds the page tag 
+ *   (see basic_arena_t::set_page_tag()), so deallocate() finds the owner by address masking.
+ * - larger sizes go to the backing allocator as is, with a cookie word just before the block.
+ *   the cookie is the block address mixed with large_cookie, that is never a valid pointer on 64-bit.
+ *   the word before a small item is the tail of its neighbour or the page header, that hardly matches it.
+ *
+ * thread cache:
+ * each class is a magazine_arena_t, so each thread keeps a magazine of free items for each class.
+ * give 0 as 'magazine_size' for the shared path that locks the arena on each call.
+ *
+ * restrictions (same as magazine_arena_t):
+ * - each class consumes a TLS key: nclasses keys for each instance.
+ * - dtor requires that no other thread touches the slab, and no thread that has used it exits meanwhile.
+ * - size() is just a snapshot under concurrent access.
+ */
+template<class Concurrent=default_concurrent_t>
+class slab_allocator_t : public allocator_t
+{
+public:
+	typedef Concurrent concurrent_type;
+	typedef magazine_arena_t<concurrent_type> arena_type;
+	typedef typename arena_type::base_arena_type base_arena_type;
+	typedef slab_allocator_t self_type;
+
+	enum {
+		default_page_size = 64*1024,
+		max_class_size = 4096,
+		nclasses = 35,
+		nlookups = max_class_size/8 + 1,
+		/* keeps large blocks 16-byte aligned, as malloc() does */
+		large_offset = 16,
+		default_magazine_size = 16
+	};
+
+	static const size_t large_cookie = size_t(0xfa11b10c) << (sizeof(size_t)*8 - 32);
+
+	explicit slab_allocator_t(allocator_t* backing=0, size_t page_size=default_page_size,
+														size_t magazine_size=default_magazine_size)
+		: m_backing(backing ? backing : &m_default), m_page_size(page_size), m_magazine_size(magazine_size)
+	{
+		size_t cls = 0;
+		for (size_t i=0; i<nlookups; ++i) {
+			while (class_size(cls) < i*8) { ++cls; }
+			m_lookup[i] = static_cast<unsigned char>(cls);
+		}
+
+		for (size_t i=0; i<nclasses; ++i) {
+			byte_t* mem = m_backing->allocate(sizeof(arena_type));
+			m_arenas[i] = mem ? new (mem) arena_type(m_backing, class_size(i), m_page_size, sizeof(void*),
+																							 base_arena_type::option_reclaim_pages, m_magazine_size) : 0;
+			if (m_arenas[i]) {
+				UF_ASSERT(m_arenas[i]->page_size() == m_arenas[0]->page_size());
+				m_arenas[i]->set_page_tag(i);
+			}
+		}
+
+		/* arena may enlarge the page; masking should use the actual one */
+		if (m_arenas[0]) {
+			m_page_size = m_arenas[0]->page_size();
+		}
+	}
+
+	/* dtor requires single mutual access! */
+	virtual ~slab_allocator_t()
+	{
+		for (size_t i=0; i<nclasses; ++i) {
+			if (m_arenas[i]) {
+				m_arenas[i]->~arena_type();
+				m_backing->deallocate(reinterpret_cast<byte_t*>(m_arenas[i]));
+			}
+		}
+	}
+
+	virtual byte_t* allocate(size_t size)
+	{
+		if (size <= max_class_size) {
+			arena_type* arena = m_arenas[class_of(size)];
+			UF_ALERT_AND_RETURN_UNLESS(arena, 0, "slab arena is not available!");
+			return arena->allocate();
+		}
+
+		return allocate_large(size);
+	}
+
+	virtual void deallocate(byte_t* ptr)
+	{
+		if (!ptr) {
+			return;
+		}
+
+		if (is_large(ptr)) {
+			deallocate_large(ptr);
+		} else {
+			size_t tag = base_arena_type::tag_of(ptr, m_page_size);
+			UF_ASSERT(tag < nclasses);
+			m_arenas[tag]->deallocate(ptr);
+		}
+	}
+
+	size_t class_of(size_t size) const { return m_lookup[(size + 7)/8]; }
+
+	static size_t class_size(size_t cls)
+	{
+		/* 8, 16..128 by 16, 160..512 by 32, 768..4096 by 256 */
+		if (0 == cls) { return 8; }
+		if (cls <= 8) { return cls*16; }
+		if (cls <= 20) { return 128 + (cls - 8)*32; }
+		return 512 + (cls - 20)*256;
+	}
+
+	size_t page_size() const { return m_page_size; }
+	size_t magazine_size() const { return m_magazine_size; }
+	allocator_t* backing() const { return m_backing; }
+	arena_type* arena_of(size_t cls) const { return m_arenas[cls]; }
+
+	/* living items. large blocks are not counted */
+	size_t size() const
+	{
+		size_t ret = 0;
+		for (size_t i=0; i<nclasses; ++i) {
+			if (m_arenas[i]) { ret += m_arenas[i]->size(); }
+		}
+
+		return ret;
+	}
+
+	/* items cached by the calling thread */
+	size_t ncached(size_t cls) const { return m_arenas[cls] ? m_arenas[cls]->ncached() : 0; }
+
+private:
+	slab_allocator_t(const slab_allocator_t&);
+	const slab_allocator_t& operator=(const slab_allocator_t&);
+
+	static size_t* cookie_of(byte_t* ptr) { return reinterpret_cast<size_t*>(ptr) - 1; }
+	static size_t cookie_for(byte_t* ptr) { return reinterpret_cast<size_t>(ptr) ^ large_cookie; }
+	static bool is_large(byte_t* ptr) { return *cookie_of(ptr) == cookie_for(ptr); }
+
+	byte_t* allocate_large(size_t size)
+	{
+		byte_t* base = m_backing->allocate(size + large_offset);
+		UF_ALERT_AND_RETURN_UNLESS(base, 0, "can't allocate large block!");
+		byte_t* ret = base + large_offset;
+		*cookie_of(ret) = cookie_for(ret);
+		return ret;
+	}
+
+	/* the cookie is wiped: the memory may come back as a slab page with an item on the same address */
+	void deallocate_large(byte_t* ptr)
+	{
+		*cookie_of(ptr) = 0;
+		m_backing->deallocate(ptr - large_offset);
+	}
+
+	stdlib_allocator_t m_default;
+	allocator_t* m_backing;
+	size_t m_page_size;
+	size_t m_magazine_size;
+	arena_type* m_arenas[nclasses];
+	unsigned char m_lookup[nlookups];
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_SLAB_ALLOCATOR_HPP
+
+/* -*-
+   Local Variables:
+   mode: c++
+   c-tab-always-indent: t
+   c-indent-level: 2
+   c-basic-offset: 2
+   tab-width:2
+   End:
+   -*- */
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_SNAPSHOT_HPP
+#define UNFACT_SNAPSHOT_HPP
+
+#include <unfact/tree_tracer.hpp>
+#include <unfact/memory.hpp>
+#include <unfact/string_ops.hpp>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * tracing_snapshot_t is a frozen copy of the tracing tree for reporting and analysis.
+ *
+ * take() copies scopes into flat arrays in one short pass (see tree_tracer_t::copy_scopes()),
+ * then everything else runs on the copy: formatting a report never blocks tracing threads.
+ *
+ * layout:
+ * scopes are in post-order (DFS, children first) as tree_tracer_t::iterator goes,
+ * and each attribute has its own array (structure of arrays):
+ * names(), values(), inclusives(), depths(), parents() and subtree_sizes().
+ * the subtree of scope i is contiguous [i+1-subtree_size(i), i], and the root is the last one.
+ * so subtree queries are range scans, and rankings like top_n() are plain array scans.
+ *
+ * each scope keeps its own value and the 'inclusive' one, that folds all the descendants.
+ * Value should have fold(const Value&) for that.
+ *
+ * thread safety:
+ * take() is thread safe against the tracer. the snapshot itself is NOT thread safe,
+ * but const methods are, since nothing changes until the next take().
+ *
+ * @param Tracer should be tree_tracer_t
+ */
+template<class Tracer>
+class tracing_snapshot_t
+{
+public:
+	typedef Tracer tracer_type;
+	typedef tracing_snapshot_t self_type;
+	typedef typename tracer_type::key_type key_type;
+	typedef typename tracer_type::value_type value_type;
+
+	enum { npos = size_t(-1) };
+	/* retrying take() when the tree grows faster than we copy */
+	enum { max_takes = 4 };
+
+	explicit tracing_snapshot_t(allocator_t* allocator)
+		: m_allocator(allocator), m_capacity(0), m_size(0), m_epoch(0),
+			m_names(0), m_values(0), m_inclusives(0), m_depths(0), m_parents(0), m_subtree_sizes(0) {}
+	~tracing_snapshot_t() { destroy(); }
+
+	/*
+	 * @return false if we couldn't copy whole tree. the snapshot is empty then.
+	 */
+	bool take(const tracer_type& tracer)
+	{
+		for (size_t n=0; n<max_takes; ++n) {
+			/* make a room for scopes which are created during the copy */
+			size_t needed = tracer.size() + 1;
+			if (m_capacity < needed && !reserve(needed + needed/2)) {
+				break;
+			}
+
+			copier_t c(this);
+			size_t epoch = tracer.copy_scopes(c);
+			if (!c.m_overflow) {
+				m_epoch = epoch;
+				link();
+				return true;
+			}
+		}
+
+		m_size = 0;
+		return false;
+	}
+
+	size_t size() const { return m_size; }
+	bool empty() const { return 0 == m_size; }
+	size_t epoch() const { return m_epoch; }
+	size_t root() const { return 0 < m_size ? m_size - 1 : size_t(npos); }
+
+	/* arrays: size() items each */
+	const key_type* names() const { return m_names; }
+	const value_type* values() const { return m_values; }
+	const value_type* inclusives() const { return m_inclusives; }
+	const size_t* depths() const { return m_depths; }
+	const size_t* parents() const { return m_parents; }
+	const size_t* subtree_sizes() const { return m_subtree_sizes; }
+
+	const key_type& name_of(size_t i) const { return m_names[i]; }
+	const value_type& value_of(size_t i) const { return m_values[i]; }
+	const value_type& inclusive_of(size_t i) const { return m_inclusives[i]; }
+	size_t depth_of(size_t i) const { return m_depths[i]; }
+	size_t parent_of(size_t i) const { return m_parents[i]; }
+	size_t subtree_size_of(size_t i) const { return m_subtree_sizes[i]; }
+	size_t subtree_begin(size_t i) const { return i + 1 - m_subtree_sizes[i]; }
+
+	/*
+	 * picks scopes of 'n' largest measure(values[i]) into 'out', in descending order.
+	 * ties are in the snapshot order. 
+	 * @param values values() or inclusives()
+	 * @return picked count, that is min(n, size())
+	 */
+	template<class Measure>
+	size_t top_n(const value_type* values, size_t* out, size_t n, const Measure& measure) const
+	{
+		size_t picked = 0;
+		for (size_t i=0; i<m_size; ++i) {
+			size_t m = measure(values[i]);
+			if (picked == n && (0 == n || m <= measure(values[out[n-1]]))) {
+				continue;
+			}
+
+			/* insertion: n is small in practice */
+			size_t j = (picked < n) ? picked++ : n-1;
+			while (0 < j && measure(values[out[j-1]]) < m) {
+				out[j] = out[j-1];
+				j--;
+			}
+
+			out[j] = i;
+		}
+
+		return picked;
+	}
+
+	/* same as tree_tracer_t::format_name(), but on the copy */
+	void format_name(size_t i, char* buf, size_t bufsize, size_t* written, char separator='.') const
+	{
+		size_t left = bufsize;
+
+		size_t parent = parent_of(i);
+		if (npos != parent) {
+			size_t parent_written = 0;
+			format_name(parent, buf, bufsize, &parent_written, separator);
+			left -= parent_written;
+			if (left <= 1) { // filled
+				*written = bufsize - left;
+				return;
+			}
+
+			if (0 < parent_written) {
+				buf[bufsize-left+0] = separator;
+				buf[bufsize-left+1] = '\0';
+				left -= 1;
+				if (left <= 1) { // filled
+					*written = bufsize - left;
+					return; 
+				}
+			}
+		}
+
+		size_t name_size = name_of(i).size();
+		if (name_size < left) {
+			string_ops_t<char>::copy(buf + (bufsize-left), left, name_of(i).c_str());
+			left -= min_of(name_size, left);
+		}
+
+		*written = bufsize - left;
+	}
+
+public: // implementation detail
+	struct copier_t
+	{
+		explicit copier_t(self_type* self) : m_self(self), m_overflow(false) { m_self->m_size = 0; }
+
+		bool operator()(const key_type& name, size_t depth, const value_type& value)
+		{
+			if (m_self->m_capacity <= m_self->m_size) {
+				m_overflow = true;
+				return false;
+			}
+
+			size_t i = m_self->m_size++;
+			m_self->m_names[i] = name;
+			m_self->m_values[i] = value;
+			m_self->m_inclusives[i] = value;
+			m_self->m_depths[i] = depth;
+			m_self->m_parents[i] = npos;
+			m_self->m_subtree_sizes[i] = 1;
+			return true;
+		}
+
+		self_type* m_self;
+		bool m_overflow;
+	};
+
+	/*
+	 * find parents and subtree sizes from depths, then fold inclusive values.
+	 * in post-order, finished subtrees wait on a stack until their parent comes. 
+	 * we chain the stack through m_parents, that is overwritten by the real parent on pop.
+	 */
+	void link()
+	{
+		size_t top = npos;
+		for (size_t i=0; i<m_size; ++i) {
+			while (npos != top && m_depths[top] == m_depths[i] + 1) {
+				size_t below = m_parents[top];
+				m_parents[top] = i;
+				m_subtree_sizes[i] += m_subtree_sizes[top];
+				top = below;
+			}
+
+			m_parents[i] = top;
+			top = i;
+		}
+
+		/* the root. anything else left here lost its parent to concurrent updates: we leave it parentless */
+		while (npos != top) {
+			size_t below = m_parents[top];
+			m_parents[top] = npos;
+			top = below;
+		}
+
+		for (size_t i=0; i<m_size; ++i) {
+			if (npos != m_parents[i]) {
+				m_inclusives[m_parents[i]].fold(m_inclusives[i]);
+			}
+		}
+	}
+
+	bool reserve(size_t capacity)
+	{
+		destroy();
+		bool ok = (allocate_array(&m_names, capacity) && allocate_array(&m_values, capacity) &&
+							 allocate_array(&m_inclusives, capacity) && allocate_array(&m_depths, capacity) &&
+							 allocate_array(&m_parents, capacity) && allocate_array(&m_subtree_sizes, capacity));
+		if (!ok) {
+			destroy();
+			UF_ALERT(("failed to allocate memory for tracing snapshot!"));
+			return false;
+		}
+
+		m_capacity = capacity;
+		return true;
+	}
+
+	void destroy()
+	{
+		deallocate_array(&m_names);
+		deallocate_array(&m_values);
+		deallocate_array(&m_inclusives);
+		deallocate_array(&m_depths);
+		deallocate_array(&m_parents);
+		deallocate_array(&m_subtree_sizes);
+		m_capacity = 0;
+		m_size = 0;
+	}
+
+	template<class T>
+	bool allocate_array(T** arr, size_t capacity)
+	{
+		byte_t* mem = m_allocator->allocate(sizeof(T)*capacity);
+		if (!mem) {
+			return false;
+		}
+
+		*arr = reinterpret_cast<T*>(mem);
+		for (size_t i=0; i<capacity; ++i) { new (*arr + i) T(); }
+		return true;
+	}
+
+	template<class T>
+	void deallocate_array(T** arr)
+	{
+		if (*arr) {
+			for (size_t i=0; i<m_capacity; ++i) { (*arr)[i].~T(); }
+			m_allocator->deallocate(reinterpret_cast<byte_t*>(*arr));
+		}
+
+		*arr = 0;
+	}
+
+private:
+	tracing_snapshot_t(const tracing_snapshot_t&);
+	const tracing_snapshot_t& operator=(const tracing_snapshot_t&);
+
+private:
+	allocator_t* m_allocator;
+	size_t m_capacity;
+	size_t m_size;
+	size_t m_epoch;
+	key_type* m_names;
+	value_type* m_values;
+	value_type* m_inclusives;
+	size_t* m_depths;
+	size_t* m_parents;
+	size_t* m_subtree_sizes;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_SNAPSHOT_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */
@@ -73,6 +73,35 @@ public:
 		m_samples = 0;
 	}
 
+	/* merge the trace of evicted scope. see tree_tracer_t::evict() */
+	void fold(const sticky_accumulation_t& that)
+	{
+		m_total += that.m_total;
+		m_samples += that.m_samples;
+	}
+
+	/*
+	 * the trace between 'earlier' and this. see interval.hpp
+	 * fewer samples than 'earlier' means clear() or the modulo wrap in between.
+	 */
+	sticky_accumulation_t since(const sticky_accumulation_t& earlier) const
+	{
+		if (m_samples < earlier.m_samples) {
+			return *this;
+		}
+
+		return sticky_accumulation_t(m_total - earlier.m_total, m_samples - earlier.m_samples);
+	}
+
+	/* for exporters. see exporter.hpp */
+	template<class Visitor>
+	void visit_fields(Visitor& v) const
+	{
+		v("total", m_total);
+		v("samples", m_samples);
+		v("average", average());
+	}
+
 private:
 	value_type m_total;
   size_t m_samples;
@@ -108,7 +137,7 @@ public:
 			m_buf[0] = '\0';
 		} else {
 			value_type value = m_tracer->at(tracer_type::to_ticket(m_here));
-			int printed = snprintf(m_buf, m_bufsize, "%8.1f (%6d times):", value.average(), value.samples());
+			int printed = snprintf(m_buf, m_bufsize, "%8.1f (%6lu times):", value.average(), static_cast<unsigned long>(value.samples()));
 			if (m_bufsize-1 <= static_cast<size_t>(printed)) {
 				return; // filled
 			}
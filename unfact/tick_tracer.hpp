@@ -30,7 +30,9 @@
 #include <unfact/keyed_value.hpp>
 #include <unfact/string_ops.hpp>
 #include <unfact/sticky.hpp>
+#include <unfact/windowed.hpp>
 #include <unfact/tick_ops.hpp>
+#include <unfact/snapshot.hpp>
 
 UNFACT_NAMESPACE_BEGIN
 
@@ -65,6 +67,7 @@ public:
 
   void trace(ticket_type here, value_type value)
   {
+		typename tracer_type::write_section_type w;
 		scalar_lock_scope_t<trace_iterator, synchronized_t> l(m_tracer.to_iterator(here));
 		m_tracer.at(here).trace(value);
   }
@@ -73,6 +76,14 @@ public:
   ticket_type parent(ticket_type here) const { return m_tracer.parent(here); }
   ticket_type push(ticket_type ticket, const trace_key_type& key) { return m_tracer.push(ticket, key); }
   ticket_type pop(ticket_type ticket) { return m_tracer.pop(ticket); }
+  bool pin(ticket_type ticket) { return m_tracer.pin(ticket); }
+  void unpin(ticket_type ticket) { m_tracer.unpin(ticket); }
+  size_t depth_of(ticket_type ticket) const { return m_tracer.depth_of(ticket); }
+  bool muted(ticket_type ticket) const { return m_tracer.muted(ticket); }
+  void set_muted(ticket_type ticket, bool muted) { m_tracer.set_muted(ticket, muted); }
+  void set_node_budget(size_t budget) { m_tracer.set_node_budget(budget); }
+  size_t evict(size_t limit=size_t(-1)) { return m_tracer.evict(any_trace_t(), limit); }
+  size_t trim() { return m_tracer.trim(any_trace_t()); }
   const trace_key_type& name_of(ticket_type ticket) const { return m_tracer.name_of(ticket); }
   const trace_value_type& at(ticket_type ticket) const { return m_tracer.at(ticket); }
   /* NOTE: we does not provide mutable at(). the data structure is read-only for outsiders. */
@@ -82,7 +93,19 @@ public:
 	void acquire() const { m_tracer.acquire(); }
 	void release() const { m_tracer.release(); }
 
+	/* every lock we have, for fork(). see fork_guard_t */
+	void acquire_all() const { m_tracer.acquire_all(); }
+	void release_all() const { m_tracer.release_all(); }
+	/* starts counting from zero, keeping scopes. for a child process after fork() */
+	void restart() { m_tracer.fill(trace_value_type()); }
+
 private:
+	/* nobody but the scope keeps sticky traces */
+	struct any_trace_t
+	{
+		bool operator()(const trace_value_type&) const { return true; }
+	};
+
   tracer_type m_tracer;
 };
 
@@ -119,15 +142,25 @@ public:
 		m_tracer(init.tracer()), m_here(init.here()), m_start(m_tracer ? ops_type::tick() : tick_value_type())
 	{}
 
-	~tick_scope_t()
+	~tick_scope_t() { finish(); }
+
+	/* traces now instead of at the destructor. @return traced milliseconds, or 0 if nothing */
+	float finish()
 	{
-		if (m_tracer) {
-			tick_value_type end = ops_type::tick();
-			m_tracer->trace(m_here, ops_type::to_milliseconds(ops_type::distance(m_start, end)));
+		if (!m_tracer) {
+			return 0;
 		}
+
+		tick_value_type end = ops_type::tick();
+		float ms = ops_type::to_milliseconds(ops_type::distance(m_start, end));
+		m_tracer->trace(m_here, ms);
+		m_tracer = 0;
+		return ms;
 	}
 
 	ticket_type here() const { return m_here; }
+	/* null once finished */
+	tracer_type* tracer() const { return m_tracer; }
 private:
 	tick_scope_t(const tick_scope_t&);
 	const tick_scope_t& operator=(const tick_scope_t&);
@@ -153,8 +186,16 @@ public:
  */
 typedef sticky_accumulation_t<float> tick_accumulation_t;
 typedef sticky_tracer_t<tick_accumulation_t, default_concurrent_t> accumulative_tick_tracer_t;
+/* readable out of the process. see live_tracer_t */
+typedef sticky_tracer_t<tick_accumulation_t, optimistic_concurrent_t<default_concurrent_t> > live_tick_tracer_t;
 typedef tick_scope_t<accumulative_tick_tracer_t> accumulative_tick_scope_t;
 typedef flat_tracing_formatter_t<accumulative_tick_tracer_t::tracer_type> accumulative_tick_tracing_formatter_t;
+typedef tracing_snapshot_t<accumulative_tick_tracer_t::tracer_type> accumulative_tick_snapshot_t;
+/* recent figures along with lifetime ones. see windowed.hpp */
+typedef windowed_accumulation_t<float> windowed_tick_accumulation_t;
+typedef sticky_tracer_t<windowed_tick_accumulation_t, default_concurrent_t> windowed_tick_tracer_t;
+typedef tick_scope_t<windowed_tick_tracer_t> windowed_tick_scope_t;
+typedef windowed_tracing_formatter_t<windowed_tick_tracer_t::tracer_type> windowed_tick_tracing_formatter_t;
 
 // TODO: formatter here
 
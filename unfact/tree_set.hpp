@@ -46,6 +46,82 @@ UNFACT_NAMESPACE_BEGIN
  * changing item can cause ORDER INCONSISTENCY for the set, so you should do it carefully.
  */
 
+/*
+ * optimistic_concurrent_t is a concurrent policy that enables optimistic reads on tree_set_skeleton_t.
+ * each set carries a sequence counter (seqlock): writers lock the set and bump the counter,
+ * and find() walks the tree without the lock, then retries if the counter has moved.
+ *
+ * readers can walk through nodes under removal, so their memory should stay readable.
+ * arena of such sets never releases pages nor fills efnoise (we drop these options.)
+ * removed node can be reused by another set of same arena. that is OK: the removal bumped the counter.
+ * keys are compared even when torn, so they should be safe for that (strings are: search key terminates it.)
+ *
+ * arena_select_t sees this policy itself, so the arena is always basic_arena_t.
+ */
+template<class Base>
+struct optimistic_concurrent_t : public Base
+{
+	typedef Base base_type;
+};
+
+/*
+ * seqlock_ops_t gives sequence counter operations for the policy. 
+ * they are no-op unless the policy is optimistic_concurrent_t.
+ */
+template<class Concurrent>
+struct seqlock_ops_t
+{
+	typedef typename basic_arena_t<Concurrent>::option_e option_e;
+	enum { enabled = 0 };
+
+	static void begin_write(volatile size_t*) {}
+	static void end_write(volatile size_t*) {}
+	static size_t read_begin(const volatile size_t*) { return 0; }
+	static bool read_validate(const volatile size_t*, size_t) { return true; }
+	static option_e arena_options(option_e opts) { return opts; }
+};
+
+template<class Base>
+struct seqlock_ops_t< optimistic_concurrent_t<Base> >
+{
+	typedef typename Base::atomic_ops_type ops_type;
+	typedef basic_arena_t< optimistic_concurrent_t<Base> > arena_type;
+	typedef typename arena_type::option_e option_e;
+	enum { enabled = 1 };
+
+	/* should be called under the lock: only one writer touches the counter */
+	static void begin_write(volatile size_t* seq)
+	{
+		*seq = *seq + 1;
+		ops_type::barrier();
+	}
+
+	static void end_write(volatile size_t* seq)
+	{
+		ops_type::barrier();
+		*seq = *seq + 1;
+	}
+
+	/* @return odd value if a writer is there */
+	static size_t read_begin(const volatile size_t* seq)
+	{
+		size_t ret = *seq;
+		ops_type::barrier();
+		return ret;
+	}
+
+	static bool read_validate(const volatile size_t* seq, size_t began)
+	{
+		ops_type::barrier();
+		return 0 == (began & 1) && *seq == began;
+	}
+
+	static option_e arena_options(option_e opts)
+	{
+		return option_e(opts & ~(arena_type::option_fill_efnoise | arena_type::option_reclaim_pages));
+	}
+};
+
 /*
  * tree_set_skeleton_t is a helper class to implement tree_set_t and its variant.
  * tree_set_skeleton_t has only root node, but does not have sharable elements,
@@ -59,7 +135,7 @@ class tree_set_skeleton_t
 public:
 	typedef Concurrent concurrent_type;
 	typedef typename concurrent_type::spin_lock_type lock_type;
-	typedef basic_arena_t<concurrent_type> arena_type;
+	typedef typename arena_select_t<concurrent_type>::type arena_type;
   typedef tree_set_skeleton_t self_type;
   typedef Key key_type;
   typedef Comparator comparator_type;
@@ -68,6 +144,13 @@ public:
   typedef typename node_type::removal_unbalance_t removal_unbalance_type;
   typedef red_black_dfs_iterator_t<key_type, comparator_type, subclass_type> dfs_iterator_type;
   typedef node_type item_type;
+	typedef seqlock_ops_t<concurrent_type> seqlock_type;
+
+	/*
+	 * optimistic find() walks at most optimistic_walk_limit nodes (rb-tree is never that deep),
+	 * and falls back to the lock after max_optimistic_retries failures.
+	 */
+	enum { optimistic_walk_limit = 128, max_optimistic_retries = 4 };
 
   class const_iterator_t : public red_black_iterator_base_t<const_iterator_t, 
 																														key_type, comparator_type, subclass_type>
@@ -242,6 +325,12 @@ public:
 		}
   }
 
+	/*
+	 * forget all nodes without releasing them.
+	 * the owner of the arena should reset() it then. node destructors are never called.
+	 */
+	void reset() { pop_root(); }
+
 	template<class Synchronized>
   bool invariant(const Synchronized&) const
 	{
@@ -252,13 +341,13 @@ public:
 	bool invariant() const { return invariant(synchronized_t()); }
 	
 	template<class Synchronized>
-  bool empty(const Synchronized&) const { return 0 == lock_scope_t<const self_type, synchronized_t>(this)->m_root; }
+  bool empty(const Synchronized&) const { return 0 == lock_scope_t<const self_type, Synchronized>(this)->m_root; }
 	bool empty() const { return empty(synchronized_t()); }
 
 	template<class Synchronized>
   size_t count(const Synchronized&) const
 	{
-		lock_scope_t<const self_type, synchronized_t> l(this);
+		lock_scope_t<const self_type, Synchronized> l(this);
 		return m_root ? m_root->size() : 0;
 	}
 
@@ -271,7 +360,7 @@ public:
 	void acquire() const { m_lock.acquire(); }
 	void release() const { m_lock.release(); }
 
-  tree_set_skeleton_t()	: m_root(0) {}
+  tree_set_skeleton_t()	: m_root(0), m_seq(0) {}
 
   ~tree_set_skeleton_t()
   {
@@ -288,7 +377,11 @@ public:
 		if (this == &that)  { return; } // ESSENTIAL: deadlock in such case
 		lock_scope_t<self_type, Synchronized> lo(&that);
 		lock_scope_t<self_type, Synchronized> lt(this);
+		seqlock_type::begin_write(&m_seq);
+		seqlock_type::begin_write(&that.m_seq);
 		unfact::exchange(m_root, that.m_root);
+		seqlock_type::end_write(&that.m_seq);
+		seqlock_type::end_write(&m_seq);
 	}
 	
 	void exchange(tree_set_skeleton_t& that) { exchange(synchronized_t()); }
@@ -304,12 +397,17 @@ public: // impelemntation detail
 
   node_type* begin_node() const { begin_node(synchronized_t()); }
 
+	/* for lock-free readers: see find_node_optimistic() and live_tracer_view_t */
+	const volatile size_t* seq() const { return &m_seq; }
+
 	template<class Synchronized>
 	node_type* pop_root(const Synchronized&)
 	{
 		lock_scope_t<const self_type, Synchronized> l(this);
+		seqlock_type::begin_write(&m_seq);
 		node_type* ret = m_root;
 		m_root = 0;
+		seqlock_type::end_write(&m_seq);
 		return ret;
 	}
 
@@ -322,11 +420,15 @@ public: // impelemntation detail
 
 		if (!m_root) {
 			node->set_black();
+			seqlock_type::begin_write(&m_seq);
 			m_root = node;
+			seqlock_type::end_write(&m_seq);
 			return iterator_t(node);
 		}
 
+		seqlock_type::begin_write(&m_seq);
 		bool ok = node_type::insert(m_root, node, &m_root, compare);
+		seqlock_type::end_write(&m_seq);
 		if (!ok) {
 			return end();
 		}
@@ -348,7 +450,9 @@ public: // impelemntation detail
 		 * Because we should have at least one node if we have node to remove. 
 		 */
 		UF_ASSERT(m_root); 
+		seqlock_type::begin_write(&m_seq);
 		node_type::remove(m_root, node, &m_root);
+		seqlock_type::end_write(&m_seq);
 	}
 
 	void remove_node(node_type* node) { remove_node(node, synchronized_t()); }
@@ -360,6 +464,41 @@ public: // impelemntation detail
 		return (m_root ? const_cast<node_type*>(m_root->find(k, compare)) : 0);
   }
 
+	/* locking version goes optimistic if the policy allows */
+  template<class FindKey>
+  node_type* find_node(const comparator_type& compare, const FindKey& k, const synchronized_t&) const
+  {
+		node_type* found = 0;
+		if (try_find_node(compare, k, &found)) {
+			return found;
+		}
+
+		lock_scope_t<const self_type, synchronized_t> l(this);
+		return (m_root ? const_cast<node_type*>(m_root->find(k, compare)) : 0);
+  }
+
+	/*
+	 * the optimistic part of find_node(): never locks.
+	 * @return false if no walk is validated (or the policy is not optimistic.) then '*found' is meaningless.
+	 */
+  template<class FindKey>
+	bool try_find_node(const comparator_type& compare, const FindKey& k, node_type** found) const
+	{
+		if (!seqlock_type::enabled) {
+			return false;
+		}
+
+		for (size_t i=0; i<max_optimistic_retries; ++i) {
+			size_t began = seqlock_type::read_begin(&m_seq);
+			bool walked = find_node_optimistic(compare, k, found);
+			if (seqlock_type::read_validate(&m_seq, began) && walked) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
   template<class FindKey>
   node_type* find_node(const comparator_type& compare, const FindKey& k) const
 	{
@@ -383,9 +522,40 @@ public: // impelemntation detail
 private:
   tree_set_skeleton_t(const tree_set_skeleton_t&);
   tree_set_skeleton_t& operator=(tree_set_skeleton_t&);
+
+	/*
+	 * red_black_t::find() without the lock. the tree can be torn by writers, 
+	 * so we give up on too long walk. the result is meaningful only if the sequence is validated.
+	 */
+  template<class FindKey>
+	bool find_node_optimistic(const comparator_type& compare, const FindKey& k, node_type** found) const
+	{
+		node_type* here = m_root;
+		for (size_t n=0; n<optimistic_walk_limit; ++n) {
+			if (!here) {
+				*found = 0;
+				return true;
+			}
+
+			if (compare(k, here->key())) {
+				here = here->left();
+			} else {
+				if (!compare(here->key(), k)) {
+					*found = here;
+					return true;
+				}
+
+				here = here->right();
+			}
+		}
+
+		return false;
+	}
+
 private:
 	mutable lock_type  m_lock;
   node_type* m_root;
+	volatile size_t m_seq;
 };
 
 /*
@@ -401,7 +571,7 @@ public:
   typedef Key key_type;
   typedef Comparator comparator_type;
 	typedef Concurrent concurrent_type;
-	typedef basic_arena_t<concurrent_type> arena_type;
+	typedef typename arena_select_t<concurrent_type>::type arena_type;
   typedef tree_set_skeleton_t<key_type, comparator_type, none_t, concurrent_type> skeleton_type;
   typedef typename skeleton_type::iterator_t iterator;  
   typedef typename skeleton_type::const_iterator_t const_iterator;  
@@ -430,18 +600,39 @@ public:
   void insert(Iterator beg, Iterator end) { return m_skeleton.insert(&m_arena, m_compare, beg, end); }
   void clear() { m_skeleton.clear(&m_arena); }
   bool empty() const { return m_skeleton.empty(); }
+
+	/*
+	 * region-reset: O(pages) alternative of clear(). we own the arena, so we just reset it.
+	 * key destructors are NOT called, and this requires single mutual access.
+	 */
+  void reset() 
+	{ 
+		m_skeleton.reset();
+		m_arena.reset();
+	}
+
   size_t size() const { return m_arena.size(); }
 
 	void acquire() const { m_skeleton.acquire(); }
 	void release() const { m_skeleton.release(); }
 
-  explicit tree_set_t(allocator_t* allocator, size_t page_size=DEFAULT_PAGE_SIZE, const comparator_type& compare=less_t<key_type>())
-		: m_arena(allocator, sizeof(item_type), page_size), m_compare(compare) {}
+	/* takes all locks in the lock order, for fork(). see set_tree_t::acquire_all() */
+	void acquire_all() const { m_skeleton.acquire(); m_arena.acquire(); }
+	void release_all() const { m_arena.release(); m_skeleton.release(); }
+
+  /*
+   * @param opts arena options. every arena_type accepts basic_arena_t options.
+   */
+  explicit tree_set_t(allocator_t* allocator, size_t page_size=DEFAULT_PAGE_SIZE, const comparator_type& compare=less_t<key_type>(),
+											typename basic_arena_t<concurrent_type>::option_e opts=basic_arena_t<concurrent_type>::option_default)
+		: m_arena(allocator, sizeof(item_type), page_size, sizeof(void*), seqlock_ops_t<concurrent_type>::arena_options(opts)), 
+			m_compare(compare) {}
 
   ~tree_set_t() { clear(); }
 
   tree_set_t(const tree_set_t& other)
-		: m_arena(other.m_arena.allocator(), sizeof(item_type), other.m_arena.page_size()), 
+		: m_arena(other.m_arena.allocator(), sizeof(item_type), other.m_arena.page_size(), sizeof(void*),
+							seqlock_ops_t<concurrent_type>::arena_options(basic_arena_t<concurrent_type>::option_default)), 
 			m_compare(other.m_compare)
   {
 		insert(other.begin(), other.end());
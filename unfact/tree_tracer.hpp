@@ -47,6 +47,17 @@ UNFACT_NAMESPACE_BEGIN
  * Although push() and pop() is a primary operation for the tracer, 
  * we also provide tree traversal api like parent(), begin(), end(), etc.
  * These APIs are useful when making the statistics report. 
+ *
+ * node budget:
+ * with set_node_budget(), push() pins the scope until pop(), and a new scope over the budget
+ * goes to "(other)" child of its parent instead. the budget is soft: "(other)"s themselves can exceed it.
+ * evict() removes cold leaves (neither pinned nor pushed since the last evict()),
+ * folding their values into the parent. pinned tickets, like ones in tracing_chain_t, stay valid.
+ * Value should have fold(const Value&) to evict().
+ *
+ * aggregates:
+ * with set_aggregating(), each scope keeps a scalar sum over its subtree, that is given with
+ * advance_aggregate() and is read by aggregate_of() in O(1). reset() and fill() don't touch it.
  */
 template<class Value, class Concurrent=null_concurrent_t>
 class tree_tracer_t
@@ -56,19 +67,29 @@ public:
   typedef Value value_type;
 	typedef Concurrent concurrent_type;
 	typedef tree_tracer_t self_type;
-	typedef basic_arena_t<concurrent_type> arena_t;
+	typedef typename arena_select_t<concurrent_type>::type arena_t;
   typedef keyed_value_t<key_type, value_type> node_type;
-  typedef set_tree_t<node_type, less_t<node_type>, concurrent_type> tree_type;
+  typedef set_tree_t<node_type, less_t<node_type>, concurrent_type, hash_t<node_type> > tree_type;
   typedef typename tree_type::ticket_t ticket_type;
   typedef typename tree_type::const_iterator iterator;
 
 	// impl detail...
 	typedef typename tree_type::const_child_iterator_t const_child_iterator_type;
+	typedef typename tree_type::quiescence_type quiescence_type;
+	/* value writers stay in it around the node lock, so that acquire_all() waits for them. see set_tree_t */
+	typedef typename tree_type::write_section_type write_section_type;
 
   enum { key_size = key_type::capacity  };
+	/* scopes with this many children get hashed lookup. see set_tree_t */
+	enum { default_index_threshold = 32 };
+	/* scope flags. kept in the node and inherited by new children */
+	enum { scope_flag_muted = 0x01 };
   
-  tree_tracer_t(allocator_t* allocator, size_t page_size=DEFAULT_PAGE_SIZE)
-		: m_tree(node_type(""), allocator, page_size) {}
+  tree_tracer_t(allocator_t* allocator, size_t page_size=DEFAULT_PAGE_SIZE, 
+								size_t index_threshold=default_index_threshold)
+		: m_tree(node_type(""), allocator, page_size, less_t<node_type>(), index_threshold), m_budget(0), m_aggregating(false), m_epoch(0) {}
+
+	static const char* other_name() { return "(other)"; }
 
 	/*
 	 * thread safety:
@@ -105,14 +126,51 @@ public:
 
   ticket_type push(ticket_type parent, const key_type& name)
   {
-		return tree_type::to_ticket(m_tree.ensure(tree_type::to_child_iterator(parent), node_type(name)));
+		typedef typename tree_type::child_iterator_t child_iter_type;
+		child_iter_type p = tree_type::to_child_iterator(parent);
+		if (!pinning()) {
+			return tree_type::to_ticket(m_tree.ensure(p, node_type(name)));
+		}
+
+		child_iter_type found = m_tree.find_pinned(p, node_type(name));
+		if (!found.good()) {
+			found = m_tree.ensure_pinned(p, node_type(m_budget <= m_tree.size() ? key_type(other_name()) : name));
+		}
+
+		return tree_type::to_ticket(found);
   }
 
   ticket_type pop(ticket_type top)
   {
+		if (pinning()) {
+			tree_type::unpin(tree_type::to_child_iterator(top));
+		}
+
 		return tree_type::to_ticket(parent(tree_type::to_iterator(top)));
   }
 
+	/*
+	 * keeps 'here' pinned beyond pop() of its pusher, like the handoff of tracing_chain_t.
+	 * 'here' should be pushed and not popped yet, or be the root. no-op without the node budget.
+	 * @return true if pinned: unpin() it later then.
+	 */
+	bool pin(ticket_type here)
+	{
+		if (!pinning()) {
+			return false;
+		}
+
+		tree_type::pin(tree_type::to_child_iterator(here));
+		return true;
+	}
+
+	void unpin(ticket_type here)
+	{
+		if (pinning()) {
+			tree_type::unpin(tree_type::to_child_iterator(here));
+		}
+	}
+
   ticket_type parent(ticket_type here) const
   {
 		return to_ticket(parent(to_iterator(here)));
@@ -137,6 +195,7 @@ public:
 	void fill(ticket_type here, const value_type& val, const Synchronized&)
 	{
 		typedef typename tree_type::iterator iter_type;
+		write_section_type w;
 		for(iter_type
 					i=m_tree.begin_for(tree_type::to_iterator(here)),
 					e=m_tree.end_for(tree_type::to_iterator(here));
@@ -148,6 +207,116 @@ public:
 
 	void fill(ticket_type here, const value_type& t) { fill(here, t, synchronized_t()); }
 
+	/*
+	 * depth_of() and muted() are stateless: lock-free single word reads.
+	 * root() is at depth 0.
+	 */
+	size_t depth_of(ticket_type here) const { return tree_type::depth_of(here); }
+	bool muted(ticket_type here) const { return 0 != (tree_type::flags_of(here) & scope_flag_muted); }
+
+	/*
+	 * mutes (or unmutes) the scope and all its descendants.
+	 * descendants created later inherit the flag from their parent.
+	 */
+	template<class Synchronized>
+	void set_muted(ticket_type here, bool muted, const Synchronized&)
+	{
+		typedef typename tree_type::iterator iter_type;
+		write_section_type w;
+		for(iter_type
+					i=m_tree.begin_for(tree_type::to_iterator(here)),
+					e=m_tree.end_for(tree_type::to_iterator(here));
+					i!=e; /* */) {
+			ticket_type t = to_ticket(i);
+			size_t flags = tree_type::flags_of(t);
+			tree_type::set_flags_of(t, muted ? (flags | scope_flag_muted) : (flags & ~size_t(scope_flag_muted)));
+			++i;
+		}
+	}
+
+	void set_muted(ticket_type here, bool muted) { set_muted(here, muted, synchronized_t()); }
+
+	/*
+	 * turn it on before tracing: aggregates never know the values given before.
+	 */
+	void set_aggregating(bool aggregating)
+	{
+		UF_ALERT_AND_RETURN_VOID_UNLESS(m_tree.empty(), "aggregating should be turned on/off before tracing");
+		m_aggregating = aggregating;
+	}
+
+	bool aggregating() const { return m_aggregating; }
+	size_t aggregate_of(ticket_type here) const { return tree_type::aggregate_of(here); }
+
+	/* adds 'delta' to the scope and its ancestors. we do nothing unless aggregating() */
+	void advance_aggregate(ticket_type here, size_t delta)
+	{
+		if (m_aggregating) {
+			tree_type::advance_aggregate_of(here, delta);
+		}
+	}
+
+	/* zeroes aggregates of all scopes, like restarting with the same shape */
+	void clear_aggregates()
+	{
+		write_section_type w;
+		for(iterator i=begin_for(root()), e=end_for(root()); i!=e; ++i) {
+			tree_type::clear_aggregate_of(to_ticket(i));
+		}
+	}
+
+	/*
+	 * 0 means unbounded. pins are counted only under the budget, 
+	 * so turn it on or off before tracing: we refuse it on non-empty tree.
+	 */
+	void set_node_budget(size_t budget)
+	{
+		UF_ALERT_AND_RETURN_VOID_UNLESS((0 == budget) == (0 == m_budget) || m_tree.empty(), 
+																		"node budget should be turned on/off before tracing");
+		m_budget = budget;
+	}
+
+	size_t node_budget() const { return m_budget; }
+	bool pinning() const { return 0 != m_budget; }
+	size_t size() const { return m_tree.size(); }
+
+	/*
+	 * @param evictable tells that nobody refers the value but the scope.
+	 * @param limit stop after evicting this many scopes
+	 * @return evicted scope count
+	 *
+	 * we visit scopes in post-order, so a parent whose children all have gone is evicted in the same call.
+	 */
+	template<class Evictable>
+	size_t evict(const Evictable& evictable, size_t limit=size_t(-1))
+	{
+		UF_ALERT_AND_RETURN_UNLESS(pinning(), 0, "evict() requires the node budget");
+		lock_scope_t<evict_lock_t> l(&m_evict_lock);
+
+		typedef typename tree_type::iterator iter_type;
+		fold_t<Evictable> fold(evictable);
+		size_t evicted = 0;
+		for(iter_type
+					i=m_tree.begin_for(tree_type::to_iterator(root())),
+					e=m_tree.end_for(tree_type::to_iterator(root()));
+				i!=e && evicted < limit; /* */) {
+			iter_type here = i++; // step forward first: 'here' may go away
+			if (m_tree.remove_cold_leaf(here, fold)) {
+				evicted++;
+			}
+		}
+
+		return evicted;
+	}
+
+	/* evict() until the tree fits the budget, if possible */
+	template<class Evictable>
+	size_t trim(const Evictable& evictable)
+	{
+		size_t n = m_tree.size();
+		return m_budget < n ? evict(evictable, n - m_budget) : 0;
+	}
+
   void format_name(iterator here, char* buf, size_t bufsize, size_t* written) const
   {
 		size_t left = bufsize;
@@ -188,11 +357,82 @@ public:
 		return;
 	}
 
+	/*
+	 * copy-on-read traversal for reports: calls v(name, depth, value) for each scope in post-order
+	 * until v returns false. the value is copied under the lock of its node, and we hold no global lock:
+	 * tracing threads never wait for us. only evict() waits, since we visit nodes it may remove.
+	 * @return epoch, that is incremented on each call.
+	 */
+	template<class Visitor>
+	size_t copy_scopes(Visitor& v) const
+	{
+		lock_scope_t<const evict_lock_t> l(&m_evict_lock);
+		size_t epoch = ++m_epoch;
+		for(iterator i=begin_for(root()), e=end_for(root()); i!=e; ++i) {
+			ticket_type t = to_ticket(i);
+			value_type copied;
+			{
+				scalar_lock_scope_t<iterator, synchronized_t> nl(i);
+				copied = i->value();
+			}
+
+			if (!v(i->key(), depth_of(t), copied)) {
+				break;
+			}
+		}
+
+		return epoch;
+	}
+
+	/*
+	 * drop all scopes but the root at once. see set_tree_t::reset() for restrictions:
+	 * no one should be tracing, and tickets other than root() go invalid.
+	 */
+	void reset() { m_tree.reset(); }
+
 	void acquire() const { m_tree.acquire(); }
 	void release() const { m_tree.release(); }
 
+	/* every lock we have, for fork(). see fork_guard_t. writers are quiesced first: none of them waits for the evict lock */
+	void acquire_all() const { quiescence_type::quiesce(); m_evict_lock.acquire(); m_tree.acquire_all(); }
+	void release_all() const { m_tree.release_all(); m_evict_lock.release(); quiescence_type::resume(); }
+
+private:
+	/* evict() and copy_scopes() are serialized, so that no one removes the nodes we are visiting */
+	struct evict_lock_t
+	{
+		void acquire() const { m_lock.acquire(); }
+		void release() const { m_lock.release(); }
+
+		mutable typename concurrent_type::spin_lock_type m_lock;
+	};
+
+	template<class Evictable>
+	struct fold_t
+	{
+		typedef typename tree_type::child_iterator_t child_iter_type;
+
+		explicit fold_t(const Evictable& evictable) : m_evictable(evictable) {}
+
+		bool operator()(child_iter_type parent, child_iter_type leaf)
+		{
+			if (!m_evictable(leaf->value())) {
+				return false;
+			}
+
+			parent->value().fold(leaf->value());
+			return true;
+		}
+
+		const Evictable& m_evictable;
+	};
+
 private:
   tree_type m_tree;
+	size_t m_budget;
+	bool m_aggregating;
+	evict_lock_t m_evict_lock;
+	mutable size_t m_epoch;
 };
 
 UNFACT_NAMESPACE_END
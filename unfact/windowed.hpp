@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2008 Community Engine Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNFACT_WINDOWED_HPP
+#define UNFACT_WINDOWED_HPP
+
+#include <unfact/sticky.hpp>
+#include <time.h>
+#include <stdio.h>
+
+UNFACT_NAMESPACE_BEGIN
+
+/*
+ * EpochClock gives the current epoch, that is the number of 'epoch_seconds' long periods.
+ * wall_epoch_clock_t counts them on time(), that is cheap enough for every trace.
+ */
+template<size_t EpochSeconds>
+struct wall_epoch_clock_t
+{
+	enum { epoch_seconds = EpochSeconds };
+	static size_t epoch() { return static_cast<size_t>(time(0))/EpochSeconds; }
+};
+
+/*
+ * windowed_accumulation_t is a StickyTrace that keeps recent figures along with the lifetime ones:
+ * - a ring of 'Buckets' per-epoch buckets, that gives sums over last N epochs. see window().
+ * - EWMA of the traced values, with weight 1/EwmaWeight of the latest.
+ * - lifetime total and samples as sticky_accumulation_t does, cleared on every Modulo samples.
+ *
+ * epochs rotate lazily: trace() finds the bucket of the current epoch and clears it 
+ * if it belongs to an older one. there's no global tick nor lock; the node lock of trace() is enough.
+ * readers skip buckets out of the window, so idle scopes show zero for recent figures.
+ *
+ * default parameters keep 5 minutes in 60 buckets of 5 seconds.
+ */
+template<class Value, size_t Buckets=60, class EpochClock=wall_epoch_clock_t<5>, size_t EwmaWeight=16, size_t Modulo=16777216>
+class windowed_accumulation_t
+{
+public:
+	typedef Value value_type;
+	typedef EpochClock clock_type;
+	typedef windowed_accumulation_t self_type;
+	/* lifetime figures, and also sums of windows */
+	typedef sticky_accumulation_t<Value, Modulo> figure_type;
+
+	enum { 
+		bucket_size = Buckets, 
+		ewma_weight = EwmaWeight,
+		minute_epochs = (60 + clock_type::epoch_seconds - 1)/clock_type::epoch_seconds
+	};
+
+	struct bucket_t
+	{
+		unsigned int m_epoch;
+		unsigned int m_samples;
+		value_type m_total;
+	};
+
+	windowed_accumulation_t() : m_ewma(0) { clear_buckets(); }
+	windowed_accumulation_t(value_type t, size_t s) : m_lifetime(t, s), m_ewma(0) { clear_buckets(); }
+
+	value_type average() const { return m_lifetime.average(); }
+	value_type total() const { return m_lifetime.total(); }
+	size_t samples() const { return m_lifetime.samples(); }
+	value_type ewma() const { return m_ewma; }
+	const figure_type& lifetime() const { return m_lifetime; }
+
+	/* sum of last 'epochs' epochs, including the current one */
+	figure_type window(size_t epochs) const { return window(epochs, clock_type::epoch()); }
+
+	figure_type window(size_t epochs, size_t now) const
+	{
+		value_type total(0);
+		size_t samples = 0;
+		for (size_t i=0; i<bucket_size; ++i) {
+			const bucket_t& b = m_buckets[i];
+			if (0 < b.m_samples && static_cast<unsigned int>(now) - b.m_epoch < epochs) {
+				total += b.m_total;
+				samples += b.m_samples;
+			}
+		}
+
+		return figure_type(total, samples);
+	}
+
+	figure_type last_minute() const { return window(min_of(to_size(minute_epochs), to_size(bucket_size))); }
+	figure_type last_five_minutes() const { return window(min_of(to_size(minute_epochs*5), to_size(bucket_size))); }
+
+	void trace(value_type value)
+	{
+		if (0 == m_lifetime.samples()) {
+			m_ewma = value;
+		} else {
+			m_ewma += (value - m_ewma)/static_cast<value_type>(ewma_weight);
+		}
+
+		m_lifetime.trace(value);
+		unsigned int epoch = static_cast<unsigned int>(clock_type::epoch());
+		bucket_t& b = m_buckets[epoch%bucket_size];
+		if (b.m_epoch != epoch) {
+			b.m_epoch = epoch;
+			b.m_samples = 0;
+			b.m_total = value_type(0);
+		}
+
+		b.m_samples++;
+		b.m_total += value;
+	}
+
+	void clear(value_type toclear=value_type(0))
+	{
+		m_lifetime.clear(toclear);
+		m_ewma = value_type(0);
+		clear_buckets();
+	}
+
+	/* merge the trace of evicted scope. see tree_tracer_t::evict() */
+	void fold(const windowed_accumulation_t& that)
+	{
+		if (0 == m_lifetime.samples()) {
+			m_ewma = that.m_ewma;
+		}
+
+		m_lifetime.fold(that.m_lifetime);
+		for (size_t i=0; i<bucket_size; ++i) {
+			bucket_t& b = m_buckets[i];
+			const bucket_t& t = that.m_buckets[i];
+			if (0 == t.m_samples) {
+				continue;
+			}
+
+			if (b.m_epoch == t.m_epoch) {
+				b.m_samples += t.m_samples;
+				b.m_total += t.m_total;
+			} else if (0 == b.m_samples || static_cast<int>(t.m_epoch - b.m_epoch) > 0) {
+				b = t;
+			}
+		}
+	}
+
+	/* lifetime figures between 'earlier' and this. recent ones are as they are. see interval.hpp */
+	windowed_accumulation_t since(const windowed_accumulation_t& earlier) const
+	{
+		windowed_accumulation_t ret(*this);
+		ret.m_lifetime = m_lifetime.since(earlier.m_lifetime);
+		return ret;
+	}
+
+	/* for exporters. see exporter.hpp */
+	template<class Visitor>
+	void visit_fields(Visitor& v) const
+	{
+		figure_type m1 = last_minute();
+		figure_type m5 = last_five_minutes();
+		v("total", m_lifetime.total());
+		v("samples", m_lifetime.samples());
+		v("average", m_lifetime.average());
+		v("ewma", m_ewma);
+		v("samples_1m", m1.samples());
+		v("average_1m", m1.average());
+		v("samples_5m", m5.samples());
+		v("average_5m", m5.average());
+	}
+
+private:
+	void clear_buckets()
+	{
+		for (size_t i=0; i<bucket_size; ++i) {
+			m_buckets[i].m_epoch = 0;
+			m_buckets[i].m_samples = 0;
+			m_buckets[i].m_total = value_type(0);
+		}
+	}
+
+private:
+	figure_type m_lifetime;
+	value_type m_ewma;
+	bucket_t m_buckets[Buckets];
+};
+
+/*
+ * flat_tracing_formatter_t for windowed_accumulation_t: last-1m, last-5m and lifetime averages side by side.
+ */
+template<class Tracer>
+class windowed_tracing_formatter_t
+{
+public:
+	typedef Tracer tracer_type;
+	typedef typename tracer_type::value_type value_type;
+	typedef typename tracer_type::ticket_type ticket_type;
+  typedef typename tracer_type::iterator iterator_type;
+
+	windowed_tracing_formatter_t(const tracer_type* tracer, char* buf, size_t bufsize,
+															 ticket_type root)
+		: m_tracer(tracer),  m_buf(buf), m_bufsize(bufsize),
+			m_here(tracer->begin_for(root)), m_end(tracer->end_for(root))
+	{ format(); }
+
+  bool atend() const { return m_here == m_end; }
+  const char* c_str() const { return m_buf; }
+
+	void increment()
+	{
+		++m_here;
+		format();
+	}
+	
+  void format()
+  {
+		if (atend()) {
+			m_buf[0] = '\0';
+		} else {
+			value_type value = m_tracer->at(tracer_type::to_ticket(m_here));
+			typename value_type::figure_type m1 = value.last_minute();
+			typename value_type::figure_type m5 = value.last_five_minutes();
+			int printed = snprintf(m_buf, m_bufsize, "%8.1f %8.1f %8.1f (%6lu/%6lu/%6lu times):",
+														 double(m1.average()), double(m5.average()), double(value.average()), 
+														 static_cast<unsigned long>(m1.samples()), static_cast<unsigned long>(m5.samples()),
+														 static_cast<unsigned long>(value.samples()));
+			if (m_bufsize-1 <= static_cast<size_t>(printed)) {
+				return; // filled
+			}
+	
+			char* buf = m_buf + printed;
+			size_t dummy = 0;
+			m_tracer->format_name(m_here, buf, m_bufsize - printed, &dummy);
+		}
+	}
+	
+private:
+  const tracer_type* m_tracer;
+	char*  m_buf;
+  size_t m_bufsize;
+  iterator_type m_here;
+  iterator_type m_end;
+};
+
+UNFACT_NAMESPACE_END
+
+#endif//UNFACT_WINDOWED_HPP
+
+/* -*-
+	 Local Variables:
+	 mode: c++
+	 c-tab-always-indent: t
+	 c-indent-level: 2
+	 c-basic-offset: 2
+	 tab-width: 2
+	 End:
+	 -*- */